@@ -0,0 +1,179 @@
+// Compares the two ways from source to the ast.h nodes: parsing to a tree without
+// pass-through nodes and lowering it, and running the semantic actions while
+// parsing. Reports the time, and the allocations and bytes allocated, per token;
+// the tree's arena counts as its blocks.
+//
+// usage: ast_bench [grammar file] [statements]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include "corpus.h"
+#include "handlers.h"
+#include "lower.h"
+
+static size_t allocations = 0;
+static size_t allocatedBytes = 0;
+
+// counts what goes through operator new, which is also where the tree's arena gets its blocks
+void* operator new(size_t size) {
+    allocations++;
+    allocatedBytes += size;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    allocations++;
+    allocatedBytes += size;
+    const size_t align = std::max(static_cast<size_t>(alignment), sizeof(void*));
+    if (void* p = std::aligned_alloc(align, (size + align - 1) / align * align)) return p;
+    throw std::bad_alloc();
+}
+
+// the deletes only free what the news above got from malloc; they are kept out of line so the
+// compiler pairs every new with a delete instead of seeing free called on a new's result
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+BENCH_NOINLINE void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+BENCH_NOINLINE void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+BENCH_NOINLINE void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+BENCH_NOINLINE void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+// assignments, calls and loops over expressions of every precedence level, all of which lower
+class ProgramWriter {
+    private:
+        std::mt19937 random{1};
+        std::string out;
+
+        int pick(int count) {
+            return static_cast<int>(random() % static_cast<uint32_t>(count));
+        }
+
+        void operand(int depth) {
+            static const char* atoms[] = {"a", "b", "count", "x1", "42", "7", "3.25", "TRUE"};
+            switch (depth > 0 ? pick(6) : 0) {
+                case 1: out += "( "; expression(depth - 1); out += " )"; break;
+                case 2: out += "- "; operand(depth - 1); break;
+                case 3: out += "f ( "; expression(depth - 1); out += " , b )"; break;
+                default: out += atoms[pick(8)];
+            }
+        }
+
+        void expression(int depth) {
+            static const char* operators[] = {"+", "-", "*", "/", "//", "%", "^", "==", "!=", "<", "<=", ">", ">=", "&", "|"};
+            operand(depth);
+            for (int i = pick(4); i >= 0; i--) {
+                out += ' ';
+                out += operators[pick(15)];
+                out += ' ';
+                operand(depth);
+            }
+        }
+
+    public:
+        std::string program(size_t statements) {
+            for (size_t i = 0; i < statements; i++) {
+                switch (pick(8)) {
+                    case 0:
+                        out += "while ";
+                        expression(1);
+                        out += " do\nv = ";
+                        expression(2);
+                        out += "\nend ";
+                        break;
+                    case 1:
+                        out += "print ( ";
+                        expression(2);
+                        out += " )\n";
+                        break;
+                    default:
+                        out += "v = ";
+                        expression(2);
+                        out += '\n';
+                }
+            }
+            out += "pass";
+            return std::move(out);
+        }
+};
+
+int main(int argc, char* argv[]) {
+    std::string grammarPath = argc > 1 ? argv[1] : BABEL_GRAMMAR_PATH;
+    size_t statements = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 20'000;
+
+    BenchParser bench(grammarPath);
+    const Parser& parser = bench.parser;
+
+    Lexer lexer("bench", babelTokenSpecs());
+    TokenList tokens = lexer.tokenize(ProgramWriter().program(statements));
+
+    // the best of five runs each, taken in turns, with the allocations of one run
+    struct Measurement {
+        double nanoseconds = 0;
+        double allocations = 0;
+        double bytes = 0;
+        size_t statements = 0;
+    };
+    auto measure = [&](Measurement& m, auto&& run) {
+        const size_t allocationsBefore = allocations, bytesBefore = allocatedBytes;
+        auto start = std::chrono::steady_clock::now();
+        m.statements = run();
+        const double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / tokens.size();
+        m.nanoseconds = m.nanoseconds == 0 ? nanoseconds : std::min(m.nanoseconds, nanoseconds);
+        m.allocations = static_cast<double>(allocations - allocationsBefore) / tokens.size();
+        m.bytes = static_cast<double>(allocatedBytes - bytesBefore) / tokens.size();
+    };
+
+    Measurement lowered, built;
+    for (int i = 0; i < 5; i++) {
+        measure(lowered, [&] {
+            std::ostringstream diagnostics;
+            ParseTree tree = parser.parse(tokens, diagnostics, std::pmr::get_default_resource(), Parser::ELIDE_PASS_THROUGH);
+            if (!tree.accepted) {
+                std::cerr << diagnostics.str().substr(0, 1000);
+                std::exit(1);
+            }
+            return lowerProgram(tree).size();
+        });
+        measure(built, [&] {
+            std::ostringstream diagnostics;
+            SemanticActions actions(parser.getTables());
+            auto result = parser.parseWith(tokens, actions, diagnostics);
+            return std::get<SemanticActions::ASTList>(result.value).size();
+        });
+    }
+    if (lowered.statements != built.statements) {
+        std::cerr << "the two ways made " << lowered.statements << " and " << built.statements << " statements" << std::endl;
+        return 1;
+    }
+
+    std::cout << "tokens: " << tokens.size() << ", statements: " << built.statements << std::endl;
+    std::cout << std::setw(24) << "" << std::setw(14) << "ns/token" << std::setw(14) << "allocs/token" << std::setw(14) << "bytes/token" << std::endl;
+    for (const auto& [name, m] : {std::pair{"tree, then lowering", lowered}, std::pair{"semantic actions", built}}) {
+        std::cout << std::setw(24) << std::left << name << std::right << std::setw(14) << m.nanoseconds << std::setw(14) << m.allocations
+                  << std::setw(14) << m.bytes << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,294 @@
+// End to end benchmark of the front end on a synthesized corpus: lexer and parser
+// throughput, parse table generation, table loading, lexing and parsing a batch of
+// files on 1 up to all cores, and peak RSS. The results are printed as one JSON
+// object, so runs of different revisions can be compared.
+//
+// usage: babel_bench [--grammar file] [--tokens n] [--depth n] [--seed n]
+//                    [--repetitions n] [--corpus-out file] [--out file]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory_resource>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "lrparser.h"
+#include "threadpool.h"
+#include "corpus.h"
+
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifndef BABEL_REVISION
+#define BABEL_REVISION "unknown"
+#endif
+
+template <typename F>
+double medianSeconds(int repetitions, F&& f) {
+    std::vector<double> seconds;
+    for (int i = 0; i < repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(seconds.begin(), seconds.end());
+    return seconds[seconds.size() / 2];
+}
+
+// peak resident set size of this process in KiB
+long peakRssKilobytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return -1;
+    return static_cast<long>(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;    // bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// JSON object built field by field; values are kept as JSON text, nested objects
+// are indented when the outer one is written.
+class JsonObject {
+    private:
+        std::vector<std::pair<std::string, std::string>> fields;
+
+    public:
+        static std::string quote(const std::string& text) {
+            std::string quoted = "\"";
+            for (char c : text) {
+                if (c == '"' || c == '\\') quoted += '\\';
+                quoted += c;
+            }
+            return quoted + "\"";
+        }
+
+        template <typename T>
+        JsonObject& add(const std::string& key, const T& value) {
+            std::ostringstream s;
+            s << std::setprecision(6) << std::boolalpha << value;
+            fields.emplace_back(key, s.str());
+            return *this;
+        }
+
+        JsonObject& add(const std::string& key, const std::string& value) {
+            fields.emplace_back(key, quote(value));
+            return *this;
+        }
+
+        JsonObject& add(const std::string& key, const JsonObject& object) {
+            fields.emplace_back(key, object.str());
+            return *this;
+        }
+
+        std::string str() const {
+            std::string result = "{\n";
+            for (size_t i = 0; i < fields.size(); i++) {
+                result += "    " + quote(fields[i].first) + ": ";
+                for (char c : fields[i].second) {
+                    result += c;
+                    if (c == '\n') result += "    ";
+                }
+                result += i + 1 < fields.size() ? ",\n" : "\n";
+            }
+            return result + "}";
+        }
+};
+
+// runs f with std::cout captured, parse() reports success there
+template <typename F>
+std::string quietly(F&& f) {
+    std::ostringstream captured;
+    std::streambuf* out = std::cout.rdbuf(captured.rdbuf());
+    f();
+    std::cout.rdbuf(out);
+    return captured.str();
+}
+
+int main(int argc, char* argv[]) {
+    std::string grammarPath = BABEL_GRAMMAR_PATH;
+    std::string corpusOut;
+    std::string out;
+    CorpusShape shape;
+    int repetitions = 5;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "--grammar") grammarPath = value;
+        else if (option == "--tokens") shape.tokens = std::strtoull(value.c_str(), nullptr, 10);
+        else if (option == "--depth") shape.depth = std::atoi(value.c_str());
+        else if (option == "--seed") shape.seed = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        else if (option == "--repetitions") repetitions = std::max(1, std::atoi(value.c_str()));
+        else if (option == "--corpus-out") corpusOut = value;
+        else if (option == "--out") out = value;
+        else {
+            std::cerr << "unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+
+    std::string grammarText = readGrammar(grammarPath);
+
+    // table generation
+    Grammar grammar(grammarText);
+    JsonObject tablegen;
+    for (LRClosureTable::Mode mode : {LRClosureTable::LALR1, LRClosureTable::LR1}) {
+        int states = 0;
+        double seconds = medianSeconds(repetitions, [&] {
+            LRClosureTable closureTable(grammar, mode);
+            states = static_cast<int>(closureTable.states.size());
+        });
+        LRTable lrTable{LRClosureTable(grammar, mode)};
+        tablegen.add(mode == LRClosureTable::LALR1 ? "lalr1" : "lr1", JsonObject()
+            .add("states", states)
+            .add("shift_reduce_conflicts", lrTable.shiftReduceConflicts)
+            .add("reduce_reduce_conflicts", lrTable.reduceReduceConflicts)
+            .add("ms", seconds * 1e3));
+    }
+
+    LRTable lrTable{LRClosureTable(grammar)};
+    Parser parser(lrTable);
+    Lexer lexer("bench", babelTokenSpecs());
+
+    // table loading, the old Boost archive next to the mapped table file
+    const std::string archivePath = "babel_bench_parser.dat";
+    const std::string tablePath = "babel_bench_parser.tbl";
+    {
+        std::ofstream ofs(archivePath, std::ios::binary);
+        boost::archive::binary_oarchive ar(ofs);
+        ar << lrTable;
+    }
+    parser.getTables().save(tablePath);
+
+    int sink = 0;
+    JsonObject load;
+    load.add("archive_us", medianSeconds(repetitions, [&] {
+        LRTable loaded;
+        std::ifstream ifs(archivePath, std::ios::binary);
+        boost::archive::binary_iarchive ar(ifs);
+        ar >> loaded;
+        sink += loaded.action(0, END_SYMBOL).kind();
+    }) * 1e6);
+    for (bool verify : {true, false}) {
+        load.add(verify ? "mapped_checked_us" : "mapped_unchecked_us", medianSeconds(repetitions, [&] {
+            sink += ParserTables::load(tablePath, verify)->action(0, END_SYMBOL).kind();
+        }) * 1e6);
+    }
+    std::remove(archivePath.c_str());
+    std::remove(tablePath.c_str());
+
+    // corpus
+    auto start = std::chrono::steady_clock::now();
+    std::string source = CorpusGenerator(grammar, lexer, parser.getTables(), shape.seed).generate(shape);
+    double generateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!corpusOut.empty()) std::ofstream(corpusOut, std::ios::binary) << source;
+
+    TokenList tokens = lexer.tokenize(source);
+    double megabytes = source.size() / 1e6;
+    double millionTokens = tokens.size() / 1e6;
+
+    bool accepted = quietly([&] { parser.parse(tokens); }).rfind("success", 0) == 0;
+
+    JsonObject corpus;
+    corpus.add("bytes", source.size())
+          .add("tokens", tokens.size())
+          .add("depth", shape.depth)
+          .add("seed", shape.seed)
+          .add("accepted", accepted)
+          .add("generate_ms", generateSeconds * 1e3);
+
+    // lexer and parser throughput
+    double lexSeconds = medianSeconds(repetitions, [&] {
+        sink += static_cast<int>(lexer.tokenize(source).size());
+    });
+    double streamSeconds = medianSeconds(repetitions, [&] {
+        std::istringstream stream(source);
+        StreamingLexer streamingLexer(lexer, std::make_unique<IstreamReader>(stream), "bench");
+        StreamToken token;
+        while (streamingLexer.next(token)) sink += token.kind;
+    });
+    double parseSeconds = medianSeconds(repetitions, [&] {
+        quietly([&] { sink += parser.parse(tokens).nodes.size(); });
+    });
+
+    JsonObject lexing;
+    lexing.add("mb_per_s", megabytes / lexSeconds)
+          .add("mtokens_per_s", millionTokens / lexSeconds)
+          .add("stream_mb_per_s", megabytes / streamSeconds);
+
+    JsonObject parsing;
+    parsing.add("mtokens_per_s", millionTokens / parseSeconds)
+           .add("ns_per_token", parseSeconds * 1e9 / tokens.size());
+
+    // a batch of files, each lexed and parsed as one job on the pool, as babelc does
+    const size_t fileCount = 64;
+    CorpusShape fileShape = shape;
+    fileShape.tokens = std::max<size_t>(1, shape.tokens / fileCount);
+    CorpusGenerator fileGenerator(grammar, lexer, parser.getTables(), shape.seed + 1);
+    std::vector<std::string> files;
+    for (size_t i = 0; i < fileCount; i++) files.push_back(fileGenerator.generate(fileShape));
+
+    JsonObject scaling;
+    const unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    double singleThreaded = 0;
+    for (unsigned threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        ThreadPool pool(threads);
+        std::vector<std::unique_ptr<std::pmr::unsynchronized_pool_resource>> arenas;
+        for (unsigned worker = 0; worker < pool.size(); worker++) {
+            arenas.push_back(std::make_unique<std::pmr::unsynchronized_pool_resource>());
+        }
+
+        double seconds = medianSeconds(repetitions, [&] {
+            pool.parallelFor(files.size(), [&](size_t index, unsigned worker) {
+                std::ostringstream diagnostics;
+                TokenList fileTokens = lexer.tokenize(files[index]);
+                ParseTree tree = parser.parse(fileTokens, diagnostics, arenas[worker].get());
+            });
+        });
+        if (threads == 1) singleThreaded = seconds;
+        scaling.add(std::to_string(threads), JsonObject()
+            .add("ms", seconds * 1e3)
+            .add("speedup", singleThreaded / seconds));
+        if (threads == maxThreads) break;
+    }
+
+    JsonObject batch;
+    batch.add("files", fileCount)
+         .add("tokens_per_file", fileShape.tokens)
+         .add("threads", scaling);
+
+    JsonObject result;
+    result.add("revision", std::string(BABEL_REVISION))
+          .add("grammar", grammarPath)
+          .add("repetitions", repetitions)
+          .add("corpus", corpus)
+          .add("lexer", lexing)
+          .add("parser", parsing)
+          .add("batch", batch)
+          .add("tablegen", tablegen)
+          .add("table_load", load)
+          .add("peak_rss_kb", peakRssKilobytes());
+
+    if (out.empty()) {
+        std::cout << result.str() << std::endl;
+    } else {
+        std::ofstream(out) << result.str() << std::endl;
+    }
+    return sink == -1;
+}
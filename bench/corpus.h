@@ -0,0 +1,289 @@
+#pragma once
+
+// Synthesizes Babel programs from the grammar for benchmarks. Statements are random
+// derivations of the grammar's statement symbol, written out with a sample lexeme
+// per terminal. Each statement is run through the parse table right after the ones
+// before it and drawn again if the table rejects it there, so the whole program is
+// accepted even where the table resolves conflicts away from the grammar. A statement
+// is only kept when another one can start after it at the top level: one that ends in
+// a block without a closing keyword, like the last case of a match, would take in all
+// that follows and nest the program deeper the longer it gets. The reading of the
+// grammar and the making of a parser the benches share are here too.
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "lrparser.h"
+
+#ifndef BABEL_GRAMMAR_PATH
+#define BABEL_GRAMMAR_PATH "src/grammar.txt"
+#endif
+
+// the text of a grammar file as the parser generator takes it, a bench can not go on without it
+inline std::string readGrammar(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "cannot open " << path << std::endl;
+        std::exit(1);
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return transform_string(buffer.str());
+}
+
+// a grammar with the LALR(1) table and parser babel would make of it
+struct BenchParser {
+    Grammar grammar;
+    LRTable table;
+    Parser parser;
+
+    explicit BenchParser(const std::string& path) : grammar(readGrammar(path)), table(LRClosureTable(grammar)), parser(table) {}
+};
+
+struct CorpusShape {
+    size_t tokens = 100'000;     // stop once the program has at least this many tokens
+    int depth = 8;               // derivations deeper than this take the shortest way out
+    uint32_t seed = 1;
+};
+
+class CorpusGenerator {
+    private:
+        const Grammar& grammar;
+        const Lexer& lexer;
+        const ParserTables& tables;
+        std::mt19937 random;
+        std::vector<std::string> samples;   // lexeme per terminal, empty when there is none
+        std::vector<int> heights;           // least derivation height per symbol
+        int variableCount = 0;
+
+        // LR state stack of the program so far; entries below floor are the ones of the
+        // last accepted statement, the ones a trial popped from there are kept in undo
+        std::vector<int> stack = {0};
+        size_t floor = 1;
+        std::vector<int> undo;
+
+        // text the lexer turns into the terminal, for the specs that are not plain words
+        static const std::map<std::string, std::string>& knownSamples() {
+            static const std::map<std::string, std::string> known = {
+                {"TYPE", "int"}, {"STORAGE_MODIFIER", "const"}, {"STRING", "\"text\""}, {"CHAR", "'c'"},
+                {"FLOATING_POINT", "3.25"}, {"BOOL", "TRUE"}, {"INTEGER", "42"}, {"VAR", "v"}, {"NEWLINE", "\n"},
+            };
+            return known;
+        }
+
+        // a spec like "\\+=" or "while" stands for itself once the escapes are dropped
+        static std::string literalOf(const std::string& pattern) {
+            std::string literal;
+            for (size_t i = 0; i < pattern.size(); i++) {
+                char c = pattern[i];
+                if (c == '\\' && i + 1 < pattern.size() && !std::isalnum(static_cast<unsigned char>(pattern[i + 1]))) {
+                    literal += pattern[++i];
+                } else if (std::isalnum(static_cast<unsigned char>(c)) || std::string("=<>!&|,:;%/*+-^.").find(c) != std::string::npos) {
+                    literal += c;
+                } else {
+                    return "";
+                }
+            }
+            return literal;
+        }
+
+        bool lexesAs(const std::string& text, const std::string& kind) const {
+            TokenList tokens = lexer.tokenize(text);
+            return tokens.size() == 1 && tokens.getType(tokens[0]) == kind;
+        }
+
+        void collectSamples() {
+            const std::list<std::pair<std::string, std::string>> specs = babelTokenSpecs();
+            samples.assign(grammar.symbols.size(), "");
+
+            for (Symbol terminal : grammar.terminals) {
+                const std::string& name = grammar.nameOf(terminal);
+                auto known = knownSamples().find(name);
+                std::string sample = known != knownSamples().end() ? known->second : "";
+
+                for (auto it = specs.begin(); sample.empty() && it != specs.end(); ++it) {
+                    if (it->first == name) sample = literalOf(it->second);
+                }
+
+                if (!sample.empty() && lexesAs(sample, name)) samples[terminal] = sample;
+            }
+        }
+
+        // terminals without a sample can not be written, rules that need them are never taken
+        void computeHeights() {
+            const int unreachable = std::numeric_limits<int>::max();
+            heights.assign(grammar.symbols.size(), unreachable);
+            for (Symbol terminal : grammar.terminals) {
+                if (!samples[terminal].empty()) heights[terminal] = 0;
+            }
+
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (const Rule& rule : grammar.rules) {
+                    int height = ruleHeight(rule);
+                    if (height != unreachable && height + 1 < heights[rule.nonterminal]) {
+                        heights[rule.nonterminal] = height + 1;
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        int ruleHeight(const Rule& rule) const {
+            int height = 0;
+            for (int i = 0; i < rule.length(); i++) {
+                height = std::max(height, heights[rule.development[i]]);
+            }
+            return height;
+        }
+
+        void derive(Symbol symbol, int depth, std::vector<Symbol>& out) {
+            if (grammar.isTerminal(symbol)) {
+                out.push_back(symbol);
+                return;
+            }
+
+            std::vector<const Rule*> choices;
+            int lowest = std::numeric_limits<int>::max();
+            for (int ruleIndex : grammar.getRulesForNonterminal(symbol)) {
+                const Rule& rule = grammar.rules[ruleIndex];
+                int height = ruleHeight(rule);
+                if (height == std::numeric_limits<int>::max()) continue;
+
+                if (depth < 0) {
+                    // too deep, only the rules closest to the leaves
+                    if (height < lowest) choices.clear();
+                    if (height <= lowest) choices.push_back(&rule);
+                    lowest = std::min(lowest, height);
+                } else {
+                    choices.push_back(&rule);
+                }
+            }
+
+            const Rule* rule = choices[std::uniform_int_distribution<size_t>(0, choices.size() - 1)(random)];
+            for (int i = 0; i < rule->length(); i++) {
+                derive(rule->development[i], depth - 1, out);
+            }
+        }
+
+        std::string write(const std::vector<Symbol>& terminals) {
+            std::string text;
+            for (Symbol terminal : terminals) {
+                const std::string& sample = samples[terminal];
+                if (!text.empty() && text.back() != '\n' && sample != "\n") text += ' ';
+                text += sample;
+                if (grammar.nameOf(terminal) == "VAR") text += std::to_string(variableCount++ % 997);
+            }
+            return text;
+        }
+
+        void pop(size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                if (stack.size() - 1 < floor) {
+                    undo.push_back(stack.back());
+                    floor = stack.size() - 1;
+                }
+                stack.pop_back();
+            }
+        }
+
+        // runs the table up to and including the shift of symbol, false on a syntax error
+        bool feed(Symbol symbol) {
+            while (true) {
+                LRAction action = tables.action(stack.back(), symbol);
+                switch (action.kind()) {
+                    case LRAction::SHIFT:
+                        stack.push_back(action.value());
+                        return true;
+                    case LRAction::REDUCE: {
+                        const Symbol nonterminal = tables.ruleNonterminal(action.value());
+                        pop(tables.ruleLength(action.value()));
+                        stack.push_back(tables.goTo(stack.back(), nonterminal));
+                        break;
+                    }
+                    case LRAction::ACCEPT:
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+        }
+
+        void commit() {
+            undo.clear();
+            floor = stack.size();
+        }
+
+        void rollback() {
+            stack.resize(floor);
+            stack.insert(stack.end(), undo.rbegin(), undo.rend());
+            commit();
+        }
+
+        bool feedAll(const std::vector<Symbol>& terminals) {
+            for (Symbol terminal : terminals) {
+                if (!feed(terminal)) return false;
+            }
+            return true;
+        }
+
+    public:
+        CorpusGenerator(const Grammar& grammar, const Lexer& lexer, const ParserTables& tables, uint32_t seed)
+            : grammar(grammar), lexer(lexer), tables(tables), random(seed) {
+            collectSamples();
+            computeHeights();
+        }
+
+        // Appends statements until the program has shape.tokens tokens and the table
+        // accepts it as a whole.
+        std::string generate(const CorpusShape& shape) {
+            Symbol statement = grammar.symbols.find("statement");
+            if (statement < 0) statement = grammar.axiom;
+
+            // the first terminal of a short statement stands for the next one
+            std::vector<Symbol> shortest;
+            derive(statement, -1, shortest);
+            const Symbol probe = shortest.front();
+            size_t topLevel = 1;        // entries on the stack in front of the next statement
+
+            stack = {0};
+            commit();
+
+            std::string program;
+            size_t tokenCount = 0;
+            int rejected = 0;
+            while (true) {
+                if (tokenCount >= shape.tokens && tokenCount > 0) {
+                    bool accepted = feed(END_SYMBOL);
+                    rollback();
+                    if (accepted) return program;
+                }
+
+                std::vector<Symbol> terminals;
+                derive(statement, shape.depth, terminals);
+                if (!feedAll(terminals) || !feed(probe) || stack.size() > topLevel + 2) {
+                    rollback();
+                    if (++rejected > 1000) throw std::runtime_error("the grammar yields no statements the parser accepts");
+                    continue;
+                }
+                topLevel = stack.size() - 1;
+                rollback();
+                feedAll(terminals);
+                commit();
+                rejected = 0;
+
+                // a statement ending in END continues on the same line, the grammar has no NEWLINE there
+                if (!program.empty() && program.back() != '\n') program += ' ';
+                program += write(terminals);
+                tokenCount += terminals.size();
+            }
+        }
+};
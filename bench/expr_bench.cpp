@@ -0,0 +1,109 @@
+// Measures how the grammar's expression rules shape the table and the parse of
+// expression heavy code: the number of states, the tree nodes built per token,
+// which are the tokens plus one per reduction, and the time per token, for full
+// trees and for trees without pass-through nodes. Run it with an older grammar
+// file to compare the two.
+//
+// usage: expr_bench [grammar file] [statements]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include "corpus.h"
+
+class ExpressionWriter {
+    private:
+        std::mt19937 random{1};
+        std::string out;
+
+        int pick(int count) {
+            return static_cast<int>(random() % static_cast<uint32_t>(count));
+        }
+
+        void operand(int depth) {
+            static const char* atoms[] = {"a", "b", "count", "x1", "42", "7", "3.25", "TRUE"};
+            switch (depth > 0 ? pick(6) : 0) {
+                case 1: out += "( "; expression(depth - 1); out += " )"; break;
+                case 2: out += "- "; operand(depth - 1); break;
+                case 3: out += "f ( "; expression(depth - 1); out += " , b )"; break;
+                default: out += atoms[pick(8)];
+            }
+        }
+
+    public:
+        // operands joined by binary operators of every precedence level
+        void expression(int depth) {
+            static const char* operators[] = {"+", "-", "*", "/", "//", "%", "^", "==", "!=", "<", "<=", ">", ">=", "&", "|"};
+            operand(depth);
+            for (int i = pick(4); i >= 0; i--) {
+                out += ' ';
+                out += operators[pick(15)];
+                out += ' ';
+                operand(depth);
+            }
+        }
+
+        std::string program(size_t statements) {
+            for (size_t i = 0; i < statements; i++) {
+                out += "v = ";
+                expression(2);
+                out += '\n';
+            }
+            return std::move(out);
+        }
+};
+
+int main(int argc, char* argv[]) {
+    std::string grammarPath = argc > 1 ? argv[1] : BABEL_GRAMMAR_PATH;
+    size_t statements = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100'000;
+
+    auto start = std::chrono::steady_clock::now();
+    BenchParser bench(grammarPath);
+    double tableSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const Parser& parser = bench.parser;
+
+    Lexer lexer("bench", babelTokenSpecs());
+    TokenList tokens = lexer.tokenize(ExpressionWriter().program(statements));
+
+    // the best of five parses and the tree's nodes per token
+    auto measure = [&](Parser::TreeMode mode, double& nodesPerToken) {
+        double best = 0;
+        for (int run = 0; run < 5; run++) {
+            std::ostringstream diagnostics;
+            auto parseStart = std::chrono::steady_clock::now();
+            ParseTree tree = parser.parse(tokens, diagnostics, std::pmr::get_default_resource(), mode);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - parseStart).count();
+            if (!tree.accepted) {
+                std::cerr << diagnostics.str().substr(0, 1000);
+                std::exit(1);
+            }
+            best = run == 0 ? seconds : std::min(best, seconds);
+            nodesPerToken = static_cast<double>(tree.nodes.size()) / tokens.size();
+        }
+        return best * 1e9 / tokens.size();
+    };
+    double fullNodes = 0, elidedNodes = 0;
+    const double fullTime = measure(Parser::FULL_TREE, fullNodes);
+    const double elidedTime = measure(Parser::ELIDE_PASS_THROUGH, elidedNodes);
+
+    std::cout << std::left;
+    std::cout << std::setw(28) << "grammar" << grammarPath << "\n";
+    std::cout << std::setw(28) << "rules" << bench.grammar.rules.size() << "\n";
+    std::cout << std::setw(28) << "states" << bench.table.stateCount << "\n";
+    std::cout << std::setw(28) << "shift/reduce conflicts" << bench.table.shiftReduceConflicts << "\n";
+    std::cout << std::setw(28) << "reduce/reduce conflicts" << bench.table.reduceReduceConflicts << "\n";
+    std::cout << std::setw(28) << "bypassed transitions" << bench.table.bypassedTransitions << "\n";
+    std::cout << std::setw(28) << "table seconds" << tableSeconds << "\n";
+    std::cout << std::setw(28) << "tokens" << tokens.size() << "\n";
+    std::cout << std::setw(28) << "reductions per token" << fullNodes - 1 << "\n";
+    std::cout << std::setw(28) << "parse ns per token" << fullTime << "\n";
+    std::cout << std::setw(28) << "elided nodes per token" << elidedNodes << "\n";
+    std::cout << std::setw(28) << "elided parse ns per token" << elidedTime << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+// Measures IncrementalParser::edit against lexing and parsing the whole text again,
+// on synthesized programs from 1K tokens up to a maximum (1M by default). Each edit
+// replaces an integer literal at a random place; a second run types an opening
+// parenthesis there and deletes it again, so half of the edits leave a syntax error.
+//
+// usage: incremental_bench [grammar file] [max tokens] [edits]
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include "incremental.h"
+#include "corpus.h"
+
+int main(int argc, char* argv[]) {
+    std::string grammarPath = argc > 1 ? argv[1] : BABEL_GRAMMAR_PATH;
+    size_t maxTokens = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1'000'000;
+    int edits = argc > 3 ? std::max(1, std::atoi(argv[3])) : 200;
+
+    BenchParser bench(grammarPath);
+    const Parser& parser = bench.parser;
+    Lexer lexer("bench", babelTokenSpecs());
+    CorpusGenerator generator(bench.grammar, lexer, parser.getTables(), 1);
+
+    std::cout << std::setw(10) << "tokens" << std::setw(12) << "full ms" << std::setw(12) << "edit us"
+              << std::setw(12) << "error us" << std::setw(12) << "new nodes" << std::setw(12) << "relexed" << std::endl;
+
+    for (size_t tokenCount = 1000; tokenCount <= maxTokens; tokenCount *= 10) {
+        CorpusShape shape;
+        shape.tokens = tokenCount;
+        IncrementalParser input(lexer, parser, "bench", generator.generate(shape));
+
+        std::ostringstream discard;
+        auto start = std::chrono::steady_clock::now();
+        parser.parse(lexer.tokenize(input.getText()), discard);
+        double fullSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // every edit goes to the first integer literal from a random offset on
+        std::mt19937 random(1);
+        auto literalOffset = [&] {
+            const std::string& text = input.getText();
+            size_t offset = text.find("42", random() % text.size());
+            return offset != std::string::npos ? offset : text.find("42");
+        };
+
+        double editSeconds = 0;
+        size_t newNodes = 0;
+        size_t relexed = 0;
+        for (int i = 0; i < edits; i++) {
+            const size_t offset = literalOffset();
+            start = std::chrono::steady_clock::now();
+            input.edit(offset, 2, "43");
+            editSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            newNodes += input.getStats().newNodes;
+            relexed += input.getStats().relexedTokens;
+            input.edit(offset, 2, "42");
+        }
+
+        double errorSeconds = 0;
+        for (int i = 0; i < edits; i++) {
+            const size_t offset = literalOffset();
+            start = std::chrono::steady_clock::now();
+            input.edit(offset, 0, "(");
+            input.edit(offset, 1, "");
+            errorSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        std::cout << std::setw(10) << input.getTokens().size()
+                  << std::setw(12) << std::fixed << std::setprecision(3) << fullSeconds * 1e3
+                  << std::setw(12) << std::setprecision(1) << editSeconds * 1e6 / edits
+                  << std::setw(12) << errorSeconds * 1e6 / (2 * edits)
+                  << std::setw(12) << newNodes / edits
+                  << std::setw(12) << relexed / edits << std::endl;
+        if (!input.isAccepted()) {
+            std::cerr << input.getDiagnostic() << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
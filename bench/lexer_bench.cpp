@@ -0,0 +1,99 @@
+// Compares the DFA lexer with the previous std::regex based implementation.
+//
+// usage: lexer_bench [megabytes]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <regex>
+#include <string>
+#include "lexer.h"
+
+// the scanning loop Lexer::tokenize used before the DFA, kept as a baseline
+std::list<std::pair<std::string, std::string>> legacyTokenize(const std::list<std::pair<std::string, std::string>>& token_specs, std::string input_stream) {
+    std::list<std::pair<std::string, std::string>> tokens;
+
+    while (!input_stream.empty()) {
+        bool matched = false;
+        for (const std::pair<std::string, std::string>& spec : token_specs) {
+            std::regex regex_pattern("^" + spec.second);
+            std::smatch re;
+
+            if (regex_search(input_stream, re, regex_pattern)) {
+                std::string match = re[0];
+                if (match.size() == 0) break;
+                tokens.push_back({spec.first, match});
+                input_stream = re.suffix();
+                matched = true;
+                break;
+            }
+        }
+
+        if (!matched) {
+            input_stream = input_stream.substr(1);
+        }
+    }
+
+    return tokens;
+}
+
+std::string makeSource(size_t bytes) {
+    const std::string snippet =
+        "task fib(n: int) => int\n"
+        "    if n <= 1 then return n end\n"
+        "    return fib(n - 1) + fib(n - 2)\n"
+        "end\n"
+        "x: float = 3.25 * (y + 42) // 7\n"
+        "name = \"babel\"; c = 'b'\n"
+        "while x >= 0.5 do x -= 1 end\n"
+        "values = [1, 2, 3] + map_values(x, key=TRUE)\n";
+
+    std::string source;
+    source.reserve(bytes + snippet.size());
+    while (source.size() < bytes) source += snippet;
+    return source;
+}
+
+template <typename F>
+double measureSeconds(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool sameTokens(const std::list<std::pair<std::string, std::string>>& expected, const TokenList& tokens) {
+    if (expected.size() != tokens.size()) return false;
+    auto j = tokens.begin();
+    for (auto i = expected.begin(); i != expected.end(); ++i, ++j) {
+        if (i->first != tokens.getType(*j) || i->second != tokens.getValue(*j)) return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    double megabytes = argc > 1 ? std::atof(argv[1]) : 16.0;
+    const auto specs = babelTokenSpecs();
+
+    Lexer lexer("bench", specs);
+
+    // the legacy lexer is quadratic, so it only gets a small input
+    std::string small = makeSource(4 * 1024);
+    std::list<std::pair<std::string, std::string>> expected;
+    double legacySeconds = measureSeconds([&] { expected = legacyTokenize(specs, small); });
+
+    if (!sameTokens(expected, lexer.tokenize(small))) {
+        std::cerr << "token streams differ between the legacy and the DFA lexer" << std::endl;
+        return 1;
+    }
+
+    std::string large = makeSource(static_cast<size_t>(megabytes * 1024 * 1024));
+    size_t tokenCount = 0;
+    double dfaSeconds = measureSeconds([&] { tokenCount = lexer.tokenize(large).size(); });
+
+    std::cout << "legacy regex lexer: " << small.size() / legacySeconds / (1024 * 1024) << " MB/s ("
+              << small.size() / 1024 << " KB)" << std::endl;
+    std::cout << "dfa lexer:          " << large.size() / dfaSeconds / (1024 * 1024) << " MB/s ("
+              << large.size() / (1024 * 1024) << " MB, " << tokenCount << " tokens)" << std::endl;
+
+    return 0;
+}
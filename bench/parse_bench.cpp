@@ -0,0 +1,56 @@
+// Measures Parser::parse on inputs from 1K tokens up to a maximum (10M by default)
+// to check that the time per token stays flat as the input grows.
+//
+// usage: parse_bench [grammar file] [max tokens]
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "corpus.h"
+
+// every repetition is 8 tokens: VAR EQUALS INTEGER PLUS VAR MULTIPLY INTEGER NEWLINE
+std::string makeSource(size_t tokenCount) {
+    const std::string statement = "x = 1 + y * 2\n";
+    std::string source;
+    source.reserve(tokenCount / 8 * statement.size() + statement.size());
+    for (size_t i = 0; i < tokenCount; i += 8) source += statement;
+    return source;
+}
+
+int main(int argc, char* argv[]) {
+    std::string grammarPath = argc > 1 ? argv[1] : BABEL_GRAMMAR_PATH;
+    size_t maxTokens = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10'000'000;
+
+    BenchParser bench(grammarPath);
+    const Parser& parser = bench.parser;
+    Lexer lexer("bench", babelTokenSpecs());
+
+    std::cout << std::setw(12) << "tokens" << std::setw(12) << "seconds" << std::setw(12) << "ns/token" << std::endl;
+
+    double first = 0;
+    double last = 0;
+    for (size_t tokenCount = 1000; tokenCount <= maxTokens; tokenCount *= 10) {
+        TokenList tokens = lexer.tokenize(makeSource(tokenCount));
+
+        // parse() reports success on stdout, keep that out of the table
+        std::ostringstream discard;
+        std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+        auto start = std::chrono::steady_clock::now();
+        ParseTree tree = parser.parse(tokens);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout.rdbuf(out);
+
+        double perToken = seconds * 1e9 / tokens.size();
+        if (first == 0) first = perToken;
+        last = perToken;
+
+        std::cout << std::setw(12) << tokens.size() << std::setw(12) << seconds << std::setw(12) << perToken << std::endl;
+    }
+
+    std::cout << "ns/token at the largest size relative to the smallest: " << last / first << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+// Compares loading the parser from a Boost binary archive of the LRTable with
+// mapping a flat table file, and, in a build with the generated header, with the
+// tables compiled into the program. The lexer is built from its token specs or
+// taken from the header. Cold runs drop the file from the page cache first.
+//
+// usage: startup_bench [grammar file] [repetitions]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "corpus.h"
+#include "lexer.h"
+#ifdef BABEL_EMBEDDED_TABLES
+#include "babel_tables.h"
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// asks the kernel to forget the cached pages of a file, a no-op where that is not available
+void dropFromPageCache(const std::string& path) {
+#if defined(POSIX_FADV_DONTNEED)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+#else
+    (void) path;
+#endif
+}
+
+template <typename F>
+double measureMicroseconds(const std::string& path, bool cold, int repetitions, F&& f) {
+    double total = 0;
+    for (int i = 0; i < repetitions; i++) {
+        if (cold) dropFromPageCache(path);
+        auto start = std::chrono::steady_clock::now();
+        f();
+        total += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+    return total / repetitions;
+}
+
+int main(int argc, char* argv[]) {
+    std::string grammarPath = argc > 1 ? argv[1] : BABEL_GRAMMAR_PATH;
+    int repetitions = argc > 2 ? std::atoi(argv[2]) : 20;
+
+    BenchParser bench(grammarPath);
+    const LRTable& lrTable = bench.table;
+
+    const std::string archivePath = "startup_bench_parser.dat";
+    const std::string tablePath = "startup_bench_parser.tbl";
+    {
+        std::ofstream ofs(archivePath, std::ios::binary);
+        boost::archive::binary_oarchive ar(ofs);
+        ar << lrTable;
+    }
+    Parser(lrTable).getTables().save(tablePath);
+
+    // every variant ends with a table that has been read from once
+    int sink = 0;
+    auto loadArchive = [&] {
+        LRTable loaded;
+        std::ifstream ifs(archivePath, std::ios::binary);
+        boost::archive::binary_iarchive ar(ifs);
+        ar >> loaded;
+        sink += loaded.action(0, END_SYMBOL).kind();
+    };
+    auto mapTable = [&](bool verify) {
+        Parser parser(ParserTables::load(tablePath, verify));
+        sink += parser.getTables().action(0, END_SYMBOL).kind();
+    };
+
+    std::cout << "states: " << lrTable.stateCount << ", archive: " << std::filesystem::file_size(archivePath)
+              << " bytes, table file: " << std::filesystem::file_size(tablePath) << " bytes" << std::endl;
+    std::cout << std::setw(28) << "" << std::setw(14) << "warm (us)" << std::setw(14) << "cold (us)" << std::endl;
+
+    auto row = [&](const std::string& name, const std::string& path, auto&& f) {
+        double warm = measureMicroseconds(path, false, repetitions, f);
+        double cold = measureMicroseconds(path, true, repetitions, f);
+        std::cout << std::setw(28) << std::left << name << std::right << std::setw(14) << warm << std::setw(14) << cold << std::endl;
+    };
+    row("boost binary archive", archivePath, loadArchive);
+    row("mapped table, checksummed", tablePath, [&] { mapTable(true); });
+    row("mapped table, unchecked", tablePath, [&] { mapTable(false); });
+#ifdef BABEL_EMBEDDED_TABLES
+    row("generated header", tablePath, [&] {
+        Parser parser(ParserTables::fromArrays(generated::PARSER_TABLES));
+        sink += parser.getTables().action(0, END_SYMBOL).kind();
+    });
+#endif
+    row("lexer from token specs", tablePath, [&] {
+        Lexer lexer("bench", babelTokenSpecs());
+        sink += lexer.getDfa().getStateCount();
+    });
+#ifdef BABEL_EMBEDDED_TABLES
+    row("lexer from generated header", tablePath, [&] {
+        Lexer lexer("bench", LexerDfa(generated::LEXER_TABLES),
+                    std::vector<std::string>(std::begin(generated::TOKEN_KINDS), std::end(generated::TOKEN_KINDS)));
+        sink += lexer.getDfa().getStateCount();
+    });
+#endif
+
+    std::remove(archivePath.c_str());
+    std::remove(tablePath.c_str());
+    return sink < 0;
+}
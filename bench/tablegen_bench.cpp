@@ -0,0 +1,89 @@
+// Measures parse table generation for the LALR(1) and canonical LR(1) modes, then
+// the parallel LR(1) construction from 1 up to max threads (all cores by default).
+//
+// usage: tablegen_bench [grammar file] [repetitions] [max threads]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "corpus.h"
+
+template <typename F>
+double medianMilliseconds(int repetitions, F&& f) {
+    std::vector<double> milliseconds;
+    for (int i = 0; i < repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        milliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(milliseconds.begin(), milliseconds.end());
+    return milliseconds[milliseconds.size() / 2];
+}
+
+// the flat image of the table, to compare tables byte for byte
+std::string tableImage(const LRTable& lrTable) {
+    const std::string path = "tablegen_bench.tbl";
+    Parser(lrTable).getTables().save(path);
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream bytes;
+    bytes << in.rdbuf();
+    in.close();
+    std::remove(path.c_str());
+    return bytes.str();
+}
+
+int main(int argc, char* argv[]) {
+    std::string grammarPath = argc > 1 ? argv[1] : BABEL_GRAMMAR_PATH;
+    int repetitions = argc > 2 ? std::max(1, std::atoi(argv[2])) : 10;
+    unsigned maxThreads = argc > 3 ? static_cast<unsigned>(std::max(1, std::atoi(argv[3]))) : std::max(1u, std::thread::hardware_concurrency());
+
+    const std::string text = readGrammar(grammarPath);
+
+    std::cout << std::setw(8) << "mode" << std::setw(10) << "states" << std::setw(14) << "s/r conflicts"
+              << std::setw(14) << "r/r conflicts" << std::setw(14) << "median ms" << std::endl;
+
+    for (LRClosureTable::Mode mode : {LRClosureTable::LALR1, LRClosureTable::LR1}) {
+        int states = 0;
+        int shiftReduce = 0;
+        int reduceReduce = 0;
+
+        double median = medianMilliseconds(repetitions, [&] {
+            Grammar grammar(text);
+            LRClosureTable closureTable(grammar, mode);
+            LRTable lrTable(closureTable);
+            states = lrTable.stateCount;
+            shiftReduce = lrTable.shiftReduceConflicts;
+            reduceReduce = lrTable.reduceReduceConflicts;
+        });
+
+        std::cout << std::setw(8) << (mode == LRClosureTable::LALR1 ? "LALR(1)" : "LR(1)") << std::setw(10) << states
+                  << std::setw(14) << shiftReduce << std::setw(14) << reduceReduce << std::setw(14) << median << std::endl;
+    }
+
+    Grammar grammar(text);
+    const std::string serialImage = tableImage(LRTable(LRClosureTable(grammar, LRClosureTable::LR1)));
+
+    std::cout << std::endl << std::setw(8) << "threads" << std::setw(14) << "LR(1) ms" << std::setw(10) << "speedup" << std::setw(12) << "identical" << std::endl;
+    double single = 0;
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        ThreadPool pool(threads);
+        double median = medianMilliseconds(repetitions, [&] { LRClosureTable closureTable(grammar, LRClosureTable::LR1, &pool); });
+        if (threads == 1) single = median;
+
+        bool identical = tableImage(LRTable(LRClosureTable(grammar, LRClosureTable::LR1, &pool))) == serialImage;
+        std::cout << std::setw(8) << threads << std::setw(14) << median << std::setw(10) << single / median
+                  << std::setw(12) << (identical ? "yes" : "NO") << std::endl;
+        if (!identical) return 1;
+
+        if (threads < maxThreads && threads * 2 > maxThreads) threads = maxThreads / 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+// Compares the bytecode interpreter with the JIT: the time to the first result of a
+// session, which includes setting the tier up, the time for a further small input, and
+// the throughput of a recursive task and of a loop, on the first call and in the steady
+// state, where the interpreter has compiled the hot task. Parsing is done up front and
+// is not part of any time.
+//
+// usage: tier_bench [grammar file] [repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "corpus.h"
+#include "handlers.h"
+#include "interpreter.h"
+#include "jit.h"
+
+using Statements = std::vector<std::unique_ptr<BaseAST>>;
+
+static const char* const FIRST_INPUT = "task square(x) => int\nreturn x * x\nend y = square(12) + 1";
+static const char* const NEXT_INPUT = "z = y * 2 - 1";
+static const char* const FIB = "task fib(n: int) => int\nif n < 2 then return n end return fib(n - 1) + fib(n - 2)\nend";
+static const char* const LOOP = "task sum(n: int) => int\ns = 0\nfor i = 0; i < n; i ++ do s += i % 7 end return s\nend";
+
+template <typename F>
+double microseconds(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    std::string grammarPath = argc > 1 ? argv[1] : BABEL_GRAMMAR_PATH;
+    int repetitions = argc > 2 ? std::atoi(argv[2]) : 20;
+
+    BenchParser bench(grammarPath);
+    const Parser& parser = bench.parser;
+    Lexer lexer("bench", babelTokenSpecs());
+
+    auto parse = [&](const std::string& source) {
+        std::ostringstream diagnostics;
+        SemanticActions actions(parser.getTables());
+        auto result = parser.parseWith(lexer.tokenize(source), actions, diagnostics);
+        if (!result.accepted) {
+            std::cerr << diagnostics.str();
+            std::exit(1);
+        }
+        return std::get<SemanticActions::ASTList>(std::move(result.value));
+    };
+    auto run = [](auto& tier, Statements& statements) {
+        if (!tier.run(statements, false)) std::exit(1);
+    };
+
+    // a new session for every repetition, the mean of them
+    struct Latency {
+        double first = 0;
+        double next = 0;
+    };
+    auto latency = [&]<typename Tier>(Latency& l) {
+        for (int i = 0; i < repetitions; i++) {
+            Statements first = parse(FIRST_INPUT);
+            Statements next = parse(NEXT_INPUT);
+            std::unique_ptr<Tier> tier;
+            l.first += microseconds([&] {
+                tier = std::make_unique<Tier>();
+                run(*tier, first);
+            }) / repetitions;
+            l.next += microseconds([&] { run(*tier, next); }) / repetitions;
+        }
+    };
+
+    // the first and the best of three runs of a call, in a session that has the task already
+    struct Throughput {
+        double first = 0;
+        double best = 0;
+    };
+    auto throughput = [&]<typename Tier>(const char* task, const std::string& call) {
+        Tier tier;
+        Statements definition = parse(task);
+        run(tier, definition);
+        Throughput t;
+        for (int i = 0; i < 3; i++) {
+            Statements statements = parse(call);
+            const double time = microseconds([&] { run(tier, statements); }) / 1000;
+            if (i == 0) t.first = t.best = time;
+            t.best = std::min(t.best, time);
+        }
+        return t;
+    };
+
+    Latency interpreted, compiled;
+    latency.operator()<BabelInterpreter>(interpreted);
+    latency.operator()<BabelJIT>(compiled);
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::setw(32) << "" << std::setw(14) << "interpreter" << std::setw(14) << "JIT" << std::endl;
+    std::cout << std::setw(32) << std::left << "first result (us)" << std::right << std::setw(14) << interpreted.first << std::setw(14) << compiled.first << std::endl;
+    std::cout << std::setw(32) << std::left << "next input (us)" << std::right << std::setw(14) << interpreted.next << std::setw(14) << compiled.next << std::endl;
+
+    for (const auto& [name, task, call] : {std::tuple{"fib(27)", FIB, "r = fib(27)"}, std::tuple{"loop of 10^7", LOOP, "r = sum(10000000)"}}) {
+        const Throughput slow = throughput.operator()<BabelInterpreter>(task, call);
+        const Throughput fast = throughput.operator()<BabelJIT>(task, call);
+        std::cout << std::setw(32) << std::left << std::string(name) + ", first call (ms)" << std::right << std::setw(14) << slow.first << std::setw(14) << fast.first << std::endl;
+        std::cout << std::setw(32) << std::left << std::string(name) + ", steady (ms)" << std::right << std::setw(14) << slow.best << std::setw(14) << fast.best << std::endl;
+    }
+    return 0;
+}
@@ -1,23 +1,34 @@
-#include "llvm/ADT/APFloat.h"
-#include "llvm/ADT/STLExtras.h"
-#include "llvm/IR/BasicBlock.h"
-#include "llvm/IR/Constants.h"
-#include "llvm/IR/DerivedTypes.h"
-#include "llvm/IR/Function.h"
-#include "llvm/IR/IRBuilder.h"
-#include "llvm/IR/LLVMContext.h"
-#include "llvm/IR/Module.h"
-#include "llvm/IR/Type.h"
-#include "llvm/IR/Verifier.h"
+#pragma once
+
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "types.h"
+
+class BytecodeCompiler;
 
 // Base class for all expression node
 class BaseAST {
+    protected:
+        BabelType Type = BabelType::Unknown;
+
     public:
         virtual ~BaseAST() = default;
-        virtual Value *codegen() = 0;
+
+        // infers the node's type into the checker's forest and returns its id, Type is
+        // concrete once the enclosing task is checked for the second time
+        virtual int check(TypeChecker &checker) = 0;
+        virtual llvm::Value *codegen() = 0;
+        // writes the node's bytecode and returns the register its value is in
+        virtual int emit(BytecodeCompiler &compiler) = 0;
+
+        BabelType getType() const { return Type; }
 };
 
 // class for referencing variables
@@ -26,16 +37,22 @@ class VariableAST : public BaseAST {
 
     public:
         explicit VariableAST (const std::string &Name) : Name(Name) {}
-        Value *codegen() override;
+        const std::string &getName() const { return Name; }
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
 };
 
 // class for numeric literals which are integers
 class IntegerAST : public BaseAST {
-    const int Val;
+    const int64_t Val;
 
     public:
-        explicit IntegerAST (int Val) : Val(Val) {}
-        Value *codegen() override;
+        explicit IntegerAST (int64_t Val) : Val(Val) {}
+        int64_t getValue() const { return Val; }
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
 };
 
 // class for numeric literals which are floating points
@@ -44,7 +61,43 @@ class FloatingPointAST : public BaseAST {
 
     public:
         explicit FloatingPointAST (double Val) : Val(Val) {}
-        Value *codegen() override;
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
+};
+
+// class for TRUE and FALSE
+class BoolAST : public BaseAST {
+    const bool Val;
+
+    public:
+        explicit BoolAST (bool Val) : Val(Val) {}
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
+};
+
+// class for character literals
+class CharAST : public BaseAST {
+    const char Val;
+
+    public:
+        explicit CharAST (char Val) : Val(Val) {}
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
+};
+
+// class for prefix operators (+, -, !) and the postfix ++ and --, which need a variable
+class UnaryOperatorAST : public BaseAST {
+    const std::string Op;
+    std::unique_ptr<BaseAST> Operand;
+
+    public:
+        UnaryOperatorAST (std::string Op, std::unique_ptr<BaseAST> Operand) : Op(std::move(Op)), Operand(std::move(Operand)) {}
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
 };
 
 // class for when binary operators are used
@@ -52,30 +105,148 @@ class BinaryOperatorAST : public BaseAST {
     const std::string Op;
     std::unique_ptr<BaseAST> LHS;
     std::unique_ptr<BaseAST> RHS;
+    BabelType OperandType = BabelType::Unknown;     // both sides are converted to it
 
     public:
-        BinaryOperatorAST (std::string Op, std::unique_ptr<BaseAST> LHS, std::unique_ptr<BaseAST> RHS) : Op(Op), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
-        Value *codegen() override;
+        BinaryOperatorAST (std::string Op, std::unique_ptr<BaseAST> LHS, std::unique_ptr<BaseAST> RHS) : Op(std::move(Op)), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
 };
 
 // class for when a function is called
 class TaskCallAST : public BaseAST {
     const std::string callsTo;
     std::vector<std::unique_ptr<BaseAST>> Args;
+    std::vector<BabelType> ParamTypes;
 
     public:
         TaskCallAST (const std::string &callsTo, std::vector<std::unique_ptr<BaseAST>> Args) : callsTo(callsTo), Args(std::move(Args)) {}
-        Value *codegen() override;
+        const std::string &getCallee() const { return callsTo; }
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
+};
+
+// class for assigning to a variable, its value is the one assigned
+class AssignmentAST : public BaseAST {
+    const std::string Name;
+    std::unique_ptr<BaseAST> Val;
+    const BabelType DeclaredType;      // from x: type = ..., Unknown without one
+
+    public:
+        AssignmentAST (const std::string &Name, std::unique_ptr<BaseAST> Val, BabelType DeclaredType = BabelType::Unknown) : Name(Name), Val(std::move(Val)), DeclaredType(DeclaredType) {}
+        const std::string &getName() const { return Name; }
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
+};
+
+// class for a sequence of statements, its value is the one of the last statement
+class BlockAST : public BaseAST {
+    std::vector<std::unique_ptr<BaseAST>> Statements;
+
+    public:
+        explicit BlockAST (std::vector<std::unique_ptr<BaseAST>> Statements) : Statements(std::move(Statements)) {}
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
+};
+
+// class for if, elif chains are nested in Else
+class IfAST : public BaseAST {
+    std::unique_ptr<BaseAST> Cond;
+    std::unique_ptr<BaseAST> Then;
+    std::unique_ptr<BaseAST> Else;
+
+    public:
+        IfAST (std::unique_ptr<BaseAST> Cond, std::unique_ptr<BaseAST> Then, std::unique_ptr<BaseAST> Else) : Cond(std::move(Cond)), Then(std::move(Then)), Else(std::move(Else)) {}
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
+};
+
+// class for while and for loops, Step runs after the body and on continue
+class WhileAST : public BaseAST {
+    std::unique_ptr<BaseAST> Cond;
+    std::unique_ptr<BaseAST> Body;
+    std::unique_ptr<BaseAST> Step;
+
+    public:
+        WhileAST (std::unique_ptr<BaseAST> Cond, std::unique_ptr<BaseAST> Body, std::unique_ptr<BaseAST> Step = nullptr) : Cond(std::move(Cond)), Body(std::move(Body)), Step(std::move(Step)) {}
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
+};
+
+// class for break and continue
+class LoopControlAST : public BaseAST {
+    const bool IsBreak;
+
+    public:
+        explicit LoopControlAST (bool IsBreak) : IsBreak(IsBreak) {}
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
+};
+
+// class for raise, the error is named by its kind, which is what a catch matches
+class RaiseAST : public BaseAST {
+    const std::string Kind;
+
+    public:
+        explicit RaiseAST (const std::string &Kind) : Kind(Kind) {}
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
+};
+
+// class for try, the catches are tried in order and Finally runs however the try is left
+class TryAST : public BaseAST {
+    std::unique_ptr<BaseAST> Body;
+    std::vector<std::pair<std::string, std::unique_ptr<BaseAST>>> Catches;     // kind of error and block
+    std::unique_ptr<BaseAST> Finally;
+
+    public:
+        TryAST (std::unique_ptr<BaseAST> Body, std::vector<std::pair<std::string, std::unique_ptr<BaseAST>>> Catches, std::unique_ptr<BaseAST> Finally)
+            : Body(std::move(Body)), Catches(std::move(Catches)), Finally(std::move(Finally)) {}
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
+};
+
+// class for returning from a task
+class ReturnAST : public BaseAST {
+    std::unique_ptr<BaseAST> Val;
+
+    public:
+        explicit ReturnAST (std::unique_ptr<BaseAST> Val) : Val(std::move(Val)) {}
+        int check(TypeChecker &checker) override;
+        llvm::Value *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
 };
 
 // class for the function header (definition)
 class TaskHeaderAST : public BaseAST {
-    const std::string Name;
-    std::vector<std::unique_ptr<BaseAST>> Args;
+    std::string Name;
+    std::vector<std::string> Args;
+    std::vector<BabelType> ArgTypes;    // Unknown where the argument has no annotation
+    BabelType ReturnType;               // Unknown without => type
 
     public:
-        TaskHeaderAST (const std::string &Name, std::vector<std::unique_ptr<BaseAST>> Args) : Name(Name), Args(std::move(Args)) {}
-        Function *codegen() override;
+        TaskHeaderAST (const std::string &Name, std::vector<std::string> Args, std::vector<BabelType> ArgTypes, BabelType ReturnType = BabelType::Unknown)
+            : Name(Name), Args(std::move(Args)), ArgTypes(std::move(ArgTypes)), ReturnType(ReturnType) {}
+        const std::string &getName() const { return Name; }
+        const std::vector<std::string> &getArgs() const { return Args; }
+        const std::vector<BabelType> &getArgTypes() const { return ArgTypes; }
+        BabelType getReturnType() const { return ReturnType; }
+        void setSignature(const TaskSignature &signature) {
+            ArgTypes = signature.args;
+            ReturnType = signature.result;
+        }
+        int check(TypeChecker &checker) override;
+        llvm::Function *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
 };
 
 // class for the function definition
@@ -85,101 +256,39 @@ class TaskAST : public BaseAST {
 
     public:
         TaskAST (std::unique_ptr<TaskHeaderAST> Header, std::unique_ptr<BaseAST> Body) : Header(std::move(Header)), Body(std::move(Body)) {}
-        Function *codegen() override;
-};
-
-static std::unique_ptr<LLVMContext> TheContext;
-static std::unique_ptr<IRBuilder<>> Builder(TheContext);
-static std::unique_ptr<Module> TheModule;
-static std::map<std::string, Value *> NamedValues;
-
-Value *LogError(const char *str) {
-    std::cerr << str << '\n';
-    return nullptr;
-}
-
-Value *FloatingPointAST::codegen() {
-    return ConstantFP::get(*TheContext, APFloat(Val))
-}
-
-Value *IntegerAST::codegen() {
-    return ConstantInt::get(*TheContext, APInt(Val));
-}
-
-Value *VariableAST::codegen() {
-    Value *V = NamedValues[Name];
-    if (!V) LogError("error");
-    return V;
-}
-
-Value *BinaryOperatorAST::codegen() {
-    Value *left = LHS->codegen();
-    Value *right = RHS->codegen();
-    if (!left || !right) return nullptr;
-
-    switch (Op) {
-        case "+":
-            return Builder->CreateAdd(left, right, "addtmp");
-        case "-":
-            return Builder->CreateSub(left, right, "subtmp");
-        case "*":
-            return Builder->CreateMul(left, right, "multmp");
-        case "/":
-            return Builder->CreateSDiv(left, right, "divtmp");
-        default:
-            return LogError("Invalid binary operator");
-    }
-}
-
-Value *TaskCallAST::codegen() {
-    Function *CalleF = TheModule->getFunction(callsTo);
-    if (!CalleF) return LogError("Unknown Task referenced");
-
-    if (CalleF->arg_size() != Args.size()) return LogError("Passed incorect number of arguments");
-
-    std::vector<Value *> ArgsV;
-    for (unsigned int i = 0, e = Args.size(); i != e; ++i) {
-        ArgsV.push_back(Args[i]->codegen());
-        if (!ArgsV.back()) return nullptr;
-    }
-
-    return Builder->CreateCall(CalleF, ArgsV, "calltmp");
-}
-
-Function *TaskHeaderAST::codegen() {
-    // ! currently double, change later
-    std::vector<Type*> Doubles(Args.size(), Type::getDoubleTy(*TheContext));
-    FunctionType *FT = FunctionType::get(Type::getDoubleTy(*TheContext), Doubles, false);
-    Function *F = Function::Create(FT, Function::ExternalLinkage, Name, TheModule.get());
-
-    unsigned int idx = 0;
-    for (auto &Arg : F->args()) {
-        Arg.setName(Args[idx++]);
-    }
-
-    return F;
-}
-
-Function TaskAST::codegen() {
-    Function *TheFunction = TheModule->getFunction(Proto->getName());
-    if (!TheFunction) TheFunction = Proto->codegen();
-    if (!TheFunction) return nullptr;
-    if (!TheFunction->empty()) return (Function*)LogError("Task cannot be redefined");
-
-    BasicBlock *BB = BasicBlock::Create(*TheContext, "entry", TheFunction);
-    Builder->SetInsertPoint(BB);
-
-    NamedValues.clear();
-    for (auto &Arg : TheFunction->args()) {
-        NamedValues[std::string(arg.getName())] = &Arg;
-    }
-
-    if ((Value *RetVal = Body->codegen())) {
-        Builder->CreateRet(RetVal);
-        verifyFunction(*TheFunction);
-        return TheFunction;
-    }
-
-    TheFunction->eraseFromParent();
-    return nullptr;
-}
\ No newline at end of file
+        const TaskHeaderAST &getHeader() const { return *Header; }
+        int check(TypeChecker &checker) override;
+        llvm::Function *codegen() override;
+        int emit(BytecodeCompiler &compiler) override;
+};
+
+// The module codegen currently writes to. Every input gets a module of its own, tasks
+// and variables of earlier modules are declared in it when they are used.
+extern std::unique_ptr<llvm::LLVMContext> TheContext;
+extern std::unique_ptr<llvm::Module> TheModule;
+
+void initializeModule(const std::string &name);
+
+// Checks the types of the top level statements, with the tasks and variables earlier
+// programs defined known, and makes every node's type concrete. Returns what is defined
+// after the statements, the caller keeps it once they compiled. Throws std::runtime_error
+// with a TypeError.
+ProgramTypes checkProgram(std::vector<std::unique_ptr<BaseAST>> &statements, const ProgramTypes &defined);
+
+// Generates the tasks among the top level statements and a task called name, taking no
+// arguments and returning nothing, that runs the other statements. Tasks and globals are
+// the symbols babel.<name>, what earlier modules defined is declared in the module where
+// it is used. print(x) calls the runtime function
+// babel.print.<type of x>, with echo a last call that has a value is printed as well.
+// Returns nullptr on an error.
+llvm::Function *codegenTopLevel(std::vector<std::unique_ptr<BaseAST>> &statements, const ProgramTypes &defined,
+                                const std::string &name, bool echo = false);
+
+// Generates task definitions that were checked before, with the tasks of defined declared
+// where they are called, and for every task an entry babel.entry.<name> taking a pointer
+// to 64 bit slots: the arguments are read from the first ones and the result is written
+// to the first, floats as their bits and bools and chars widened to ints. This is how the
+// interpreter calls a task it compiled. The tasks raise a stack overflow through
+// babel.error.overflow once their frames reach below babel.stack.limit, an address the
+// caller sets. Returns the entries, none on an error.
+std::vector<llvm::Function *> codegenEntries(const std::vector<TaskAST *> &tasks, const ProgramTypes &defined);
@@ -0,0 +1,180 @@
+// Batch front end: lexes and parses every file on the command line in one process,
+// with the parse table loaded once and shared by all threads. Files are parsed in
+// parallel, largest first, but their output is written in command line order, so
+// it is the same for any number of threads. Syntax errors go to stderr and the
+// exit status is 1 if any file failed.
+//
+// Results are cached in a cache directory next to the parse table in use, keyed by
+// the file's normalized path and text, the grammar and the token specs, so a file
+// that did not change since the last run is not lexed or parsed again. Trees are
+// only cached, and read back, with --tree; otherwise whether the file parsed and
+// its syntax errors are all that is kept.
+//
+// usage: babelc [--table file] [--grammar file] [--cache dir] [--cache-size MiB] [--no-cache] [--tree] [-j threads] file...
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory_resource>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cache.h"
+#include "frontend.h"
+#include "threadpool.h"
+
+struct FileResult {
+    std::string output;
+    std::string errors;
+    bool failed = false;
+    bool done = false;
+};
+
+int main(int argc, char* argv[]) {
+    const std::filesystem::path ROOT_DIR = std::filesystem::absolute(std::filesystem::path(argv[0])).parent_path().parent_path();
+    std::filesystem::path tablePath = ROOT_DIR / "assets" / "parser.tbl";
+    std::filesystem::path grammarPath = ROOT_DIR / "build" / "grammar.txt";
+    std::optional<std::filesystem::path> cachePath;
+    uint64_t cacheSize = BuildCache::DEFAULT_SIZE_LIMIT;
+    bool useCache = true;
+    bool printTrees = false;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "--table" || arg == "--grammar") && i + 1 < argc) {
+            (arg == "--table" ? tablePath : grammarPath) = argv[++i];
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cachePath = argv[++i];
+        } else if (arg == "--cache-size" && i + 1 < argc) {
+            cacheSize = std::strtoull(argv[++i], nullptr, 10) << 20;
+        } else if (arg == "--no-cache") {
+            useCache = false;
+        } else if (arg == "-j" && i + 1 < argc) {
+            threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--tree") {
+            printTrees = true;
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "babelc: unknown option " << arg << std::endl;
+            return 2;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    if (files.empty()) {
+        std::cerr << "usage: babelc [--table file] [--grammar file] [--cache dir] [--cache-size MiB] [--no-cache] [--tree] [-j threads] file..." << std::endl;
+        return 2;
+    }
+
+    if (!cachePath) cachePath = std::filesystem::absolute(tablePath).parent_path() / "cache";
+
+    Lexer lexer("babelc", babelTokenSpecs());
+    Parser parser = loadParser(tablePath, grammarPath);
+
+    std::optional<BuildCache> cache;
+    if (useCache) cache.emplace(*cachePath, cacheSize);
+    const std::string cacheContext = "parse " + std::to_string(parser.getTables().grammarHash()) + " " + std::to_string(hashTokenSpecs(babelTokenSpecs())) + " ";
+    std::atomic<bool> stored{false};
+
+    ThreadPool pool(static_cast<unsigned>(std::min<size_t>(threads, files.size())));
+
+    // one pool of memory per worker for trees and token text, so workers do not
+    // contend in the allocator and a worker reuses the blocks of its previous file
+    std::vector<std::unique_ptr<std::pmr::unsynchronized_pool_resource>> arenas;
+    for (unsigned worker = 0; worker < pool.size(); worker++) {
+        arenas.push_back(std::make_unique<std::pmr::unsynchronized_pool_resource>());
+    }
+
+    // the largest files start first, so none of them is left for the end
+    std::vector<uintmax_t> sizes(files.size(), 0);
+    for (size_t i = 0; i < files.size(); i++) {
+        std::error_code error;
+        sizes[i] = std::filesystem::file_size(files[i], error);
+    }
+    std::vector<size_t> order(files.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    std::vector<FileResult> results(files.size());
+    std::mutex outputMutex;
+    size_t flushed = 0;
+    size_t failed = 0;
+
+    pool.parallelFor(order.size(), [&](size_t job, unsigned worker) {
+        const size_t index = order[job];
+        FileResult& result = results[index];
+
+        try {
+            auto file = std::make_shared<const MappedFile>(files[index]);
+            CacheKey key;
+            // a.babel and ./a.babel are the same entry
+            if (cache) key = CacheKey(std::string_view(file->data(), file->size()), cacheContext + std::filesystem::weakly_canonical(std::filesystem::absolute(files[index])).string());
+
+            // without --tree the verdict is enough and the file is not parsed at all on a hit
+            std::optional<std::pair<bool, std::string>> verdict;
+            if (cache && !printTrees) {
+                if (std::optional<std::string> entry = cache->load(key, "verdict")) verdict = decodeVerdict(*entry);
+                if (verdict) verdict->second = namedDiagnostics(verdict->second, files[index]);
+            }
+
+            if (!verdict) {
+                std::optional<std::string> entry = cache && printTrees ? cache->load(key, "tree") : std::nullopt;
+                std::optional<CachedParse> parse = entry ? decodeParse(*entry, parser, arenas[worker].get()) : std::nullopt;
+                if (parse) parse->diagnostics = namedDiagnostics(parse->diagnostics, files[index]);
+                if (!parse) {
+                    StreamingLexer stream(lexer, file);
+                    std::ostringstream diagnostics;
+                    // only printed trees need the pass-through nodes
+                    ParseTree tree = parser.parse(stream, diagnostics, arenas[worker].get(), printTrees ? Parser::FULL_TREE : Parser::ELIDE_PASS_THROUGH);
+                    parse.emplace(CachedParse{diagnostics.str(), std::move(tree)});
+                    if (cache) {
+                        const std::string unnamed = unnamedDiagnostics(parse->diagnostics, files[index]);
+                        cache->store(key, "verdict", encodeVerdict(parse->tree.accepted, unnamed));
+                        if (printTrees) cache->store(key, "tree", encodeParse(parse->tree, unnamed));
+                        stored = true;
+                    }
+                }
+
+                if (printTrees && parse->tree.accepted) {
+                    std::ostringstream output;
+                    output << parse->tree << std::endl;
+                    result.output = output.str();
+                }
+                verdict.emplace(parse->tree.accepted, std::move(parse->diagnostics));
+            }
+
+            if (!verdict->first) {
+                result.errors = std::move(verdict->second);
+                result.failed = true;
+            }
+        } catch (const std::exception& e) {
+            result.errors = std::string("babelc: ") + e.what() + "\n";
+            result.failed = true;
+        }
+
+        // write out every finished file that has no unfinished one before it
+        std::lock_guard<std::mutex> lock(outputMutex);
+        result.done = true;
+        while (flushed < results.size() && results[flushed].done) {
+            FileResult& next = results[flushed++];
+            std::cout << next.output;
+            std::cerr << next.errors;
+            if (next.failed) failed++;
+            next.output = std::string();
+            next.errors = std::string();
+        }
+    });
+
+    std::cout.flush();
+    if (stored) cache->evict();
+    if (failed != 0) std::cerr << failed << " of " << files.size() << " files failed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
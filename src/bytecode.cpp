@@ -0,0 +1,507 @@
+#include "bytecode.h"
+
+#include <algorithm>
+#include <iostream>
+
+int BytecodeCompiler::checkedRegister(int reg) {
+    if (reg > UINT16_MAX) fail("Task " + task->name + " needs too many registers");
+    if (reg >= task->registers) task->registers = reg + 1;
+    return reg;
+}
+
+int BytecodeCompiler::emit(Opcode op, int a, int b, int c) {
+    task->code.push_back({op, static_cast<uint16_t>(a), static_cast<uint16_t>(b), static_cast<uint16_t>(c)});
+    return here() - 1;
+}
+
+int BytecodeCompiler::emitWide(Opcode op, int a, uint32_t wide) {
+    return emit(op, a, static_cast<int>(wide & 0xFFFF), static_cast<int>(wide >> 16));
+}
+
+void BytecodeCompiler::patch(int jump, int target) {
+    task->code[jump].b = static_cast<uint16_t>(target & 0xFFFF);
+    task->code[jump].c = static_cast<uint16_t>(static_cast<uint32_t>(target) >> 16);
+}
+
+int BytecodeCompiler::temporary() {
+    return checkedRegister(nextRegister++);
+}
+
+int BytecodeCompiler::local(const std::string& name) const {
+    auto it = locals.find(name);
+    return it == locals.end() ? -1 : it->second;
+}
+
+// only at the start of a statement, the first temporary becomes the variable
+int BytecodeCompiler::defineLocal(const std::string& name) {
+    return locals[name] = hiddenLocal();
+}
+
+// a register kept until the task ends, that no name refers to, also only at the start of a statement
+int BytecodeCompiler::hiddenLocal() {
+    const int reg = checkedRegister(localCount++);
+    if (nextRegister < localCount) nextRegister = localCount;
+    return reg;
+}
+
+int BytecodeCompiler::global(const std::string& name) const {
+    auto it = program.globalIndex.find(name);
+    return it == program.globalIndex.end() ? -1 : it->second;
+}
+
+int BytecodeCompiler::defineGlobal(const std::string& name) {
+    const int index = static_cast<int>(program.globalIndex.size());
+    program.globalIndex[name] = index;
+    return index;
+}
+
+int BytecodeCompiler::constant(Slot value) {
+    task->constants.push_back(value);
+    return static_cast<int>(task->constants.size()) - 1;
+}
+
+int BytecodeCompiler::loadInt(int64_t value) {
+    const int reg = temporary();
+    if (value >= INT16_MIN && value <= INT16_MAX) emit(Opcode::LOADI, reg, static_cast<uint16_t>(value));
+    else emitWide(Opcode::LOADK, reg, constant(Slot{.i = value}));
+    return reg;
+}
+
+int BytecodeCompiler::move(int target, int reg) {
+    if (target != reg) emit(Opcode::MOVE, target, reg);
+    return target;
+}
+
+int BytecodeCompiler::convert(int reg, BabelType from, BabelType to) {
+    if (from != BabelType::Int || to != BabelType::Float) return reg;
+    const int result = temporary();
+    emit(Opcode::INTTOFLOAT, result, reg);
+    return result;
+}
+
+// a register the jumps can test, ints and chars are already true when they are not zero
+int BytecodeCompiler::condition(int reg, BabelType type) {
+    if (type != BabelType::Float) return reg;
+    const int result = temporary();
+    emit(Opcode::FTRUTH, result, reg);
+    return result;
+}
+
+// the condition as a bool in target
+int BytecodeCompiler::truth(int target, int reg, BabelType type) {
+    if (type == BabelType::Bool) return move(target, reg);
+    emit(type == BabelType::Float ? Opcode::FTRUTH : Opcode::TRUTH, target, reg);
+    return target;
+}
+
+void BytecodeCompiler::print(int reg, BabelType type) {
+    switch (type) {
+        case BabelType::Int: emit(Opcode::PRINTINT, reg); break;
+        case BabelType::Float: emit(Opcode::PRINTFLOAT, reg); break;
+        case BabelType::Bool: emit(Opcode::PRINTBOOL, reg); break;
+        default: emit(Opcode::PRINTCHAR, reg);
+    }
+}
+
+int BytecodeCompiler::taskIndex(const std::string& name) const {
+    auto it = program.taskIndex.find(name);
+    return it == program.taskIndex.end() ? -1 : it->second;
+}
+
+void BytecodeCompiler::beginTask(const TaskHeaderAST& header) {
+    if (taskIndex(header.getName()) >= 0) fail("Task cannot be redefined");
+
+    // registered first, so the body can call the task itself
+    program.taskIndex[header.getName()] = static_cast<int>(program.tasks.size());
+    program.tasks.push_back(std::make_unique<BytecodeTask>());
+    task = program.tasks.back().get();
+    task->name = header.getName();
+    task->params = static_cast<int>(header.getArgs().size());
+    task->result = header.getReturnType();
+
+    locals.clear();
+    localCount = nextRegister = 0;
+    for (const std::string& arg : header.getArgs()) defineLocal(arg);
+    inTask = true;
+}
+
+// falling off the end of a task with a result returns zero
+void BytecodeCompiler::endTask() {
+    endStatement();
+    if (task->result == BabelType::Void) emit(Opcode::RETVOID);
+    else emit(Opcode::RET, loadInt(0));
+    locals.clear();
+    localCount = nextRegister = 0;
+    inTask = false;
+}
+
+void BytecodeCompiler::endLoop(int continueTarget, int breakTarget) {
+    for (int jump : loops.back().continues) patch(jump, continueTarget);
+    for (int jump : loops.back().breaks) patch(jump, breakTarget);
+    loops.pop_back();
+}
+
+// the trys that began inside the loop are left
+void BytecodeCompiler::loopControl(bool isBreak) {
+    if (loops.empty()) fail(isBreak ? "break outside of a loop" : "continue outside of a loop");
+    size_t depth = trys.size();
+    while (depth > 0 && trys[depth - 1].loops >= loops.size()) depth--;
+    const int jump = leave(depth, Opcode::JUMP);
+    (isBreak ? loops.back().breaks : loops.back().continues).push_back(jump);
+}
+
+int BytecodeCompiler::errorKind(const std::string& name) {
+    auto it = std::find(program.errors.begin(), program.errors.end(), name);
+    if (it != program.errors.end()) return static_cast<int>(it - program.errors.begin());
+    program.errors.push_back(name);
+    return static_cast<int>(program.errors.size()) - 1;
+}
+
+void BytecodeCompiler::beginTry(BaseAST* finally) {
+    trys.push_back({finally, loops.size(), here(), {}});
+}
+
+// the ranges of the innermost try covered so far, the next one starts here
+std::vector<std::pair<int, int>> BytecodeCompiler::tryRanges() {
+    Try& current = trys.back();
+    if (current.start < here()) current.ranges.emplace_back(current.start, here());
+    current.start = here();
+    return std::exchange(current.ranges, {});
+}
+
+bool BytecodeCompiler::leavesFinally(size_t depth) const {
+    return std::any_of(trys.begin() + depth, trys.end(), [](const Try& t) { return t.finally; });
+}
+
+// Writes op, a return or the jump of a break or continue, after the finally blocks of the
+// trys from depth on, innermost first. The handlers of a try cover neither its own finally
+// block nor op, the ones of the trys around it still cover its finally block.
+int BytecodeCompiler::leave(size_t depth, Opcode op, int a) {
+    std::vector<Try> left;
+    while (trys.size() > depth) {
+        left.push_back(std::move(trys.back()));
+        trys.pop_back();
+        Try& current = left.back();
+        if (current.start < here()) current.ranges.emplace_back(current.start, here());
+        if (current.finally) current.finally->emit(*this);
+    }
+    const int at = emit(op, a);
+    for (auto it = left.rbegin(); it != left.rend(); ++it) {
+        it->start = here();
+        trys.push_back(std::move(*it));
+    }
+    return at;
+}
+
+void BytecodeCompiler::handle(const std::vector<std::pair<int, int>>& ranges, int kind, int target, int reg) {
+    for (const auto& [begin, end] : ranges) task->handlers.push_back({begin, end, target, kind, reg});
+}
+
+std::unique_ptr<BytecodeTask> BytecodeCompiler::compileTopLevel(std::vector<std::unique_ptr<BaseAST>>& statements, const std::string& name, bool echo) {
+    auto main = std::make_unique<BytecodeTask>();
+    main->name = name;
+    task = main.get();
+    int last = NO_VALUE;
+    for (auto& statement : statements) {
+        endStatement();
+        // a task is compiled where it is defined, so it sees the globals assigned before it
+        if (dynamic_cast<TaskAST*>(statement.get())) {
+            statement->emit(*this);
+            task = main.get();
+            continue;
+        }
+        last = statement->emit(*this);
+    }
+
+    // a call on its own shows its value, like in other REPLs
+    auto* call = statements.empty() ? nullptr : dynamic_cast<TaskCallAST*>(statements.back().get());
+    if (echo && call && call->getCallee() != "print" && call->getType() != BabelType::Void) print(last, call->getType());
+    emit(Opcode::HALT);
+    task = nullptr;
+    return main;
+}
+
+std::unique_ptr<BytecodeTask> compileBytecode(BytecodeProgram& program, std::vector<std::unique_ptr<BaseAST>>& statements,
+                                              const std::string& name, bool echo) {
+    const size_t taskCount = program.tasks.size();
+    const std::map<std::string, int> tasks = program.taskIndex;
+    const std::map<std::string, int> globals = program.globalIndex;
+    const size_t errorCount = program.errors.size();
+    try {
+        return BytecodeCompiler(program).compileTopLevel(statements, name, echo);
+    } catch (const BytecodeError& e) {
+        std::cerr << e.what() << '\n';
+        program.tasks.resize(taskCount);
+        program.taskIndex = tasks;
+        program.globalIndex = globals;
+        program.errors.resize(errorCount);
+        return nullptr;
+    }
+}
+
+int FloatingPointAST::emit(BytecodeCompiler &compiler) {
+    const int reg = compiler.temporary();
+    compiler.emitWide(Opcode::LOADK, reg, compiler.constant(Slot{.f = Val}));
+    return reg;
+}
+
+int IntegerAST::emit(BytecodeCompiler &compiler) {
+    return compiler.loadInt(Val);
+}
+
+int BoolAST::emit(BytecodeCompiler &compiler) {
+    return compiler.loadInt(Val);
+}
+
+int CharAST::emit(BytecodeCompiler &compiler) {
+    return compiler.loadInt(Val);
+}
+
+// a local is used in its own register, a global is loaded
+int VariableAST::emit(BytecodeCompiler &compiler) {
+    if (int reg = compiler.local(Name); reg >= 0) return reg;
+    const int global = compiler.global(Name);
+    if (global < 0) compiler.fail("Unknown variable " + Name);
+    const int reg = compiler.temporary();
+    compiler.emitWide(Opcode::GETGLOBAL, reg, global);
+    return reg;
+}
+
+int UnaryOperatorAST::emit(BytecodeCompiler &compiler) {
+    if (Op == "++" || Op == "--") {
+        const std::string &Name = static_cast<VariableAST *>(Operand.get())->getName();
+        const int old = compiler.temporary();
+        const int local = compiler.local(Name);
+        const int global = local < 0 ? compiler.global(Name) : -1;
+        if (local < 0 && global < 0) compiler.fail("Unknown variable " + Name);
+
+        int slot = local;
+        if (local >= 0) {
+            compiler.move(old, local);
+        } else {
+            compiler.emitWide(Opcode::GETGLOBAL, old, global);
+            slot = compiler.temporary();
+        }
+        if (Type == BabelType::Float) {
+            const int one = compiler.temporary();
+            compiler.emitWide(Opcode::LOADK, one, compiler.constant(Slot{.f = 1.0}));
+            compiler.emit(Op == "++" ? Opcode::FADD : Opcode::FSUB, slot, old, one);
+        } else {
+            compiler.emit(Opcode::ADDI, slot, old, static_cast<uint16_t>(Op == "++" ? 1 : -1));
+        }
+        if (global >= 0) compiler.emitWide(Opcode::SETGLOBAL, slot, global);
+        return old;
+    }
+
+    const int mark = compiler.mark();
+    const int V = Operand->emit(compiler);
+    if (Op == "+") return V;
+
+    compiler.release(mark);
+    const int result = compiler.temporary();
+    if (Op == "-") compiler.emit(Type == BabelType::Float ? Opcode::FNEG : Opcode::NEG, result, V);
+    else if (Op == "!") compiler.emit(Opcode::NOT, result, compiler.condition(V, Operand->getType()));
+    else compiler.fail("Invalid unary operator");
+    return result;
+}
+
+// an operand that can not change a variable, so a local on the left is still its value after it
+static bool isLeaf(const BaseAST *node) {
+    return dynamic_cast<const VariableAST *>(node) || dynamic_cast<const IntegerAST *>(node) || dynamic_cast<const FloatingPointAST *>(node)
+        || dynamic_cast<const BoolAST *>(node) || dynamic_cast<const CharAST *>(node);
+}
+
+int BinaryOperatorAST::emit(BytecodeCompiler &compiler) {
+    // & and | only evaluate the right side when the left one does not decide
+    if (Op == "&" || Op == "|") {
+        const int result = compiler.temporary();
+        const int mark = compiler.mark();
+        compiler.truth(result, LHS->emit(compiler), LHS->getType());
+        compiler.release(mark);
+        const int jump = compiler.emit(Op == "&" ? Opcode::JUMPIFNOT : Opcode::JUMPIF, result);
+        compiler.truth(result, RHS->emit(compiler), RHS->getType());
+        compiler.release(mark);
+        compiler.patchHere(jump);
+        return result;
+    }
+
+    const int mark = compiler.mark();
+    int left = LHS->emit(compiler);
+    if (compiler.isLocal(left) && !isLeaf(RHS.get())) left = compiler.move(compiler.temporary(), left);
+    left = compiler.convert(left, LHS->getType(), OperandType);
+
+    // adding a small int constant needs no register for it
+    if ((Op == "+" || Op == "-") && OperandType == BabelType::Int) {
+        if (auto *constant = dynamic_cast<IntegerAST *>(RHS.get()); constant && constant->getValue() > INT16_MIN && constant->getValue() <= INT16_MAX) {
+            compiler.release(mark);
+            const int result = compiler.temporary();
+            const int64_t step = Op == "+" ? constant->getValue() : -constant->getValue();
+            compiler.emit(Opcode::ADDI, result, left, static_cast<uint16_t>(step));
+            return result;
+        }
+    }
+
+    const int right = compiler.convert(RHS->emit(compiler), RHS->getType(), OperandType);
+    compiler.release(mark);
+    const int result = compiler.temporary();
+
+    // the int and the float instruction of an operator, HALT where the type has none
+    static const std::map<std::string, std::pair<Opcode, Opcode>> operations = {
+        {"+", {Opcode::ADD, Opcode::FADD}}, {"-", {Opcode::SUB, Opcode::FSUB}}, {"*", {Opcode::MUL, Opcode::FMUL}}, {"/", {Opcode::HALT, Opcode::FDIV}},
+        {"//", {Opcode::FLOORDIV, Opcode::FFLOORDIV}}, {"%", {Opcode::FLOORMOD, Opcode::FMOD}}, {"^", {Opcode::POW, Opcode::FPOW}},
+        {"==", {Opcode::EQ, Opcode::FEQ}}, {"!=", {Opcode::NE, Opcode::FNE}}, {"<", {Opcode::LT, Opcode::FLT}}, {"<=", {Opcode::LE, Opcode::FLE}},
+        {">", {Opcode::GT, Opcode::FGT}}, {">=", {Opcode::GE, Opcode::FGE}}, {"bit_or", {Opcode::BITOR, Opcode::HALT}}, {"bit_xor", {Opcode::BITXOR, Opcode::HALT}},
+        {"bit_and", {Opcode::BITAND, Opcode::HALT}}, {"<<", {Opcode::SHL, Opcode::HALT}}, {">>", {Opcode::SHR, Opcode::HALT}},
+    };
+    auto it = operations.find(Op);
+    const Opcode op = it == operations.end() ? Opcode::HALT : OperandType == BabelType::Float ? it->second.second : it->second.first;
+    if (op == Opcode::HALT) compiler.fail("Invalid binary operator");
+    compiler.emit(op, result, left, right);
+    return result;
+}
+
+int TaskCallAST::emit(BytecodeCompiler &compiler) {
+    if (callsTo == "print") {
+        const int V = compiler.convert(Args[0]->emit(compiler), Args[0]->getType(), ParamTypes[0]);
+        compiler.print(V, ParamTypes[0]);
+        return V;
+    }
+
+    const int index = compiler.taskIndex(callsTo);
+    if (index < 0) compiler.fail("Unknown Task referenced " + callsTo);
+    if (compiler.taskAt(index).params != static_cast<int>(Args.size())) compiler.fail("Passed incorect number of arguments");
+
+    // the callee's frame starts at the first argument, the result replaces it
+    const int base = compiler.temporary();
+    for (size_t i = 1; i < Args.size(); i++) compiler.temporary();
+    for (size_t i = 0; i < Args.size(); i++) {
+        const int mark = compiler.mark();
+        compiler.move(base + static_cast<int>(i), compiler.convert(Args[i]->emit(compiler), Args[i]->getType(), ParamTypes[i]));
+        compiler.release(mark);
+    }
+    compiler.emit(Opcode::CALL, base, index);
+    compiler.release(base + 1);
+    return base;
+}
+
+int AssignmentAST::emit(BytecodeCompiler &compiler) {
+    const int V = compiler.convert(Val->emit(compiler), Val->getType(), Type);
+
+    if (int reg = compiler.local(Name); reg >= 0) return compiler.move(reg, V);
+    int global = compiler.global(Name);
+    if (global < 0) {
+        // a new name is a global at the top level and a local in a task
+        if (compiler.compilingTask()) return compiler.move(compiler.defineLocal(Name), V);
+        global = compiler.defineGlobal(Name);
+    }
+    compiler.emitWide(Opcode::SETGLOBAL, V, global);
+    return V;
+}
+
+int BlockAST::emit(BytecodeCompiler &compiler) {
+    int Last = BytecodeCompiler::NO_VALUE;
+    for (auto &Statement : Statements) {
+        compiler.endStatement();
+        Last = Statement->emit(compiler);
+    }
+    return Last;
+}
+
+int IfAST::emit(BytecodeCompiler &compiler) {
+    const int toElse = compiler.emit(Opcode::JUMPIFNOT, compiler.condition(Cond->emit(compiler), Cond->getType()));
+    Then->emit(compiler);
+    if (!Else) {
+        compiler.patchHere(toElse);
+        return BytecodeCompiler::NO_VALUE;
+    }
+    const int toEnd = compiler.emit(Opcode::JUMP);
+    compiler.patchHere(toElse);
+    Else->emit(compiler);
+    compiler.patchHere(toEnd);
+    return BytecodeCompiler::NO_VALUE;
+}
+
+// the condition is tested at the bottom, so an iteration takes one jump
+int WhileAST::emit(BytecodeCompiler &compiler) {
+    const int toCond = compiler.emit(Opcode::JUMP);
+    const int body = compiler.here();
+    compiler.beginLoop();
+    Body->emit(compiler);
+
+    const int step = compiler.here();
+    if (Step) {
+        compiler.endStatement();
+        Step->emit(compiler);
+    }
+    compiler.endStatement();
+    compiler.patchHere(toCond);
+    compiler.emitWide(Opcode::LOOP, compiler.condition(Cond->emit(compiler), Cond->getType()), body);
+    compiler.endLoop(step, compiler.here());
+    return BytecodeCompiler::NO_VALUE;
+}
+
+int LoopControlAST::emit(BytecodeCompiler &compiler) {
+    compiler.loopControl(IsBreak);
+    return BytecodeCompiler::NO_VALUE;
+}
+
+// the kind is a small int, with no reason for the error in the high bits
+int RaiseAST::emit(BytecodeCompiler &compiler) {
+    compiler.emit(Opcode::RAISE, compiler.loadInt(compiler.errorKind(Kind)));
+    return BytecodeCompiler::NO_VALUE;
+}
+
+// The body is covered by a handler for every catch, in order. With a finally, the body and
+// the catches are covered by one for any error as well, which keeps the error in a register,
+// runs the finally block and raises the error again; the finally block is written out once
+// more where the body and every catch end, and at every return, break and continue leaving
+// the try.
+int TryAST::emit(BytecodeCompiler &compiler) {
+    const int error = compiler.hiddenLocal();
+    const size_t depth = compiler.tryDepth();
+    compiler.beginTry(Finally.get());
+    Body->emit(compiler);
+    std::vector<int> ends = {compiler.leave(depth, Opcode::JUMP)};
+    const std::vector<std::pair<int, int>> body = compiler.tryRanges();
+
+    for (auto &[Kind, Block] : Catches) {
+        compiler.handle(body, compiler.errorKind(Kind), compiler.here(), error);
+        Block->emit(compiler);
+        ends.push_back(compiler.leave(depth, Opcode::JUMP));
+    }
+    std::vector<std::pair<int, int>> covered = compiler.tryRanges();
+    compiler.endTry();
+
+    if (Finally) {
+        covered.insert(covered.begin(), body.begin(), body.end());
+        compiler.handle(covered, ErrorHandler::ANY_ERROR, compiler.here(), error);
+        Finally->emit(compiler);
+        compiler.emit(Opcode::RAISE, error);
+    }
+    for (int jump : ends) compiler.patchHere(jump);
+    return BytecodeCompiler::NO_VALUE;
+}
+
+// the finally blocks a return leaves run after its value is computed, which is kept in a register of its own meanwhile
+int ReturnAST::emit(BytecodeCompiler &compiler) {
+    if (!Val) {
+        compiler.leave(0, Opcode::RETVOID);
+        return BytecodeCompiler::NO_VALUE;
+    }
+    const int result = compiler.leavesFinally(0) ? compiler.hiddenLocal() : BytecodeCompiler::NO_VALUE;
+    int V = compiler.convert(Val->emit(compiler), Val->getType(), Type);
+    if (result != BytecodeCompiler::NO_VALUE) V = compiler.move(result, V);
+    compiler.leave(0, Opcode::RET, V);
+    return BytecodeCompiler::NO_VALUE;
+}
+
+int TaskHeaderAST::emit(BytecodeCompiler &) {
+    return BytecodeCompiler::NO_VALUE;
+}
+
+int TaskAST::emit(BytecodeCompiler &compiler) {
+    compiler.beginTask(*Header);
+    Body->emit(compiler);
+    compiler.endTask();
+    return BytecodeCompiler::NO_VALUE;
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ast.h"
+
+// The instructions of the interpreter, register based: a, b and c are registers of the
+// task's frame unless said otherwise, and ops come in an int and a float version, the
+// type checker already decided which one. Bools and chars are ints, a condition is an
+// int that is not zero. Jump targets, constants and globals are wide, in b and c.
+#define BABEL_OPCODES(X) \
+    X(MOVE)             /* a = b */ \
+    X(LOADK)            /* a = constant wide */ \
+    X(LOADI)            /* a = b as a signed 16 bit int */ \
+    X(GETGLOBAL)        /* a = global wide */ \
+    X(SETGLOBAL)        /* global wide = a */ \
+    X(INTTOFLOAT)       /* a = float(b) */ \
+    X(ADD) X(SUB) X(MUL) X(FLOORDIV) X(FLOORMOD) X(POW) \
+    X(ADDI)             /* a = b + c as a signed 16 bit int */ \
+    X(FADD) X(FSUB) X(FMUL) X(FDIV) X(FMOD) X(FFLOORDIV) X(FPOW) \
+    X(EQ) X(NE) X(LT) X(LE) X(GT) X(GE) \
+    X(FEQ) X(FNE) X(FLT) X(FLE) X(FGT) X(FGE) \
+    X(BITOR) X(BITXOR) X(BITAND) X(SHL) X(SHR) \
+    X(NEG) X(FNEG) \
+    X(NOT)              /* a = b == 0 */ \
+    X(TRUTH)            /* a = b != 0 */ \
+    X(FTRUTH)           /* a = b != 0.0 */ \
+    X(JUMP)             /* to wide */ \
+    X(JUMPIF)           /* to wide if a */ \
+    X(JUMPIFNOT)        /* to wide unless a */ \
+    X(LOOP)             /* to wide if a, the back edge of a loop, which makes the task hotter */ \
+    X(CALL)             /* task b with its frame at a, where the arguments are; the result goes to a */ \
+    X(RET)              /* returns a */ \
+    X(RETVOID) \
+    X(RAISE)            /* the error in a, its kind is the low 32 bits */ \
+    X(PRINTINT) X(PRINTFLOAT) X(PRINTBOOL) X(PRINTCHAR) \
+    X(HALT)
+
+enum class Opcode : uint8_t {
+#define BABEL_OPCODE_ENUM(name) name,
+    BABEL_OPCODES(BABEL_OPCODE_ENUM)
+#undef BABEL_OPCODE_ENUM
+};
+
+struct Instruction {
+    Opcode op;
+    uint16_t a = 0;
+    uint16_t b = 0;
+    uint16_t c = 0;
+
+    uint32_t wide() const { return b | static_cast<uint32_t>(c) << 16; }
+};
+
+// a register or global, which type it holds is known where it is used
+union Slot {
+    int64_t i;
+    double f;
+};
+
+// An error raised in code from begin up to end goes to target when it is of kind, or of
+// any kind for ANY_ERROR, and is kept in register reg then. Inner handlers come first.
+struct ErrorHandler {
+    static constexpr int ANY_ERROR = -1;
+
+    int begin;
+    int end;
+    int target;
+    int kind;
+    int reg;
+};
+
+// A compiled task, or the statements of one run. threaded is filled by the interpreter
+// the first time the code runs, with the address of every instruction's handler; heat
+// counts its calls and loop iterations, a hot task gets a native entry from the JIT,
+// which takes the task's registers, unless it is not promotable.
+struct BytecodeTask {
+    std::string name;
+    std::vector<Instruction> code;
+    std::vector<Slot> constants;
+    std::vector<ErrorHandler> handlers;
+    int params = 0;
+    int registers = 0;
+    BabelType result = BabelType::Void;
+    std::vector<const void*> threaded;
+    int64_t heat = 0;
+    bool promotable = true;
+    void (*native)(void* registers) = nullptr;
+};
+
+// What runs have defined so far, the interpreter keeps the values of the globals. The
+// kinds of errors are numbered by their names, RuntimeError is what running raises.
+struct BytecodeProgram {
+    static constexpr int RUNTIME_ERROR = 0;
+
+    std::vector<std::unique_ptr<BytecodeTask>> tasks;
+    std::map<std::string, int> taskIndex;
+    std::map<std::string, int> globalIndex;
+    std::vector<std::string> errors = {"RuntimeError"};
+};
+
+// what codegen reports with LogError, the run is not executed then
+struct BytecodeError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Writes the code of one task or of the top level statements, the nodes call it from
+// emit. Registers below the locals' count belong to the arguments and variables, the
+// ones above are temporaries, which are given back when a statement ends.
+class BytecodeCompiler {
+    private:
+        struct Loop {
+            std::vector<int> breaks;
+            std::vector<int> continues;
+        };
+
+        // a try whose code is being written, the handlers cover ranges, the current one
+        // from start on; loops is how many loops were open when it began
+        struct Try {
+            BaseAST* finally;
+            size_t loops;
+            int start;
+            std::vector<std::pair<int, int>> ranges;
+        };
+
+        BytecodeProgram& program;
+        BytecodeTask* task = nullptr;
+        std::map<std::string, int> locals;
+        int localCount = 0;
+        int nextRegister = 0;
+        std::vector<Loop> loops;
+        std::vector<Try> trys;
+        bool inTask = false;
+
+        int checkedRegister(int reg);
+
+    public:
+        // a node without a value returns this instead of a register
+        static constexpr int NO_VALUE = -1;
+
+        explicit BytecodeCompiler(BytecodeProgram& program) : program(program) {}
+
+        [[noreturn]] static void fail(const std::string& message) {
+            throw BytecodeError(message);
+        }
+
+        int emit(Opcode op, int a = 0, int b = 0, int c = 0);
+        int emitWide(Opcode op, int a, uint32_t wide);
+        int here() const { return static_cast<int>(task->code.size()); }
+        void patch(int jump, int target);
+        void patchHere(int jump) { patch(jump, here()); }
+
+        int temporary();
+        int mark() const { return nextRegister; }
+        void release(int mark) { nextRegister = mark; }
+        void endStatement() { nextRegister = localCount; }
+        bool isLocal(int reg) const { return reg >= 0 && reg < localCount; }
+
+        int local(const std::string& name) const;
+        int defineLocal(const std::string& name);
+        int hiddenLocal();
+        int global(const std::string& name) const;
+        int defineGlobal(const std::string& name);
+        bool compilingTask() const { return inTask; }
+
+        int constant(Slot value);
+        int loadInt(int64_t value);
+        int move(int target, int reg);
+        int convert(int reg, BabelType from, BabelType to);
+        int condition(int reg, BabelType type);
+        int truth(int target, int reg, BabelType type);
+        void print(int reg, BabelType type);
+
+        int taskIndex(const std::string& name) const;
+        const BytecodeTask& taskAt(int index) const { return *program.tasks[index]; }
+        void beginTask(const TaskHeaderAST& header);
+        void endTask();
+
+        void beginLoop() { loops.emplace_back(); }
+        void endLoop(int continueTarget, int breakTarget);
+        void loopControl(bool isBreak);
+
+        int errorKind(const std::string& name);
+        void beginTry(BaseAST* finally);
+        std::vector<std::pair<int, int>> tryRanges();
+        void endTry() { trys.pop_back(); }
+        size_t tryDepth() const { return trys.size(); }
+        bool leavesFinally(size_t depth) const;
+        int leave(size_t depth, Opcode op, int a = 0);
+        void handle(const std::vector<std::pair<int, int>>& ranges, int kind, int target, int reg);
+
+        std::unique_ptr<BytecodeTask> compileTopLevel(std::vector<std::unique_ptr<BaseAST>>& statements, const std::string& name, bool echo);
+};
+
+// Compiles the tasks among the top level statements into the program and returns the
+// code for the other statements, like codegenTopLevel. Returns nullptr after reporting
+// an error on stderr, nothing the input defined is remembered then.
+std::unique_ptr<BytecodeTask> compileBytecode(BytecodeProgram& program, std::vector<std::unique_ptr<BaseAST>>& statements,
+                                              const std::string& name, bool echo = false);
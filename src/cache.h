@@ -0,0 +1,433 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "lrparser.h"
+
+// Key of a cache entry: the hash of the source text and the hash of everything else
+// the output depends on, like the path, the grammar and the compiler flags. Both are
+// written into the entry again, so a file name that matches by accident is no hit.
+struct CacheKey {
+    uint64_t source = 0;
+    uint64_t context = 0;
+
+    CacheKey() = default;
+    CacheKey(std::string_view sourceText, std::string_view contextText)
+        : source(hashBytes(sourceText.data(), sourceText.size())), context(hashBytes(contextText.data(), contextText.size())) {}
+
+    std::string hex() const {
+        static const char digits[] = "0123456789abcdef";
+        std::string text(32, '0');
+        for (int i = 0; i < 16; i++) {
+            text[15 - i] = digits[(source >> (4 * i)) & 0xf];
+            text[31 - i] = digits[(context >> (4 * i)) & 0xf];
+        }
+        return text;
+    }
+};
+
+struct CacheEntryHeader {
+    static constexpr char MAGIC[8] = {'B', 'A', 'B', 'E', 'L', 'C', 'C', 'H'};
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t source;
+    uint64_t context;
+    uint64_t payloadSize;
+    uint64_t checksum;          // of the payload
+};
+
+// Content addressed store of build outputs, one file per entry under
+// <directory>/<first two hex digits of the key>/. Entries are written to a
+// temporary file and renamed into place, so readers, other processes included,
+// see a whole entry or none. A hit moves the entry's modification time to now
+// and evict() removes the least recently used entries until the directory is
+// under its size limit. Everything is best effort: an entry that can not be
+// read is a miss and one that can not be written is dropped, the build goes on.
+class BuildCache {
+    private:
+        std::filesystem::path directory;
+        uint64_t sizeLimit;
+
+        std::filesystem::path pathOf(const CacheKey& key, std::string_view kind) const {
+            const std::string hex = key.hex();
+            return directory / hex.substr(0, 2) / (hex.substr(2) + "." + std::string(kind));
+        }
+
+        // unique among the threads and, very likely, the processes writing at once
+        static std::string temporarySuffix() {
+            static std::atomic<uint64_t> counter{0};
+            const uint64_t now = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+            const uint64_t thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+            return ".tmp." + std::to_string(now ^ thread) + "." + std::to_string(counter++);
+        }
+
+    public:
+        static constexpr uint64_t DEFAULT_SIZE_LIMIT = 256ull << 20;
+
+        explicit BuildCache(std::filesystem::path directory, uint64_t sizeLimit = DEFAULT_SIZE_LIMIT)
+            : directory(std::move(directory)), sizeLimit(sizeLimit) {}
+
+        const std::filesystem::path& getDirectory() const {
+            return directory;
+        }
+
+        // the payload stored for key and kind, nothing when there is none or it is damaged
+        std::optional<std::string> load(const CacheKey& key, std::string_view kind) const {
+            const std::filesystem::path path = pathOf(key, kind);
+            std::ifstream in(path, std::ios::binary);
+            if (!in) return std::nullopt;
+
+            CacheEntryHeader header;
+            if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return std::nullopt;
+            if (std::memcmp(header.magic, CacheEntryHeader::MAGIC, sizeof(header.magic)) != 0 || header.version != CacheEntryHeader::VERSION
+                || header.source != key.source || header.context != key.context) {
+                return std::nullopt;
+            }
+
+            std::error_code error;
+            const uintmax_t fileSize = std::filesystem::file_size(path, error);
+            if (error || fileSize != sizeof(header) + header.payloadSize) return std::nullopt;
+
+            std::string payload(header.payloadSize, '\0');
+            if (!in.read(payload.data(), static_cast<std::streamsize>(payload.size()))) return std::nullopt;
+            if (hashBytes(payload.data(), payload.size()) != header.checksum) return std::nullopt;
+
+            std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+            return payload;
+        }
+
+        void store(const CacheKey& key, std::string_view kind, std::string_view payload) const {
+            const std::filesystem::path path = pathOf(key, kind);
+            std::error_code error;
+            std::filesystem::create_directories(path.parent_path(), error);
+            if (error) return;
+
+            CacheEntryHeader header{};
+            std::memcpy(header.magic, CacheEntryHeader::MAGIC, sizeof(header.magic));
+            header.version = CacheEntryHeader::VERSION;
+            header.source = key.source;
+            header.context = key.context;
+            header.payloadSize = payload.size();
+            header.checksum = hashBytes(payload.data(), payload.size());
+
+            std::filesystem::path temporary = path;
+            temporary += temporarySuffix();
+            {
+                std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+                out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+                if (!out) {
+                    out.close();
+                    std::filesystem::remove(temporary, error);
+                    return;
+                }
+            }
+            std::filesystem::rename(temporary, path, error);
+            if (error) std::filesystem::remove(temporary, error);
+        }
+
+        // Removes the least recently used entries until the rest fit in the size limit.
+        // Temporary files of writers that died are removed once they are an hour old.
+        void evict() const {
+            struct Entry {
+                std::filesystem::file_time_type used;
+                uintmax_t size;
+                std::filesystem::path path;
+            };
+
+            std::error_code error;
+            std::vector<Entry> entries;
+            uintmax_t total = 0;
+            const auto staleBefore = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+            for (auto it = std::filesystem::recursive_directory_iterator(directory, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+                // an entry that went away meanwhile is skipped, not the rest of the walk
+                std::error_code entryError;
+                if (!it->is_regular_file(entryError)) continue;
+                Entry entry{it->last_write_time(entryError), it->file_size(entryError), it->path()};
+                if (entryError) continue;
+                if (entry.path.filename().string().find(".tmp.") != std::string::npos) {
+                    if (entry.used < staleBefore) std::filesystem::remove(entry.path, entryError);
+                    continue;
+                }
+                total += entry.size;
+                entries.push_back(std::move(entry));
+            }
+            if (total <= sizeLimit) return;
+
+            std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+            for (const Entry& entry : entries) {
+                if (total <= sizeLimit) break;
+                if (std::filesystem::remove(entry.path, error)) total -= entry.size;
+            }
+        }
+};
+
+// hash of the lexer's token specs, a tree holds the terminals they produce
+inline uint64_t hashTokenSpecs(const std::list<std::pair<std::string, std::string>>& specs) {
+    std::string text;
+    for (const auto& [name, pattern] : specs) text += name + '\0' + pattern + '\0';
+    return hashBytes(text.data(), text.size());
+}
+
+// A parse as babelc caches it: what the parse wrote to its diagnostics, so a hit
+// reports the same syntax errors again, and the tree.
+struct CachedParse {
+    std::string diagnostics;
+    ParseTree tree;
+};
+
+namespace cache_detail {
+    inline void putVarint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    inline void putSigned(std::string& out, int64_t value) {
+        putVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    inline void putBytes(std::string& out, std::string_view bytes) {
+        putVarint(out, bytes.size());
+        out.append(bytes);
+    }
+
+    class Reader {
+        private:
+            std::string_view in;
+
+            [[noreturn]] static void truncated() {
+                throw std::runtime_error("truncated cache entry");
+            }
+
+        public:
+            explicit Reader(std::string_view in) : in(in) {}
+
+            uint64_t varint() {
+                uint64_t value = 0;
+                for (int shift = 0; shift < 64; shift += 7) {
+                    if (in.empty()) truncated();
+                    const uint8_t byte = static_cast<uint8_t>(in.front());
+                    in.remove_prefix(1);
+                    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                    if (byte < 0x80) return value;
+                }
+                truncated();
+            }
+
+            int64_t signedVarint() {
+                const uint64_t value = varint();
+                return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+            }
+
+            std::string_view bytes() {
+                const uint64_t size = varint();
+                if (size > in.size()) truncated();
+                std::string_view value = in.substr(0, size);
+                in.remove_prefix(size);
+                return value;
+            }
+    };
+}
+
+// Diagnostics start every message with the file's name as it was given. The cache keeps
+// them with a mark in its place, so a file has one entry whichever path names it, and
+// a hit reports the errors under the name given this time.
+inline constexpr char FILE_NAME_MARK = '\x1e';
+
+inline std::string unnamedDiagnostics(std::string_view diagnostics, std::string_view name) {
+    std::string out;
+    for (size_t line = 0; line < diagnostics.size();) {
+        const size_t end = std::min(diagnostics.find('\n', line), diagnostics.size() - 1) + 1;
+        std::string_view text = diagnostics.substr(line, end - line);
+        if (text.substr(0, name.size()) == name && text.substr(name.size(), 1) == ":") {
+            out.push_back(FILE_NAME_MARK);
+            text.remove_prefix(name.size());
+        }
+        out.append(text);
+        line = end;
+    }
+    return out;
+}
+
+inline std::string namedDiagnostics(std::string_view diagnostics, std::string_view name) {
+    std::string out;
+    for (size_t line = 0; line < diagnostics.size();) {
+        const size_t end = std::min(diagnostics.find('\n', line), diagnostics.size() - 1) + 1;
+        std::string_view text = diagnostics.substr(line, end - line);
+        if (text.front() == FILE_NAME_MARK) {
+            out.append(name);
+            text.remove_prefix(1);
+        }
+        out.append(text);
+        line = end;
+    }
+    return out;
+}
+
+// Only the verdict of a parse: whether it was accepted and its diagnostics. This is
+// all a build that does not print trees needs, and a fraction of the tree's size.
+inline std::string encodeVerdict(bool accepted, std::string_view diagnostics) {
+    std::string out;
+    cache_detail::putVarint(out, accepted ? 1 : 0);
+    cache_detail::putBytes(out, diagnostics);
+    return out;
+}
+
+inline std::optional<std::pair<bool, std::string>> decodeVerdict(std::string_view payload) {
+    try {
+        cache_detail::Reader in(payload);
+        const bool accepted = in.varint() != 0;
+        return std::make_pair(accepted, std::string(in.bytes()));
+    } catch (const std::runtime_error&) {
+        return std::nullopt;
+    }
+}
+
+// Nodes are written as varints relative to what comes before them. Children come
+// before their parent, so a reduction's children are written as the distance back
+// from it and its span as the difference to the one its children cover; a token's
+// offset is the distance from the end of the token before it. A node takes about
+// 5 bytes instead of 20.
+inline std::string encodeParse(const ParseTree& tree, std::string_view diagnostics) {
+    std::string out;
+    cache_detail::putBytes(out, diagnostics);
+    cache_detail::putVarint(out, tree.accepted ? 1 : 0);
+    cache_detail::putVarint(out, tree.root);
+    cache_detail::putBytes(out, tree.text);
+    cache_detail::putVarint(out, tree.nodes.size());
+    cache_detail::putVarint(out, tree.children.size());
+
+    int64_t tokenEnd = 0;
+    int64_t nextChild = 0;
+    for (size_t i = 0; i < tree.nodes.size(); i++) {
+        const TreeNode& node = tree.nodes[i];
+        cache_detail::putVarint(out, static_cast<uint32_t>(node.symbol));
+        cache_detail::putVarint(out, node.childCount);
+        if (node.childCount == 0) {
+            cache_detail::putSigned(out, static_cast<int64_t>(node.offset) - tokenEnd);
+            cache_detail::putVarint(out, node.length);
+            tokenEnd = static_cast<int64_t>(node.offset) + node.length;
+            continue;
+        }
+
+        cache_detail::putSigned(out, static_cast<int64_t>(node.firstChild) - nextChild);
+        nextChild = static_cast<int64_t>(node.firstChild) + node.childCount;
+        std::span<const uint32_t> children = tree.childrenOf(node);
+        for (uint32_t child : children) cache_detail::putSigned(out, static_cast<int64_t>(i) - child);
+
+        const TreeNode& first = tree.nodes[children.front()];
+        const TreeNode& last = tree.nodes[children.back()];
+        const int64_t coveredEnd = static_cast<int64_t>(last.offset) + last.length;
+        cache_detail::putSigned(out, static_cast<int64_t>(node.offset) - first.offset);
+        cache_detail::putSigned(out, static_cast<int64_t>(node.length) - (coveredEnd - node.offset));
+    }
+
+    cache_detail::putVarint(out, tree.errors.size());
+    for (const SyntaxDiagnostic& error : tree.errors) {
+        cache_detail::putVarint(out, static_cast<uint32_t>(error.line));
+        cache_detail::putVarint(out, static_cast<uint32_t>(error.column));
+        cache_detail::putVarint(out, static_cast<uint32_t>(error.state));
+        cache_detail::putSigned(out, error.found);
+        cache_detail::putSigned(out, error.inserted);
+    }
+    return out;
+}
+
+// the tree of an entry written by encodeParse, nothing when the entry does not fit parser's tables
+inline std::optional<CachedParse> decodeParse(std::string_view payload, const Parser& parser,
+                                              std::pmr::memory_resource* memory = std::pmr::get_default_resource()) {
+    try {
+        cache_detail::Reader in(payload);
+        const std::string_view diagnostics = in.bytes();
+        const bool accepted = in.varint() != 0;
+        const uint64_t root = in.varint();
+        const std::string_view text = in.bytes();
+        const uint64_t nodeCount = std::min<uint64_t>(in.varint(), payload.size());
+        const uint64_t childCount = std::min<uint64_t>(in.varint(), payload.size());
+
+        CachedParse parse{std::string(diagnostics), ParseTree(nodeCount, memory)};
+        ParseTree& tree = parse.tree;
+        tree.children.assign(childCount, 0);
+        const uint64_t symbolCount = static_cast<uint64_t>(parser.getTables().symbolCount());
+        int64_t tokenEnd = 0;
+        int64_t nextChild = 0;
+        for (uint64_t i = 0; i < nodeCount; i++) {
+            TreeNode node{};
+            const uint64_t symbol = in.varint();
+            const uint64_t count = in.varint();
+            if (symbol >= symbolCount || count > childCount) return std::nullopt;
+            node.symbol = static_cast<Symbol>(symbol);
+            node.childCount = static_cast<uint32_t>(count);
+
+            int64_t offset;
+            int64_t length;
+            if (count == 0) {
+                offset = tokenEnd + in.signedVarint();
+                length = static_cast<int64_t>(std::min<uint64_t>(in.varint(), text.size()));
+                tokenEnd = offset + length;
+            } else {
+                const int64_t firstChild = nextChild + in.signedVarint();
+                if (firstChild < 0 || static_cast<uint64_t>(firstChild) + count > childCount) return std::nullopt;
+                node.firstChild = static_cast<uint32_t>(firstChild);
+                nextChild = firstChild + static_cast<int64_t>(count);
+                for (uint64_t k = 0; k < count; k++) {
+                    const int64_t child = static_cast<int64_t>(i) - in.signedVarint();
+                    if (child < 0 || static_cast<uint64_t>(child) >= i) return std::nullopt;
+                    tree.children[firstChild + k] = static_cast<uint32_t>(child);
+                }
+
+                const TreeNode& first = tree.nodes[tree.children[firstChild]];
+                const TreeNode& last = tree.nodes[tree.children[firstChild + count - 1]];
+                offset = static_cast<int64_t>(first.offset) + in.signedVarint();
+                length = static_cast<int64_t>(last.offset) + last.length - offset + in.signedVarint();
+            }
+            if (offset < 0 || length < 0 || static_cast<uint64_t>(offset + length) > text.size()) return std::nullopt;
+            node.offset = static_cast<uint32_t>(offset);
+            node.length = static_cast<uint32_t>(length);
+            tree.nodes.push_back(node);
+        }
+        if (root >= nodeCount) return std::nullopt;
+
+        const uint64_t errorCount = std::min<uint64_t>(in.varint(), payload.size());
+        for (uint64_t i = 0; i < errorCount; i++) {
+            SyntaxDiagnostic error{};
+            error.line = static_cast<int>(in.varint());
+            error.column = static_cast<int>(in.varint());
+            error.state = static_cast<int>(in.varint());
+            error.found = static_cast<Symbol>(in.signedVarint());
+            error.inserted = static_cast<Symbol>(in.signedVarint());
+            tree.errors.push_back(error);
+        }
+
+        tree.root = static_cast<uint32_t>(root);
+        tree.accepted = accepted;
+        tree.tables = parser.getSharedTables();
+        auto storage = std::make_shared<const std::string>(text);
+        tree.text = *storage;
+        tree.storage = std::move(storage);
+        return parse;
+    } catch (const std::runtime_error&) {
+        return std::nullopt;
+    }
+}
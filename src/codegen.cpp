@@ -0,0 +1,551 @@
+#include "ast.h"
+
+#include <iostream>
+#include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/APInt.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Type.h"
+#include "llvm/IR/Verifier.h"
+
+using namespace llvm;
+
+std::unique_ptr<LLVMContext> TheContext;
+std::unique_ptr<Module> TheModule;
+static std::unique_ptr<IRBuilder<>> Builder;
+
+// variables of the task being generated, top level ones are globals
+static std::map<std::string, AllocaInst *> NamedValues;
+static bool InTask = false;
+
+// what earlier modules defined, declared again in the module that uses it
+static const ProgramTypes *Defined = nullptr;
+
+// targets of break and continue for the loops around the current statement
+static std::vector<std::pair<BasicBlock *, BasicBlock *>> LoopTargets;
+
+// whether tasks check their frame against babel.stack.limit, which the ones the
+// interpreter calls do
+static bool StackChecked = false;
+
+void initializeModule(const std::string &name) {
+    // a module that was not handed on still uses the old context
+    Builder.reset();
+    TheModule.reset();
+    TheContext = std::make_unique<LLVMContext>();
+    TheModule = std::make_unique<Module>(name, *TheContext);
+    Builder = std::make_unique<IRBuilder<>>(*TheContext);
+}
+
+Value *LogError(const char *str) {
+    std::cerr << str << '\n';
+    return nullptr;
+}
+
+static Type *llvmType(BabelType type) {
+    switch (type) {
+        case BabelType::Int: return Type::getInt64Ty(*TheContext);
+        case BabelType::Bool: return Type::getInt1Ty(*TheContext);
+        case BabelType::Char: return Type::getInt8Ty(*TheContext);
+        case BabelType::Void: return Type::getVoidTy(*TheContext);
+        default: return Type::getDoubleTy(*TheContext);
+    }
+}
+
+// the checker only lets an int stand for a float
+static Value *convert(Value *V, BabelType from, BabelType to) {
+    if (from == BabelType::Int && to == BabelType::Float) return Builder->CreateSIToFP(V, llvmType(to), "floattmp");
+    return V;
+}
+
+// statements have no value, this stands for their success
+static Value *noValue() {
+    return ConstantInt::getFalse(*TheContext);
+}
+
+// tasks and globals are prefixed, so they do not clash with the symbols of the C library
+// and a task main is not the entry point of an executable
+static std::string symbolName(const std::string &Name) {
+    return "babel." + Name;
+}
+
+static Function *getFunction(const std::string &Name) {
+    if (Function *F = TheModule->getFunction(symbolName(Name))) return F;
+
+    auto FI = Defined->tasks.find(Name);
+    if (FI == Defined->tasks.end()) return nullptr;
+    std::vector<llvm::Type *> Params;
+    for (BabelType ArgType : FI->second.args) Params.push_back(llvmType(ArgType));
+    FunctionType *FT = FunctionType::get(llvmType(FI->second.result), Params, false);
+    return Function::Create(FT, Function::ExternalLinkage, symbolName(Name), TheModule.get());
+}
+
+static GlobalVariable *getGlobal(const std::string &Name, BabelType type) {
+    if (GlobalVariable *G = TheModule->getGlobalVariable(symbolName(Name))) return G;
+    if (!Defined->globals.count(Name)) return nullptr;
+    return new GlobalVariable(*TheModule, llvmType(type), false, GlobalValue::ExternalLinkage, nullptr, symbolName(Name));
+}
+
+// where a variable lives, nullptr when it was never assigned
+static Value *getSlot(const std::string &Name, BabelType type) {
+    auto VI = NamedValues.find(Name);
+    if (VI != NamedValues.end()) return VI->second;
+    return getGlobal(Name, type);
+}
+
+static AllocaInst *createEntryBlockAlloca(Function *TheFunction, const std::string &Name, BabelType type) {
+    IRBuilder<> TmpB(&TheFunction->getEntryBlock(), TheFunction->getEntryBlock().begin());
+    return TmpB.CreateAlloca(llvmType(type), nullptr, Name);
+}
+
+// a value is true when it is not zero
+static Value *toCondition(Value *V, BabelType type) {
+    if (type == BabelType::Bool) return V;
+    if (type == BabelType::Float) return Builder->CreateFCmpONE(V, ConstantFP::get(*TheContext, APFloat(0.0)), "cond");
+    return Builder->CreateICmpNE(V, Constant::getNullValue(V->getType()), "cond");
+}
+
+// code after a return, break or continue is unreachable but still needs a block
+static void startUnreachableBlock(const char *name) {
+    Function *TheFunction = Builder->GetInsertBlock()->getParent();
+    Builder->SetInsertPoint(BasicBlock::Create(*TheContext, name, TheFunction));
+}
+
+Value *FloatingPointAST::codegen() {
+    return ConstantFP::get(*TheContext, APFloat(Val));
+}
+
+Value *IntegerAST::codegen() {
+    return ConstantInt::get(*TheContext, APInt(64, Val, true));
+}
+
+Value *BoolAST::codegen() {
+    return ConstantInt::getBool(*TheContext, Val);
+}
+
+Value *CharAST::codegen() {
+    return ConstantInt::get(*TheContext, APInt(8, Val, true));
+}
+
+Value *VariableAST::codegen() {
+    Value *Slot = getSlot(Name, Type);
+    if (!Slot) return LogError(("Unknown variable " + Name).c_str());
+    return Builder->CreateLoad(llvmType(Type), Slot, Name);
+}
+
+Value *UnaryOperatorAST::codegen() {
+    if (Op == "++" || Op == "--") {
+        auto *Var = static_cast<VariableAST *>(Operand.get());
+        Value *Slot = getSlot(Var->getName(), Type);
+        if (!Slot) return LogError(("Unknown variable " + Var->getName()).c_str());
+
+        Value *Old = Builder->CreateLoad(llvmType(Type), Slot, Var->getName());
+        Value *New;
+        if (Type == BabelType::Float) {
+            Value *One = ConstantFP::get(*TheContext, APFloat(1.0));
+            New = Op == "++" ? Builder->CreateFAdd(Old, One, "inctmp") : Builder->CreateFSub(Old, One, "dectmp");
+        } else {
+            New = Op == "++" ? Builder->CreateAdd(Old, Builder->getInt64(1), "inctmp") : Builder->CreateSub(Old, Builder->getInt64(1), "dectmp");
+        }
+        Builder->CreateStore(New, Slot);
+        return Old;
+    }
+
+    Value *V = Operand->codegen();
+    if (!V) return nullptr;
+
+    if (Op == "+") return V;
+    if (Op == "-") return Type == BabelType::Float ? Builder->CreateFNeg(V, "negtmp") : Builder->CreateNeg(V, "negtmp");
+    if (Op == "!") return Builder->CreateNot(toCondition(V, Operand->getType()), "nottmp");
+    return LogError("Invalid unary operator");
+}
+
+// // and % on ints round towards negative infinity, as they do on floats. A zero divisor
+// calls babel.error.division, which does not return; -1 negates, as the division would
+// overflow for the smallest int.
+static Value *floorDivision(Value *left, Value *right, bool modulo) {
+    Value *zero = Builder->getInt64(0);
+    Function *TheFunction = Builder->GetInsertBlock()->getParent();
+    BasicBlock *ZeroBB = BasicBlock::Create(*TheContext, "divzero", TheFunction);
+    BasicBlock *DivideBB = BasicBlock::Create(*TheContext, "divide", TheFunction);
+    Builder->CreateCondBr(Builder->CreateICmpEQ(right, zero), ZeroBB, DivideBB);
+
+    Builder->SetInsertPoint(ZeroBB);
+    FunctionCallee Error = TheModule->getOrInsertFunction("babel.error.division", Type::getVoidTy(*TheContext));
+    Builder->CreateCall(Error)->setDoesNotReturn();
+    Builder->CreateUnreachable();
+
+    Builder->SetInsertPoint(DivideBB);
+    Value *negate = Builder->CreateICmpEQ(right, Builder->getInt64(-1), "negate");
+    Value *divisor = Builder->CreateSelect(negate, Builder->getInt64(1), right, "divisor");
+    Value *quotient = Builder->CreateSDiv(left, divisor, "divtmp");
+    quotient = Builder->CreateSelect(negate, Builder->CreateSub(zero, left, "negtmp"), quotient);
+    Value *remainder = Builder->CreateSRem(left, divisor, "remtmp");
+    Value *adjust = Builder->CreateAnd(Builder->CreateICmpNE(remainder, zero), Builder->CreateICmpSLT(Builder->CreateXor(remainder, right), zero), "adjust");
+    if (modulo) return Builder->CreateSelect(adjust, Builder->CreateAdd(remainder, right), remainder, "modtmp");
+    return Builder->CreateSub(quotient, Builder->CreateZExt(adjust, quotient->getType()), "idivtmp");
+}
+
+Value *BinaryOperatorAST::codegen() {
+    // & and | only evaluate the right side when the left one does not decide
+    if (Op == "&" || Op == "|") {
+        Value *left = LHS->codegen();
+        if (!left) return nullptr;
+        left = toCondition(left, LHS->getType());
+
+        Function *TheFunction = Builder->GetInsertBlock()->getParent();
+        BasicBlock *LeftBB = Builder->GetInsertBlock();
+        BasicBlock *RightBB = BasicBlock::Create(*TheContext, "rhs", TheFunction);
+        BasicBlock *MergeBB = BasicBlock::Create(*TheContext, "logiccont", TheFunction);
+        if (Op == "&") Builder->CreateCondBr(left, RightBB, MergeBB);
+        else Builder->CreateCondBr(left, MergeBB, RightBB);
+
+        Builder->SetInsertPoint(RightBB);
+        Value *right = RHS->codegen();
+        if (!right) return nullptr;
+        right = toCondition(right, RHS->getType());
+        RightBB = Builder->GetInsertBlock();
+        Builder->CreateBr(MergeBB);
+
+        Builder->SetInsertPoint(MergeBB);
+        PHINode *PN = Builder->CreatePHI(llvm::Type::getInt1Ty(*TheContext), 2, "logictmp");
+        PN->addIncoming(left, LeftBB);
+        PN->addIncoming(right, RightBB);
+        return PN;
+    }
+
+    Value *left = LHS->codegen();
+    Value *right = RHS->codegen();
+    if (!left || !right) return nullptr;
+    left = convert(left, LHS->getType(), OperandType);
+    right = convert(right, RHS->getType(), OperandType);
+
+    if (OperandType == BabelType::Float) {
+        if (Op == "+") return Builder->CreateFAdd(left, right, "addtmp");
+        if (Op == "-") return Builder->CreateFSub(left, right, "subtmp");
+        if (Op == "*") return Builder->CreateFMul(left, right, "multmp");
+        if (Op == "/") return Builder->CreateFDiv(left, right, "divtmp");
+        if (Op == "%") return Builder->CreateFRem(left, right, "modtmp");
+        if (Op == "//") return Builder->CreateUnaryIntrinsic(Intrinsic::floor, Builder->CreateFDiv(left, right, "divtmp"), nullptr, "idivtmp");
+        if (Op == "^") return Builder->CreateBinaryIntrinsic(Intrinsic::pow, left, right, nullptr, "powtmp");
+        if (Op == "==") return Builder->CreateFCmpOEQ(left, right, "cmptmp");
+        if (Op == "!=") return Builder->CreateFCmpUNE(left, right, "cmptmp");
+        if (Op == "<") return Builder->CreateFCmpOLT(left, right, "cmptmp");
+        if (Op == "<=") return Builder->CreateFCmpOLE(left, right, "cmptmp");
+        if (Op == ">") return Builder->CreateFCmpOGT(left, right, "cmptmp");
+        if (Op == ">=") return Builder->CreateFCmpOGE(left, right, "cmptmp");
+        return LogError("Invalid binary operator");
+    }
+
+    if (Op == "+") return Builder->CreateAdd(left, right, "addtmp");
+    if (Op == "-") return Builder->CreateSub(left, right, "subtmp");
+    if (Op == "*") return Builder->CreateMul(left, right, "multmp");
+    if (Op == "%") return floorDivision(left, right, true);
+    if (Op == "//") return floorDivision(left, right, false);
+    if (Op == "==") return Builder->CreateICmpEQ(left, right, "cmptmp");
+    if (Op == "!=") return Builder->CreateICmpNE(left, right, "cmptmp");
+    if (Op == "<") return Builder->CreateICmpSLT(left, right, "cmptmp");
+    if (Op == "<=") return Builder->CreateICmpSLE(left, right, "cmptmp");
+    if (Op == ">") return Builder->CreateICmpSGT(left, right, "cmptmp");
+    if (Op == ">=") return Builder->CreateICmpSGE(left, right, "cmptmp");
+    if (Op == "bit_or") return Builder->CreateOr(left, right, "ortmp");
+    if (Op == "bit_xor") return Builder->CreateXor(left, right, "xortmp");
+    if (Op == "bit_and") return Builder->CreateAnd(left, right, "andtmp");
+    // shifts take the count modulo 64, a larger one would be poison
+    if (Op == "<<") return Builder->CreateShl(left, Builder->CreateAnd(right, 63), "shltmp");
+    if (Op == ">>") return Builder->CreateAShr(left, Builder->CreateAnd(right, 63), "shrtmp");
+
+    // int ^ int calls babel.pow.int, which wraps around like the multiplications do
+    if (Op == "^") {
+        FunctionCallee Power = TheModule->getOrInsertFunction("babel.pow.int", left->getType(), left->getType(), right->getType());
+        if (auto *F = dyn_cast<Function>(Power.getCallee())) {
+            F->setDoesNotAccessMemory();
+            F->setDoesNotThrow();
+        }
+        return Builder->CreateCall(Power, {left, right}, "powtmp");
+    }
+    return LogError("Invalid binary operator");
+}
+
+// print(x) calls babel.print.int, .float, .bool or .char, a bool is passed as a byte
+static Value *codegenPrint(Value *V, BabelType type) {
+    Type *ParamTy = type == BabelType::Bool ? Type::getInt8Ty(*TheContext) : llvmType(type);
+    FunctionCallee Print = TheModule->getOrInsertFunction(std::string("babel.print.") + typeName(type), Type::getVoidTy(*TheContext), ParamTy);
+    Builder->CreateCall(Print, {type == BabelType::Bool ? Builder->CreateZExt(V, ParamTy) : V});
+    return V;
+}
+
+Value *TaskCallAST::codegen() {
+    std::vector<Value *> ArgsV;
+    for (unsigned int i = 0, e = Args.size(); i != e; ++i) {
+        Value *V = Args[i]->codegen();
+        if (!V) return nullptr;
+        ArgsV.push_back(convert(V, Args[i]->getType(), ParamTypes[i]));
+    }
+
+    if (callsTo == "print") return codegenPrint(ArgsV[0], ParamTypes[0]);
+
+    Function *CalleF = getFunction(callsTo);
+    if (!CalleF) return LogError(("Unknown Task referenced " + callsTo).c_str());
+
+    if (CalleF->arg_size() != Args.size()) return LogError("Passed incorect number of arguments");
+
+    if (Type == BabelType::Void) {
+        Builder->CreateCall(CalleF, ArgsV);
+        return noValue();
+    }
+    return Builder->CreateCall(CalleF, ArgsV, "calltmp");
+}
+
+Value *AssignmentAST::codegen() {
+    Value *V = Val->codegen();
+    if (!V) return nullptr;
+    V = convert(V, Val->getType(), Type);
+
+    Value *Slot = getSlot(Name, Type);
+    if (!Slot) {
+        // a new name is a global at the top level and a local in a task
+        if (!InTask) {
+            Slot = new GlobalVariable(*TheModule, llvmType(Type), false, GlobalValue::ExternalLinkage, Constant::getNullValue(llvmType(Type)), symbolName(Name));
+        } else {
+            Slot = NamedValues[Name] = createEntryBlockAlloca(Builder->GetInsertBlock()->getParent(), Name, Type);
+        }
+    }
+
+    Builder->CreateStore(V, Slot);
+    return V;
+}
+
+Value *BlockAST::codegen() {
+    Value *Last = noValue();
+    for (auto &Statement : Statements) {
+        Last = Statement->codegen();
+        if (!Last) return nullptr;
+    }
+    return Last;
+}
+
+Value *IfAST::codegen() {
+    Value *CondV = Cond->codegen();
+    if (!CondV) return nullptr;
+
+    Function *TheFunction = Builder->GetInsertBlock()->getParent();
+    BasicBlock *ThenBB = BasicBlock::Create(*TheContext, "then", TheFunction);
+    BasicBlock *ElseBB = BasicBlock::Create(*TheContext, "else", TheFunction);
+    BasicBlock *MergeBB = BasicBlock::Create(*TheContext, "ifcont", TheFunction);
+    Builder->CreateCondBr(toCondition(CondV, Cond->getType()), ThenBB, ElseBB);
+
+    Builder->SetInsertPoint(ThenBB);
+    if (!Then->codegen()) return nullptr;
+    Builder->CreateBr(MergeBB);
+
+    Builder->SetInsertPoint(ElseBB);
+    if (Else && !Else->codegen()) return nullptr;
+    Builder->CreateBr(MergeBB);
+
+    Builder->SetInsertPoint(MergeBB);
+    return noValue();
+}
+
+Value *WhileAST::codegen() {
+    Function *TheFunction = Builder->GetInsertBlock()->getParent();
+    BasicBlock *CondBB = BasicBlock::Create(*TheContext, "loopcond", TheFunction);
+    BasicBlock *BodyBB = BasicBlock::Create(*TheContext, "loop", TheFunction);
+    BasicBlock *StepBB = BasicBlock::Create(*TheContext, "loopstep", TheFunction);
+    BasicBlock *AfterBB = BasicBlock::Create(*TheContext, "afterloop", TheFunction);
+
+    Builder->CreateBr(CondBB);
+    Builder->SetInsertPoint(CondBB);
+    Value *CondV = Cond->codegen();
+    if (!CondV) return nullptr;
+    Builder->CreateCondBr(toCondition(CondV, Cond->getType()), BodyBB, AfterBB);
+
+    Builder->SetInsertPoint(BodyBB);
+    LoopTargets.emplace_back(AfterBB, StepBB);
+    Value *BodyV = Body->codegen();
+    LoopTargets.pop_back();
+    if (!BodyV) return nullptr;
+    Builder->CreateBr(StepBB);
+
+    Builder->SetInsertPoint(StepBB);
+    if (Step && !Step->codegen()) return nullptr;
+    Builder->CreateBr(CondBB);
+
+    Builder->SetInsertPoint(AfterBB);
+    return noValue();
+}
+
+Value *LoopControlAST::codegen() {
+    if (LoopTargets.empty()) return LogError(IsBreak ? "break outside of a loop" : "continue outside of a loop");
+    Builder->CreateBr(IsBreak ? LoopTargets.back().first : LoopTargets.back().second);
+    startUnreachableBlock(IsBreak ? "afterbreak" : "aftercontinue");
+    return noValue();
+}
+
+Value *RaiseAST::codegen() {
+    return LogError("raise is only supported by the interpreter yet");
+}
+
+Value *TryAST::codegen() {
+    return LogError("try is only supported by the interpreter yet");
+}
+
+Value *ReturnAST::codegen() {
+    if (!Val) {
+        Builder->CreateRetVoid();
+    } else {
+        Value *V = Val->codegen();
+        if (!V) return nullptr;
+        Builder->CreateRet(convert(V, Val->getType(), Type));
+    }
+    startUnreachableBlock("afterreturn");
+    return noValue();
+}
+
+Function *TaskHeaderAST::codegen() {
+    std::vector<llvm::Type*> Params;
+    for (BabelType ArgType : ArgTypes) Params.push_back(llvmType(ArgType));
+    FunctionType *FT = FunctionType::get(llvmType(ReturnType), Params, false);
+    Function *F = Function::Create(FT, Function::ExternalLinkage, symbolName(Name), TheModule.get());
+
+    unsigned int idx = 0;
+    for (auto &Arg : F->args()) {
+        Arg.setName(Args[idx++]);
+    }
+
+    return F;
+}
+
+// ends the block codegen stopped in, it may be one after a return or an empty merge block;
+// falling off the end of a task with a result returns zero
+static void finishFunction(Function *TheFunction) {
+    if (Builder->GetInsertBlock()->getTerminator()) return;
+    llvm::Type *ReturnTy = TheFunction->getReturnType();
+    if (ReturnTy->isVoidTy()) Builder->CreateRetVoid();
+    else Builder->CreateRet(Constant::getNullValue(ReturnTy));
+}
+
+// A frame below babel.stack.limit calls babel.error.overflow, which does not return, so
+// deep recursion raises a RuntimeError instead of running off the machine stack.
+static void codegenStackCheck(Function *TheFunction) {
+    llvm::Type *AddressTy = Builder->getInt64Ty();
+    Value *Frame = Builder->CreateIntrinsic(Intrinsic::frameaddress, {Builder->getInt8PtrTy()}, {Builder->getInt32(0)});
+    Value *Limit = Builder->CreateLoad(AddressTy, TheModule->getOrInsertGlobal("babel.stack.limit", AddressTy), "limit");
+    BasicBlock *OverflowBB = BasicBlock::Create(*TheContext, "overflow", TheFunction);
+    BasicBlock *BodyBB = BasicBlock::Create(*TheContext, "body", TheFunction);
+    Builder->CreateCondBr(Builder->CreateICmpULT(Builder->CreatePtrToInt(Frame, AddressTy), Limit), OverflowBB, BodyBB);
+
+    Builder->SetInsertPoint(OverflowBB);
+    FunctionCallee Error = TheModule->getOrInsertFunction("babel.error.overflow", Type::getVoidTy(*TheContext));
+    Builder->CreateCall(Error)->setDoesNotReturn();
+    Builder->CreateUnreachable();
+
+    Builder->SetInsertPoint(BodyBB);
+}
+
+Function *TaskAST::codegen() {
+    if (Defined->tasks.count(Header->getName()) || TheModule->getFunction(symbolName(Header->getName()))) {
+        return (Function*)LogError("Task cannot be redefined");
+    }
+
+    // created first, so the body can call the task itself
+    Function *TheFunction = Header->codegen();
+
+    BasicBlock *BB = BasicBlock::Create(*TheContext, "entry", TheFunction);
+    Builder->SetInsertPoint(BB);
+
+    NamedValues.clear();
+    unsigned int idx = 0;
+    for (auto &Arg : TheFunction->args()) {
+        AllocaInst *Alloca = createEntryBlockAlloca(TheFunction, std::string(Arg.getName()), Header->getArgTypes()[idx++]);
+        Builder->CreateStore(&Arg, Alloca);
+        NamedValues[std::string(Arg.getName())] = Alloca;
+    }
+    if (StackChecked) codegenStackCheck(TheFunction);
+
+    InTask = true;
+    Value *BodyV = Body->codegen();
+    InTask = false;
+    NamedValues.clear();
+    if (BodyV) {
+        finishFunction(TheFunction);
+        if (!verifyFunction(*TheFunction, &errs())) return TheFunction;
+    }
+
+    TheFunction->eraseFromParent();
+    return nullptr;
+}
+
+Function *codegenTopLevel(std::vector<std::unique_ptr<BaseAST>> &statements, const ProgramTypes &defined, const std::string &name, bool echo) {
+    Defined = &defined;
+
+    FunctionType *FT = FunctionType::get(llvm::Type::getVoidTy(*TheContext), {}, false);
+    Function *TheFunction = Function::Create(FT, Function::ExternalLinkage, name, TheModule.get());
+    Builder->SetInsertPoint(BasicBlock::Create(*TheContext, "entry", TheFunction));
+
+    Value *Last = nullptr;
+    for (auto &statement : statements) {
+        // a task is generated where it is defined, so it sees the globals assigned before it
+        if (dynamic_cast<TaskAST *>(statement.get())) {
+            BasicBlock *Resume = Builder->GetInsertBlock();
+            if (!statement->codegen()) return nullptr;
+            Builder->SetInsertPoint(Resume);
+            continue;
+        }
+        Last = statement->codegen();
+        if (!Last) return nullptr;
+    }
+
+    // a call on its own shows its value, like in other REPLs
+    auto *call = statements.empty() ? nullptr : dynamic_cast<TaskCallAST *>(statements.back().get());
+    if (echo && call && call->getCallee() != "print" && call->getType() != BabelType::Void) codegenPrint(Last, call->getType());
+    finishFunction(TheFunction);
+
+    if (verifyFunction(*TheFunction, &errs())) return nullptr;
+    return TheFunction;
+}
+
+// babel.entry.<name>, which reads the arguments of Task from slots and writes its result to the first
+static Function *codegenEntry(Function *Task, const TaskHeaderAST &Header) {
+    llvm::Type *SlotTy = Builder->getInt64Ty();
+    FunctionType *FT = FunctionType::get(Builder->getVoidTy(), {PointerType::getUnqual(SlotTy)}, false);
+    Function *Entry = Function::Create(FT, Function::ExternalLinkage, "babel.entry." + Header.getName(), TheModule.get());
+    Builder->SetInsertPoint(BasicBlock::Create(*TheContext, "entry", Entry));
+
+    Value *Slots = Entry->getArg(0);
+    std::vector<Value *> ArgsV;
+    for (size_t i = 0; i < Header.getArgTypes().size(); i++) {
+        llvm::Type *ArgTy = llvmType(Header.getArgTypes()[i]);
+        Value *Slot = Builder->CreateConstGEP1_64(SlotTy, Slots, i);
+        if (ArgTy->isDoubleTy()) ArgsV.push_back(Builder->CreateLoad(ArgTy, Builder->CreateBitCast(Slot, PointerType::getUnqual(ArgTy))));
+        else ArgsV.push_back(Builder->CreateTrunc(Builder->CreateLoad(SlotTy, Slot), ArgTy));
+    }
+
+    Value *Result = Builder->CreateCall(Task, ArgsV);
+    switch (Header.getReturnType()) {
+        case BabelType::Void: break;
+        case BabelType::Float: Builder->CreateStore(Result, Builder->CreateBitCast(Slots, PointerType::getUnqual(Result->getType()))); break;
+        case BabelType::Bool: Builder->CreateStore(Builder->CreateZExt(Result, SlotTy), Slots); break;
+        default: Builder->CreateStore(Builder->CreateSExt(Result, SlotTy), Slots);
+    }
+    Builder->CreateRetVoid();
+    return Entry;
+}
+
+std::vector<Function *> codegenEntries(const std::vector<TaskAST *> &tasks, const ProgramTypes &defined) {
+    Defined = &defined;
+
+    std::vector<Function *> entries;
+    for (TaskAST *task : tasks) {
+        StackChecked = true;
+        Function *F = task->codegen();
+        StackChecked = false;
+        if (!F) return {};
+        entries.push_back(codegenEntry(F, task->getHeader()));
+        if (verifyFunction(*entries.back(), &errs())) return {};
+    }
+    return entries;
+}
@@ -0,0 +1,249 @@
+#include "compile.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+
+using namespace llvm;
+
+static OptimizationLevel toOptimizationLevel(int optLevel) {
+    switch (optLevel) {
+        case 0: return OptimizationLevel::O0;
+        case 1: return OptimizationLevel::O1;
+        case 2: return OptimizationLevel::O2;
+        default: return OptimizationLevel::O3;
+    }
+}
+
+void optimizeModule(Module &module, int optLevel, TargetMachine *target, bool lto) {
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+
+    PassBuilder PB(target);
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    const OptimizationLevel level = toOptimizationLevel(optLevel);
+    ModulePassManager MPM;
+    if (level == OptimizationLevel::O0) MPM = PB.buildO0DefaultPipeline(level, lto);
+    else if (lto) MPM = PB.buildLTOPreLinkDefaultPipeline(level);
+    else MPM = PB.buildPerModuleDefaultPipeline(level);
+    MPM.run(module, MAM);
+}
+
+// the CPU and features to generate code for, native is the host's
+static std::pair<std::string, std::string> resolveCpu(const CompileOptions &options) {
+    if (options.cpu != "native") return {options.cpu, ""};
+
+    std::string features;
+    StringMap<bool> hostFeatures;
+    if (sys::getHostCPUFeatures(hostFeatures)) {
+        // sorted, so cache keys do not depend on StringMap's hash order
+        std::vector<std::string> sorted;
+        for (auto &feature : hostFeatures) sorted.push_back(std::string(feature.second ? "+" : "-") + std::string(feature.first()));
+        std::sort(sorted.begin(), sorted.end());
+        for (const std::string &feature : sorted) features += (features.empty() ? "" : ",") + feature;
+    }
+    return {std::string(sys::getHostCPUName()), features};
+}
+
+std::string describeOptions(const CompileOptions &options) {
+    const auto [cpu, features] = resolveCpu(options);
+    return sys::getDefaultTargetTriple() + " " + cpu + " " + features + " -O" + std::to_string(options.optLevel)
+         + (options.lto ? " -flto" : "") + " output=" + std::to_string(options.output);
+}
+
+static std::unique_ptr<TargetMachine> createTargetMachine(const CompileOptions &options) {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    const std::string triple = sys::getDefaultTargetTriple();
+    std::string error;
+    const Target *target = TargetRegistry::lookupTarget(triple, error);
+    if (!target) throw std::runtime_error(error);
+
+    const auto [cpu, features] = resolveCpu(options);
+
+    const CodeGenOpt::Level codeGenLevel = options.optLevel <= 0 ? CodeGenOpt::None
+                                         : options.optLevel == 1 ? CodeGenOpt::Less
+                                         : options.optLevel == 2 ? CodeGenOpt::Default
+                                         : CodeGenOpt::Aggressive;
+    return std::unique_ptr<TargetMachine>(target->createTargetMachine(triple, cpu, features, TargetOptions(), Reloc::PIC_, None, codeGenLevel));
+}
+
+// the print runtime the JIT links against, written with printf for the types the program prints
+static void definePrints(Module &module) {
+    LLVMContext &context = module.getContext();
+    FunctionCallee printf = module.getOrInsertFunction("printf", FunctionType::get(Type::getInt32Ty(context), {Type::getInt8PtrTy(context)}, true));
+    for (BabelType type : {BabelType::Int, BabelType::Float, BabelType::Bool, BabelType::Char}) {
+        Function *print = module.getFunction(std::string("babel.print.") + typeName(type));
+        if (!print || !print->empty()) continue;
+        print->setLinkage(Function::InternalLinkage);
+
+        IRBuilder<> builder(BasicBlock::Create(context, "entry", print));
+        Value *x = print->getArg(0);
+        if (type == BabelType::Int) {
+            builder.CreateCall(printf, {builder.CreateGlobalStringPtr("%lld\n", "print.int.format"), x});
+        } else if (type == BabelType::Float) {
+            builder.CreateCall(printf, {builder.CreateGlobalStringPtr("%g\n", "print.float.format"), x});
+        } else if (type == BabelType::Bool) {
+            Value *text = builder.CreateSelect(builder.CreateICmpNE(x, builder.getInt8(0)), builder.CreateGlobalStringPtr("TRUE", "print.true"), builder.CreateGlobalStringPtr("FALSE", "print.false"));
+            builder.CreateCall(printf, {builder.CreateGlobalStringPtr("%s\n", "print.bool.format"), text});
+        } else {
+            builder.CreateCall(printf, {builder.CreateGlobalStringPtr("%c\n", "print.char.format"), builder.CreateSExt(x, builder.getInt32Ty())});
+        }
+        builder.CreateRetVoid();
+    }
+}
+
+// int ^ int by squaring like babelPowInt, which the JIT links against
+static void definePower(Module &module) {
+    Function *power = module.getFunction("babel.pow.int");
+    if (!power || !power->empty()) return;
+    power->setLinkage(Function::InternalLinkage);
+
+    LLVMContext &context = module.getContext();
+    BasicBlock *entry = BasicBlock::Create(context, "entry", power);
+    BasicBlock *negative = BasicBlock::Create(context, "negative", power);
+    BasicBlock *loop = BasicBlock::Create(context, "loop", power);
+    BasicBlock *step = BasicBlock::Create(context, "step", power);
+    BasicBlock *done = BasicBlock::Create(context, "done", power);
+    IRBuilder<> builder(entry);
+    Value *base = power->getArg(0);
+    Value *exponent = power->getArg(1);
+    builder.CreateCondBr(builder.CreateICmpSLT(exponent, builder.getInt64(0)), negative, loop);
+
+    // the result truncated towards zero, only 1 and -1 keep a magnitude
+    builder.SetInsertPoint(negative);
+    Value *odd = builder.CreateTrunc(exponent, builder.getInt1Ty());
+    Value *minusOne = builder.CreateSelect(odd, builder.getInt64(-1), builder.getInt64(1));
+    Value *small = builder.CreateSelect(builder.CreateICmpEQ(base, builder.getInt64(-1)), minusOne, builder.getInt64(0));
+    builder.CreateRet(builder.CreateSelect(builder.CreateICmpEQ(base, builder.getInt64(1)), builder.getInt64(1), small));
+
+    builder.SetInsertPoint(loop);
+    PHINode *result = builder.CreatePHI(builder.getInt64Ty(), 2, "result");
+    PHINode *factor = builder.CreatePHI(builder.getInt64Ty(), 2, "factor");
+    PHINode *rest = builder.CreatePHI(builder.getInt64Ty(), 2, "rest");
+    builder.CreateCondBr(builder.CreateICmpEQ(rest, builder.getInt64(0)), done, step);
+
+    builder.SetInsertPoint(step);
+    Value *bit = builder.CreateTrunc(rest, builder.getInt1Ty());
+    Value *next = builder.CreateSelect(bit, builder.CreateMul(result, factor), result);
+    result->addIncoming(builder.getInt64(1), entry);
+    result->addIncoming(next, step);
+    factor->addIncoming(base, entry);
+    factor->addIncoming(builder.CreateMul(factor, factor), step);
+    rest->addIncoming(exponent, entry);
+    rest->addIncoming(builder.CreateLShr(rest, 1), step);
+    builder.CreateBr(loop);
+
+    builder.SetInsertPoint(done);
+    builder.CreateRet(result);
+}
+
+// a division by zero reports the RuntimeError like babel --run does, after what the program printed, and exits with 1
+static void defineErrors(Module &module) {
+    Function *division = module.getFunction("babel.error.division");
+    if (!division || !division->empty()) return;
+    division->setLinkage(Function::InternalLinkage);
+
+    LLVMContext &context = module.getContext();
+    Type *pointer = Type::getInt8PtrTy(context);
+    FunctionCallee fflush = module.getOrInsertFunction("fflush", FunctionType::get(Type::getInt32Ty(context), {pointer}, false));
+    FunctionCallee write = module.getOrInsertFunction("write", FunctionType::get(Type::getInt64Ty(context), {Type::getInt32Ty(context), pointer, Type::getInt64Ty(context)}, false));
+    FunctionCallee exit = module.getOrInsertFunction("exit", FunctionType::get(Type::getVoidTy(context), {Type::getInt32Ty(context)}, false));
+
+    IRBuilder<> builder(BasicBlock::Create(context, "entry", division));
+    const std::string message = "RuntimeError: integer division by zero\n";
+    builder.CreateCall(fflush, {Constant::getNullValue(pointer)});
+    builder.CreateCall(write, {builder.getInt32(2), builder.CreateGlobalStringPtr(message, "error.division"), builder.getInt64(message.size())});
+    builder.CreateCall(exit, {builder.getInt32(1)});
+    builder.CreateUnreachable();
+}
+
+// int main() runs the top level statements and returns 0
+static void defineMain(Module &module, Function *program) {
+    LLVMContext &context = module.getContext();
+    Function *main = Function::Create(FunctionType::get(Type::getInt32Ty(context), false), Function::ExternalLinkage, "main", module);
+    IRBuilder<> builder(BasicBlock::Create(context, "entry", main));
+    builder.CreateCall(program);
+    builder.CreateRet(builder.getInt32(0));
+}
+
+static void emit(Module &module, TargetMachine &target, CodeGenFileType fileType, const std::string &outputPath) {
+    std::error_code error;
+    raw_fd_ostream out(outputPath, error, sys::fs::OF_None);
+    if (error) throw std::runtime_error("cannot open " + outputPath + ": " + error.message());
+
+    legacy::PassManager pass;
+    if (target.addPassesToEmitFile(pass, out, nullptr, fileType)) throw std::runtime_error("the target can not emit this file type");
+    pass.run(module);
+    out.flush();
+}
+
+bool compileProgram(std::vector<std::unique_ptr<BaseAST>> &statements, const std::string &moduleName,
+                    const CompileOptions &options, const std::string &outputPath) {
+    std::unique_ptr<TargetMachine> target = createTargetMachine(options);
+
+    initializeModule(moduleName);
+    TheModule->setTargetTriple(target->getTargetTriple().str());
+    TheModule->setDataLayout(target->createDataLayout());
+
+    // the program is compiled on its own, nothing is defined before it
+    const ProgramTypes defined;
+    checkProgram(statements, defined);
+    Function *program = codegenTopLevel(statements, defined, "__babel_main");
+    if (!program) return false;
+    // only main is seen from outside, the optimizer may drop what the program does not use
+    for (Function &function : *TheModule) {
+        if (!function.isDeclaration()) function.setLinkage(Function::InternalLinkage);
+    }
+    for (GlobalVariable &global : TheModule->globals()) global.setLinkage(GlobalValue::InternalLinkage);
+    definePrints(*TheModule);
+    definePower(*TheModule);
+    defineErrors(*TheModule);
+    defineMain(*TheModule, program);
+
+    optimizeModule(*TheModule, options.optLevel, target.get(), options.lto);
+
+    if (options.output == CompileOptions::BITCODE || options.output == CompileOptions::IR) {
+        std::error_code error;
+        raw_fd_ostream out(outputPath, error, sys::fs::OF_None);
+        if (error) throw std::runtime_error("cannot open " + outputPath + ": " + error.message());
+        if (options.output == CompileOptions::BITCODE) WriteBitcodeToFile(*TheModule, out);
+        else TheModule->print(out, nullptr);
+        return true;
+    }
+
+    if (options.output != CompileOptions::EXECUTABLE) {
+        emit(*TheModule, *target, options.output == CompileOptions::ASSEMBLY ? CGFT_AssemblyFile : CGFT_ObjectFile, outputPath);
+        return true;
+    }
+
+    const std::string object = outputPath + ".o";
+    emit(*TheModule, *target, CGFT_ObjectFile, object);
+    const std::string command = "cc \"" + object + "\" -lm -o \"" + outputPath + "\"";
+    const int status = std::system(command.c_str());
+    std::filesystem::remove(object);
+    if (status != 0) throw std::runtime_error("linking failed: " + command);
+    return true;
+}
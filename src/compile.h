@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "ast.h"
+
+namespace llvm {
+    class TargetMachine;
+}
+
+struct CompileOptions {
+    enum Output { OBJECT, ASSEMBLY, BITCODE, IR, EXECUTABLE };
+
+    Output output = OBJECT;
+    int optLevel = 2;               // -O0 to -O3
+    bool lto = false;               // bitcode for a link time optimizer, only the pre-link pipeline runs
+    std::string cpu = "native";     // the host CPU and its features, or a CPU name for llc
+};
+
+// Runs the new pass manager's default pipeline for optLevel 0 to 3 over the module. With a
+// target machine the passes see its cost model, so vectorization fits the CPU; with lto only
+// the pre-link part runs and the rest is left to the link.
+void optimizeModule(llvm::Module &module, int optLevel, llvm::TargetMachine *target = nullptr, bool lto = false);
+
+// Compiles a whole program ahead of time: the tasks, and a main that runs the other top
+// level statements, with print defined on top of printf. Objects and assembly are for the
+// host triple; an executable is linked from the object by the system's cc. Returns false
+// when codegen reported an error, throws std::runtime_error with a TypeError or when the
+// target or the output file fail.
+bool compileProgram(std::vector<std::unique_ptr<BaseAST>> &statements, const std::string &moduleName,
+                    const CompileOptions &options, const std::string &outputPath);
+
+// What compileProgram's output depends on besides the source, for cache keys: the options,
+// with native resolved to the host's CPU and its features, and the host triple.
+std::string describeOptions(const CompileOptions &options);
@@ -0,0 +1,691 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cctype>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A deterministic automaton recognising every token spec of a lexer at once.
+// The specs are compiled into a single NFA, converted with the subset construction
+// and minimized, so that scanning a token is one table walk over the input.
+// Matching follows the usual lexer rules: the longest match wins and ties are
+// resolved in favour of the spec that was listed first.
+//
+// Supported regex syntax: literals, escapes (\d \w \s \D \W \S \n \t and escaped
+// metacharacters), '.', classes ([a-z_], [^"]), groups ((...) and (?:...)),
+// alternation, the quantifiers * + ? {n} {n,} {n,m}, and \b at the very beginning
+// or end of a pattern.
+
+using CharSet = std::bitset<256>;
+
+inline bool isWordChar(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+inline char firstChar(const CharSet& set) {
+    for (int c = 0; c < 256; c++) {
+        if (set.test(c)) return static_cast<char>(c);
+    }
+    return '\0';
+}
+
+// The tables of a LexerDfa as flat arrays: babel_tablegen writes them into a
+// generated header and a LexerDfa can run on them there without building anything.
+struct LexerDfaTables {
+    const uint8_t* byteClass;       // 256 entries
+    int classCount;
+    int stateCount;
+    int tokenCount;
+    const int32_t* transitions;     // stateCount * classCount, -1 is the dead state
+    const int32_t* acceptBegin;     // stateCount + 1 offsets into acceptTokens
+    const int32_t* acceptTokens;    // by state, in priority order
+    const uint8_t* boundaryFlags;   // by token
+};
+
+struct RegexNode {
+    enum Kind { EMPTY, CHARS, CONCAT, ALTERNATE, REPEAT };
+
+    Kind kind = EMPTY;
+    CharSet chars;
+    std::vector<std::unique_ptr<RegexNode>> children;
+    int min = 0;
+    int max = -1; // -1 means unbounded
+};
+
+class RegexParser {
+    private:
+        const std::string& pattern;
+        size_t pos = 0;
+
+        [[noreturn]] void fail(const std::string& msg) const {
+            throw std::invalid_argument("invalid token pattern '" + pattern + "': " + msg);
+        }
+
+        bool atEnd() const {
+            return pos >= pattern.size();
+        }
+
+        static CharSet rangeOf(char from, char to) {
+            CharSet set;
+            for (int c = static_cast<unsigned char>(from); c <= static_cast<unsigned char>(to); c++) {
+                set.set(c);
+            }
+            return set;
+        }
+
+        static CharSet wordChars() {
+            return rangeOf('a', 'z') | rangeOf('A', 'Z') | rangeOf('0', '9') | rangeOf('_', '_');
+        }
+
+        static CharSet spaceChars() {
+            CharSet set;
+            for (char c : {' ', '\t', '\n', '\r', '\f', '\v'}) set.set(static_cast<unsigned char>(c));
+            return set;
+        }
+
+        // parses the character following a backslash
+        CharSet parseEscape() {
+            if (atEnd()) fail("trailing backslash");
+            char c = pattern[pos++];
+
+            switch (c) {
+                case 'd': return rangeOf('0', '9');
+                case 'D': return ~rangeOf('0', '9');
+                case 'w': return wordChars();
+                case 'W': return ~wordChars();
+                case 's': return spaceChars();
+                case 'S': return ~spaceChars();
+                case 'n': return rangeOf('\n', '\n');
+                case 't': return rangeOf('\t', '\t');
+                case 'r': return rangeOf('\r', '\r');
+                case 'f': return rangeOf('\f', '\f');
+                case 'v': return rangeOf('\v', '\v');
+                case '0': return rangeOf('\0', '\0');
+                case 'b': fail("\\b is only supported at the beginning or end of a pattern");
+                default:
+                    if (isWordChar(static_cast<unsigned char>(c))) fail(std::string("unsupported escape \\") + c);
+                    return rangeOf(c, c);
+            }
+        }
+
+        CharSet parseClass() {
+            bool negated = false;
+            CharSet set;
+
+            if (!atEnd() && pattern[pos] == '^') {
+                negated = true;
+                pos++;
+            }
+
+            bool first = true;
+            while (!atEnd() && (pattern[pos] != ']' || first)) {
+                first = false;
+                CharSet item;
+                char low = pattern[pos];
+
+                if (low == '\\') {
+                    pos++;
+                    item = parseEscape();
+                    if (item.count() != 1) {
+                        set |= item;
+                        continue;
+                    }
+                    low = firstChar(item);
+                } else {
+                    pos++;
+                }
+
+                if (pos + 1 < pattern.size() && pattern[pos] == '-' && pattern[pos + 1] != ']') {
+                    pos++;
+                    char high = pattern[pos++];
+                    if (high == '\\') {
+                        CharSet escaped = parseEscape();
+                        if (escaped.count() != 1) fail("invalid class range");
+                        high = firstChar(escaped);
+                    }
+                    if (static_cast<unsigned char>(high) < static_cast<unsigned char>(low)) fail("invalid class range");
+                    set |= rangeOf(low, high);
+                } else {
+                    set.set(static_cast<unsigned char>(low));
+                }
+            }
+
+            if (atEnd()) fail("unterminated character class");
+            pos++; // ']'
+
+            return negated ? ~set : set;
+        }
+
+        std::unique_ptr<RegexNode> parseAtom() {
+            auto node = std::make_unique<RegexNode>();
+            char c = pattern[pos++];
+
+            switch (c) {
+                case '(': {
+                    if (pattern.compare(pos, 2, "?:") == 0) pos += 2;
+                    node = parseAlternation();
+                    if (atEnd() || pattern[pos] != ')') fail("missing ')'");
+                    pos++;
+                    return node;
+                }
+                case '[':
+                    node->kind = RegexNode::CHARS;
+                    node->chars = parseClass();
+                    return node;
+                case '.':
+                    node->kind = RegexNode::CHARS;
+                    node->chars = ~rangeOf('\n', '\n');
+                    return node;
+                case '\\':
+                    node->kind = RegexNode::CHARS;
+                    node->chars = parseEscape();
+                    return node;
+                case '*': case '+': case '?': case '{': case ')': case '|':
+                    fail(std::string("unexpected '") + c + "'");
+                default:
+                    node->kind = RegexNode::CHARS;
+                    node->chars = rangeOf(c, c);
+                    return node;
+            }
+        }
+
+        int parseNumber() {
+            if (atEnd() || !std::isdigit(static_cast<unsigned char>(pattern[pos]))) fail("expected a number");
+            int value = 0;
+            while (!atEnd() && std::isdigit(static_cast<unsigned char>(pattern[pos]))) {
+                value = value * 10 + (pattern[pos++] - '0');
+            }
+            return value;
+        }
+
+        std::unique_ptr<RegexNode> parseRepeat() {
+            std::unique_ptr<RegexNode> atom = parseAtom();
+
+            while (!atEnd()) {
+                int min, max;
+                char c = pattern[pos];
+
+                if (c == '*') { min = 0; max = -1; }
+                else if (c == '+') { min = 1; max = -1; }
+                else if (c == '?') { min = 0; max = 1; }
+                else if (c == '{') {
+                    pos++;
+                    min = parseNumber();
+                    max = min;
+                    if (!atEnd() && pattern[pos] == ',') {
+                        pos++;
+                        max = (!atEnd() && pattern[pos] == '}') ? -1 : parseNumber();
+                    }
+                    if (atEnd() || pattern[pos] != '}') fail("missing '}'");
+                    if (max != -1 && max < min) fail("invalid repetition range");
+                } else {
+                    break;
+                }
+                pos++;
+
+                auto repeat = std::make_unique<RegexNode>();
+                repeat->kind = RegexNode::REPEAT;
+                repeat->min = min;
+                repeat->max = max;
+                repeat->children.push_back(std::move(atom));
+                atom = std::move(repeat);
+            }
+
+            return atom;
+        }
+
+        std::unique_ptr<RegexNode> parseConcatenation() {
+            auto node = std::make_unique<RegexNode>();
+            node->kind = RegexNode::CONCAT;
+
+            while (!atEnd() && pattern[pos] != '|' && pattern[pos] != ')') {
+                node->children.push_back(parseRepeat());
+            }
+
+            return node;
+        }
+
+        std::unique_ptr<RegexNode> parseAlternation() {
+            auto node = std::make_unique<RegexNode>();
+            node->kind = RegexNode::ALTERNATE;
+            node->children.push_back(parseConcatenation());
+
+            while (!atEnd() && pattern[pos] == '|') {
+                pos++;
+                node->children.push_back(parseConcatenation());
+            }
+
+            return node;
+        }
+
+    public:
+        bool boundaryBefore = false;
+        bool boundaryAfter = false;
+
+        explicit RegexParser(const std::string& pattern) : pattern(pattern) {}
+
+        std::unique_ptr<RegexNode> parse() {
+            size_t end = pattern.size();
+
+            if (pattern.compare(0, 2, "\\b") == 0) {
+                boundaryBefore = true;
+                pos = 2;
+            }
+            if (end >= pos + 2 && pattern.compare(end - 2, 2, "\\b") == 0 && (end < 3 || pattern[end - 3] != '\\')) {
+                boundaryAfter = true;
+            }
+
+            std::string body = pattern.substr(pos, end - pos - (boundaryAfter ? 2 : 0));
+            RegexParser inner(body);
+            std::unique_ptr<RegexNode> root = inner.parseAlternation();
+            if (!inner.atEnd()) inner.fail("unbalanced ')'");
+
+            return root;
+        }
+};
+
+class LexerDfa {
+    private:
+        struct NfaState {
+            CharSet chars;
+            int next = -1;
+            std::vector<int> epsilon;
+            int accept = -1;
+        };
+
+        struct Fragment {
+            int start;
+            int end;
+        };
+
+        class NfaBuilder {
+            public:
+                std::vector<NfaState> states;
+
+                int newState() {
+                    states.emplace_back();
+                    return static_cast<int>(states.size()) - 1;
+                }
+
+                Fragment build(const RegexNode& node) {
+                    switch (node.kind) {
+                        case RegexNode::CHARS: {
+                            int start = newState();
+                            int end = newState();
+                            states[start].chars = node.chars;
+                            states[start].next = end;
+                            return {start, end};
+                        }
+                        case RegexNode::CONCAT: {
+                            int start = newState();
+                            int end = start;
+                            for (const auto& child : node.children) {
+                                Fragment f = build(*child);
+                                states[end].epsilon.push_back(f.start);
+                                end = f.end;
+                            }
+                            return {start, end};
+                        }
+                        case RegexNode::ALTERNATE: {
+                            int start = newState();
+                            int end = newState();
+                            for (const auto& child : node.children) {
+                                Fragment f = build(*child);
+                                states[start].epsilon.push_back(f.start);
+                                states[f.end].epsilon.push_back(end);
+                            }
+                            return {start, end};
+                        }
+                        case RegexNode::REPEAT: {
+                            const RegexNode& body = *node.children.front();
+                            int start = newState();
+                            int end = start;
+                            for (int i = 0; i < node.min; i++) {
+                                Fragment f = build(body);
+                                states[end].epsilon.push_back(f.start);
+                                end = f.end;
+                            }
+                            if (node.max == -1) {
+                                Fragment f = build(body);
+                                int loopEnd = newState();
+                                states[end].epsilon.push_back(f.start);
+                                states[end].epsilon.push_back(loopEnd);
+                                states[f.end].epsilon.push_back(f.start);
+                                states[f.end].epsilon.push_back(loopEnd);
+                                end = loopEnd;
+                            } else {
+                                int last = newState();
+                                for (int i = node.min; i < node.max; i++) {
+                                    Fragment f = build(body);
+                                    states[end].epsilon.push_back(f.start);
+                                    states[end].epsilon.push_back(last);
+                                    end = f.end;
+                                }
+                                states[end].epsilon.push_back(last);
+                                end = last;
+                            }
+                            return {start, end};
+                        }
+                        case RegexNode::EMPTY:
+                        default: {
+                            int state = newState();
+                            return {state, state};
+                        }
+                    }
+                }
+        };
+
+        static void collectCharSets(const RegexNode& node, std::vector<CharSet>& sets) {
+            if (node.kind == RegexNode::CHARS) sets.push_back(node.chars);
+            for (const auto& child : node.children) collectCharSets(*child, sets);
+        }
+
+        // the arrays of a LexerDfa that built its own automaton, copies share them
+        struct Storage {
+            std::array<uint8_t, 256> byteClass{};
+            std::vector<int32_t> transitions;
+            std::vector<int32_t> acceptBegin;
+            std::vector<int32_t> acceptTokens;
+            std::vector<uint8_t> boundaryFlags;
+        };
+
+        void computeByteClasses(Storage& storage, const std::vector<CharSet>& sets) {
+            // bytes that no pattern tells apart share a class
+            std::map<std::vector<bool>, int> signatures;
+            classCount = 0;
+
+            for (int c = 0; c < 256; c++) {
+                std::vector<bool> signature(sets.size());
+                for (size_t i = 0; i < sets.size(); i++) signature[i] = sets[i].test(c);
+
+                auto [it, inserted] = signatures.emplace(signature, classCount);
+                if (inserted) classCount++;
+                storage.byteClass[c] = static_cast<uint8_t>(it->second);
+            }
+        }
+
+        static void epsilonClosure(const std::vector<NfaState>& nfa, std::vector<int>& set) {
+            std::vector<bool> seen(nfa.size());
+            std::vector<int> work(set);
+            for (int s : set) seen[s] = true;
+
+            while (!work.empty()) {
+                int s = work.back();
+                work.pop_back();
+                for (int t : nfa[s].epsilon) {
+                    if (!seen[t]) {
+                        seen[t] = true;
+                        set.push_back(t);
+                        work.push_back(t);
+                    }
+                }
+            }
+
+            std::sort(set.begin(), set.end());
+        }
+
+        void minimize(Storage& storage, const std::vector<std::vector<int>>& transitionsIn, const std::vector<std::vector<int>>& acceptsIn) {
+            // Moore's partition refinement; the dead state is implicit (-1)
+            const int n = static_cast<int>(transitionsIn.size());
+            std::vector<int> block(n);
+            int blockCount = 0;
+
+            {
+                std::map<std::vector<int>, int> initial;
+                for (int s = 0; s < n; s++) {
+                    auto [it, inserted] = initial.emplace(acceptsIn[s], blockCount);
+                    if (inserted) blockCount++;
+                    block[s] = it->second;
+                }
+            }
+
+            while (true) {
+                std::map<std::vector<int>, int> refined;
+                std::vector<int> next(n);
+
+                for (int s = 0; s < n; s++) {
+                    std::vector<int> signature;
+                    signature.reserve(classCount + 1);
+                    signature.push_back(block[s]);
+                    for (int t : transitionsIn[s]) signature.push_back(t < 0 ? -1 : block[t]);
+
+                    auto [it, inserted] = refined.emplace(std::move(signature), static_cast<int>(refined.size()));
+                    next[s] = it->second;
+                }
+
+                bool stable = static_cast<int>(refined.size()) == blockCount;
+                blockCount = static_cast<int>(refined.size());
+                block = std::move(next);
+                if (stable) break;
+            }
+
+            // renumber so that the start state stays 0
+            std::vector<int> order(blockCount, -1);
+            int count = 0;
+            for (int s = 0; s < n; s++) {
+                if (order[block[s]] < 0) order[block[s]] = count++;
+            }
+
+            std::vector<int32_t>& transitions = storage.transitions;
+            std::vector<int32_t>& acceptBegin = storage.acceptBegin;
+            std::vector<int32_t>& acceptTokens = storage.acceptTokens;
+            transitions.assign(static_cast<size_t>(count) * classCount, -1);
+            acceptBegin.assign(count + 1, 0);
+            std::vector<std::vector<int>> accepts(count);
+
+            for (int s = 0; s < n; s++) {
+                int target = order[block[s]];
+                accepts[target] = acceptsIn[s];
+                for (int c = 0; c < classCount; c++) {
+                    int t = transitionsIn[s][c];
+                    transitions[static_cast<size_t>(target) * classCount + c] = t < 0 ? -1 : order[block[t]];
+                }
+            }
+
+            acceptTokens.clear();
+            for (int s = 0; s < count; s++) {
+                acceptBegin[s] = static_cast<int>(acceptTokens.size());
+                acceptTokens.insert(acceptTokens.end(), accepts[s].begin(), accepts[s].end());
+            }
+            acceptBegin[count] = static_cast<int>(acceptTokens.size());
+            stateCount = count;
+        }
+
+        // returns the best token accepted in state for the lexeme [start, end), or -1
+        int resolveAccept(int state, const char* data, size_t size, size_t start, size_t end) const {
+            for (int i = acceptBegin[state]; i < acceptBegin[state + 1]; i++) {
+                int token = acceptTokens[i];
+                uint8_t flags = boundaryFlags[token];
+
+                if (flags & BOUNDARY_BEFORE) {
+                    bool before = start > 0 && isWordChar(static_cast<unsigned char>(data[start - 1]));
+                    if (before == isWordChar(static_cast<unsigned char>(data[start]))) continue;
+                }
+                if (flags & BOUNDARY_AFTER) {
+                    bool after = end < size && isWordChar(static_cast<unsigned char>(data[end]));
+                    if (after == isWordChar(static_cast<unsigned char>(data[end - 1]))) continue;
+                }
+
+                return token;
+            }
+
+            return -1;
+        }
+
+        static constexpr uint8_t BOUNDARY_BEFORE = 1;
+        static constexpr uint8_t BOUNDARY_AFTER = 2;
+
+        // the arrays are either in storage or in a generated header
+        std::shared_ptr<const Storage> storage;
+        const uint8_t* byteClass = nullptr;
+        int classCount = 0;
+        int stateCount = 0;
+        int tokenCount = 0;
+        const int32_t* transitions = nullptr;
+        const int32_t* acceptBegin = nullptr;
+        const int32_t* acceptTokens = nullptr;
+        const uint8_t* boundaryFlags = nullptr;
+
+    public:
+        LexerDfa() = default;
+
+        // runs on the arrays of a generated header, they are used in place
+        explicit LexerDfa(const LexerDfaTables& tables)
+            : byteClass(tables.byteClass), classCount(tables.classCount), stateCount(tables.stateCount), tokenCount(tables.tokenCount),
+              transitions(tables.transitions), acceptBegin(tables.acceptBegin), acceptTokens(tables.acceptTokens), boundaryFlags(tables.boundaryFlags) {}
+
+        explicit LexerDfa(const std::list<std::pair<std::string, std::string>>& token_specs) {
+            auto built = std::make_shared<Storage>();
+            std::vector<uint8_t>& boundaryFlags = built->boundaryFlags;
+            std::vector<std::unique_ptr<RegexNode>> patterns;
+            std::vector<CharSet> sets;
+
+            for (const auto& spec : token_specs) {
+                RegexParser parser(spec.second);
+                patterns.push_back(parser.parse());
+                boundaryFlags.push_back((parser.boundaryBefore ? BOUNDARY_BEFORE : 0) | (parser.boundaryAfter ? BOUNDARY_AFTER : 0));
+                collectCharSets(*patterns.back(), sets);
+            }
+
+            computeByteClasses(*built, sets);
+            const std::array<uint8_t, 256>& byteClass = built->byteClass;
+
+            NfaBuilder nfa;
+            int nfaStart = nfa.newState();
+            for (size_t i = 0; i < patterns.size(); i++) {
+                Fragment f = nfa.build(*patterns[i]);
+                nfa.states[nfaStart].epsilon.push_back(f.start);
+                nfa.states[f.end].accept = static_cast<int>(i);
+            }
+
+            // representative byte of each class
+            std::vector<int> representative(classCount, -1);
+            for (int c = 0; c < 256; c++) {
+                if (representative[byteClass[c]] < 0) representative[byteClass[c]] = c;
+            }
+
+            // subset construction
+            std::map<std::vector<int>, int> dfaStates;
+            std::vector<std::vector<int>> worklist;
+            std::vector<std::vector<int>> dfaTransitions;
+            std::vector<std::vector<int>> dfaAccepts;
+
+            std::vector<int> startSet = {nfaStart};
+            epsilonClosure(nfa.states, startSet);
+            dfaStates.emplace(startSet, 0);
+            worklist.push_back(startSet);
+
+            for (size_t current = 0; current < worklist.size(); current++) {
+                const std::vector<int> set = worklist[current];
+                std::vector<int> row(classCount, -1);
+                std::vector<int> accepts;
+
+                for (int s : set) {
+                    if (nfa.states[s].accept >= 0) accepts.push_back(nfa.states[s].accept);
+                }
+                std::sort(accepts.begin(), accepts.end());
+
+                // a token without boundary conditions shadows every lower priority one
+                for (size_t i = 0; i < accepts.size(); i++) {
+                    if (boundaryFlags[accepts[i]] == 0) {
+                        accepts.resize(i + 1);
+                        break;
+                    }
+                }
+
+                for (int c = 0; c < classCount; c++) {
+                    std::vector<int> target;
+                    for (int s : set) {
+                        if (nfa.states[s].next >= 0 && nfa.states[s].chars.test(representative[c])) {
+                            target.push_back(nfa.states[s].next);
+                        }
+                    }
+                    if (target.empty()) continue;
+
+                    epsilonClosure(nfa.states, target);
+                    auto [it, inserted] = dfaStates.emplace(target, static_cast<int>(worklist.size()));
+                    if (inserted) worklist.push_back(target);
+                    row[c] = it->second;
+                }
+
+                dfaTransitions.push_back(std::move(row));
+                dfaAccepts.push_back(std::move(accepts));
+            }
+
+            minimize(*built, dfaTransitions, dfaAccepts);
+
+            tokenCount = static_cast<int>(patterns.size());
+            this->byteClass = built->byteClass.data();
+            this->transitions = built->transitions.data();
+            this->acceptBegin = built->acceptBegin.data();
+            this->acceptTokens = built->acceptTokens.data();
+            this->boundaryFlags = boundaryFlags.data();
+            storage = std::move(built);
+        }
+
+        LexerDfaTables getTables() const {
+            return LexerDfaTables{byteClass, classCount, stateCount, tokenCount, transitions, acceptBegin, acceptTokens, boundaryFlags};
+        }
+
+        int getStateCount() const {
+            return stateCount;
+        }
+
+        int getClassCount() const {
+            return classCount;
+        }
+
+        // Finds the longest token starting at pos. Returns the index of the matching
+        // spec and stores the lexeme length in length, or returns -1 if no non-empty
+        // token matches.
+        int match(const char* data, size_t size, size_t pos, size_t& length) const {
+            bool truncated;
+            return match(data, size, pos, length, truncated);
+        }
+
+        // Same as above for input that arrives in pieces: truncated is set when the
+        // scan reached the end of data while a longer token was still possible, in
+        // which case the result may change once more input follows.
+        int match(const char* data, size_t size, size_t pos, size_t& length, bool& truncated) const {
+            size_t scanEnd;
+            return match(data, size, pos, length, truncated, scanEnd);
+        }
+
+        // As above, scanEnd is set past the last byte the scan looked at. The result
+        // only depends on data[pos - 1] and the bytes up to scanEnd, which tells an
+        // incremental lexer which tokens an edit can change.
+        int match(const char* data, size_t size, size_t pos, size_t& length, bool& truncated, size_t& scanEnd) const {
+            int state = 0;
+            int token = -1;
+            length = 0;
+            truncated = false;
+
+            size_t i = pos;
+            while (i < size) {
+                state = transitions[static_cast<size_t>(state) * classCount + byteClass[static_cast<unsigned char>(data[i])]];
+                if (state < 0) break;
+                i++;
+
+                if (acceptBegin[state] != acceptBegin[state + 1]) {
+                    int accepted = resolveAccept(state, data, size, pos, i);
+                    if (accepted >= 0) {
+                        token = accepted;
+                        length = i - pos;
+                    }
+                }
+
+                if (i == size) truncated = true;
+            }
+
+            scanEnd = std::min(i + 1, size);
+            return token;
+        }
+};
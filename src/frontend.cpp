@@ -0,0 +1,35 @@
+#include "frontend.h"
+
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+
+Parser loadParser(const std::filesystem::path& tablePath, const std::filesystem::path& grammarPath) {
+    std::optional<std::string> grammarText;
+    if (std::ifstream t(grammarPath); t.is_open()) {
+        std::stringstream buffer;
+        buffer << t.rdbuf();
+        grammarText = transform_string(buffer.str());
+    }
+
+    try {
+        auto tables = ParserTables::load(tablePath.string());
+        if (!grammarText || tables->grammarHash() == hashGrammar(*grammarText)) return Parser(tables);
+    } catch (const std::runtime_error&) {
+        // missing, stale or damaged, generate it again below
+    }
+
+    if (!grammarText) {
+        std::cout << "Error opening file" << std::endl;
+        grammarText = "";
+    }
+
+    Grammar grammar(*grammarText);
+    LRClosureTable closureTable(grammar);
+    LRTable lrTable(closureTable);
+    Parser parser(lrTable);
+    std::filesystem::create_directories(tablePath.parent_path());
+    parser.getTables().save(tablePath.string());
+    return parser;
+}
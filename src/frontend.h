@@ -0,0 +1,11 @@
+#pragma once
+
+#include <filesystem>
+#include "lexer.h"
+#include "lrparser.h"
+#include "streamlexer.h"
+
+// Maps the table file when it was generated from the grammar file, otherwise
+// generates the table from the grammar and writes it for the next start. Without
+// a grammar file whatever table there is gets used.
+Parser loadParser(const std::filesystem::path& tablePath, const std::filesystem::path& grammarPath);
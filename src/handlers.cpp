@@ -0,0 +1,317 @@
+#include "handlers.h"
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+SemanticActions::SemanticActions(const ParserTables& tables) : tables(tables) {
+    static const std::map<std::string_view, Handler> byNonterminal = {
+        {"program", &SemanticActions::program},
+        {"statement_list", &SemanticActions::statementList},
+        {"simple_stmt_list", &SemanticActions::statementList},
+        {"block", &SemanticActions::statementList},
+        {"return_stmt", &SemanticActions::returnStatement},
+        {"assignment", &SemanticActions::assignment},
+        {"type_spec", &SemanticActions::typeSpec},
+        {"args", &SemanticActions::args},
+        {"task_header", &SemanticActions::taskHeader},
+        {"task_def", &SemanticActions::taskDefinition},
+        {"if_stmt", &SemanticActions::ifStatement},
+        {"elif_stmt", &SemanticActions::ifStatement},
+        {"match_stmt", &SemanticActions::matchStatement},
+        {"cases", &SemanticActions::cases},
+        {"loop_stmt", &SemanticActions::loopStatement},
+        {"try_stmt", &SemanticActions::tryStatement},
+        {"catch_blocks", &SemanticActions::catchBlocks},
+        {"raise_stmt", &SemanticActions::raiseStatement},
+        {"expression", &SemanticActions::operation},
+        {"function_call", &SemanticActions::call},
+        {"params", &SemanticActions::valueList},
+        {"comma_values", &SemanticActions::valueList},
+        {"tuple", &SemanticActions::tuple},
+        // only found inside what is not supported
+        {"members", &SemanticActions::ignore},
+        {"task_def_list", &SemanticActions::ignore},
+        {"kvpairs", &SemanticActions::ignore},
+    };
+
+    handlers.reserve(tables.ruleCount());
+    for (int rule = 0; rule < tables.ruleCount(); rule++) {
+        auto found = byNonterminal.find(tables.nameOf(tables.ruleNonterminal(rule)));
+        handlers.push_back(found != byNonterminal.end() ? found->second : &SemanticActions::unsupportedRule);
+    }
+
+    // in the order of Kind
+    static const std::string_view kindNames[] = {
+        "", "VAR", "TYPE", "INTEGER", "FLOATING_POINT", "BOOL", "CHAR", "EQUALS", "COMMA", "LPAREN", "RPAREN", "RARR", "END",
+        "WHILE", "SEMICOLON", "STEP", "INCREMENT", "DECREMENT", "BREAK", "CONTINUE", "RETURN", "PLUS", "MINUS", "NOT",
+    };
+    for (Symbol terminal = 0; terminal < tables.terminalCount(); terminal++) {
+        const std::string_view name = tables.nameOf(terminal);
+        const auto found = std::find(std::begin(kindNames) + 1, std::end(kindNames), name);
+        const Kind kind = found != std::end(kindNames) ? static_cast<Kind>(found - std::begin(kindNames)) : Kind::OTHER;
+        kinds.push_back(kind);
+        keepsText.push_back(kind == Kind::VAR || kind == Kind::TYPE || kind == Kind::INTEGER || kind == Kind::FLOATING_POINT || kind == Kind::BOOL
+                            || kind == Kind::CHAR || kind == Kind::PLUS || kind == Kind::MINUS || kind == Kind::NOT);
+
+        const auto binary = ::binaryOperators.find(name);
+        binaryOperatorOf.push_back(binary != ::binaryOperators.end() ? &binary->second : nullptr);
+        const auto compound = ::compoundAssignments.find(name);
+        compoundOperatorOf.push_back(compound != ::compoundAssignments.end() ? &compound->second : nullptr);
+    }
+}
+
+bool SemanticActions::is(const Value& value, Kind kind) const {
+    const TokenValue* token = std::get_if<TokenValue>(&value);
+    return token && kinds[token->terminal] == kind;
+}
+
+const std::string& SemanticActions::text(const Value& value) const {
+    return std::get<TokenValue>(value).text;
+}
+
+void SemanticActions::unsupported(std::string_view name) const {
+    throw std::runtime_error(std::string(name) + " is not supported yet");
+}
+
+std::unique_ptr<BaseAST> SemanticActions::atom(const TokenValue& token) const {
+    switch (kinds[token.terminal]) {
+        case Kind::INTEGER: return std::make_unique<IntegerAST>(std::stoll(token.text));
+        case Kind::FLOATING_POINT: return std::make_unique<FloatingPointAST>(std::stod(token.text));
+        case Kind::BOOL: return std::make_unique<BoolAST>(token.text == "TRUE");
+        case Kind::CHAR: return std::make_unique<CharAST>(token.text[1]);
+        case Kind::VAR: return std::make_unique<VariableAST>(token.text);
+        default: unsupported(tables.nameOf(token.terminal));
+    }
+}
+
+// pass-through rules leave a token where an atom is, and a list where values are separated by commas
+std::unique_ptr<BaseAST> SemanticActions::expression(Value& value) const {
+    if (const TokenValue* token = std::get_if<TokenValue>(&value)) return atom(*token);
+    if (std::holds_alternative<ASTList>(value)) unsupported("comma_values");
+    return std::move(std::get<std::unique_ptr<BaseAST>>(value));
+}
+
+// Appends the statements of value to a last first list. Pass-through rules leave tokens
+// for break, continue and a bare return, the others add nothing.
+void SemanticActions::statements(Value& value, ASTList& out) const {
+    if (TokenValue* token = std::get_if<TokenValue>(&value)) {
+        const Kind kind = kinds[token->terminal];
+        if (kind == Kind::BREAK || kind == Kind::CONTINUE) out.push_back(std::make_unique<LoopControlAST>(kind == Kind::BREAK));
+        else if (kind == Kind::RETURN) out.push_back(std::make_unique<ReturnAST>(nullptr));
+    } else if (auto* node = std::get_if<std::unique_ptr<BaseAST>>(&value)) {
+        out.push_back(std::move(*node));
+    } else if (ASTList* list = std::get_if<ASTList>(&value)) {
+        std::move(list->begin(), list->end(), std::back_inserter(out));
+    }
+}
+
+std::unique_ptr<BaseAST> SemanticActions::block(Value& value) const {
+    ASTList body;
+    if (ASTList* list = std::get_if<ASTList>(&value)) body = std::move(*list);
+    else statements(value, body);
+    std::reverse(body.begin(), body.end());
+    for (const std::unique_ptr<BaseAST>& statement : body) {
+        if (dynamic_cast<TaskAST*>(statement.get())) throw std::runtime_error("tasks can only be defined at the top level");
+    }
+    return std::make_unique<BlockAST>(std::move(body));
+}
+
+void SemanticActions::argList(Value& value, ArgList& out) const {
+    if (is(value, Kind::VAR)) {
+        out.names.push_back(text(value));
+        out.types.push_back(BabelType::Unknown);
+        return;
+    }
+    ArgList& list = std::get<ArgList>(value);
+    std::move(list.names.begin(), list.names.end(), std::back_inserter(out.names));
+    out.types.insert(out.types.end(), list.types.begin(), list.types.end());
+}
+
+SemanticActions::Value SemanticActions::program(int rule, std::span<Value> values) {
+    ASTList list = std::get<ASTList>(statementList(rule, values));
+    std::reverse(list.begin(), list.end());
+    return list;
+}
+
+// statement lists and blocks, the list of the rest of the input is last and is appended to
+SemanticActions::Value SemanticActions::statementList(int, std::span<Value> values) {
+    ASTList list;
+    size_t count = values.size();
+    if (ASTList* rest = std::get_if<ASTList>(&values.back())) {
+        list = std::move(*rest);
+        count--;
+    }
+    for (size_t i = count; i-- > 0;) statements(values[i], list);
+    return list;
+}
+
+SemanticActions::Value SemanticActions::returnStatement(int, std::span<Value> values) {
+    return std::make_unique<ReturnAST>(expression(values[1]));
+}
+
+// VAR [type_spec] assignment_operator expression, x op= e is x = x op e
+SemanticActions::Value SemanticActions::assignment(int, std::span<Value> values) {
+    const Value& op = values[values.size() - 2];
+    const std::string* compound = is(op, Kind::EQUALS) ? nullptr : compoundOperatorOf[std::get<TokenValue>(op).terminal];
+    const BabelType declared = is(values[1], Kind::TYPE) ? valueType(text(values[1])) : BabelType::Unknown;
+    return makeAssignment(text(values[0]), compound, expression(values.back()), declared);
+}
+
+// the TYPE token, whoever uses it checks the type
+SemanticActions::Value SemanticActions::typeSpec(int, std::span<Value> values) {
+    return std::move(values[1]);
+}
+
+// VAR type_spec or args COMMA args, default values are not supported
+SemanticActions::Value SemanticActions::args(int rule, std::span<Value> values) {
+    ArgList list;
+    if (values.size() == 2) {
+        list.names.push_back(text(values[0]));
+        list.types.push_back(valueType(text(values[1])));
+    } else if (values.size() == 3 && is(values[1], Kind::COMMA)) {
+        argList(values[0], list);
+        argList(values[2], list);
+    } else {
+        return unsupportedRule(rule, values);
+    }
+    return list;
+}
+
+// TASK VAR LPAREN [args] RPAREN [RARR TYPE]
+SemanticActions::Value SemanticActions::taskHeader(int, std::span<Value> values) {
+    ArgList list;
+    if (!is(values[3], Kind::RPAREN)) argList(values[3], list);
+
+    const BabelType returnType = is(values[values.size() - 2], Kind::RARR) ? resultType(text(values.back())) : BabelType::Unknown;
+    return std::make_unique<TaskHeaderAST>(text(values[1]), std::move(list.names), std::move(list.types), returnType);
+}
+
+SemanticActions::Value SemanticActions::taskDefinition(int, std::span<Value> values) {
+    std::unique_ptr<BaseAST> body = block(values[1]);
+    return std::make_unique<TaskAST>(std::move(std::get<std::unique_ptr<TaskHeaderAST>>(values[0])), std::move(body));
+}
+
+// if_stmt and elif_stmt: IF e THEN block (END | elif_stmt | ELSE block END)
+SemanticActions::Value SemanticActions::ifStatement(int, std::span<Value> values) {
+    std::unique_ptr<BaseAST> otherwise;
+    if (values.size() == 5 && !is(values[4], Kind::END)) otherwise = std::move(std::get<std::unique_ptr<BaseAST>>(values[4]));
+    else if (values.size() == 7) otherwise = block(values[5]);
+    return std::make_unique<IfAST>(expression(values[1]), block(values[3]), std::move(otherwise));
+}
+
+// MATCH e NEWLINE cases [OTHERWISE block]
+SemanticActions::Value SemanticActions::matchStatement(int, std::span<Value> values) {
+    std::unique_ptr<BaseAST> subject = expression(values[1]);
+    std::unique_ptr<BaseAST> otherwise = values.size() == 6 ? block(values[5]) : nullptr;
+
+    ASTList list;
+    makeMatch(std::move(subject), std::move(std::get<CaseList>(values[3])), std::move(otherwise), list);
+    std::reverse(list.begin(), list.end());
+    return list;
+}
+
+// CASE e block [cases], the later cases are reduced first
+SemanticActions::Value SemanticActions::cases(int, std::span<Value> values) {
+    CaseList list;
+    if (values.size() == 4) list = std::move(std::get<CaseList>(values[3]));
+    std::unique_ptr<BaseAST> body = block(values[2]);
+    list.emplace_back(expression(values[1]), std::move(body));
+    return list;
+}
+
+// WHILE, FOR init ; cond ; step or FOR init TO last [STEP by], the init goes before the loop
+SemanticActions::Value SemanticActions::loopStatement(int, std::span<Value> values) {
+    if (is(values[0], Kind::WHILE)) {
+        std::unique_ptr<BaseAST> cond = expression(values[1]);
+        return std::make_unique<WhileAST>(std::move(cond), block(values[3]));
+    }
+
+    std::unique_ptr<BaseAST> init = std::move(std::get<std::unique_ptr<BaseAST>>(values[1]));
+    std::unique_ptr<BaseAST> loop;
+    if (is(values[2], Kind::SEMICOLON)) {
+        std::unique_ptr<BaseAST> cond = expression(values[3]);
+        std::unique_ptr<BaseAST> step = expression(values[5]);
+        loop = std::make_unique<WhileAST>(std::move(cond), block(values[7]), std::move(step));
+    } else {
+        std::unique_ptr<BaseAST> last = expression(values[3]);
+        std::unique_ptr<BaseAST> by = is(values[4], Kind::STEP) ? expression(values[5]) : nullptr;
+        loop = makeCountingLoop(static_cast<const AssignmentAST&>(*init).getName(), std::move(last), std::move(by), block(values[values.size() - 2]));
+    }
+
+    ASTList list;
+    list.push_back(std::move(loop));
+    list.push_back(std::move(init));
+    return list;
+}
+
+// TRY block catch_blocks [FINALLY block] END
+SemanticActions::Value SemanticActions::tryStatement(int, std::span<Value> values) {
+    std::unique_ptr<BaseAST> body = block(values[1]);
+    CatchList catches = std::move(std::get<CatchList>(values[2]));
+    std::reverse(catches.begin(), catches.end());
+    std::unique_ptr<BaseAST> finally = values.size() == 6 ? block(values[4]) : nullptr;
+    return std::make_unique<TryAST>(std::move(body), std::move(catches), std::move(finally));
+}
+
+// CATCH VAR block [catch_blocks], the later catches are reduced first
+SemanticActions::Value SemanticActions::catchBlocks(int, std::span<Value> values) {
+    CatchList list;
+    if (values.size() == 4) list = std::move(std::get<CatchList>(values[3]));
+    std::unique_ptr<BaseAST> body = block(values[2]);
+    list.emplace_back(text(values[1]), std::move(body));
+    return list;
+}
+
+SemanticActions::Value SemanticActions::raiseStatement(int, std::span<Value> values) {
+    return makeRaise(expression(values[1]));
+}
+
+// an operator and its operands
+SemanticActions::Value SemanticActions::operation(int rule, std::span<Value> values) {
+    if (values.size() == 3) {
+        const std::string* op = binaryOperatorOf[std::get<TokenValue>(values[1]).terminal];
+        if (!op) return unsupportedRule(rule, values);
+        std::unique_ptr<BaseAST> lhs = expression(values[0]);
+        return std::make_unique<BinaryOperatorAST>(*op, std::move(lhs), expression(values[2]));
+    }
+    if (is(values[1], Kind::INCREMENT)) return std::make_unique<UnaryOperatorAST>("++", expression(values[0]));
+    if (is(values[1], Kind::DECREMENT)) return std::make_unique<UnaryOperatorAST>("--", expression(values[0]));
+    return std::make_unique<UnaryOperatorAST>(text(values[0]), expression(values[1]));
+}
+
+// VAR LPAREN [params] RPAREN, calling a member is not supported
+SemanticActions::Value SemanticActions::call(int rule, std::span<Value> values) {
+    if (!is(values[1], Kind::LPAREN)) return unsupportedRule(rule, values);
+
+    ASTList args;
+    if (values.size() == 4) {
+        if (ASTList* list = std::get_if<ASTList>(&values[2])) args = std::move(*list);
+        else args.push_back(expression(values[2]));
+        std::reverse(args.begin(), args.end());
+    }
+    return std::make_unique<TaskCallAST>(text(values[0]), std::move(args));
+}
+
+// params and comma_values, value COMMA rest
+SemanticActions::Value SemanticActions::valueList(int, std::span<Value> values) {
+    ASTList list;
+    if (ASTList* rest = std::get_if<ASTList>(&values[2])) list = std::move(*rest);
+    else list.push_back(expression(values[2]));
+    list.push_back(expression(values[0]));
+    return list;
+}
+
+// LPAREN e RPAREN is the value itself, larger tuples are not supported
+SemanticActions::Value SemanticActions::tuple(int rule, std::span<Value> values) {
+    if (values.size() != 3 || std::holds_alternative<ASTList>(values[1])) return unsupportedRule(rule, values);
+    return expression(values[1]);
+}
+
+SemanticActions::Value SemanticActions::ignore(int, std::span<Value>) {
+    return {};
+}
+
+SemanticActions::Value SemanticActions::unsupportedRule(int rule, std::span<Value>) {
+    unsupported(tables.nameOf(tables.ruleNonterminal(rule)));
+}
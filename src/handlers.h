@@ -1,6 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
 #include "ast.h"
+#include "lower.h"
+#include "lrparser.h"
+
+// The semantic actions that build the ast.h nodes while a file is parsed, for
+// Parser::parseWith, so no parse tree is made. There is a handler for every rule,
+// picked by its nonterminal when the actions are made, and it sees the values of
+// the rule's right hand side. The value of the first rule is the program's top
+// level statements, in order. A handler throws std::runtime_error for what codegen
+// can not do yet, with the same messages as lowerProgram.
+class SemanticActions {
+    public:
+        // statements and values of right recursive rules, which append to the list of the
+        // rest of the input, so these lists are last first until a block or call takes them
+        using ASTList = std::vector<std::unique_ptr<BaseAST>>;
+
+        struct TokenValue {
+            Symbol terminal;
+            std::string text;
+        };
+
+        struct ArgList {
+            std::vector<std::string> names;
+            std::vector<BabelType> types;       // Unknown where none is given
+        };
+
+        using CaseList = MatchCases;
+        using CatchList = CatchBlocks;
+
+        // monostate is for the parts of constructs that are not supported, which say so themselves
+        using Value = std::variant<std::monostate, TokenValue, std::unique_ptr<BaseAST>, ASTList, ArgList, CaseList, CatchList, std::unique_ptr<TaskHeaderAST>>;
+
+        explicit SemanticActions(const ParserTables& tables);
+
+        // only the text of names, literals and types is kept
+        Value shift(Symbol terminal, std::string_view text) const {
+            return TokenValue{terminal, keepsText[terminal] ? std::string(text) : std::string()};
+        }
+
+        Value reduce(int rule, std::span<Value> values) {
+            return (this->*handlers[rule])(rule, values);
+        }
+
+    private:
+        using Handler = Value (SemanticActions::*)(int rule, std::span<Value> values);
+
+        // the terminals the handlers tell apart, the others are OTHER
+        enum class Kind : uint8_t {
+            OTHER, VAR, TYPE, INTEGER, FLOATING_POINT, BOOL, CHAR, EQUALS, COMMA, LPAREN, RPAREN, RARR, END,
+            WHILE, SEMICOLON, STEP, INCREMENT, DECREMENT, BREAK, CONTINUE, RETURN, PLUS, MINUS, NOT,
+        };
+
+        const ParserTables& tables;
+        std::vector<Handler> handlers;      // by rule
+        std::vector<Kind> kinds;            // by terminal
+        std::vector<bool> keepsText;        // by terminal
+        std::vector<const std::string*> binaryOperatorOf;       // by terminal, nullptr if it is none
+        std::vector<const std::string*> compoundOperatorOf;     // by terminal, nullptr if it is none
+
+        bool is(const Value& value, Kind kind) const;
+        const std::string& text(const Value& value) const;
+        [[noreturn]] void unsupported(std::string_view name) const;
+
+        std::unique_ptr<BaseAST> atom(const TokenValue& token) const;
+        std::unique_ptr<BaseAST> expression(Value& value) const;
+        void statements(Value& value, ASTList& out) const;
+        std::unique_ptr<BaseAST> block(Value& value) const;
+        void argList(Value& value, ArgList& out) const;
 
-std::unique_ptr<BaseAST> name() {
-    auto Result = std::make_unique<BaseAST>(NumVal);
-    return std::move(Result);
-}
\ No newline at end of file
+        Value program(int rule, std::span<Value> values);
+        Value statementList(int rule, std::span<Value> values);
+        Value returnStatement(int rule, std::span<Value> values);
+        Value assignment(int rule, std::span<Value> values);
+        Value typeSpec(int rule, std::span<Value> values);
+        Value args(int rule, std::span<Value> values);
+        Value taskHeader(int rule, std::span<Value> values);
+        Value taskDefinition(int rule, std::span<Value> values);
+        Value ifStatement(int rule, std::span<Value> values);
+        Value matchStatement(int rule, std::span<Value> values);
+        Value cases(int rule, std::span<Value> values);
+        Value loopStatement(int rule, std::span<Value> values);
+        Value tryStatement(int rule, std::span<Value> values);
+        Value catchBlocks(int rule, std::span<Value> values);
+        Value raiseStatement(int rule, std::span<Value> values);
+        Value operation(int rule, std::span<Value> values);
+        Value call(int rule, std::span<Value> values);
+        Value valueList(int rule, std::span<Value> values);
+        Value tuple(int rule, std::span<Value> values);
+        Value ignore(int rule, std::span<Value> values);
+        Value unsupportedRule(int rule, std::span<Value> values);
+};
@@ -0,0 +1,1174 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "lexer.h"
+#include "lrparser.h"
+
+// Text in chunks at the nodes of a treap ordered by position, so replacing a range
+// costs time for the range and the depth of the treap, not a move of the whole text.
+class TextRope {
+    private:
+        static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+        static constexpr size_t CHUNK = 1024;      // an edit cuts the chunks around it again to at most this size
+
+        struct Chunk {
+            std::string text;
+            uint32_t left;
+            uint32_t right;
+            uint32_t priority;
+            size_t size;        // of the text in the subtree
+        };
+
+        std::vector<Chunk> chunks;
+        std::vector<uint32_t> unused;
+        uint32_t root = NONE;
+        uint32_t seed = 2463534242u;
+
+        size_t sizeOf(uint32_t chunk) const {
+            return chunk == NONE ? 0 : chunks[chunk].size;
+        }
+
+        uint32_t update(uint32_t chunk) {
+            Chunk& c = chunks[chunk];
+            c.size = c.text.size() + sizeOf(c.left) + sizeOf(c.right);
+            return chunk;
+        }
+
+        uint32_t make(std::string text) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            Chunk chunk{std::move(text), NONE, NONE, seed, 0};
+            if (unused.empty()) {
+                chunks.push_back(std::move(chunk));
+                return update(static_cast<uint32_t>(chunks.size() - 1));
+            }
+            const uint32_t index = unused.back();
+            unused.pop_back();
+            chunks[index] = std::move(chunk);
+            return update(index);
+        }
+
+        uint32_t merge(uint32_t left, uint32_t right) {
+            if (left == NONE) return right;
+            if (right == NONE) return left;
+            if (chunks[left].priority > chunks[right].priority) {
+                const uint32_t merged = merge(chunks[left].right, right);
+                chunks[left].right = merged;
+                return update(left);
+            }
+            const uint32_t merged = merge(left, chunks[right].left);
+            chunks[right].left = merged;
+            return update(right);
+        }
+
+        // the chunks that end at or before pos, and the rest; pos is where a chunk starts or the end
+        std::pair<uint32_t, uint32_t> split(uint32_t chunk, size_t pos) {
+            if (chunk == NONE) return {NONE, NONE};
+            const size_t leftSize = sizeOf(chunks[chunk].left);
+            if (pos <= leftSize) {
+                auto [before, after] = split(chunks[chunk].left, pos);
+                chunks[chunk].left = after;
+                return {before, update(chunk)};
+            }
+            auto [before, after] = split(chunks[chunk].right, pos - leftSize - chunks[chunk].text.size());
+            chunks[chunk].right = before;
+            return {update(chunk), after};
+        }
+
+        // the start and the end of the chunk that holds the byte at pos
+        std::pair<size_t, size_t> chunkAround(size_t pos) const {
+            uint32_t chunk = root;
+            size_t base = 0;
+            while (true) {
+                const Chunk& c = chunks[chunk];
+                const size_t begin = base + sizeOf(c.left);
+                if (pos < begin) {
+                    chunk = c.left;
+                } else if (pos < begin + c.text.size()) {
+                    return {begin, begin + c.text.size()};
+                } else {
+                    base = begin + c.text.size();
+                    chunk = c.right;
+                }
+            }
+        }
+
+        // appends the text of a subtree to out and frees its chunks
+        void take(uint32_t chunk, std::string& out) {
+            if (chunk == NONE) return;
+            take(chunks[chunk].left, out);
+            out += chunks[chunk].text;
+            take(chunks[chunk].right, out);
+            chunks[chunk].text = std::string();
+            unused.push_back(chunk);
+        }
+
+        void append(uint32_t chunk, size_t base, size_t from, size_t to, std::string& out) const {
+            if (chunk == NONE) return;
+            const Chunk& c = chunks[chunk];
+            const size_t begin = base + sizeOf(c.left);
+            const size_t end = begin + c.text.size();
+            if (from < begin) append(c.left, base, from, to, out);
+            if (from < end && to > begin) out.append(c.text, std::max(from, begin) - begin, std::min(to, end) - std::max(from, begin));
+            if (to > end) append(c.right, end, from, to, out);
+        }
+
+    public:
+        size_t size() const {
+            return sizeOf(root);
+        }
+
+        void replace(size_t offset, size_t length, std::string_view replacement) {
+            // the chunks the range touches are cut again together with their neighbours,
+            // which keeps chunks at least half full unless the whole text is smaller
+            size_t begin = offset > 0 ? chunkAround(offset - 1).first : 0;
+            size_t end = offset + length < size() ? chunkAround(offset + length).second : size();
+            if ((offset - begin) + replacement.size() + (end - offset - length) < CHUNK / 2) {
+                if (begin > 0) begin = chunkAround(begin - 1).first;
+                if (end < size()) end = chunkAround(end).second;
+            }
+
+            auto [left, rest] = split(root, begin);
+            auto [middle, right] = split(rest, end - begin);
+            std::string old;
+            take(middle, old);
+            std::string text = old.substr(0, offset - begin);
+            text += replacement;
+            text.append(old, offset + length - begin);
+
+            const size_t pieces = (text.size() + CHUNK - 1) / CHUNK;
+            uint32_t built = NONE;
+            for (size_t i = 0; i < pieces; i++) {
+                const size_t from = text.size() * i / pieces;
+                const uint32_t chunk = make(text.substr(from, text.size() * (i + 1) / pieces - from));
+                built = merge(built, chunk);
+            }
+            root = merge(merge(left, built), right);
+        }
+
+        // appends the bytes from from up to to to out
+        void copy(size_t from, size_t to, std::string& out) const {
+            if (from < to) append(root, 0, from, to, out);
+        }
+
+        std::string str() const {
+            std::string out;
+            out.reserve(size());
+            copy(0, size(), out);
+            return out;
+        }
+};
+
+// A node of an incrementally maintained tree. Its position is kept by the parent, so
+// a subtree behind an edit is taken over as it is.
+//
+// A right recursive list, A : α A, is not kept as the chain of nodes a full parse
+// builds for it: a LIST node holds the elements in a height balanced tree of SEGMENT
+// nodes, whose leaves hold the α of one element each, and the node the chain ends in
+// as its second child. An edit in a long list builds one path through that tree
+// again instead of every list node in front of the edited element.
+struct IncrementalNode {
+    enum Shape : uint8_t { PLAIN, LIST, SEGMENT };
+
+    Symbol symbol;
+    int32_t state;          // parser state before the node's first token, -1 where that does not apply
+    int32_t rule;           // the rule reduced to the node, for a token its kind
+    uint32_t length;
+    uint32_t tokenCount;
+    uint32_t firstChild;
+    uint32_t childCount;
+    Shape shape;
+    uint8_t height;         // of a segment, 0 for one that holds a single element
+};
+
+// a child with its position from the start of the parent
+struct IncrementalChild {
+    uint32_t node;
+    uint32_t offset;
+};
+
+// Source text with its tokens and parse tree, kept up to date across edits.
+//
+// An edit is lexed again from the first token whose scan may have read an edited
+// byte until the lexer starts a token where it started one before the edit; the
+// tokens from there on are taken over. The parse starts from the stack the last
+// parse had in front of the lexed tokens, which the old tree holds as the left
+// siblings on the way down to them, and shifts subtrees of the old tree as a whole
+// when it is in the state the subtree was built in and neither the subtree's tokens
+// nor the one after it changed. The LR automaton would take the same steps inside
+// the subtree as before, so the tree is the one a full parse builds (Wagner and
+// Graham's condition for state matching).
+//
+// Unlike Parser::parse this does not recover from syntax errors: the tree ends at
+// the first one. The old subtrees behind it are kept for the next edit though, so
+// fixing the error does not parse the rest of the file from scratch.
+//
+// The tokens live in the tree and the text in a TextRope, and lists are balanced, so
+// the work for an edit grows with its size, the nesting depth at the edit and the
+// logarithm of the list lengths, not with the size of the text. Long chains of left
+// associative operators are not balanced and are still built again up to the edit.
+// getText and getTokens build the whole text and token array on their first call
+// after an edit.
+class IncrementalParser {
+    public:
+        struct Stats {
+            size_t relexedTokens = 0;
+            size_t reusedNodes = 0;
+            size_t newNodes = 0;
+        };
+
+    private:
+        static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+        static constexpr size_t LEX_WINDOW = 4096;
+
+        // a node with its start in the text, on the parse stack a segment stands for its elements
+        struct Piece {
+            uint32_t node;
+            uint32_t start;
+        };
+
+        // the tokens of an edit: below prefix and from newSuffix on the old ones, the
+        // latter were at oldSuffix before and moved by delta bytes
+        struct Splice {
+            size_t prefix = 0;
+            size_t oldSuffix = 0;
+            size_t newSuffix = 0;
+            int64_t delta = 0;
+            std::vector<Token> lexed;
+        };
+
+        struct TokenInfo {
+            Symbol symbol;
+            uint32_t kind;
+            uint32_t start;
+            uint32_t length;
+        };
+
+        const Lexer& lexer;
+        Parser parser;
+        std::string fileName;
+        TextRope text;
+        std::vector<Symbol> kindSymbols;
+        size_t lookahead = 1;       // the furthest a scan has read past what it produced, since the last full lex
+
+        std::vector<IncrementalNode> nodes;
+        std::vector<IncrementalChild> children;
+        uint32_t root = NONE;
+        uint32_t reuseRoot = NONE;  // the root, after an error with the old subtrees behind it as further children
+        uint32_t rootStart = 0;     // where both roots start in the text
+        size_t compactedSize = 0;
+        std::vector<std::pair<int, std::vector<Symbol>>> listElements;     // the α of the list rules reduced so far
+
+        bool accepted = false;
+        bool errorAtEnd = false;
+        size_t errorIndex = 0;      // the token the parse stopped at
+        uint32_t errorOffset = 0;
+        int errorState = 0;
+        std::string errorToken;
+        Stats stats;
+
+        mutable std::string textCopy;
+        mutable bool textCopied = false;
+        mutable std::vector<Token> tokenCopy;
+        mutable bool tokensCopied = false;
+
+        // Walks the old tree in token order to find the subtrees starting at a token,
+        // outermost first. Targets only ever grow, so one walk serves a whole parse.
+        class ReuseCursor {
+            public:
+                struct Frame {
+                    uint32_t node;
+                    size_t first;       // token index of the node's first token
+                    uint32_t start;     // position of the node in the old text
+                    uint32_t index;     // position among the parent's children
+                };
+
+            private:
+                const std::vector<IncrementalNode>& nodes;
+                const std::vector<IncrementalChild>& children;
+                std::vector<Frame> path;
+
+                Frame childOf(const Frame& parent, uint32_t index, size_t first) const {
+                    const IncrementalChild child = children[nodes[parent.node].firstChild + index];
+                    return Frame{child.node, first, parent.start + child.offset, index};
+                }
+
+                // moves to the next node in token order that is not inside the current one
+                void next() {
+                    while (!path.empty()) {
+                        Frame done = path.back();
+                        path.pop_back();
+                        if (path.empty()) return;
+
+                        const Frame parent = path.back();
+                        if (done.index + 1 < nodes[parent.node].childCount) {
+                            path.push_back(childOf(parent, done.index + 1, done.first + nodes[done.node].tokenCount));
+                            return;
+                        }
+                    }
+                }
+
+            public:
+                ReuseCursor(const std::vector<IncrementalNode>& nodes, const std::vector<IncrementalChild>& children, uint32_t root, uint32_t start)
+                    : nodes(nodes), children(children) {
+                    if (root != NONE) path.push_back(Frame{root, 0, start, 0});
+                }
+
+                // the outermost node starting at token target, NONE if there is none
+                uint32_t seek(size_t target) {
+                    while (!path.empty()) {
+                        const Frame frame = path.back();
+                        const IncrementalNode& node = nodes[frame.node];
+                        if (node.tokenCount == 0 || frame.first + node.tokenCount <= target) {
+                            next();
+                        } else if (frame.first == target) {
+                            return frame.node;
+                        } else if (frame.first > target || node.childCount == 0) {
+                            return NONE;
+                        } else {
+                            path.push_back(childOf(frame, 0, frame.first));
+                        }
+                    }
+                    return NONE;
+                }
+
+                // the next smaller node starting where the current one does
+                uint32_t descend() {
+                    const Frame frame = path.back();
+                    if (nodes[frame.node].childCount == 0) return NONE;
+                    path.push_back(childOf(frame, 0, frame.first));
+                    return seek(frame.first);
+                }
+
+                // the current node has been taken over
+                void skip() {
+                    next();
+                }
+
+                // the token at index target, which is in the tree
+                Frame token(size_t target) {
+                    for (uint32_t node = seek(target); nodes[node].childCount != 0; node = descend()) {}
+                    return path.back();
+                }
+
+                // the depth of the innermost LIST around the current node, -1 if there is none
+                int listDepth() const {
+                    for (size_t depth = path.size() - 1; depth-- > 0;) {
+                        if (nodes[path[depth].node].shape == IncrementalNode::LIST) return static_cast<int>(depth);
+                    }
+                    return -1;
+                }
+
+                const Frame& at(int depth) const {
+                    return path[depth];
+                }
+
+                // the rest of the node at depth, from the current node on, has been taken over
+                void skipFrom(int depth) {
+                    path.resize(depth + 1);
+                    next();
+                }
+        };
+
+        size_t tokenCount() const {
+            return reuseRoot != NONE ? nodes[reuseRoot].tokenCount : 0;
+        }
+
+        uint32_t endOf(Piece piece) const {
+            return piece.start + nodes[piece.node].length;
+        }
+
+        uint32_t addToken(Symbol symbol, int32_t state, uint32_t kind, uint32_t length) {
+            nodes.push_back(IncrementalNode{symbol, state, static_cast<int32_t>(kind), length, 1, 0, 0, IncrementalNode::PLAIN, 0});
+            stats.newNodes++;
+            return static_cast<uint32_t>(nodes.size() - 1);
+        }
+
+        // appends a node over parts, which start at start unless there are none
+        uint32_t addNode(Symbol symbol, int32_t state, int32_t rule, IncrementalNode::Shape shape, uint8_t height, uint32_t start,
+                         const Piece* parts, size_t count) {
+            const uint32_t firstChild = static_cast<uint32_t>(children.size());
+            uint32_t tokens = 0;
+            uint32_t end = start;
+            for (size_t i = 0; i < count; i++) {
+                children.push_back(IncrementalChild{parts[i].node, parts[i].start - start});
+                tokens += nodes[parts[i].node].tokenCount;
+                end = endOf(parts[i]);
+            }
+            nodes.push_back(IncrementalNode{symbol, state, rule, end - start, tokens, firstChild, static_cast<uint32_t>(count), shape, height});
+            stats.newNodes++;
+            return static_cast<uint32_t>(nodes.size() - 1);
+        }
+
+        std::pair<Piece, Piece> halves(Piece segment) const {
+            const IncrementalNode& node = nodes[segment.node];
+            const IncrementalChild left = children[node.firstChild];
+            const IncrementalChild right = children[node.firstChild + 1];
+            return {Piece{left.node, segment.start + left.offset}, Piece{right.node, segment.start + right.offset}};
+        }
+
+        int heightOf(Piece segment) const {
+            return nodes[segment.node].height;
+        }
+
+        Piece segment(Piece left, Piece right) {
+            const IncrementalNode first = nodes[left.node];
+            const Piece parts[] = {left, right};
+            const uint8_t height = static_cast<uint8_t>(std::max(heightOf(left), heightOf(right)) + 1);
+            return Piece{addNode(first.symbol, first.state, first.rule, IncrementalNode::SEGMENT, height, left.start, parts, 2), left.start};
+        }
+
+        // the elements of both segments in one, balanced again along the seam
+        Piece join(Piece left, Piece right) {
+            if (left.node == NONE) return right;
+            if (right.node == NONE) return left;
+
+            if (heightOf(left) > heightOf(right) + 1) {
+                const auto [outer, inner] = halves(left);
+                const Piece joined = join(inner, right);
+                if (heightOf(joined) <= heightOf(outer) + 1) return segment(outer, joined);
+                const auto [middle, last] = halves(joined);
+                if (heightOf(middle) <= heightOf(last)) return segment(segment(outer, middle), last);
+                const auto [middleLeft, middleRight] = halves(middle);
+                return segment(segment(outer, middleLeft), segment(middleRight, last));
+            }
+            if (heightOf(right) > heightOf(left) + 1) {
+                const auto [inner, outer] = halves(right);
+                const Piece joined = join(left, inner);
+                if (heightOf(joined) <= heightOf(outer) + 1) return segment(joined, outer);
+                const auto [first, middle] = halves(joined);
+                if (heightOf(middle) <= heightOf(first)) return segment(first, segment(middle, outer));
+                const auto [middleLeft, middleRight] = halves(middle);
+                return segment(segment(first, middleLeft), segment(middleRight, outer));
+            }
+            return segment(left, right);
+        }
+
+        // the elements of a segment whose first token is first that end by token at, and the rest
+        std::pair<Piece, Piece> split(Piece segment, size_t first, size_t at) {
+            const Piece none{NONE, 0};
+            if (heightOf(segment) == 0) {
+                return first + nodes[segment.node].tokenCount <= at ? std::pair{segment, none} : std::pair{none, segment};
+            }
+            const auto [left, right] = halves(segment);
+            const size_t middle = first + nodes[left.node].tokenCount;
+            if (at < middle) {
+                const auto [before, after] = split(left, first, at);
+                return {before, join(after, right)};
+            }
+            const auto [before, after] = split(right, middle, at);
+            return {join(left, before), after};
+        }
+
+        // the segment without its last element, and that element
+        std::pair<Piece, Piece> splitLast(Piece segment) {
+            if (heightOf(segment) == 0) return {Piece{NONE, 0}, segment};
+            const auto [left, right] = halves(segment);
+            const auto [rest, last] = splitLast(right);
+            return {join(left, rest), last};
+        }
+
+        Piece build(const std::vector<Piece>& elements, size_t from, size_t to) {
+            if (to - from == 1) return elements[from];
+            const size_t middle = from + (to - from) / 2;
+            return segment(build(elements, from, middle), build(elements, middle, to));
+        }
+
+        // the symbols of the elements of a segment
+        std::vector<Symbol> elementOf(uint32_t segment) const {
+            while (nodes[segment].height != 0) segment = children[nodes[segment].firstChild].node;
+            std::vector<Symbol> symbols;
+            const IncrementalNode& leaf = nodes[segment];
+            for (uint32_t i = 0; i < leaf.childCount; i++) symbols.push_back(nodes[children[leaf.firstChild + i].node].symbol);
+            return symbols;
+        }
+
+        // the state the automaton is in after an element that starts in state, -1 if it does not take it
+        int afterElement(int state, const std::vector<Symbol>& element) const {
+            const ParserTables& table = parser.getTables();
+            for (Symbol symbol : element) {
+                if (state < 0) return -1;
+                if (symbol < table.terminalCount()) {
+                    const LRAction action = table.action(state, symbol);
+                    state = action.kind() == LRAction::SHIFT ? action.value() : -1;
+                } else {
+                    state = table.goTo(state, symbol);
+                }
+            }
+            return state;
+        }
+
+        static bool isRun(const std::vector<IncrementalNode>& nodes, Piece entry) {
+            return nodes[entry.node].shape == IncrementalNode::SEGMENT;
+        }
+
+        // Replaces the run at position of the stack with the run without its last
+        // element and the entries of that element.
+        void expandRun(std::vector<Piece>& stack, std::vector<int>& states, size_t position) {
+            const auto [rest, last] = splitLast(stack[position]);
+            const IncrementalNode leaf = nodes[last.node];
+            std::vector<Piece> entries;
+            std::vector<int> after;
+            if (rest.node != NONE) {
+                entries.push_back(rest);
+                after.push_back(leaf.state);
+            }
+            for (uint32_t i = 0; i < leaf.childCount; i++) {
+                const IncrementalChild child = children[leaf.firstChild + i];
+                entries.push_back(Piece{child.node, last.start + child.offset});
+                after.push_back(i + 1 < leaf.childCount ? nodes[children[leaf.firstChild + i + 1].node].state : states[position + 1]);
+            }
+            stack.erase(stack.begin() + position);
+            stack.insert(stack.begin() + position, entries.begin(), entries.end());
+            states.erase(states.begin() + position + 1);
+            states.insert(states.begin() + position + 1, after.begin(), after.end());
+        }
+
+        // Reduces rule, whose last symbol is its nonterminal, as often in a row as the
+        // automaton would: the list's elements below the top of the stack are taken while
+        // each one is the rule's α and the state on top of it reduces the rule again. The
+        // elements go into a LIST node, runs of them as a whole after one check of the
+        // states a run can leave. False when only one element would be reduced.
+        bool reduceList(int rule, size_t length, Symbol lookahead, std::vector<Piece>& stack, std::vector<int>& states) {
+            const ParserTables& table = parser.getTables();
+            const Symbol nonterminal = table.ruleNonterminal(rule);
+            const size_t width = length - 1;
+            const size_t top = stack.size() - 1;
+
+            std::vector<Symbol> element;
+            if (isRun(nodes, stack[top - 1])) {
+                if (nodes[stack[top - 1].node].rule != rule) return false;
+                element = elementOf(stack[top - 1].node);
+                if (element.size() != width) return false;
+            } else {
+                if (top < width) return false;
+                for (size_t i = top - width; i < top; i++) {
+                    if (isRun(nodes, stack[i])) return false;
+                    element.push_back(nodes[stack[i].node].symbol);
+                }
+            }
+
+            auto reducesAfter = [&](int state) {
+                if (state < 0) return false;
+                const int next = table.goTo(state, nonterminal);
+                if (next < 0) return false;
+                const LRAction action = table.action(next, lookahead);
+                return action.kind() == LRAction::REDUCE && action.value() == rule;
+            };
+            // the states after the elements of a run follow from the one before it
+            auto runReduces = [&](size_t position) {
+                int state = states[position];
+                for (int step = 0; step < 16; step++) {
+                    state = afterElement(state, element);
+                    if (!reducesAfter(state)) return false;
+                    if (state == states[position + 1] && afterElement(state, element) == state) return true;
+                }
+                return false;
+            };
+
+            size_t bottom = top;
+            while (bottom > 0) {
+                if (isRun(nodes, stack[bottom - 1])) {
+                    if (nodes[stack[bottom - 1].node].rule != rule || !runReduces(bottom - 1)) break;
+                    bottom--;
+                    continue;
+                }
+                if (bottom < width || !reducesAfter(states[bottom])) break;
+                bool matches = true;
+                for (size_t i = 0; i < width && matches; i++) {
+                    matches = !isRun(nodes, stack[bottom - width + i]) && nodes[stack[bottom - width + i].node].symbol == element[i];
+                }
+                if (!matches) break;
+                bottom -= width;
+            }
+
+            const Piece tail = stack[top];
+            const IncrementalNode last = nodes[tail.node];
+            const bool tailIsList = last.rule == rule && (last.shape == IncrementalNode::LIST || last.childCount == length);
+            if (bottom == top || (bottom + width == top && !isRun(nodes, stack[bottom]) && !tailIsList)) return false;
+
+            Piece elements{NONE, 0};
+            std::vector<Piece> leaves;
+            auto flush = [&] {
+                if (!leaves.empty()) elements = join(elements, build(leaves, 0, leaves.size()));
+                leaves.clear();
+            };
+            for (size_t i = bottom; i < top;) {
+                if (isRun(nodes, stack[i])) {
+                    flush();
+                    elements = join(elements, stack[i]);
+                    i++;
+                } else {
+                    leaves.push_back(Piece{addNode(nonterminal, states[i], rule, IncrementalNode::SEGMENT, 0, stack[i].start, &stack[i], width), stack[i].start});
+                    i += width;
+                }
+            }
+
+            Piece end = tail;
+            if (last.shape == IncrementalNode::LIST && last.rule == rule) {
+                const auto [rest, inner] = halves(tail);
+                flush();
+                elements = join(elements, rest);
+                end = inner;
+            } else if (tailIsList) {
+                std::vector<Piece> parts;
+                for (uint32_t i = 0; i < last.childCount; i++) {
+                    const IncrementalChild child = children[last.firstChild + i];
+                    parts.push_back(Piece{child.node, tail.start + child.offset});
+                }
+                leaves.push_back(Piece{addNode(nonterminal, last.state, rule, IncrementalNode::SEGMENT, 0, tail.start, parts.data(), width), tail.start});
+                end = parts.back();
+            }
+            flush();
+
+            const Piece parts[] = {elements, end};
+            const uint32_t list = addNode(nonterminal, states[bottom], rule, IncrementalNode::LIST, 0, elements.start, parts, 2);
+            stack.resize(bottom);
+            states.resize(bottom + 1);
+            stack.push_back(Piece{list, elements.start});
+            states.push_back(table.goTo(states.back(), nonterminal));
+
+            if (std::none_of(listElements.begin(), listElements.end(), [&](const auto& known) { return known.first == rule; })) {
+                listElements.emplace_back(rule, element);
+            }
+            return true;
+        }
+
+        void reduce(int rule, size_t length, const TokenInfo& token, std::vector<Piece>& stack, std::vector<int>& states) {
+            const ParserTables& table = parser.getTables();
+            const Symbol nonterminal = table.ruleNonterminal(rule);
+            if (length >= 2 && !isRun(nodes, stack.back()) && nodes[stack.back().node].symbol == nonterminal
+                && reduceList(rule, length, token.symbol, stack, states)) {
+                return;
+            }
+
+            // a reduction that ends inside a run takes its elements out one by one
+            for (size_t i = stack.size(); i > 0 && i + length > stack.size();) {
+                if (isRun(nodes, stack[--i])) {
+                    expandRun(stack, states, i);
+                    i = stack.size();
+                }
+            }
+
+            const size_t first = stack.size() - length;
+            const uint32_t start = length != 0 ? stack[first].start : token.start;
+            const uint32_t node = addNode(nonterminal, states[first], rule, IncrementalNode::PLAIN, 0, start, stack.data() + first, length);
+            stack.resize(first);
+            states.resize(first + 1);
+            stack.push_back(Piece{node, start});
+            states.push_back(table.goTo(states.back(), nonterminal));
+        }
+
+        // Before the stack becomes the root's children at a syntax error, the elements of
+        // lists on it are put into runs, so the next parse gets them back in one piece.
+        std::vector<Piece> compressStack(const std::vector<Piece>& stack, const std::vector<int>& states) {
+            std::vector<Piece> compressed;
+            for (size_t i = 0; i < stack.size();) {
+                auto matchesAt = [&](size_t at, const std::vector<Symbol>& element) {
+                    if (at + element.size() > stack.size()) return false;
+                    for (size_t k = 0; k < element.size(); k++) {
+                        if (isRun(nodes, stack[at + k]) || nodes[stack[at + k].node].symbol != element[k]) return false;
+                    }
+                    return true;
+                };
+
+                bool grouped = false;
+                for (const auto& [rule, element] : listElements) {
+                    if (!matchesAt(i, element) || !matchesAt(i + element.size(), element)) continue;
+                    std::vector<Piece> leaves;
+                    const Symbol nonterminal = parser.getTables().ruleNonterminal(rule);
+                    for (; matchesAt(i, element); i += element.size()) {
+                        leaves.push_back(Piece{addNode(nonterminal, states[i], rule, IncrementalNode::SEGMENT, 0, stack[i].start, &stack[i], element.size()), stack[i].start});
+                    }
+                    Piece run = build(leaves, 0, leaves.size());
+                    if (!compressed.empty() && isRun(nodes, compressed.back()) && nodes[compressed.back().node].rule == rule) {
+                        run = join(compressed.back(), run);
+                        compressed.pop_back();
+                    }
+                    compressed.push_back(run);
+                    grouped = true;
+                    break;
+                }
+                if (!grouped) compressed.push_back(stack[i++]);
+            }
+            return compressed;
+        }
+
+        // Puts the stack the last parse had in front of token prefix - 1 on stack: the
+        // left siblings on the way from the root to that token, with the elements of
+        // lists joined into runs. Returns the index of the token the parse goes on at.
+        size_t restoreStack(size_t prefix, std::vector<Piece>& stack, std::vector<int>& states) {
+            if (root == NONE || prefix == 0) return 0;
+            const size_t at = prefix - 1;
+
+            Piece run{NONE, 0};
+            auto push = [&](Piece piece) {
+                if (isRun(nodes, piece)) {
+                    run = join(run, piece);
+                    return;
+                }
+                if (run.node != NONE) stack.push_back(run);
+                run.node = NONE;
+                stack.push_back(piece);
+            };
+
+            size_t resume = errorIndex;
+            int last = errorState;
+            if (!accepted && at >= errorIndex) {
+                // the root's children are the stack at the error, the parse stops there again
+                const IncrementalNode top = nodes[root];
+                for (uint32_t i = 0; i < top.childCount; i++) {
+                    push(Piece{children[top.firstChild + i].node, rootStart + children[top.firstChild + i].offset});
+                }
+            } else {
+                uint32_t id = root;
+                uint32_t start = rootStart;
+                size_t first = 0;
+                while (nodes[id].childCount != 0) {
+                    const IncrementalNode node = nodes[id];
+                    uint32_t next = NONE;
+                    for (uint32_t i = 0; i < node.childCount && next == NONE; i++) {
+                        const IncrementalChild child = children[node.firstChild + i];
+                        const size_t tokens = nodes[child.node].tokenCount;
+                        if (first + tokens > at) {
+                            next = child.node;
+                            start += child.offset;
+                        } else {
+                            push(Piece{child.node, start + child.offset});
+                            first += tokens;
+                        }
+                    }
+                    id = next;
+                }
+                resume = at;
+                last = nodes[id].state;
+            }
+            if (run.node != NONE) stack.push_back(run);
+
+            states.assign(1, 0);
+            for (size_t i = 1; i < stack.size(); i++) states.push_back(nodes[stack[i].node].state);
+            if (!stack.empty()) states.push_back(last);
+            if ((stack.empty() ? last : nodes[stack.front().node].state) != 0) {
+                stack.clear();
+                states.assign(1, 0);
+                return 0;
+            }
+            return resume;
+        }
+
+        // The largest old subtree starting at token at whose tokens and following token
+        // are unchanged, and which was built in state unless that is -1. Inside a list
+        // that is the rest of the list from the element at the token on, as a new LIST.
+        uint32_t findReusable(size_t at, int state, const Splice& splice, ReuseCursor& cursor) {
+            size_t old;
+            size_t limit;
+            if (at < splice.prefix) {
+                old = at;
+                limit = splice.prefix - 1;
+            } else if (at >= splice.newSuffix) {
+                old = at - splice.newSuffix + splice.oldSuffix;
+                limit = std::numeric_limits<size_t>::max();
+            } else {
+                return NONE;
+            }
+
+            bool inList = false;
+            for (uint32_t id = cursor.seek(old); id != NONE; id = cursor.descend()) {
+                const IncrementalNode node = nodes[id];
+                if (node.shape != IncrementalNode::SEGMENT) {
+                    if ((state < 0 || node.state == state) && old + node.tokenCount <= limit) {
+                        cursor.skip();
+                        return id;
+                    }
+                    continue;
+                }
+                if (inList) continue;
+                inList = true;
+
+                const int depth = cursor.listDepth();
+                if (depth < 0) continue;
+                const ReuseCursor::Frame frame = cursor.at(depth);
+                const IncrementalNode list = nodes[frame.node];
+                if (frame.first == old || (state >= 0 && node.state != state) || frame.first + list.tokenCount > limit) continue;
+
+                const IncrementalChild elements = children[list.firstChild];
+                const IncrementalChild end = children[list.firstChild + 1];
+                const Piece parts[] = {split(Piece{elements.node, frame.start + elements.offset}, frame.first, old).second, Piece{end.node, frame.start + end.offset}};
+                const uint32_t rest = addNode(list.symbol, node.state, list.rule, IncrementalNode::LIST, 0, parts[0].start, parts, 2);
+                cursor.skipFrom(depth);
+                return rest;
+            }
+            return NONE;
+        }
+
+        // the number of tokens that end at or before bound
+        size_t tokensEndingBy(size_t bound) const {
+            if (reuseRoot == NONE) return 0;
+            size_t count = 0;
+            uint32_t id = reuseRoot;
+            size_t start = rootStart;
+            while (true) {
+                const IncrementalNode& node = nodes[id];
+                if (node.childCount == 0) return count + (node.tokenCount == 1 && start + node.length <= bound ? 1 : 0);
+
+                uint32_t next = NONE;
+                for (uint32_t i = 0; i < node.childCount; i++) {
+                    const IncrementalChild child = children[node.firstChild + i];
+                    const IncrementalNode& inner = nodes[child.node];
+                    if (start + child.offset + inner.length <= bound) {
+                        count += inner.tokenCount;
+                    } else {
+                        if (inner.tokenCount != 0) next = child.node;
+                        start += child.offset;
+                        break;
+                    }
+                }
+                if (next == NONE) return count;
+                id = next;
+            }
+        }
+
+        // Lexes the text from pos into lexed. Past syncAfter, lexing stops at the first
+        // token that starts where token old did before the text moved by delta, for
+        // some old from oldFrom on, and returns that old; the old token count if it never does.
+        size_t lexFrom(size_t pos, size_t syncAfter, size_t oldFrom, int64_t delta, std::vector<Token>& lexed) {
+            const LexerDfa& dfa = lexer.getDfa();
+            const size_t size = text.size();
+            const size_t oldCount = tokenCount();
+            ReuseCursor oldTokens(nodes, children, reuseRoot, rootStart);
+            const bool whole = pos == 0;
+            size_t old = oldFrom;
+            size_t furthest = 1;
+
+            // the text from the byte before pos on, as far as the scans read it
+            const size_t base = pos > 0 ? pos - 1 : 0;
+            std::string window;
+            text.copy(base, std::min(size, pos + LEX_WINDOW), window);
+
+            while (pos < size) {
+                if (pos > syncAfter) {
+                    const uint64_t oldPos = static_cast<uint64_t>(static_cast<int64_t>(pos) - delta);
+                    while (old < oldCount && oldTokens.token(old).start < oldPos) old++;
+                    if (old < oldCount && oldTokens.token(old).start == oldPos) {
+                        lookahead = std::max(lookahead, furthest);
+                        return old;
+                    }
+                }
+
+                // the window grows when a scan reaches its end before the text's
+                auto grow = [&] { text.copy(base + window.size(), std::min(size, base + 2 * window.size() + LEX_WINDOW), window); };
+                if (pos - base >= window.size()) grow();
+
+                size_t length;
+                size_t scanEnd;
+                bool truncated;
+                int kind = dfa.match(window.data(), window.size(), pos - base, length, truncated, scanEnd);
+                if (truncated && base + window.size() < size) {
+                    grow();
+                    continue;
+                }
+                scanEnd += base;
+
+                if (kind >= 0) {
+                    lexed.push_back(Token{static_cast<uint32_t>(kind), static_cast<uint32_t>(pos), static_cast<uint32_t>(length)});
+                    furthest = std::max(furthest, scanEnd - (pos + length));
+                    pos += length;
+                } else {
+                    //ignore or handle errors
+                    furthest = std::max(furthest, scanEnd - pos);
+                    pos++;
+                }
+            }
+
+            // a pass over the whole text sees every scan, so a long one from earlier text can be forgotten
+            lookahead = whole ? furthest : std::max(lookahead, furthest);
+            return oldCount;
+        }
+
+        // Parses the tokens of splice into new nodes appended to the store, from the
+        // stack the last parse had in front of them.
+        void parse(const Splice& splice) {
+            const ParserTables& table = parser.getTables();
+            const size_t count = tokenCount() - (splice.oldSuffix - splice.prefix) + splice.lexed.size();
+            ReuseCursor cursor(nodes, children, reuseRoot, rootStart);
+            ReuseCursor oldTokens(nodes, children, reuseRoot, rootStart);
+
+            auto tokenAt = [&](size_t index) -> TokenInfo {
+                if (index >= count) return TokenInfo{END_SYMBOL, 0, static_cast<uint32_t>(text.size()), 0};
+                if (index >= splice.prefix && index < splice.newSuffix) {
+                    const Token& token = splice.lexed[index - splice.prefix];
+                    return TokenInfo{kindSymbols[token.kind], token.kind, token.offset, token.length};
+                }
+                const bool moved = index >= splice.newSuffix;
+                const ReuseCursor::Frame leaf = oldTokens.token(moved ? index - splice.newSuffix + splice.oldSuffix : index);
+                const IncrementalNode& node = nodes[leaf.node];
+                return TokenInfo{node.symbol, static_cast<uint32_t>(node.rule), static_cast<uint32_t>(leaf.start + (moved ? splice.delta : 0)), node.length};
+            };
+
+            std::vector<Piece> stack;
+            std::vector<int> states = {0};
+            size_t index = restoreStack(splice.prefix, stack, states);
+            TokenInfo token = tokenAt(index);
+            LRAction action = table.action(states.back(), token.symbol);
+
+            while (action.kind() == LRAction::SHIFT || action.kind() == LRAction::REDUCE) {
+                const bool isReduce = action.kind() == LRAction::REDUCE;
+                const size_t length = isReduce ? table.ruleLength(action.value()) : 0;
+
+                // a shift or an empty reduction starts a node at the next token
+                uint32_t reused = isReduce && length != 0 ? NONE : findReusable(index, states.back(), splice, cursor);
+                if (reused != NONE) {
+                    const IncrementalNode& node = nodes[reused];
+                    stack.push_back(Piece{reused, token.start});
+                    states.push_back(node.symbol < table.terminalCount() ? action.value() : table.goTo(states.back(), node.symbol));
+                    index += node.tokenCount;
+                    stats.reusedNodes++;
+                    token = tokenAt(index);
+                } else if (!isReduce) {
+                    stack.push_back(Piece{addToken(token.symbol, states.back(), token.kind, token.length), token.start});
+                    states.push_back(action.value());
+                    index++;
+                    token = tokenAt(index);
+                } else {
+                    reduce(action.value(), length, token, stack, states);
+                }
+
+                action = table.action(states.back(), token.symbol);
+            }
+
+            accepted = action.kind() == LRAction::ACCEPT;
+            errorAtEnd = !accepted && index >= count;
+            errorIndex = index;
+            errorState = states.back();
+            if (!accepted) {
+                errorOffset = token.start;
+                errorToken.clear();
+                if (index < count) text.copy(token.start, token.start + token.length, errorToken);
+                else errorToken = "$";
+                stack = compressStack(stack, states);
+            }
+
+            // as in Parser::parse the root covers whatever is on the stack, it is never taken over
+            rootStart = stack.empty() ? token.start : stack.front().start;
+            root = addNode(table.axiom(), -1, -1, IncrementalNode::PLAIN, 0, rootStart, stack.data(), stack.size());
+            reuseRoot = root;
+            if (index >= count) return;
+
+            // the tokens from the error on, as old subtrees where possible, follow the root's children
+            std::vector<Piece> all = stack;
+            for (size_t at = index; at < count;) {
+                const TokenInfo next = tokenAt(at);
+                uint32_t node = findReusable(at, -1, splice, cursor);
+                if (node == NONE) node = addToken(next.symbol, -1, next.kind, next.length);
+                all.push_back(Piece{node, next.start});
+                at += nodes[node].tokenCount;
+            }
+            reuseRoot = addNode(table.axiom(), -1, -1, IncrementalNode::PLAIN, 0, rootStart, all.data(), all.size());
+        }
+
+        // Copies the nodes reachable from the roots to new arrays once the store has
+        // grown to twice its size after the last copy, so an edit costs amortized
+        // constant time for the nodes it drops.
+        void compactIfNeeded() {
+            if (nodes.size() < 2 * compactedSize + 4096) return;
+
+            std::vector<IncrementalNode> liveNodes;
+            std::vector<IncrementalChild> liveChildren;
+            std::vector<std::pair<uint32_t, uint32_t>> stack = {{reuseRoot, 0}};
+            std::vector<uint32_t> built;
+
+            while (!stack.empty()) {
+                auto& [id, next] = stack.back();
+                const IncrementalNode& node = nodes[id];
+                if (next < node.childCount) {
+                    uint32_t child = children[node.firstChild + next++].node;
+                    stack.emplace_back(child, 0);
+                    continue;
+                }
+
+                IncrementalNode copy = node;
+                copy.firstChild = static_cast<uint32_t>(liveChildren.size());
+                for (uint32_t i = 0; i < node.childCount; i++) {
+                    liveChildren.push_back(IncrementalChild{built[built.size() - node.childCount + i], children[node.firstChild + i].offset});
+                }
+                built.resize(built.size() - node.childCount);
+                built.push_back(static_cast<uint32_t>(liveNodes.size()));
+                liveNodes.push_back(copy);
+                stack.pop_back();
+            }
+
+            // the root's children are the first ones of the reuse root's
+            IncrementalNode top = nodes[root];
+            const bool separate = root != reuseRoot;
+            nodes = std::move(liveNodes);
+            children = std::move(liveChildren);
+            reuseRoot = built.back();
+            root = reuseRoot;
+            if (separate) {
+                top.firstChild = nodes[reuseRoot].firstChild;
+                root = static_cast<uint32_t>(nodes.size());
+                nodes.push_back(top);
+            }
+            compactedSize = nodes.size();
+        }
+
+    public:
+        IncrementalParser(const Lexer& lexer, const Parser& parser, std::string fileName, std::string text = "")
+            : lexer(lexer), parser(parser), fileName(std::move(fileName)) {
+            for (const std::string& kind : lexer.getTokenTypes()) {
+                Symbol symbol = parser.getTables().findTerminal(kind);
+                kindSymbols.push_back(symbol >= 0 ? symbol : EPSILON_SYMBOL);
+            }
+            edit(0, 0, text);
+        }
+
+        // Replaces length bytes at offset with replacement and brings the tokens and
+        // the tree up to date.
+        void edit(size_t offset, size_t length, std::string_view replacement) {
+            if (offset > text.size() || length > text.size() - offset) throw std::out_of_range("edit outside of the text");
+            if (text.size() - length + replacement.size() > UINT32_MAX) throw std::length_error("source files are limited to 4 GiB");
+
+            stats = Stats();
+            textCopied = tokensCopied = false;
+            Splice splice;
+            splice.delta = static_cast<int64_t>(replacement.size()) - static_cast<int64_t>(length);
+
+            // tokens whose scans ended before the edit stay, lexing starts again behind them
+            splice.prefix = offset >= lookahead ? tokensEndingBy(offset - lookahead) : 0;
+            size_t restart = 0;
+            if (splice.prefix > 0) {
+                const ReuseCursor::Frame last = ReuseCursor(nodes, children, reuseRoot, rootStart).token(splice.prefix - 1);
+                restart = last.start + nodes[last.node].length;
+            }
+
+            text.replace(offset, length, replacement);
+            splice.oldSuffix = lexFrom(restart, offset + replacement.size(), splice.prefix, splice.delta, splice.lexed);
+            splice.newSuffix = splice.prefix + splice.lexed.size();
+            stats.relexedTokens = splice.lexed.size();
+
+            parse(splice);
+            compactIfNeeded();
+        }
+
+        const std::string& getText() const {
+            if (!textCopied) {
+                textCopy = text.str();
+                textCopied = true;
+            }
+            return textCopy;
+        }
+
+        const std::vector<Token>& getTokens() const {
+            if (tokensCopied) return tokenCopy;
+            tokenCopy.clear();
+            std::vector<std::pair<uint32_t, uint32_t>> stack = {{reuseRoot, rootStart}};
+            while (!stack.empty()) {
+                const auto [id, start] = stack.back();
+                stack.pop_back();
+                const IncrementalNode& node = nodes[id];
+                if (node.childCount == 0 && node.tokenCount == 1) tokenCopy.push_back(Token{static_cast<uint32_t>(node.rule), start, node.length});
+                for (uint32_t i = node.childCount; i-- > 0;) {
+                    stack.emplace_back(children[node.firstChild + i].node, start + children[node.firstChild + i].offset);
+                }
+            }
+            tokensCopied = true;
+            return tokenCopy;
+        }
+
+        bool isAccepted() const {
+            return accepted;
+        }
+
+        // true when the text is a valid beginning of a program that has not ended yet
+        bool isIncomplete() const {
+            return errorAtEnd;
+        }
+
+        const Stats& getStats() const {
+            return stats;
+        }
+
+        // the first syntax error in the format of Parser::parse, empty if the text was accepted
+        std::string getDiagnostic() const {
+            if (accepted) return "";
+            const std::string& text = getText();
+            const int line = static_cast<int>(std::count(text.begin(), text.begin() + errorOffset, '\n')) + 1;
+            size_t lineStart = 0;
+            if (errorOffset > 0 && text.rfind('\n', errorOffset - 1) != std::string::npos) lineStart = text.rfind('\n', errorOffset - 1) + 1;
+            const size_t column = errorOffset - lineStart + 1;
+            return fileName + ":" + std::to_string(line) + ":" + std::to_string(column) + ": SyntaxError: " + parser.retrieveMessage(errorState, errorToken);
+        }
+
+        // the tree with absolute offsets, as Parser::parse would have built it from the
+        // text up to the first syntax error; lists get their chain of nodes back
+        ParseTree toParseTree() const {
+            ParseTree tree(tokenCount() * 2 + 1);
+            auto source = std::make_shared<const std::string>(getText());
+
+            struct Frame {
+                uint32_t node;
+                uint32_t start;
+                uint32_t next;
+                size_t built;           // entries of built before the node's children
+                size_t elements;        // entries of elementStarts before a list's elements
+            };
+            std::vector<Frame> stack = {{root, rootStart, 0, 0, 0}};
+            std::vector<uint32_t> built;
+            std::vector<uint32_t> elementStarts;
+
+            auto emit = [&](Symbol symbol, uint32_t start, uint32_t length, size_t childCount) {
+                const uint32_t firstChild = static_cast<uint32_t>(tree.children.size());
+                tree.children.insert(tree.children.end(), built.end() - childCount, built.end());
+                built.resize(built.size() - childCount);
+                built.push_back(static_cast<uint32_t>(tree.nodes.size()));
+                tree.nodes.push_back(TreeNode{symbol, start, length, firstChild, static_cast<uint32_t>(childCount)});
+            };
+
+            while (!stack.empty()) {
+                Frame& frame = stack.back();
+                const IncrementalNode& node = nodes[frame.node];
+                if (frame.next < node.childCount) {
+                    const IncrementalChild child = children[node.firstChild + frame.next++];
+                    const uint32_t start = frame.start + child.offset;
+                    if (nodes[child.node].shape == IncrementalNode::SEGMENT && nodes[child.node].height == 0) elementStarts.push_back(start);
+                    stack.push_back(Frame{child.node, start, 0, built.size(), elementStarts.size()});
+                    continue;
+                }
+
+                const Frame done = frame;
+                stack.pop_back();
+                if (node.shape == IncrementalNode::SEGMENT) continue;     // its entries stay for the node above
+                if (node.shape == IncrementalNode::PLAIN) {
+                    emit(node.symbol, done.start, node.length, built.size() - done.built);
+                    continue;
+                }
+
+                // built holds the entries of every element and then the end of the list,
+                // the chain is built from the inside out
+                const uint32_t end = done.start + node.length;
+                const size_t elements = elementStarts.size() - done.elements;
+                const size_t width = (built.size() - done.built - 1) / elements;
+                for (size_t i = elements; i-- > 0;) {
+                    const uint32_t start = elementStarts[done.elements + i];
+                    emit(node.symbol, start, end - start, width + 1);
+                }
+                elementStarts.resize(done.elements);
+            }
+
+            tree.root = built.back();
+            tree.tables = parser.getSharedTables();
+            tree.storage = source;
+            tree.text = *source;
+            tree.accepted = accepted;
+            return tree;
+        }
+};
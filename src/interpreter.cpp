@@ -0,0 +1,323 @@
+#include "interpreter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string_view>
+#include "jit.h"
+
+// registers for all frames together and the calls that can be open at once, deeper
+// recursion is a RuntimeError; a task without registers does not use up any slots, so
+// the depth is bounded on its own
+static constexpr size_t STACK_SLOTS = 1 << 20;
+static constexpr size_t MAX_FRAMES = 1 << 18;
+
+// calls and loop iterations after which a task is compiled, they take about as long as
+// compiling it does
+static constexpr int64_t HOT_TASK = 10000;
+
+// machine stack the frames of native tasks may take below the call that enters them,
+// deeper recursion is a RuntimeError like it is for interpreted frames
+static constexpr uintptr_t NATIVE_STACK = 1 << 22;
+
+#if defined(__GNUC__) && !defined(BABEL_SWITCH_DISPATCH)
+#define BABEL_THREADED_DISPATCH
+#endif
+
+// An error in flight is the index of its kind in the program's errors, with the reason it
+// was raised in the high 32 bits, which is what it says when nothing catches it.
+enum Reason : int64_t { RAISED, DIVISION_BY_ZERO, STACK_OVERFLOW };
+static const char* const reasons[] = {"raised and not caught", "integer division by zero", "stack overflow"};
+
+static int64_t runtimeError(Reason reason) {
+    return BytecodeProgram::RUNTIME_ERROR | reason << 32;
+}
+
+// native code raises a division by zero or a stack overflow by throwing the RuntimeError
+// from babelDivisionByZero or babelStackOverflow, which ends with the reason
+static bool callNative(BytecodeTask& task, Slot* registers, int64_t& error) {
+    char frame;
+    babelStackLimit = reinterpret_cast<uintptr_t>(&frame) - NATIVE_STACK;
+    try {
+        task.native(registers);
+        return true;
+    } catch (const std::runtime_error& e) {
+        error = runtimeError(std::string_view(e.what()).ends_with(reasons[STACK_OVERFLOW]) ? STACK_OVERFLOW : DIVISION_BY_ZERO);
+        return false;
+    }
+}
+
+// ints wrap around like they do in the generated code
+static int64_t wrap(uint64_t value) {
+    return static_cast<int64_t>(value);
+}
+
+// // and % on ints round towards negative infinity, as they do on floats; right is not zero
+static int64_t floorDivision(int64_t left, int64_t right, bool modulo) {
+    if (right == -1) return modulo ? 0 : wrap(0 - static_cast<uint64_t>(left));
+    int64_t quotient = left / right;
+    int64_t remainder = left % right;
+    if (remainder != 0 && (remainder ^ right) < 0) {
+        quotient--;
+        remainder += right;
+    }
+    return modulo ? remainder : quotient;
+}
+
+BabelInterpreter::BabelInterpreter() : stack(new Slot[STACK_SLOTS]) {}
+
+BabelInterpreter::~BabelInterpreter() = default;
+
+bool BabelInterpreter::run(std::vector<std::unique_ptr<BaseAST>>& statements, bool echo) {
+    ProgramTypes checked = checkProgram(statements, types);
+
+    std::unique_ptr<BytecodeTask> main = compileBytecode(program, statements, "__anon_expr." + std::to_string(runCount++), echo);
+    if (!main) return false;
+    types = std::move(checked);
+    globals.resize(program.globalIndex.size(), Slot{.i = 0});
+
+    definitions.resize(program.tasks.size());
+    for (std::unique_ptr<BaseAST>& statement : statements) {
+        if (auto* task = dynamic_cast<TaskAST*>(statement.get())) definitions[program.taskIndex.at(task->getHeader().getName())] = std::move(statement);
+    }
+    std::erase(statements, nullptr);
+
+    execute(*main);
+    return true;
+}
+
+void BabelInterpreter::uncaught(int64_t error) const {
+    throw std::runtime_error(program.errors[error & 0xFFFFFFFF] + ": " + reasons[error >> 32]);
+}
+
+// The hot task is compiled with the tasks it calls that are not native yet, in the order
+// they were defined, since codegen needs a task before its calls. It is only tried once.
+void BabelInterpreter::promote(BytecodeTask& hot) {
+    hot.promotable = false;
+
+    std::vector<bool> seen(program.tasks.size());
+    std::vector<int> work = {program.taskIndex.at(hot.name)};
+    std::vector<int> batch;
+    while (!work.empty()) {
+        const int index = work.back();
+        work.pop_back();
+        const BytecodeTask& task = *program.tasks[index];
+        if (seen[index] || task.native) continue;
+        seen[index] = true;
+
+        if (!task.handlers.empty()) return;
+        for (const Instruction& instruction : task.code) {
+            if (instruction.op == Opcode::GETGLOBAL || instruction.op == Opcode::SETGLOBAL || instruction.op == Opcode::RAISE) return;
+            if (instruction.op == Opcode::CALL) work.push_back(instruction.b);
+        }
+        batch.push_back(index);
+    }
+    std::sort(batch.begin(), batch.end());
+
+    std::vector<TaskAST*> tasks;
+    for (int index : batch) tasks.push_back(static_cast<TaskAST*>(definitions[index].get()));
+    try {
+        if (!jit) jit = std::make_unique<BabelJIT>();
+        const std::vector<void (*)(void*)> entries = jit->compileTasks(tasks, native);
+        for (size_t i = 0; i < batch.size(); i++) {
+            BytecodeTask& task = *program.tasks[batch[i]];
+            task.native = entries[i];
+            native.tasks[task.name] = types.tasks.at(task.name);
+        }
+    } catch (const std::runtime_error&) {
+        // the tasks stay interpreted
+    }
+}
+
+void BabelInterpreter::execute(BytecodeTask& main) {
+    struct Frame {
+        BytecodeTask* task;
+        const Instruction* ip;
+        Slot* base;
+    };
+    std::vector<Frame> frames;
+
+    BytecodeTask* task = &main;
+    const Instruction* code = task->code.data();
+    const Instruction* ip = code;
+    const Slot* constants = task->constants.data();
+    Slot* base = stack.get();
+    Slot* const stackEnd = stack.get() + STACK_SLOTS;
+    Slot* const globalSlots = globals.data();
+    if (base + task->registers > stackEnd) uncaught(runtimeError(STACK_OVERFLOW));
+    Instruction in{};
+    int64_t error = 0;
+
+#ifdef BABEL_THREADED_DISPATCH
+    // the code of a task is threaded the first time it runs, every instruction gets the
+    // address of its handler, so dispatch is one indirect jump
+    static const void* const labels[] = {
+#define BABEL_OPCODE_LABEL(name) &&op_##name,
+        BABEL_OPCODES(BABEL_OPCODE_LABEL)
+#undef BABEL_OPCODE_LABEL
+    };
+    auto thread = [](BytecodeTask& t) {
+        if (!t.threaded.empty()) return;
+        t.threaded.reserve(t.code.size());
+        for (const Instruction& instruction : t.code) t.threaded.push_back(labels[static_cast<int>(instruction.op)]);
+    };
+    thread(*task);
+    const void* const* threaded = task->threaded.data();
+    const void* const* tp = threaded;
+
+#define CASE(name) op_##name:
+#define NEXT() do { in = *ip++; goto **tp++; } while (0)
+#define JUMP(target) do { ip = code + (target); tp = threaded + (target); } while (0)
+#define SWITCH_TO(t) do { code = (t)->code.data(); constants = (t)->constants.data(); threaded = (t)->threaded.data(); } while (0)
+#define RESUME(t, at) do { ip = (at); tp = threaded + (ip - code); } while (0)
+    NEXT();
+#else
+#define CASE(name) case Opcode::name:
+#define NEXT() continue
+#define JUMP(target) (ip = code + (target))
+#define SWITCH_TO(t) do { code = (t)->code.data(); constants = (t)->constants.data(); } while (0)
+#define RESUME(t, at) (ip = (at))
+    for (;;) {
+        in = *ip++;
+        switch (in.op) {
+#endif
+
+#define RAISE_ERROR(e) do { error = (e); goto raise; } while (0)
+#define A base[in.a]
+#define B base[in.b]
+#define C base[in.c]
+
+    CASE(MOVE) A = B; NEXT();
+    CASE(LOADK) A = constants[in.wide()]; NEXT();
+    CASE(LOADI) A.i = static_cast<int16_t>(in.b); NEXT();
+    CASE(GETGLOBAL) A = globalSlots[in.wide()]; NEXT();
+    CASE(SETGLOBAL) globalSlots[in.wide()] = A; NEXT();
+    CASE(INTTOFLOAT) A.f = static_cast<double>(B.i); NEXT();
+
+    CASE(ADD) A.i = wrap(static_cast<uint64_t>(B.i) + static_cast<uint64_t>(C.i)); NEXT();
+    CASE(SUB) A.i = wrap(static_cast<uint64_t>(B.i) - static_cast<uint64_t>(C.i)); NEXT();
+    CASE(MUL) A.i = wrap(static_cast<uint64_t>(B.i) * static_cast<uint64_t>(C.i)); NEXT();
+    CASE(FLOORDIV) if (C.i == 0) RAISE_ERROR(runtimeError(DIVISION_BY_ZERO)); A.i = floorDivision(B.i, C.i, false); NEXT();
+    CASE(FLOORMOD) if (C.i == 0) RAISE_ERROR(runtimeError(DIVISION_BY_ZERO)); A.i = floorDivision(B.i, C.i, true); NEXT();
+    CASE(POW) A.i = babelPowInt(B.i, C.i); NEXT();
+    CASE(ADDI) A.i = wrap(static_cast<uint64_t>(B.i) + static_cast<uint64_t>(static_cast<int16_t>(in.c))); NEXT();
+
+    CASE(FADD) A.f = B.f + C.f; NEXT();
+    CASE(FSUB) A.f = B.f - C.f; NEXT();
+    CASE(FMUL) A.f = B.f * C.f; NEXT();
+    CASE(FDIV) A.f = B.f / C.f; NEXT();
+    CASE(FMOD) A.f = std::fmod(B.f, C.f); NEXT();
+    CASE(FFLOORDIV) A.f = std::floor(B.f / C.f); NEXT();
+    CASE(FPOW) A.f = std::pow(B.f, C.f); NEXT();
+
+    CASE(EQ) A.i = B.i == C.i; NEXT();
+    CASE(NE) A.i = B.i != C.i; NEXT();
+    CASE(LT) A.i = B.i < C.i; NEXT();
+    CASE(LE) A.i = B.i <= C.i; NEXT();
+    CASE(GT) A.i = B.i > C.i; NEXT();
+    CASE(GE) A.i = B.i >= C.i; NEXT();
+    CASE(FEQ) A.i = B.f == C.f; NEXT();
+    CASE(FNE) A.i = B.f != C.f; NEXT();
+    CASE(FLT) A.i = B.f < C.f; NEXT();
+    CASE(FLE) A.i = B.f <= C.f; NEXT();
+    CASE(FGT) A.i = B.f > C.f; NEXT();
+    CASE(FGE) A.i = B.f >= C.f; NEXT();
+
+    CASE(BITOR) A.i = B.i | C.i; NEXT();
+    CASE(BITXOR) A.i = B.i ^ C.i; NEXT();
+    CASE(BITAND) A.i = B.i & C.i; NEXT();
+    CASE(SHL) A.i = wrap(static_cast<uint64_t>(B.i) << (C.i & 63)); NEXT();
+    CASE(SHR) A.i = B.i >> (C.i & 63); NEXT();
+
+    CASE(NEG) A.i = wrap(0 - static_cast<uint64_t>(B.i)); NEXT();
+    CASE(FNEG) A.f = -B.f; NEXT();
+    CASE(NOT) A.i = B.i == 0; NEXT();
+    CASE(TRUTH) A.i = B.i != 0; NEXT();
+    CASE(FTRUTH) A.i = B.f != 0.0; NEXT();
+
+    CASE(JUMP) JUMP(in.wide()); NEXT();
+    CASE(JUMPIF) if (A.i) JUMP(in.wide()); NEXT();
+    CASE(JUMPIFNOT) if (!A.i) JUMP(in.wide()); NEXT();
+    CASE(LOOP) if (A.i) { task->heat++; JUMP(in.wide()); } NEXT();
+
+    CASE(CALL) {
+        BytecodeTask* callee = program.tasks[in.b].get();
+        if (!callee->native && ++callee->heat >= HOT_TASK && callee->promotable) promote(*callee);
+        if (callee->native) {
+            if (!callNative(*callee, base + in.a, error)) goto raise;
+            NEXT();
+        }
+
+        Slot* calleeBase = base + in.a;
+        if (calleeBase + callee->registers > stackEnd || frames.size() == MAX_FRAMES) RAISE_ERROR(runtimeError(STACK_OVERFLOW));
+        frames.push_back({task, ip, base});
+#ifdef BABEL_THREADED_DISPATCH
+        thread(*callee);
+#endif
+        task = callee;
+        base = calleeBase;
+        SWITCH_TO(task);
+        JUMP(0);
+        NEXT();
+    }
+    // the result goes to the callee's first register, which is the caller's register of the call
+    CASE(RET) base[0] = A; goto popFrame;
+    CASE(RETVOID) popFrame: {
+        const Frame frame = frames.back();
+        frames.pop_back();
+        task = frame.task;
+        base = frame.base;
+        SWITCH_TO(task);
+        RESUME(task, frame.ip);
+        NEXT();
+    }
+
+    CASE(PRINTINT) babelPrintInt(A.i); NEXT();
+    CASE(PRINTFLOAT) babelPrintFloat(A.f); NEXT();
+    CASE(PRINTBOOL) babelPrintBool(static_cast<int8_t>(A.i)); NEXT();
+    CASE(PRINTCHAR) babelPrintChar(static_cast<char>(A.i)); NEXT();
+    CASE(HALT) return;
+    CASE(RAISE) RAISE_ERROR(A.i);
+
+    // the frames are left until one has a handler for the error where it stopped, which
+    // is the call in the ones that called
+    raise: {
+        const int kind = static_cast<int>(error & 0xFFFFFFFF);
+        const Instruction* at = ip - 1;
+        while (true) {
+            const int pc = static_cast<int>(at - code);
+            auto handler = std::find_if(task->handlers.begin(), task->handlers.end(), [&](const ErrorHandler& h) {
+                return pc >= h.begin && pc < h.end && (h.kind == kind || h.kind == ErrorHandler::ANY_ERROR);
+            });
+            if (handler != task->handlers.end()) {
+                base[handler->reg].i = error;
+                JUMP(handler->target);
+                break;
+            }
+            if (frames.empty()) uncaught(error);
+
+            const Frame frame = frames.back();
+            frames.pop_back();
+            task = frame.task;
+            base = frame.base;
+            SWITCH_TO(task);
+            at = frame.ip - 1;
+        }
+        NEXT();
+    }
+
+#ifndef BABEL_THREADED_DISPATCH
+        }
+    }
+#endif
+
+#undef RAISE_ERROR
+#undef A
+#undef B
+#undef C
+#undef CASE
+#undef NEXT
+#undef JUMP
+#undef SWITCH_TO
+#undef RESUME
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "ast.h"
+#include "bytecode.h"
+
+class BabelJIT;
+
+// Runs top level statements as bytecode, which starts much sooner than the JIT, since
+// there is no LLVM module to build and optimize, at the price of slower loops. Like
+// the JIT, tasks and variables defined by one run can be used by the next. Dispatch is
+// direct threaded where the compiler has computed gotos, a switch otherwise.
+//
+// A task that gets hot, by being called or going round its loops often, is compiled by a
+// JIT of the interpreter's own and runs natively from its next call on, together with the
+// tasks it calls. That is left out when one of them uses a global, whose value only the
+// interpreter has, or raises or catches errors, which compiled code can not do yet. Native
+// tasks recurse on the machine stack, a bounded part of it, and raise a stack overflow
+// that can be caught when they reach its end, as interpreted ones do.
+class BabelInterpreter {
+    private:
+        BytecodeProgram program;
+        ProgramTypes types;
+        std::vector<Slot> globals;
+        std::unique_ptr<Slot[]> stack;      // the frames' registers, left uninitialized until they are used
+        std::vector<std::unique_ptr<BaseAST>> definitions;      // of the tasks, by index, for the JIT
+        std::unique_ptr<BabelJIT> jit;      // made for the first hot task
+        ProgramTypes native;                // the tasks the JIT compiled
+        int runCount = 0;
+
+        void execute(BytecodeTask& main);
+        void promote(BytecodeTask& hot);
+        [[noreturn]] void uncaught(int64_t error) const;
+
+    public:
+        BabelInterpreter();
+        ~BabelInterpreter();
+
+        // Type checks and runs the statements, with echo a call on its own prints its
+        // value. Returns false when the bytecode compiler reported an error; what the
+        // statements defined is dropped then. The task definitions are taken out of the
+        // statements otherwise, the interpreter keeps them. Throws std::runtime_error with
+        // the TypeError, or with an error running raised and nothing caught, like a division
+        // by zero, which is a RuntimeError.
+        bool run(std::vector<std::unique_ptr<BaseAST>>& statements, bool echo = true);
+};
@@ -0,0 +1,121 @@
+#include "jit.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include "compile.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/Support/TargetSelect.h"
+
+using namespace llvm;
+using namespace llvm::orc;
+
+extern "C" void babelPrintInt(int64_t x) {
+    std::printf("%lld\n", static_cast<long long>(x));
+}
+
+extern "C" void babelPrintFloat(double x) {
+    std::printf("%g\n", x);
+}
+
+extern "C" void babelPrintBool(int8_t x) {
+    std::printf("%s\n", x ? "TRUE" : "FALSE");
+}
+
+extern "C" void babelPrintChar(char x) {
+    std::printf("%c\n", x);
+}
+
+extern "C" int64_t babelPowInt(int64_t base, int64_t exponent) {
+    if (exponent < 0) return base == 1 ? 1 : base == -1 ? (exponent & 1 ? -1 : 1) : 0;
+    uint64_t result = 1;
+    for (uint64_t factor = static_cast<uint64_t>(base); exponent != 0; exponent >>= 1) {
+        if (exponent & 1) result *= factor;
+        factor *= factor;
+    }
+    return static_cast<int64_t>(result);
+}
+
+// thrown through the generated code, which has unwind tables
+extern "C" void babelDivisionByZero() {
+    throw std::runtime_error("RuntimeError: integer division by zero");
+}
+
+uintptr_t babelStackLimit = 0;
+
+extern "C" void babelStackOverflow() {
+    throw std::runtime_error("RuntimeError: stack overflow");
+}
+
+template <typename T>
+static T unwrap(Expected<T> value) {
+    if (!value) throw std::runtime_error(toString(value.takeError()));
+    return std::move(*value);
+}
+
+static void check(Error error) {
+    if (error) throw std::runtime_error(toString(std::move(error)));
+}
+
+BabelJIT::BabelJIT() {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+
+    jit = unwrap(LLJITBuilder().create());
+    // the O2 pipeline on every module before it is compiled, the allocas of variables become registers there
+    jit->getIRTransformLayer().setTransform([](ThreadSafeModule module, MaterializationResponsibility&) {
+        module.withModuleDo([](Module &m) { optimizeModule(m, 2); });
+        return Expected<ThreadSafeModule>(std::move(module));
+    });
+
+    // libm for the pow and floor the operators call
+    JITDylib &dylib = jit->getMainJITDylib();
+    dylib.addGenerator(unwrap(DynamicLibrarySearchGenerator::GetForCurrentProcess(jit->getDataLayout().getGlobalPrefix())));
+
+    MangleAndInterner mangle(jit->getExecutionSession(), jit->getDataLayout());
+    const JITSymbolFlags flags = JITSymbolFlags::Exported | JITSymbolFlags::Callable;
+    SymbolMap builtins;
+    builtins[mangle("babel.print.int")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&babelPrintInt), flags);
+    builtins[mangle("babel.print.float")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&babelPrintFloat), flags);
+    builtins[mangle("babel.print.bool")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&babelPrintBool), flags);
+    builtins[mangle("babel.print.char")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&babelPrintChar), flags);
+    builtins[mangle("babel.pow.int")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&babelPowInt), flags);
+    builtins[mangle("babel.error.division")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&babelDivisionByZero), flags);
+    builtins[mangle("babel.error.overflow")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&babelStackOverflow), flags);
+    builtins[mangle("babel.stack.limit")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&babelStackLimit), JITSymbolFlags::Exported);
+    check(dylib.define(absoluteSymbols(std::move(builtins))));
+}
+
+BabelJIT::~BabelJIT() = default;
+
+bool BabelJIT::run(std::vector<std::unique_ptr<BaseAST>>& statements, bool echo) {
+    ProgramTypes checked = checkProgram(statements, types);
+
+    const std::string name = "__anon_expr." + std::to_string(runCount++);
+    initializeModule("babel jit");
+    TheModule->setDataLayout(jit->getDataLayout());
+
+    if (!codegenTopLevel(statements, types, name, echo)) return false;
+    check(jit->addIRModule(ThreadSafeModule(std::move(TheModule), std::move(TheContext))));
+    types = std::move(checked);
+
+    auto entry = jitTargetAddressToFunction<void (*)()>(unwrap(jit->lookup(name)).getAddress());
+    entry();
+    return true;
+}
+
+std::vector<void (*)(void*)> BabelJIT::compileTasks(const std::vector<TaskAST*>& tasks, const ProgramTypes& defined) {
+    initializeModule("babel tasks");
+    TheModule->setDataLayout(jit->getDataLayout());
+
+    std::vector<std::string> names;
+    for (Function* entry : codegenEntries(tasks, defined)) names.push_back(entry->getName().str());
+    if (names.empty()) throw std::runtime_error("the tasks could not be compiled");
+    check(jit->addIRModule(ThreadSafeModule(std::move(TheModule), std::move(TheContext))));
+
+    std::vector<void (*)(void*)> entries;
+    for (const std::string& name : names) entries.push_back(jitTargetAddressToFunction<void (*)(void*)>(unwrap(jit->lookup(name)).getAddress()));
+    return entries;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ast.h"
+
+namespace llvm::orc {
+    class LLJIT;
+}
+
+// the runtime behind print(x), which the interpreter calls as well
+extern "C" void babelPrintInt(int64_t x);
+extern "C" void babelPrintFloat(double x);
+extern "C" void babelPrintBool(int8_t x);
+extern "C" void babelPrintChar(char x);
+// int ^ int by squaring, wrapping around on overflow; a negative exponent truncates the
+// result towards zero, which leaves 1 and -1 for bases 1 and -1 and 0 otherwise
+extern "C" int64_t babelPowInt(int64_t base, int64_t exponent);
+// what // and % on ints call for a zero divisor, throws std::runtime_error with the RuntimeError
+extern "C" [[noreturn]] void babelDivisionByZero();
+// the lowest address the frames of tasks compiled for the interpreter may have, below it
+// they call babelStackOverflow, which throws std::runtime_error with the RuntimeError
+extern "C" uintptr_t babelStackLimit;
+extern "C" [[noreturn]] void babelStackOverflow();
+
+// Compiles top level statements to native code with ORC's LLJIT and runs them. Every
+// run goes into a module of its own that stays in the JIT, so tasks and variables
+// defined by one run can be used by the next. The builtin print(x) writes x to stdout
+// and returns it, it is backed by one C function per type.
+class BabelJIT {
+    private:
+        std::unique_ptr<llvm::orc::LLJIT> jit;
+        ProgramTypes types;
+        int runCount = 0;
+
+    public:
+        // throws std::runtime_error when the JIT can not be set up for the host
+        BabelJIT();
+        ~BabelJIT();
+
+        // Type checks and runs the statements, with echo a call on its own prints its value.
+        // Returns false when codegen reported an error; what the statements defined is dropped
+        // then. Throws std::runtime_error with the TypeError or when the JIT fails to link the module.
+        bool run(std::vector<std::unique_ptr<BaseAST>>& statements, bool echo = true);
+
+        // Compiles task definitions another tier checked, in the order they were defined, with
+        // the tasks of defined compiled before. Returns the entry of every task, see
+        // codegenEntries. Throws std::runtime_error when codegen reports an error or the JIT
+        // fails to link the module.
+        std::vector<void (*)(void*)> compileTasks(const std::vector<TaskAST*>& tasks, const ProgramTypes& defined);
+};
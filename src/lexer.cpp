@@ -0,0 +1,91 @@
+#include "lexer.h"
+
+std::ostream& operator<< (std::ostream &s, const TokenList &tokens) {
+    for (const Token& token : tokens) {
+        s << tokens.getType(token);
+        if (token.length != 0) s << " : " << tokens.getValue(token);
+        s << '\n';
+    }
+    return s;
+}
+
+std::list<std::pair<std::string, std::string>> babelTokenSpecs() {
+    return {
+        {"TYPE", "\\b(?:int|float|bool|string|char|list|tuple|map|dict|any|void)\\b"},
+        {"CLASS", "\\bclass\\b"},
+        {"TASK", "\\btask\\b"},
+        {"STRUCT", "\\bstruct\\b"},
+        {"STORAGE_MODIFIER", "\\b(?:static|const|final)\\b"},
+        {"STRING", R"("[^"]*")"},
+        {"CHAR", "'[^']{1}'"},
+        {"FLOATING_POINT", "\\d*\\.\\d+"},
+        {"BOOL", "(TRUE|FALSE)"},
+        {"LPAREN", "\\("},
+        {"LSQUARE", "\\["},
+        {"RSQUARE", "\\]"},
+        {"LBRACE", "\\{"},
+        {"RBRACE", "\\}"},
+        {"RPAREN", "\\)"},
+        {"IF", "if"},
+        {"ELSE", "else"},
+        {"ELIF", "elif"},
+        {"THEN", "then"},
+        {"MATCH", "macth"},
+        {"CASE", "case"},
+        {"OTHERWISE", "otherwise"},
+        {"END", "end"},
+        {"DO", "do"},
+        {"WHILE", "while"},
+        {"FOR", "for"},
+        {"TO", "to"},
+        {"STEP", "step"},
+        {"TRY", "try"},
+        {"CATCH", "catch"},
+        {"FINALLY", "finally"},
+        {"PASS", "pass"},
+        {"CONTINUE", "continue"},
+        {"BREAK", "break"},
+        {"RETURN", "return"},
+        {"RAISE", "raise"},
+        {"IMPORT", "imp"},    
+        {"EQEQ", "=="},
+        {"PLUS_EQUALS", "\\+="},
+        {"MINUS_EQUALS", "-="},
+        {"MULTIPLY_EQUALS", "\\*="},
+        {"DIVIDE_EQUALS", "/="},
+        {"POWER_EQUALS", "\\^="},
+        {"MODULO_EQUALS", "%="},
+        {"INTEGER_DIVIDE_EQUALS", "//="},
+        {"NEGLIGIBLY_LOW", "<<<"},
+        {"LSHIFT", "<<"},
+        {"RSHIFT", ">>"},
+        {"LTEQ", "<="},
+        {"GTEQ", ">="},
+        {"NOTEQ", "!="},
+        {"RARR","=>"},
+        {"INTEGER_DIVIDE", "//"},
+        {"INCREMENT", "\\+\\+"},
+        {"DECREMENT", "--"},
+        {"PLUS", "\\+"},
+        {"MINUS", "-"},
+        {"MULTIPLY", "\\*"},
+        {"DIVIDE", "/"},
+        {"POWER", "\\^"},
+        {"MODULO", "%"},
+        {"EQUALS", "="},
+        {"OR", "\\|"},
+        {"AND", "&"},
+        {"NOT", "!"},
+        {"LT", "<"},
+        {"GT", ">"},
+        {"DOT", "\\."},
+        {"COMMA", ","},
+        {"COLON", ":"},
+        {"SEMICOLON", ";"},
+        {"NEWLINE", "\n"},
+        {"NULL", "null"},
+        {"NEW", "new"},
+        {"VAR", "[a-zA-Z_][a-zA-Z0-9_]*"},
+        {"INTEGER", "\\d*"} //leave INTEGER here, it matches all expressions
+    };
+}
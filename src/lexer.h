@@ -1,120 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <list>
 #include <map>
-#include <regex>
+#include <memory>
 #include <stdexcept>
+#include <vector>
+#include "dfa.h"
 
-class Token {
+// Immutable text of one source file. Tokens refer into it by offset, so a buffer is
+// shared by every token list and tree built from it. Line starts are only indexed
+// the first time a position is asked for.
+class SourceBuffer {
     private:
-        const std::string type;
-        const std::string value;
+        std::string file_name;
+        std::string text;
+        mutable std::vector<uint32_t> line_starts;
+
+        void indexLines() const {
+            line_starts.push_back(0);
+            for (size_t i = 0; i < text.size(); i++) {
+                if (text[i] == '\n') line_starts.push_back(static_cast<uint32_t>(i + 1));
+            }
+        }
 
     public:
-        Token (std::string _type, std::string _value) : type(_type), value(_value) {}
+        SourceBuffer (std::string file_name, std::string text) : file_name(std::move(file_name)), text(std::move(text)) {
+            if (this->text.size() > UINT32_MAX) throw std::length_error("source files are limited to 4 GiB");
+        }
 
-        std::string getType () const {
-            return type;
+        const std::string& getFileName () const {
+            return file_name;
         }
 
-        std::string getValue () const {
-            return value;
+        std::string_view getText () const {
+            return text;
         }
-};
 
-std::ostream& operator<< (std::ostream &s, const Token &token) {
-    if (token.getValue() != "") {
-        return s << token.getType() << " : " << token.getValue();    
-    } else {
-        return s << token.getType();
-    }
-}
+        std::string_view slice (uint32_t offset, uint32_t length) const {
+            return std::string_view(text).substr(offset, length);
+        }
 
-class Position {
-    private:
-        int line;
-        int col;
-        int ind;
+        // 1-based line of the character at offset
+        int lineOf (uint32_t offset) const {
+            if (line_starts.empty()) indexLines();
+            return static_cast<int>(std::upper_bound(line_starts.begin(), line_starts.end(), offset) - line_starts.begin());
+        }
 
-        std::string file_name;
-        std::string text;
+        // 1-based column of the character at offset
+        int columnOf (uint32_t offset) const {
+            return static_cast<int>(offset - line_starts[lineOf(offset) - 1]) + 1;
+        }
+};
 
+// A token is the index of its spec in the lexer and a span of the source buffer.
+struct Token {
+    uint32_t kind;
+    uint32_t offset;
+    uint32_t length;
+};
+
+// The tokens of one source buffer together with what is needed to interpret them.
+class TokenList {
     public:
-        Position () = default;
-        Position (int _line, int _col, int _ind, std::string _file_name, std::string _text) {
-            line = _line;
-            col = _col;
-            ind = _ind;
-            file_name = _file_name;
-            text = _text;
+        std::shared_ptr<const SourceBuffer> source;
+        std::shared_ptr<const std::vector<std::string>> kinds;
+        std::vector<Token> tokens;
+
+        size_t size () const {
+            return tokens.size();
+        }
+
+        const Token& operator[] (size_t index) const {
+            return tokens[index];
+        }
+
+        std::vector<Token>::const_iterator begin () const {
+            return tokens.begin();
+        }
+
+        std::vector<Token>::const_iterator end () const {
+            return tokens.end();
         }
 
-        void advance (char current_char) {
-            col++;
-            ind++;
-            
-            if (current_char == '\n') {
-                line++;
-                col = 0;
-            }            
+        const std::string& getType (const Token& token) const {
+            return (*kinds)[token.kind];
         }
 
-        int getInd () const {
-            return ind;
+        std::string_view getValue (const Token& token) const {
+            return source->slice(token.offset, token.length);
         }
 };
 
+std::ostream& operator<< (std::ostream &s, const TokenList &tokens);
+
 class Lexer {
     private:
         std::string file_name;
-        std::string text;
-        
-        std::list<std::pair<std::string, std::string>> token_specs;
-
-        Position pos;
-        char current_char;
+        std::shared_ptr<const std::vector<std::string>> token_types;
+        LexerDfa dfa;
 
     public:
-        Lexer (std::string file_name, std::list<std::pair<std::string, std::string>> token_specs) : file_name(file_name), token_specs(token_specs) {
-            //pos = Position(0, -1, -1, file_name, text);
-            current_char = (char) 0;
-            advance();
-        }
-
-        void advance () {
-            pos.advance(current_char);
-            current_char = pos.getInd() < text.size() ? text[pos.getInd()] : (char) 0;
-        }
-
-        std::list<Token> tokenize(std::string input_stream) const {
-            std::list<Token> tokens;
-            
-            while (!input_stream.empty()) {
-                bool matched = false;
-                for (const std::pair<std::string, std::string>& spec : token_specs) {
-                    const std::string& token_type = spec.first;
-                    const std::string& pattern = spec.second;
-
-                    std::regex regex_pattern("^" + pattern);
-                    std::smatch re;
-                    
-                    if (regex_search(input_stream, re, regex_pattern)) {
-                        std::string match = re[0];
-                        if (match.size()==0) break; //fixing wrong matches
-                        tokens.push_back(Token(token_type, match));
-                        input_stream = re.suffix();
-                        matched = true;
-                        break;
-                    }
-                }
+        Lexer (std::string file_name, const std::list<std::pair<std::string, std::string>>& token_specs) : file_name(file_name), dfa(token_specs) {
+            auto types = std::make_shared<std::vector<std::string>>();
+            for (const std::pair<std::string, std::string>& spec : token_specs) {
+                types->push_back(spec.first);
+            }
+            token_types = std::move(types);
+        }
+
+        // a lexer on a prebuilt automaton, like the one of a generated header
+        Lexer (std::string file_name, LexerDfa dfa, std::vector<std::string> token_types)
+            : file_name(std::move(file_name)), token_types(std::make_shared<const std::vector<std::string>>(std::move(token_types))), dfa(std::move(dfa)) {}
 
-                if (!matched) {
+        const std::vector<std::string>& getTokenTypes () const {
+            return *token_types;
+        }
+
+        const LexerDfa& getDfa () const {
+            return dfa;
+        }
+
+        TokenList tokenize(std::shared_ptr<const SourceBuffer> source) const {
+            TokenList tokens{source, token_types, {}};
+            std::string_view text = source->getText();
+            const char* data = text.data();
+            size_t size = text.size();
+            size_t offset = 0;
+
+            while (offset < size) {
+                size_t length;
+                int token_type = dfa.match(data, size, offset, length);
+
+                if (token_type >= 0) {
+                    tokens.tokens.push_back(Token{static_cast<uint32_t>(token_type), static_cast<uint32_t>(offset), static_cast<uint32_t>(length)});
+                    offset += length;
+                } else {
                     //ignore or handle errors
-                    input_stream = input_stream.substr(1);
+                    offset++;
                 }
-            }            
+            }
 
             return tokens;
         }
-        
+
+        TokenList tokenize(std::string input_stream) const {
+            return tokenize(std::make_shared<const SourceBuffer>(file_name, std::move(input_stream)));
+        }
 };
+
+// token specs of the language in priority order, ties in match length go to the earlier spec
+std::list<std::pair<std::string, std::string>> babelTokenSpecs();
@@ -0,0 +1,317 @@
+#include "lower.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// operators by terminal name, the logical & and | are short circuit in codegen
+const std::map<std::string_view, std::string> binaryOperators = {
+    {"PLUS", "+"}, {"MINUS", "-"}, {"MULTIPLY", "*"}, {"DIVIDE", "/"}, {"INTEGER_DIVIDE", "//"},
+    {"MODULO", "%"}, {"POWER", "^"}, {"EQEQ", "=="}, {"NOTEQ", "!="}, {"LT", "<"}, {"LTEQ", "<="},
+    {"GT", ">"}, {"GTEQ", ">="}, {"AND", "&"}, {"OR", "|"}, {"BIT_OR", "bit_or"}, {"BIT_XOR", "bit_xor"},
+    {"BIT_AND", "bit_and"}, {"LSHIFT", "<<"}, {"RSHIFT", ">>"},
+};
+
+// x op= e is x = x op e
+const std::map<std::string_view, std::string> compoundAssignments = {
+    {"PLUS_EQUALS", "+"}, {"MINUS_EQUALS", "-"}, {"MULTIPLY_EQUALS", "*"}, {"DIVIDE_EQUALS", "/"},
+    {"POWER_EQUALS", "^"}, {"MODULO_EQUALS", "%"}, {"INTEGER_DIVIDE_EQUALS", "//"},
+};
+
+BabelType valueType(const std::string& name) {
+    const BabelType type = typeNamed(name);
+    if (type == BabelType::Unknown || type == BabelType::Void) throw std::runtime_error("the type " + name + " is not supported yet");
+    return type;
+}
+
+BabelType resultType(const std::string& name) {
+    const BabelType type = typeNamed(name);
+    if (type == BabelType::Unknown) throw std::runtime_error("the type " + name + " is not supported yet");
+    return type;
+}
+
+std::unique_ptr<BaseAST> makeAssignment(const std::string& name, const std::string* compound, std::unique_ptr<BaseAST> value, BabelType declared) {
+    if (compound) value = std::make_unique<BinaryOperatorAST>(*compound, std::make_unique<VariableAST>(name), std::move(value));
+    return std::make_unique<AssignmentAST>(name, std::move(value), declared);
+}
+
+// The subject is evaluated once into a variable the cases compare against, they become
+// an if chain built from the last case up. At the top level that variable is a global,
+// so every match of the process gets one of its own, whatever type its subject has.
+void makeMatch(std::unique_ptr<BaseAST> subject, MatchCases cases, std::unique_ptr<BaseAST> otherwise, std::vector<std::unique_ptr<BaseAST>>& out) {
+    static std::atomic<int> matchCount = 0;
+    const std::string name = "match." + std::to_string(matchCount++);
+    out.push_back(std::make_unique<AssignmentAST>(name, std::move(subject)));
+
+    std::unique_ptr<BaseAST> chain = std::move(otherwise);
+    for (auto& [value, body] : cases) {
+        auto test = std::make_unique<BinaryOperatorAST>("==", std::make_unique<VariableAST>(name), std::move(value));
+        chain = std::make_unique<IfAST>(std::move(test), std::move(body), std::move(chain));
+    }
+    out.push_back(std::move(chain));
+}
+
+// counts up to last, the step runs after the body like in a FOR with ;
+std::unique_ptr<BaseAST> makeCountingLoop(const std::string& name, std::unique_ptr<BaseAST> last, std::unique_ptr<BaseAST> by, std::unique_ptr<BaseAST> body) {
+    auto cond = std::make_unique<BinaryOperatorAST>("<=", std::make_unique<VariableAST>(name), std::move(last));
+    if (!by) by = std::make_unique<IntegerAST>(1);
+    auto step = std::make_unique<AssignmentAST>(name, std::make_unique<BinaryOperatorAST>("+", std::make_unique<VariableAST>(name), std::move(by)));
+    return std::make_unique<WhileAST>(std::move(cond), std::move(body), std::move(step));
+}
+
+std::unique_ptr<BaseAST> makeRaise(std::unique_ptr<BaseAST> error) {
+    auto* kind = dynamic_cast<VariableAST*>(error.get());
+    if (!kind) throw std::runtime_error("raise takes the name of an error");
+    return std::make_unique<RaiseAST>(kind->getName());
+}
+
+namespace {
+
+class TreeLowering {
+    private:
+        const ParseTree& tree;
+
+        const TreeNode& child(const TreeNode& node, size_t index) const {
+            return tree.nodes[tree.childrenOf(node)[index]];
+        }
+
+        size_t childCount(const TreeNode& node) const {
+            return node.childCount;
+        }
+
+        bool is(const TreeNode& node, std::string_view name) const {
+            return tree.nameOf(node) == name;
+        }
+
+        std::string text(const TreeNode& node) const {
+            return std::string(tree.textOf(node));
+        }
+
+        [[noreturn]] void unsupported(const TreeNode& node) const {
+            throw std::runtime_error(std::string(tree.nameOf(node)) + " is not supported yet");
+        }
+
+        std::unique_ptr<BaseAST> atom(const TreeNode& token) const {
+            if (is(token, "INTEGER")) return std::make_unique<IntegerAST>(std::stoll(text(token)));
+            if (is(token, "FLOATING_POINT")) return std::make_unique<FloatingPointAST>(std::stod(text(token)));
+            if (is(token, "BOOL")) return std::make_unique<BoolAST>(text(token) == "TRUE");
+            if (is(token, "CHAR")) return std::make_unique<CharAST>(text(token)[1]);
+            if (is(token, "VAR")) return std::make_unique<VariableAST>(text(token));
+            unsupported(token);
+        }
+
+        // params and comma_values, both right recursive; a tree without pass-through
+        // nodes has the value itself where a list holds only one
+        void values(const TreeNode& node, std::vector<std::unique_ptr<BaseAST>>& out) {
+            if ((is(node, "params") || is(node, "comma_values")) && childCount(node) == 3) {
+                values(child(node, 0), out);
+                values(child(node, 2), out);
+                return;
+            }
+            if (is(node, "param") && childCount(node) > 1) unsupported(node);
+            out.push_back(expression(node));
+        }
+
+        std::unique_ptr<BaseAST> call(const TreeNode& node) {
+            if (!is(child(node, 1), "LPAREN")) unsupported(node);
+
+            std::vector<std::unique_ptr<BaseAST>> args;
+            if (childCount(node) == 4) values(child(node, 2), args);
+            return std::make_unique<TaskCallAST>(text(child(node, 0)), std::move(args));
+        }
+
+        std::unique_ptr<BaseAST> expression(const TreeNode& node) {
+            if (tree.isToken(node)) return atom(node);
+            if (is(node, "function_call")) return call(node);
+
+            // (e) is a tuple of one value
+            if (is(node, "tuple")) {
+                if (childCount(node) == 3 && !(is(child(node, 1), "comma_values") && childCount(child(node, 1)) == 3)) return expression(child(node, 1));
+                unsupported(node);
+            }
+
+            if (is(node, "params") || is(node, "param") || is(node, "comma_values")) {
+                if (childCount(node) != 1) unsupported(node);
+                return expression(child(node, 0));
+            }
+
+            // an operator and its operands, or one of expression -> primary -> atom
+
+            switch (childCount(node)) {
+                case 1:
+                    return expression(child(node, 0));
+                case 2: {
+                    const TreeNode& first = child(node, 0);
+                    const TreeNode& second = child(node, 1);
+                    if (is(second, "INCREMENT")) return std::make_unique<UnaryOperatorAST>("++", expression(first));
+                    if (is(second, "DECREMENT")) return std::make_unique<UnaryOperatorAST>("--", expression(first));
+                    if (!is(first, "PLUS") && !is(first, "MINUS") && !is(first, "NOT")) unsupported(node);
+                    return std::make_unique<UnaryOperatorAST>(text(first), expression(second));
+                }
+                case 3: {
+                    const TreeNode& op = child(node, 1);
+                    auto found = binaryOperators.find(tree.nameOf(op));
+                    if (found == binaryOperators.end()) unsupported(node);
+                    return std::make_unique<BinaryOperatorAST>(found->second, expression(child(node, 0)), expression(child(node, 2)));
+                }
+                default:
+                    unsupported(node);
+            }
+        }
+
+        std::unique_ptr<BaseAST> assignment(const TreeNode& node) {
+            const std::string name = text(child(node, 0));
+            const TreeNode& operatorNode = child(node, childCount(node) - 2);
+            const TreeNode& op = tree.isToken(operatorNode) ? operatorNode : child(operatorNode, 0);
+            const std::string* compound = is(op, "EQUALS") ? nullptr : &compoundAssignments.at(tree.nameOf(op));
+            std::unique_ptr<BaseAST> value = expression(child(node, childCount(node) - 1));
+            const BabelType declared = is(child(node, 1), "type_spec") ? valueType(text(child(child(node, 1), 1))) : BabelType::Unknown;
+            return makeAssignment(name, compound, std::move(value), declared);
+        }
+
+        std::unique_ptr<BaseAST> block(const TreeNode& node) {
+            std::vector<std::unique_ptr<BaseAST>> body;
+            statements(node, body, false);
+            return std::make_unique<BlockAST>(std::move(body));
+        }
+
+        // if_stmt and elif_stmt: IF e THEN block (END | elif_stmt | ELSE block END)
+        std::unique_ptr<BaseAST> ifStatement(const TreeNode& node) {
+            std::unique_ptr<BaseAST> otherwise;
+            if (childCount(node) == 5 && is(child(node, 4), "elif_stmt")) otherwise = ifStatement(child(node, 4));
+            else if (childCount(node) == 7) otherwise = block(child(node, 5));
+            return std::make_unique<IfAST>(expression(child(node, 1)), block(child(node, 3)), std::move(otherwise));
+        }
+
+        // MATCH e NEWLINE cases [OTHERWISE block], cases is CASE e block [cases]
+        void matchStatement(const TreeNode& node, std::vector<std::unique_ptr<BaseAST>>& out) {
+            std::unique_ptr<BaseAST> subject = expression(child(node, 1));
+
+            std::vector<const TreeNode*> lists;
+            for (const TreeNode* list = &child(node, 3); ; list = &child(*list, 3)) {
+                lists.push_back(list);
+                if (childCount(*list) == 3) break;
+            }
+            MatchCases cases;
+            for (auto it = lists.rbegin(); it != lists.rend(); ++it) cases.emplace_back(expression(child(**it, 1)), block(child(**it, 2)));
+
+            std::unique_ptr<BaseAST> otherwise = childCount(node) == 6 ? block(child(node, 5)) : nullptr;
+            makeMatch(std::move(subject), std::move(cases), std::move(otherwise), out);
+        }
+
+        // FOR init ; cond ; step DO block END, or FOR init TO last [STEP by] DO block END counting up to last
+        void loopStatement(const TreeNode& node, std::vector<std::unique_ptr<BaseAST>>& out) {
+            if (is(child(node, 0), "WHILE")) {
+                out.push_back(std::make_unique<WhileAST>(expression(child(node, 1)), block(child(node, 3))));
+                return;
+            }
+
+            const TreeNode& init = child(node, 1);
+            out.push_back(assignment(init));
+            if (is(child(node, 2), "SEMICOLON")) {
+                out.push_back(std::make_unique<WhileAST>(expression(child(node, 3)), block(child(node, 7)), expression(child(node, 5))));
+                return;
+            }
+
+            std::unique_ptr<BaseAST> last = expression(child(node, 3));
+            std::unique_ptr<BaseAST> by = is(child(node, 4), "STEP") ? expression(child(node, 5)) : nullptr;
+            out.push_back(makeCountingLoop(text(child(init, 0)), std::move(last), std::move(by), block(child(node, childCount(node) - 2))));
+        }
+
+        // TRY block catch_blocks [FINALLY block] END, catch_blocks is CATCH VAR block [catch_blocks]
+        std::unique_ptr<BaseAST> tryStatement(const TreeNode& node) {
+            std::unique_ptr<BaseAST> body = block(child(node, 1));
+            CatchBlocks catches;
+            for (const TreeNode* list = &child(node, 2); ; list = &child(*list, 3)) {
+                catches.emplace_back(text(child(*list, 1)), block(child(*list, 2)));
+                if (childCount(*list) == 3) break;
+            }
+            std::unique_ptr<BaseAST> finally = childCount(node) == 6 ? block(child(node, 4)) : nullptr;
+            return std::make_unique<TryAST>(std::move(body), std::move(catches), std::move(finally));
+        }
+
+        // the names of the arguments and their types, Unknown where none is given
+        void argList(const TreeNode& node, std::vector<std::string>& names, std::vector<BabelType>& types) const {
+            if (tree.isToken(node)) {
+                names.push_back(text(node));
+                types.push_back(BabelType::Unknown);
+                return;
+            }
+            if (is(child(node, 0), "args")) {
+                argList(child(node, 0), names, types);
+                argList(child(node, 2), names, types);
+                return;
+            }
+            if (childCount(node) > 2 || (childCount(node) == 2 && !is(child(node, 1), "type_spec"))) unsupported(node);
+            names.push_back(text(child(node, 0)));
+            types.push_back(childCount(node) == 2 ? valueType(text(child(child(node, 1), 1))) : BabelType::Unknown);
+        }
+
+        std::unique_ptr<BaseAST> taskDefinition(const TreeNode& node) {
+            const TreeNode& header = child(node, 0);
+            std::vector<std::string> args;
+            std::vector<BabelType> argTypes;
+            if (!is(child(header, 3), "RPAREN")) argList(child(header, 3), args, argTypes);
+
+            const bool typed = is(child(header, childCount(header) - 2), "RARR");
+            const BabelType returnType = typed ? resultType(text(child(header, childCount(header) - 1))) : BabelType::Unknown;
+
+            auto prototype = std::make_unique<TaskHeaderAST>(text(child(header, 1)), std::move(args), std::move(argTypes), returnType);
+            return std::make_unique<TaskAST>(std::move(prototype), block(child(node, 1)));
+        }
+
+        void statement(const TreeNode& node, std::vector<std::unique_ptr<BaseAST>>& out, bool topLevel) {
+            if (is(node, "BREAK") || is(node, "CONTINUE")) {
+                out.push_back(std::make_unique<LoopControlAST>(is(node, "BREAK")));
+            } else if (is(node, "return_stmt") || is(node, "RETURN")) {
+                out.push_back(std::make_unique<ReturnAST>(childCount(node) == 2 ? expression(child(node, 1)) : nullptr));
+            } else if (is(node, "assignment")) {
+                out.push_back(assignment(node));
+            } else if (is(node, "function_call")) {
+                out.push_back(call(node));
+            } else if (is(node, "task_def")) {
+                if (!topLevel) throw std::runtime_error("tasks can only be defined at the top level");
+                out.push_back(taskDefinition(node));
+            } else if (is(node, "if_stmt")) {
+                out.push_back(ifStatement(node));
+            } else if (is(node, "match_stmt")) {
+                matchStatement(node, out);
+            } else if (is(node, "loop_stmt")) {
+                loopStatement(node, out);
+            } else if (is(node, "try_stmt")) {
+                out.push_back(tryStatement(node));
+            } else if (is(node, "raise_stmt")) {
+                out.push_back(makeRaise(expression(child(node, 1))));
+            } else if (!tree.isToken(node)) {
+                unsupported(node);
+            }
+        }
+
+    public:
+        explicit TreeLowering(const ParseTree& tree) : tree(tree) {}
+
+        // Statement lists, blocks and the nodes that wrap a single statement, flattened into out.
+        // A tree without pass-through nodes has the statement itself where a list or block holds
+        // only one; tokens like PASS, NEWLINE and SEMICOLON add nothing.
+        void statements(const TreeNode& node, std::vector<std::unique_ptr<BaseAST>>& out, bool topLevel) {
+            static const std::string_view lists[] = {"program", "statement_list", "statement", "simple_stmt_list", "simple_stmt",
+                                                     "compound_stmt", "control_flow", "block"};
+            if (std::find(std::begin(lists), std::end(lists), tree.nameOf(node)) == std::end(lists)) {
+                statement(node, out, topLevel);
+                return;
+            }
+            for (const uint32_t index : tree.childrenOf(node)) {
+                statements(tree.nodes[index], out, topLevel);
+            }
+        }
+};
+
+}
+
+std::vector<std::unique_ptr<BaseAST>> lowerProgram(const ParseTree& tree) {
+    std::vector<std::unique_ptr<BaseAST>> program;
+    TreeLowering(tree).statements(tree.getRoot(), program, true);
+    return program;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "ast.h"
+#include "lrparser.h"
+
+// operators by terminal name, and those of x op= e, for the semantic actions as well
+extern const std::map<std::string_view, std::string> binaryOperators;
+extern const std::map<std::string_view, std::string> compoundAssignments;
+
+// The nodes of constructs that do not map to a single node one to one, made the same way
+// from the parse tree and by the semantic actions. The types throw std::runtime_error for
+// the ones that are not supported yet.
+
+// the value and block of every case of a match, last first
+using MatchCases = std::vector<std::pair<std::unique_ptr<BaseAST>, std::unique_ptr<BaseAST>>>;
+// the kind of error and block of every catch of a try
+using CatchBlocks = std::vector<std::pair<std::string, std::unique_ptr<BaseAST>>>;
+
+// the type a TYPE token names, only the ones values can have
+BabelType valueType(const std::string& name);
+// the type after a task's =>, void included
+BabelType resultType(const std::string& name);
+// name = value, or name = name op value for x op= e where compound is op
+std::unique_ptr<BaseAST> makeAssignment(const std::string& name, const std::string* compound, std::unique_ptr<BaseAST> value, BabelType declared);
+// appends the statements of a match, otherwise is the block after the cases or nullptr
+void makeMatch(std::unique_ptr<BaseAST> subject, MatchCases cases, std::unique_ptr<BaseAST> otherwise, std::vector<std::unique_ptr<BaseAST>>& out);
+// the loop of FOR name = first TO last [STEP by] DO body END, by is nullptr without STEP
+std::unique_ptr<BaseAST> makeCountingLoop(const std::string& name, std::unique_ptr<BaseAST> last, std::unique_ptr<BaseAST> by, std::unique_ptr<BaseAST> body);
+
+// RAISE e, where e has to be the name of the kind of error
+std::unique_ptr<BaseAST> makeRaise(std::unique_ptr<BaseAST> error);
+
+// Turns an accepted parse tree into the ast.h nodes, one per top level statement,
+// task definitions among them. Throws std::runtime_error for what the parse tree
+// can say but codegen can not do yet, like classes.
+std::vector<std::unique_ptr<BaseAST>> lowerProgram(const ParseTree& tree);
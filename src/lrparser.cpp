@@ -0,0 +1,353 @@
+#include "lrparser.h"
+
+void digraph(const std::vector<std::vector<int>>& edges, std::vector<TerminalSet>& sets) {
+    const int infinity = std::numeric_limits<int>::max();
+    std::vector<int> depth(sets.size(), 0);
+    std::vector<int> stack;
+
+    std::function<void(int)> traverse = [&](int x) {
+        stack.push_back(x);
+        const int d = static_cast<int>(stack.size());
+        depth[x] = d;
+
+        for (int y : edges[x]) {
+            if (depth[y] == 0) traverse(y);
+            depth[x] = std::min(depth[x], depth[y]);
+            sets[x].merge(sets[y]);
+        }
+
+        if (depth[x] == d) {
+            while (true) {
+                int top = stack.back();
+                stack.pop_back();
+                depth[top] = infinity;
+                if (top == x) break;
+                sets[top] = sets[x];
+            }
+        }
+    };
+
+    for (size_t x = 0; x < sets.size(); x++) {
+        if (depth[x] == 0) traverse(static_cast<int>(x));
+    }
+}
+
+void Grammar::initializeRulesAndAlphabetAndNonterminals (const std::string& text) {
+    std::list<std::string> lines = splitString(text, "\n");
+
+    for (const std::string& _ : lines) { //potentially mark const
+        std::string line = boost::trim_copy(_);
+
+        if (line.rfind('%', 0) == 0) {
+            directives.push_back(line);
+        } else if (line != "") {
+            // the annotations "%prec NAME" and "%keep" after the development are not part of it
+            std::string precedenceName;
+            bool keep = false;
+            size_t annotations = line.find('%');
+            if (annotations != std::string::npos) {
+                std::list<std::string> words = trimElements(splitString(line.substr(annotations), " "));
+                words.remove("");
+                for (auto word = words.begin(); word != words.end(); ++word) {
+                    if (*word == "%keep") keep = true;
+                    else if (*word == "%prec" && std::next(word) != words.end()) precedenceName = *++word;
+                    else throw std::runtime_error("unknown rule annotation " + *word);
+                }
+                line.erase(annotations);
+            }
+            precedenceNames.push_back(precedenceName);
+            keptRules.push_back(keep);
+
+            Rule rule(static_cast<int>(rules.size()), line, symbols);
+            rules.push_back(rule);
+
+            if (axiom < 0) {
+                axiom = rule.nonterminal;
+            }
+            
+            addUnique(rule.nonterminal, alphabet);
+            addUnique(rule.nonterminal, nonterminals);
+        }
+    }
+}
+
+void Grammar::initializeAlphabetAndTerminals () {
+    for (const Rule& rule : rules) {
+        for (Symbol symbol : rule.development) {
+            if (symbol != EPSILON_SYMBOL && symbol != END_SYMBOL && !isElement(symbol, nonterminals)) {
+                addUnique(symbol, alphabet);
+                addUnique(symbol, terminals);
+            }
+        }
+    }
+}
+
+void Grammar::renumberSymbols () {
+    // terminals come first so that the columns of ACTION and GOTO are contiguous ranges of IDs
+    std::vector<Symbol> order = {EPSILON_SYMBOL, END_SYMBOL};
+    order.insert(order.end(), terminals.begin(), terminals.end());
+    order.insert(order.end(), nonterminals.begin(), nonterminals.end());
+    assert(static_cast<int>(order.size()) == symbols.size());
+
+    std::vector<Symbol> mapping = symbols.reorder(order);
+    auto remap = [&mapping](std::vector<Symbol>& list) {
+        for (Symbol& symbol : list) symbol = mapping[symbol];
+    };
+
+    for (Rule& rule : rules) {
+        rule.nonterminal = mapping[rule.nonterminal];
+        remap(rule.development);
+    }
+    remap(alphabet);
+    remap(terminals);
+    remap(nonterminals);
+    axiom = mapping[axiom];
+}
+
+void Grammar::indexSymbols () {
+    terminalCount = symbols.size() - static_cast<int>(nonterminals.size());
+    terminalFlags.assign(symbols.size(), false);
+    rulesByNonterminal.assign(symbols.size(), {});
+
+    for (Symbol terminal : terminals) {
+        terminalFlags[terminal] = true;
+    }
+
+    for (const Rule& rule : rules) {
+        rulesByNonterminal[rule.nonterminal].push_back(rule.index);
+    }
+}
+
+// "%sync NAME..." marks terminals as synchronizing, the symbols are only known once the rules are read.
+// "%left NAME...", "%right NAME..." and "%nonassoc NAME..." each declare a precedence level, later lines
+// bind tighter; names that are no terminal, like UNARY, are only there for %prec. Rules of one symbol
+// are pass-through unless annotated with %keep.
+void Grammar::initializeDirectives () {
+    static const std::map<std::string, Associativity> levels = {{"%left", LEFT}, {"%right", RIGHT}, {"%nonassoc", NONASSOC}};
+    std::map<std::string, int> precedenceOf;
+    terminalPrecedence.assign(symbols.size(), 0);
+    associativity.assign(symbols.size(), NONE);
+
+    for (const std::string& line : directives) {
+        std::list<std::string> words = trimElements(splitString(line, " "));
+        words.remove("");
+        const std::string name = words.front();
+        words.pop_front();
+
+        if (name == "%sync") {
+            for (const std::string& word : words) {
+                Symbol symbol = symbols.find(word);
+                if (symbol < 0 || !isTerminal(symbol)) throw std::runtime_error("%sync: " + word + " is not a terminal of the grammar");
+                addUnique(symbol, syncTerminals);
+            }
+            continue;
+        }
+
+        auto level = levels.find(name);
+        if (level == levels.end()) throw std::runtime_error("unknown grammar directive " + name);
+        const int precedence = static_cast<int>(precedenceOf.size()) + 1;
+        for (const std::string& word : words) {
+            if (!precedenceOf.emplace(word, precedence).second) throw std::runtime_error(name + ": " + word + " already has a precedence");
+            Symbol symbol = symbols.find(word);
+            if (symbol >= 0 && isTerminal(symbol)) {
+                terminalPrecedence[symbol] = precedence;
+                associativity[symbol] = level->second;
+            }
+        }
+    }
+
+    rulePrecedence.assign(rules.size(), 0);
+    for (const Rule& rule : rules) {
+        const std::string& prec = precedenceNames[rule.index];
+        if (!prec.empty()) {
+            auto found = precedenceOf.find(prec);
+            if (found == precedenceOf.end()) throw std::runtime_error("%prec: " + prec + " has no precedence");
+            rulePrecedence[rule.index] = found->second;
+            continue;
+        }
+        for (Symbol symbol : rule.development) {
+            if (isTerminal(symbol) && terminalPrecedence[symbol] != 0) rulePrecedence[rule.index] = terminalPrecedence[symbol];
+        }
+    }
+
+    // the first rule is never reduced, the parser accepts instead
+    passThrough.assign(rules.size(), false);
+    for (const Rule& rule : rules) {
+        passThrough[rule.index] = rule.index != 0 && rule.length() == 1 && !keptRules[rule.index];
+    }
+}
+
+void Grammar::initializeNullable () {
+    // every rule waits for the symbols of its development that are not known to be nullable yet
+    nullable.assign(symbols.size(), false);
+    std::vector<int> waiting(rules.size(), 0);
+    std::vector<std::vector<int>> occurrences(symbols.size());
+    std::vector<Symbol> pending;
+
+    for (const Rule& rule : rules) {
+        auto end = rule.development.begin() + rule.length();
+        if (std::any_of(rule.development.begin(), end, [&](Symbol symbol) { return isTerminal(symbol); })) continue;
+
+        for (auto it = rule.development.begin(); it != end; ++it) {
+            waiting[rule.index]++;
+            occurrences[*it].push_back(rule.index);
+        }
+
+        if (waiting[rule.index] == 0 && !nullable[rule.nonterminal]) {
+            nullable[rule.nonterminal] = true;
+            pending.push_back(rule.nonterminal);
+        }
+    }
+
+    while (!pending.empty()) {
+        Symbol symbol = pending.back();
+        pending.pop_back();
+
+        for (int ruleIndex : occurrences[symbol]) {
+            Symbol nonterminal = rules[ruleIndex].nonterminal;
+            if (--waiting[ruleIndex] == 0 && !nullable[nonterminal]) {
+                nullable[nonterminal] = true;
+                pending.push_back(nonterminal);
+            }
+        }
+    }
+}
+
+void Grammar::initializeFirsts () {
+    // FIRST(A) holds the terminals that start a development of A after a nullable
+    // prefix, and FIRST(B) of every nonterminal B found there
+    firsts.assign(symbols.size(), TerminalSet(terminalCount));
+    std::vector<std::vector<int>> edges(symbols.size());
+
+    for (const Rule& rule : rules) {
+        for (int i = 0; i < rule.length(); i++) {
+            Symbol symbol = rule.development[i];
+            if (isTerminal(symbol)) {
+                firsts[rule.nonterminal].insert(symbol);
+                break;
+            }
+
+            edges[rule.nonterminal].push_back(symbol);
+            if (!nullable[symbol]) break;
+        }
+    }
+
+    digraph(edges, firsts);
+}
+
+void Grammar::initializeFollows() {
+    // for A -> alpha B beta, FOLLOW(B) holds FIRST(beta), and FOLLOW(A) when beta is nullable
+    follows.assign(symbols.size(), TerminalSet(terminalCount));
+    std::vector<std::vector<int>> edges(symbols.size());
+    follows[rules.front().nonterminal].insert(END_SYMBOL);
+
+    for (const Rule& rule : rules) {
+        for (int i = 0; i < rule.length(); i++) {
+            Symbol symbol = rule.development[i];
+            if (isTerminal(symbol)) continue;
+
+            if (getSequenceFirsts(rule.development.begin() + i + 1, rule.development.end(), follows[symbol])) {
+                edges[symbol].push_back(rule.nonterminal);
+            }
+        }
+    }
+
+    digraph(edges, follows);
+}
+
+bool Parser::simulate(const std::vector<int>& stateStack, size_t& depth, std::vector<int>& trial, Symbol terminal) const {
+    while (true) {
+        const LRAction next = tables->action(trial.empty() ? stateStack[depth - 1] : trial.back(), terminal);
+        if (next.kind() == LRAction::SHIFT) trial.push_back(next.value());
+        if (next.kind() != LRAction::REDUCE) return next.kind() == LRAction::SHIFT || next.kind() == LRAction::ACCEPT;
+
+        const size_t length = tables->ruleLength(next.value());
+        const size_t fromTrial = std::min(length, trial.size());
+        trial.resize(trial.size() - fromTrial);
+        depth -= length - fromTrial;
+        trial.push_back(tables->goTo(trial.empty() ? stateStack[depth - 1] : trial.back(), tables->ruleNonterminal(next.value())));
+    }
+}
+
+Symbol Parser::findMissing(const std::vector<int>& stateStack, Symbol found) const {
+    std::vector<int> trial;
+    for (bool sync : {true, false}) {
+        for (uint32_t terminal : tables->expected(stateStack.back())) {
+            if (terminal == END_SYMBOL || tables->isSync(terminal) != sync) continue;
+
+            trial.clear();
+            size_t depth = stateStack.size();
+            if (simulate(stateStack, depth, trial, terminal) && simulate(stateStack, depth, trial, found)) return terminal;
+        }
+    }
+    return -1;
+}
+
+size_t Parser::findResumeDepth(const std::vector<int>& stateStack, Symbol symbol, bool afterSync) const {
+    const bool mayPop = symbol == END_SYMBOL || tables->isSync(symbol) || afterSync;
+    std::vector<int> trial;
+    for (size_t depth = stateStack.size(); depth >= 1; depth--) {
+        trial.clear();
+        size_t remaining = depth;
+        if (simulate(stateStack, remaining, trial, symbol)) return depth;
+        if (!mayPop) break;
+    }
+    return 0;
+}
+
+uint64_t hashBytes(const void* data, size_t size) {
+    const uint64_t prime = 0x100000001b3ull;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ bytes[i]) * prime;
+    }
+
+    return hash;
+}
+
+uint64_t hashGrammar(const std::string& grammarText) {
+    return hashBytes(grammarText.data(), grammarText.size());
+}
+
+std::string transform_string(const std::string& input_string) {
+    std::istringstream iss(input_string);
+    std::string line;
+    std::vector<std::string> lines;
+    while (std::getline(iss, line)) {
+        lines.push_back(line);
+    }
+
+    size_t last_colon_pos;
+    std::string last_colon_part;
+
+    for (auto& line : lines) {
+        // directives are passed through as they are
+        if (line.rfind('%', 0) == 0) continue;
+
+        if (line.rfind(':') != std::string::npos) {
+            last_colon_pos = line.rfind(':');
+            last_colon_part = line.substr(0, last_colon_pos);
+        }
+        
+        size_t last_pipe_pos = line.rfind('|');
+        if (last_pipe_pos != std::string::npos) {
+            line.insert(last_pipe_pos, last_colon_part);
+        }
+    }
+
+    const std::regex separators(":|\\|");
+    std::ostringstream oss;
+    for (const auto& line : lines) {
+        oss << (line.rfind('%', 0) == 0 ? line : std::regex_replace(line, separators, "->")) << '\n';
+    }
+
+    return oss.str();
+}
@@ -1,4 +1,7 @@
+#pragma once
+
 #include <algorithm>
+#include <bit>
 #include <boost/algorithm/string.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
@@ -7,19 +10,29 @@
 #include <boost/serialization/map.hpp>
 #include <boost/serialization/list.hpp>
 #include <boost/serialization/string.hpp>
+#include <boost/serialization/vector.hpp>
 #include <cassert>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <limits>
 #include <fstream>
 #include <list>
 #include <map>
+#include <memory_resource>
 #include <optional>
+#include <span>
 #include <regex>
 #include <sstream>
-#include <stack>
 #include <string>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 #include "tools.h"
 #include "lexer.h"
+#include "streamlexer.h"
+#include "threadpool.h"
 
 #include <iostream>
 
@@ -74,468 +87,683 @@ using standalone_function_t = void (*)();
 
 const std::string EPSILON = "''";
 
-class Rule;
+// Grammar symbols are interned to dense integer IDs when the grammar is loaded.
+// The generator and the parser only ever compare IDs, names are kept for
+// diagnostics and for printing trees.
+using Symbol = int;
 
-class Grammar {
-    private:
-        void initializeRulesAndAlphabetAndNonterminals (const std::string& text);
+const Symbol EPSILON_SYMBOL = 0;
+const Symbol END_SYMBOL = 1;
 
-        void initializeAlphabetAndTerminals ();
+class SymbolTable {
+    private:
+        std::vector<std::string> names;
+        std::unordered_map<std::string, Symbol> ids;
 
-        bool collectDevelopmentFirsts(const std::list<std::string>& development, std::list<std::string>& nonterminalFirsts);
+    public:
+        SymbolTable() {
+            intern(EPSILON);
+            intern("$");
+        }
 
-        void initializeFirsts ();
+        Symbol intern(const std::string& name) {
+            auto [it, inserted] = ids.emplace(name, static_cast<Symbol>(names.size()));
+            if (inserted) names.push_back(name);
+            return it->second;
+        }
 
-        void initializeFollows();
+        // returns -1 for names that are not part of the grammar
+        Symbol find(const std::string& name) const {
+            auto it = ids.find(name);
+            return it == ids.end() ? -1 : it->second;
+        }
 
-    public:
-        std::list<std::string> alphabet;
-        std::list<std::string> nonterminals;
-        std::list<std::string> terminals;
-        std::list<Rule> rules;
-        std::string text;
-        mutable std::map<std::string, std::list<std::string>> firsts;
-        std::map<std::string, std::list<std::string>> follows;
-        std::string axiom;
+        const std::string& nameOf(Symbol symbol) const {
+            return names[symbol];
+        }
 
-        Grammar() = default;
-        explicit Grammar(std::string const& text) {
-            initializeRulesAndAlphabetAndNonterminals(text);
-            initializeAlphabetAndTerminals();
-            initializeFirsts();
-            initializeFollows();
+        int size() const {
+            return static_cast<int>(names.size());
         }
 
-        std::list<Rule> getRulesForNonterminal(const std::string& nonterminal) const;
+        // renumbers the symbols so that order[i] gets ID i, returns the new ID of every old one
+        std::vector<Symbol> reorder(const std::vector<Symbol>& order) {
+            std::vector<std::string> reordered;
+            std::vector<Symbol> mapping(names.size());
 
-        std::list<std::string> getSequenceFirsts(const std::list<std::string>& sequence) const {
-            std::list<std::string> result = {};
-            bool epsilonInSymbolFirsts = true;
+            for (Symbol symbol : order) {
+                mapping[symbol] = static_cast<Symbol>(reordered.size());
+                reordered.push_back(std::move(names[symbol]));
+            }
 
-            for (const std::string& symbol : sequence) { //potentially mark const
-                epsilonInSymbolFirsts = false;
+            names = std::move(reordered);
+            for (size_t i = 0; i < names.size(); i++) {
+                ids[names[i]] = static_cast<Symbol>(i);
+            }
 
-                if (std::find(terminals.begin(), terminals.end(), symbol) != terminals.end()) {
-                    addUnique(symbol, result);
+            return mapping;
+        }
 
-                    break;
-                }
-                
-                for (const std::string& first : firsts.at(symbol)) { //potentially mark const
-                    epsilonInSymbolFirsts |= first == EPSILON;
-                    addUnique(first, result);
+        template <class Archive>
+        void serialize(Archive& ar, const unsigned int /* version */) {
+            ar & names;
+
+            if (Archive::is_loading::value) {
+                ids.clear();
+                for (size_t i = 0; i < names.size(); i++) {
+                    ids.emplace(names[i], static_cast<Symbol>(i));
                 }
-                
-                epsilonInSymbolFirsts |= firsts.at(symbol).size() == 0;
+            }
+        }
+};
+
+// Set of terminal IDs as a bitset, used for FIRST, FOLLOW and lookahead sets.
+class TerminalSet {
+    private:
+        std::vector<uint64_t> words;
+
+    public:
+        TerminalSet() = default;
+        explicit TerminalSet(int terminalCount) : words((terminalCount + 63) / 64, 0) {}
+
+        void insert(Symbol terminal) {
+            words[terminal >> 6] |= uint64_t(1) << (terminal & 63);
+        }
+
+        bool contains(Symbol terminal) const {
+            return (words[terminal >> 6] >> (terminal & 63)) & 1;
+        }
 
-                if (!epsilonInSymbolFirsts) break;                
+        bool empty() const {
+            return std::all_of(words.begin(), words.end(), [](uint64_t word) { return word == 0; });
+        }
+
+        // returns whether this set grew
+        bool merge(const TerminalSet& that) {
+            uint64_t added = 0;
+            for (size_t i = 0; i < words.size(); i++) {
+                added |= that.words[i] & ~words[i];
+                words[i] |= that.words[i];
+            }
+            return added != 0;
+        }
+
+        template <typename F>
+        void forEach(F&& f) const {
+            for (size_t i = 0; i < words.size(); i++) {
+                for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+                    f(static_cast<Symbol>(i * 64 + std::countr_zero(word)));
+                }
             }
+        }
 
-            if (epsilonInSymbolFirsts) addUnique(EPSILON, result);
+        const std::vector<uint64_t>& getWords() const {
+            return words;
+        }
 
-            return result;
+        bool operator==(const TerminalSet& that) const {
+            return words == that.words;
         }
 
         template <class Archive>
         void serialize(Archive& ar, const unsigned int /* version */) {
-            ar & alphabet;
-            ar & nonterminals;
-            ar & terminals;
-            ar & rules;
-            ar & text;
-            ar & firsts;
-            ar & follows;
-            ar & axiom;
-        }        
+            ar & words;
+        }
 };
 
+// Digraph from DeRemer and Pennello: for every x, sets[x] becomes the union of the
+// initial sets over everything reachable from x through edges. Strongly connected
+// components are found on the way and share one set, so each edge is followed once.
+void digraph(const std::vector<std::vector<int>>& edges, std::vector<TerminalSet>& sets);
+
 class Rule {
     public:
-        const Grammar* grammar;
         int index;
-        std::string nonterminal;
-        std::list<std::string> pattern;
-        std::list<std::string> development;
+        Symbol nonterminal;
+        std::vector<Symbol> development;
         
         Rule() = default;
-        Rule(const Grammar* grammar, const std::string& text) : grammar(grammar), index(static_cast<int>(grammar->rules.size()) ) {
+        Rule(int index, const std::string& text, SymbolTable& symbols) : index(index) {
             std::list<std::string> split = splitString(text, "->");
-            nonterminal = boost::trim_copy(split.front());
-            pattern = trimElements(splitString(nonterminal, " "));
-            development = trimElements(splitString(boost::trim_copy(split.back()), " "));
+            nonterminal = symbols.intern(boost::trim_copy(split.front()));
+
+            for (const std::string& symbol : trimElements(splitString(boost::trim_copy(split.back()), " "))) {
+                if (!symbol.empty()) development.push_back(symbols.intern(symbol));
+            }
+        }
+
+        bool isEpsilon() const {
+            return development.size() == 1 && development.front() == EPSILON_SYMBOL;
+        }
+
+        // number of symbols a reduction by this rule pops
+        int length() const {
+            return isEpsilon() ? 0 : static_cast<int>(development.size());
         }
         
         bool operator==(const Rule& that) const {
-            if (nonterminal != that.nonterminal) {
-			    return false;
-		    }
-		
-		    if (development.size() != that.development.size()) {
-			    return false;
-		    }
-		
-		    if (development != that.development) {
-		        return false;
-		    }
-		
-		    return true;
+            return nonterminal == that.nonterminal && development == that.development;
         }
         
-        friend std::ostream& operator<<(std::ostream& os, const Rule& rule) {
-            os << rule.nonterminal << " -> ";
-            if (!rule.development.empty()) {
-                auto it = rule.development.begin();
-                os << *it;
-                ++it;
-                for (; it != rule.development.end(); ++it) {
-                    os << " " << *it;
-                }
+        std::string toString(const SymbolTable& symbols) const {
+            std::string result = symbols.nameOf(nonterminal) + " ->";
+            for (Symbol symbol : development) {
+                result += " " + symbols.nameOf(symbol);
             }
-            return os;
+            return result;
         }
 
         template <class Archive>
         void serialize(Archive& ar, const unsigned int /* version */) {
-            ar & grammar;
             ar & index;
             ar & nonterminal;
-            ar & pattern;
             ar & development;
         }
 };
 
-void Grammar::initializeRulesAndAlphabetAndNonterminals (const std::string& text) {
-    std::list<std::string> lines = splitString(text, "\n");
+class Grammar {
+    private:
+        std::vector<bool> terminalFlags;
+        std::vector<std::vector<int>> rulesByNonterminal;
+        std::vector<std::string> directives;
+        // the names of "%prec NAME" by rule, empty where a rule has none
+        std::vector<std::string> precedenceNames;
+        // rules annotated with %keep
+        std::vector<bool> keptRules;
 
-    for (const std::string& _ : lines) { //potentially mark const
-        std::string line = boost::trim_copy(_);
+        void initializeRulesAndAlphabetAndNonterminals (const std::string& text);
 
-        if (line != "") {
-            // should use unique_pointr here later
-            Rule rule(this, line);
-            rules.push_back(rule);
+        void initializeDirectives ();
 
-            if (axiom.empty()) {
-                axiom = rule.nonterminal;
-            }
-            
-            addUnique(rule.nonterminal, alphabet);
-            addUnique(rule.nonterminal, nonterminals);
-        }
-    }
-}
+        void initializeAlphabetAndTerminals ();
 
-void Grammar::initializeAlphabetAndTerminals () {
-    for (const Rule& rule : rules) { //potentially mark const
-        for (const std::string& symbol : rule.development) { //potentially mark const
-            if (symbol != EPSILON && symbol != "$" && std::find(nonterminals.begin(), nonterminals.end(), symbol) == nonterminals.end()) {
-                addUnique(symbol, alphabet);
-                addUnique(symbol, terminals);
-            }
-        }
-    }
-}
+        void renumberSymbols ();
 
-bool Grammar::collectDevelopmentFirsts(const std::list<std::string>& development, std::list<std::string>& nonterminalFirsts) {
-    bool result = false;
-    bool epsilonInSymbolFirsts = true;
-    
-    for (const std::string& symbol : development) { //potentially mark const
-        epsilonInSymbolFirsts = false;
+        void indexSymbols ();
 
-        if (isElement(symbol, terminals)) {
-            result |= addUnique(symbol, nonterminalFirsts);
-            
-            break;
-        }
+        void initializeNullable ();
 
-        if (firsts.find(symbol) != firsts.end()) {
-            for (const std::string& first : firsts.at(symbol)) { //potentially mark const
-                epsilonInSymbolFirsts |= first == EPSILON;
-                result |= addUnique(boost::trim_copy(first), nonterminalFirsts);
-            }
-        }
+        void initializeFirsts ();
 
-        if (!epsilonInSymbolFirsts) break;
-    }
+        void initializeFollows();
 
-    if (epsilonInSymbolFirsts) {
-        result |= addUnique(EPSILON, nonterminalFirsts);
-    }
+    public:
+        SymbolTable symbols;
+        std::vector<Symbol> alphabet;
+        std::vector<Symbol> nonterminals;
+        std::vector<Symbol> terminals;
+        std::vector<Rule> rules;
+        std::string text;
+        // indexed by symbol; FIRST and FOLLOW never contain EPSILON, nullable says whether a symbol derives it
+        std::vector<TerminalSet> firsts;
+        std::vector<TerminalSet> follows;
+        std::vector<bool> nullable;
+        // terminals named by %sync lines, error recovery resumes parsing at them
+        std::vector<Symbol> syncTerminals;
+        // levels of %left, %right and %nonassoc lines by terminal and by rule, 0 where there is none;
+        // a rule has the level of its %prec name or else of its last terminal that has one
+        enum Associativity : uint8_t { NONE, LEFT, RIGHT, NONASSOC };
+        std::vector<int> terminalPrecedence;
+        std::vector<Associativity> associativity;
+        std::vector<int> rulePrecedence;
+        // by rule, whether its node only wraps its one child: a tree can leave it out and
+        // the table can skip the reduction, see LRTable::bypassActions
+        std::vector<bool> passThrough;
+        Symbol axiom = -1;
+        // IDs below terminalCount are EPSILON, "$" and the terminals, the rest are nonterminals
+        int terminalCount = 0;
 
-    return result;
-}
+        Grammar() = default;
+        explicit Grammar(std::string const& text) : text(text) {
+            initializeRulesAndAlphabetAndNonterminals(text);
+            initializeAlphabetAndTerminals();
+            renumberSymbols();
+            indexSymbols();
+            initializeDirectives();
+            initializeNullable();
+            initializeFirsts();
+            initializeFollows();
+        }
 
-void Grammar::initializeFirsts () {
-    bool notDone;
+        bool isTerminal(Symbol symbol) const {
+            return terminalFlags[symbol];
+        }
 
-    do{
-        notDone = false;
+        bool isNonterminal(Symbol symbol) const {
+            return !rulesByNonterminal[symbol].empty();
+        }
 
-        for (Rule& rule : rules) {
-            std::list<std::string> nonterminalFirsts = getOrCreateArray(firsts, rule.nonterminal);
+        const std::string& nameOf(Symbol symbol) const {
+            return symbols.nameOf(symbol);
+        }
 
-            if (rule.development.size() == 1 && rule.development.front() == EPSILON) {
-                notDone |= addUnique(EPSILON, nonterminalFirsts);
-            } else {
-                notDone |= collectDevelopmentFirsts(rule.development, nonterminalFirsts);
-            }
-            firsts[rule.nonterminal] = nonterminalFirsts;
+        const std::vector<int>& getRulesForNonterminal(Symbol nonterminal) const {
+            return rulesByNonterminal[nonterminal];
         }
-    } while (notDone);
-}
 
-void Grammar::initializeFollows() {
-    bool notDone;
+        // ORs FIRST of the sequence into result and returns whether the whole sequence is nullable
+        template <typename Iterator>
+        bool getSequenceFirsts(Iterator begin, Iterator end, TerminalSet& result) const {
+            for (Iterator it = begin; it != end; ++it) {
+                Symbol symbol = *it;
+                if (symbol == EPSILON_SYMBOL) continue;
 
-    do {
-        notDone = false;
-        
-        for (const Rule& rule : rules) {
-            if (rule == rules.front()) {
-                std::list<std::string> nonterminalFollows = getOrCreateArray(follows, rule.nonterminal);
-                notDone |= addUnique<std::string>("$", nonterminalFollows);
-                follows[rule.nonterminal] = nonterminalFollows;
-            }
-
-            for (int i = 0; i < rule.development.size(); i++) {
-                std::string symbol = getElement(i, rule.development);
-
-                if (isElement(symbol, nonterminals)) {
-                    std::list<std::string> symbolFollows = getOrCreateArray(follows, symbol);
-                    
-                    std::list<std::string> sliced = rule.development;
-                    auto end = sliced.begin();
-                    std::advance(end, i + 1);
-                    sliced.erase(sliced.begin(), end);
-                    
-                    std::list<std::string> afterSymbolFirsts = getSequenceFirsts(sliced);
-
-                    for (const std::string& first : afterSymbolFirsts) { //potentially mark const
-                        if (first == EPSILON) {
-                            std::list<std::string> nonterminalFollows = follows[rule.nonterminal];
-
-                            for (const std::string& _ : nonterminalFollows) { //potentially mark const
-                                notDone |= addUnique(_, symbolFollows);
-                            }
-                        } else {
-                            notDone |= addUnique(first, symbolFollows);
-                        }
-                    }
-                    follows[symbol] = symbolFollows;
+                if (symbol < terminalCount) {
+                    result.insert(symbol);
+                    return false;
                 }
+
+                result.merge(firsts[symbol]);
+                if (!nullable[symbol]) return false;
             }
-        }
-    } while (notDone);
-}
 
-std::list<Rule> Grammar::getRulesForNonterminal(const std::string& nonterminal) const {
-    std::list<Rule> result = {};
+            return true;
+        }
 
-    for (Rule rule : rules) {
-        if (nonterminal == rule.nonterminal) {
-            result.push_back(rule);
+        bool getSequenceFirsts(const std::vector<Symbol>& sequence, TerminalSet& result) const {
+            return getSequenceFirsts(sequence.begin(), sequence.end(), result);
         }
-    }
-    
-    return result;
-}
 
-class UnifiedItem {
+        template <class Archive>
+        void serialize(Archive& ar, const unsigned int /* version */) {
+            ar & symbols;
+            ar & alphabet;
+            ar & nonterminals;
+            ar & terminals;
+            ar & rules;
+            ar & text;
+            ar & firsts;
+            ar & follows;
+            ar & nullable;
+            ar & syncTerminals;
+            ar & terminalPrecedence;
+            ar & associativity;
+            ar & rulePrecedence;
+            ar & passThrough;
+            ar & axiom;
+
+            if (Archive::is_loading::value) indexSymbols();
+        }        
+};
+
+// 64-bit FNV-1a over whole words, the byte-wise tail is folded in the same way.
+// Used for grammar hashes and the checksum of table files.
+uint64_t hashBytes(const void* data, size_t size);
+
+uint64_t hashGrammar(const std::string& grammarText);
+
+// A state of the LR automaton as the table builder needs it: the transitions in
+// ascending symbol order and the reductions in ascending rule order.
+struct LRState {
+    std::vector<std::pair<Symbol, int>> transitions;
+    std::vector<std::pair<int, TerminalSet>> reductions;
+};
+
+// Builds the LR automaton with a worklist. An item (rule, dot) is a single integer
+// and a kernel is looked up by hashing its sorted items, so every state is closed
+// and expanded exactly once.
+//
+// LALR1 builds the LR(0) automaton and computes lookaheads with DeRemer and
+// Pennello's relations. LR1 is the canonical construction, where lookaheads are
+// part of the kernel, so states only merge if they agree on them too.
+class LRClosureTable {
     public:
-        Rule rule;
-        int dotIndex;
-        std::list<std::string> lookAheads;
+        enum Mode { LALR1, LR1 };
 
-        UnifiedItem(const Rule& rule, int dotIndex) : rule(rule), dotIndex(dotIndex) {
-            if (rule.index == 0) {
-                lookAheads.emplace_back("$");
-            }
+        const Grammar& grammar;
+        Mode mode;
+        std::vector<LRState> states;
+
+        // a pool spreads the construction of the automaton over its threads, the result is the same
+        explicit LRClosureTable(const Grammar& grammar, Mode mode = LALR1, ThreadPool* pool = nullptr) : grammar(grammar), mode(mode) {
+            indexItems();
+            buildAutomaton(pool);
+            if (mode == LALR1) computeLookAheads();
         }
 
-        std::list<UnifiedItem> newItemsFromSymbolAfterDot() const {
-            std::list<UnifiedItem> result = {};
-            std::string ntR = getElement(dotIndex, rule.development);
-            
-            std::list<Rule> nonterminalRules = rule.grammar->getRulesForNonterminal(ntR);
+        int transitionTarget(int state, Symbol symbol) const {
+            const auto& transitions = states[state].transitions;
+            auto it = std::lower_bound(transitions.begin(), transitions.end(), std::make_pair(symbol, -1));
+            return it != transitions.end() && it->first == symbol ? it->second : -1;
+        }
 
-            for (Rule ntRule : nonterminalRules) {
-                addUnique(UnifiedItem(ntRule, 0) , result);
+    private:
+        // a kernel is its items in ascending order followed by their lookaheads, which are empty for LALR1
+        struct KernelKey {
+            std::vector<int> items;
+            std::vector<uint64_t> lookAheads;
+            size_t hash = 0;
+
+            // computed once by whichever worker built the kernel
+            void computeHash() {
+                hash = static_cast<size_t>(hashBytes(items.data(), items.size() * sizeof(int))
+                                           ^ hashBytes(lookAheads.data(), lookAheads.size() * sizeof(uint64_t)) * 31);
             }
 
-            if (result.empty()) return result;
-
-            std::list<std::string> newLookAheads = {};
-            bool epsilonPresent = false;
-            std::list<std::string> firstsAfterSymbolAfterDot = rule.grammar->getSequenceFirsts(slice(rule.development, dotIndex + 1));
+            bool operator==(const KernelKey& that) const {
+                return hash == that.hash && items == that.items && lookAheads == that.lookAheads;
+            }
+        };
 
-            for (const std::string& first : firstsAfterSymbolAfterDot) {
-                if (EPSILON == first) {
-                    epsilonPresent = true;
-                } else {
-                    addUnique(first, newLookAheads);
-                }
+        struct KernelKeyHash {
+            size_t operator()(const KernelKey& key) const {
+                return key.hash;
             }
+        };
+
+        // a closed state whose transitions still lack targets for kernels that were not known yet
+        struct Expansion {
+            LRState state;
+            std::vector<KernelKey> successors;
+        };
+
+        struct ClosureEntry {
+            int item;
+            TerminalSet lookAheads;
+        };
+
+        // items of rule r are itemBase[r] (dot at 0) up to itemBase[r] + length
+        std::vector<int> itemBase;
+        std::vector<int> itemRule;
+        std::vector<Symbol> itemNext;           // symbol after the dot, -1 for complete items
+        std::vector<TerminalSet> itemFirsts;    // FIRST of what follows the symbol after the dot
+        std::vector<bool> itemNullableRest;     // whether that remainder derives EPSILON
+
+        void indexItems() {
+            const int terminalCount = grammar.terminalCount;
+
+            for (const Rule& rule : grammar.rules) {
+                const int length = rule.length();
+                itemBase.push_back(static_cast<int>(itemRule.size()));
+
+                // FIRST and nullability of every suffix of the development, from the back
+                std::vector<TerminalSet> restFirsts(length + 1, TerminalSet(terminalCount));
+                std::vector<bool> restNullable(length + 1, true);
+                for (int i = length - 1; i >= 0; i--) {
+                    Symbol symbol = rule.development[i];
+                    restNullable[i] = restNullable[i + 1] && grammar.nullable[symbol];
+
+                    if (grammar.isTerminal(symbol)) {
+                        restFirsts[i].insert(symbol);
+                    } else {
+                        restFirsts[i] = grammar.firsts[symbol];
+                        if (grammar.nullable[symbol]) restFirsts[i].merge(restFirsts[i + 1]);
+                    }
+                }
 
-            if (epsilonPresent) {
-                for (const std::string& _ : lookAheads) {
-                    addUnique(_, newLookAheads);
+                for (int dot = 0; dot <= length; dot++) {
+                    itemRule.push_back(rule.index);
+                    itemNext.push_back(dot < length ? rule.development[dot] : -1);
+                    itemFirsts.push_back(dot < length ? restFirsts[dot + 1] : TerminalSet(terminalCount));
+                    itemNullableRest.push_back(dot < length ? restNullable[dot + 1] : true);
                 }
             }
+        }
 
-            for (UnifiedItem& item : result) {
-                item.lookAheads = slice(newLookAheads, 0);
+        // expands a kernel into its closure, propagating lookaheads in LR1 mode until nothing changes
+        std::vector<ClosureEntry> closeKernel(const KernelKey& kernel, std::vector<int>& slots) const {
+            const int terminalCount = grammar.terminalCount;
+            const size_t wordCount = (terminalCount + 63) / 64;
+            std::vector<ClosureEntry> closure;
+            std::vector<size_t> pending;
+
+            for (size_t i = 0; i < kernel.items.size(); i++) {
+                TerminalSet lookAheads(terminalCount);
+                if (mode == LR1) {
+                    for (size_t w = 0; w < wordCount; w++) {
+                        uint64_t word = kernel.lookAheads[i * wordCount + w];
+                        for (; word != 0; word &= word - 1) lookAheads.insert(static_cast<Symbol>(w * 64 + std::countr_zero(word)));
+                    }
+                }
+                slots[kernel.items[i]] = static_cast<int>(closure.size());
+                closure.push_back(ClosureEntry{kernel.items[i], std::move(lookAheads)});
+                pending.push_back(closure.size() - 1);
             }
-            
-            return result;
-        }
 
-        std::optional<UnifiedItem> newItemAfterShift() {
-            std::optional<UnifiedItem> result;
-            
-            if (dotIndex < rule.development.size() && getElement(dotIndex, rule.development) != EPSILON) {
-                result.emplace(UnifiedItem(rule, dotIndex + 1));
-            } else {
-                return std::nullopt;
-            }            
-            
-            result.value().lookAheads = slice(lookAheads, 0);            
+            while (!pending.empty()) {
+                size_t index = pending.back();
+                pending.pop_back();
 
-            return result;
-        }
+                int item = closure[index].item;
+                Symbol next = itemNext[item];
+                if (next < 0 || grammar.isTerminal(next)) continue;
 
-        bool addUniqueTo(std::list<UnifiedItem>& items) const {
-            bool result = false;
+                TerminalSet lookAheads(terminalCount);
+                if (mode == LR1) {
+                    lookAheads = itemFirsts[item];
+                    if (itemNullableRest[item]) lookAheads.merge(closure[index].lookAheads);
+                }
 
-            for (UnifiedItem& item : items) {
-                if (superEquals(item)) {
-                    for (const std::string& _ : lookAheads) {
-                        result |= addUnique(_, item.lookAheads);
+                for (int ruleIndex : grammar.getRulesForNonterminal(next)) {
+                    int start = itemBase[ruleIndex];
+                    if (slots[start] < 0) {
+                        slots[start] = static_cast<int>(closure.size());
+                        closure.push_back(ClosureEntry{start, lookAheads});
+                        pending.push_back(closure.size() - 1);
+                    } else if (closure[slots[start]].lookAheads.merge(lookAheads)) {
+                        pending.push_back(static_cast<size_t>(slots[start]));
                     }
-
-                    return result;
                 }
             }
 
-            items.push_back(*this);
-
-            return true;
-        }
+            for (const ClosureEntry& entry : closure) {
+                slots[entry.item] = -1;
+            }
 
-        bool superEquals(const UnifiedItem& that) const {
-            return rule == that.rule && dotIndex == that.dotIndex;
+            return closure;
         }
 
-        bool operator==(const UnifiedItem& that) const {
-            return superEquals(that) && includeEachOther(lookAheads, that.lookAheads);
-        }
-};
+        // Closes one kernel and groups its successors by symbol. Only reads shared state,
+        // so kernels of one level can be expanded concurrently.
+        Expansion expandKernel(const KernelKey& kernel, const std::unordered_map<KernelKey, int, KernelKeyHash>& stateIds, std::vector<int>& slots) const {
+            std::vector<ClosureEntry> closure = closeKernel(kernel, slots);
+            Expansion expansion;
+            LRState& state = expansion.state;
+
+            std::vector<size_t> shifting;
+            for (size_t i = 0; i < closure.size(); i++) {
+                if (itemNext[closure[i].item] < 0) {
+                    state.reductions.emplace_back(itemRule[closure[i].item], std::move(closure[i].lookAheads));
+                } else {
+                    shifting.push_back(i);
+                }
+            }
+            std::sort(state.reductions.begin(), state.reductions.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+            std::stable_sort(shifting.begin(), shifting.end(), [&](size_t a, size_t b) {
+                return itemNext[closure[a].item] < itemNext[closure[b].item];
+            });
+
+            for (size_t begin = 0; begin < shifting.size(); ) {
+                Symbol symbol = itemNext[closure[shifting[begin]].item];
+                size_t end = begin;
+                while (end < shifting.size() && itemNext[closure[shifting[end]].item] == symbol) end++;
+
+                std::vector<size_t> group(shifting.begin() + begin, shifting.begin() + end);
+                std::sort(group.begin(), group.end(), [&](size_t a, size_t b) { return closure[a].item < closure[b].item; });
+
+                KernelKey successor;
+                for (size_t i : group) {
+                    successor.items.push_back(closure[i].item + 1);
+                    if (mode == LR1) {
+                        const std::vector<uint64_t>& words = closure[i].lookAheads.getWords();
+                        successor.lookAheads.insert(successor.lookAheads.end(), words.begin(), words.end());
+                    }
+                }
+                successor.computeHash();
 
-class Kernel {
-    public:
-        int index;
-        std::list<UnifiedItem> items;
-        std::list<UnifiedItem> closure;
-        std::map<std::string, int> gotos;
-        std::list<std::string> keys;
-        
-        //maybe initialize with grammar
-        Kernel (int index, const std::list<UnifiedItem>& items) : index(index), items(items), closure(slice(items, 0)) {}
+                auto it = stateIds.find(successor);
+                state.transitions.emplace_back(symbol, it == stateIds.end() ? -1 : it->second);
+                if (it == stateIds.end()) expansion.successors.push_back(std::move(successor));
+                begin = end;
+            }
 
-        bool operator==(const Kernel& that) const {
-            return includeEachOther(items, that.items);
+            return expansion;
         }
-};
 
-class LRClosureTable {
-    public:
-        Grammar& grammar;
-        std::list<Kernel> kernels;
-
-        explicit LRClosureTable(Grammar& grammar) : grammar(grammar) {     
-            std::list<UnifiedItem> l = {UnifiedItem(grammar.rules.front(), 0)};
-            
-            Kernel k(0, l);            
-            kernels.push_back(k);            
-            
-            for (auto it = kernels.begin(); it != kernels.end();) {
-                Kernel& kernel = *it;
-
-                updateClosure(kernel);
-
-                if (addGotos(kernel, kernels)) {                    
-                    it = kernels.begin();
+        // Expands the automaton one BFS level at a time. Expanding is the expensive part
+        // and runs on the pool; new states are then numbered on this thread, in the
+        // order the serial construction would discover them, so the table does not
+        // depend on the number of threads.
+        void buildAutomaton(ThreadPool* pool) {
+            std::unordered_map<KernelKey, int, KernelKeyHash> stateIds;
+            std::vector<KernelKey> kernels;
+            std::vector<std::vector<int>> slots(pool ? pool->size() : 1, std::vector<int>(itemRule.size(), -1));
+
+            KernelKey start;
+            start.items.push_back(itemBase[0]);
+            if (mode == LR1) {
+                TerminalSet end(grammar.terminalCount);
+                end.insert(END_SYMBOL);
+                start.lookAheads = end.getWords();
+            }
+            start.computeHash();
+            stateIds.emplace(start, 0);
+            kernels.push_back(std::move(start));
+
+            for (size_t levelBegin = 0; levelBegin < kernels.size(); ) {
+                const size_t levelEnd = kernels.size();
+                std::vector<Expansion> expansions(levelEnd - levelBegin);
+
+                auto expand = [&](size_t index, unsigned worker) {
+                    expansions[index] = expandKernel(kernels[levelBegin + index], stateIds, slots[worker]);
+                };
+                if (pool) {
+                    pool->parallelFor(expansions.size(), expand);
                 } else {
-                    ++it;
-                    std::cout << "size: " << kernels.size() << ", i: " << std::distance( kernels.begin(), it ) << std::endl;
+                    for (size_t index = 0; index < expansions.size(); index++) expand(index, 0);
                 }
+
+                for (Expansion& expansion : expansions) {
+                    auto successor = expansion.successors.begin();
+                    for (auto& [symbol, target] : expansion.state.transitions) {
+                        if (target >= 0) continue;
+
+                        auto [it, inserted] = stateIds.emplace(*successor, static_cast<int>(kernels.size()));
+                        if (inserted) kernels.push_back(std::move(*successor));
+                        target = it->second;
+                        ++successor;
+                    }
+                    states.push_back(std::move(expansion.state));
+                }
+
+                levelBegin = levelEnd;
             }
         }
 
-        void updateClosure(Kernel& kernel) const {
-            for (const UnifiedItem& closure : kernel.closure) {
-                std::list<UnifiedItem> newItemsFromSymbolAfterDot = closure.newItemsFromSymbolAfterDot();
-                
-                for (const UnifiedItem& item : newItemsFromSymbolAfterDot) {
-                    item.addUniqueTo(kernel.closure);
+        void computeLookAheads() {
+            const int terminalCount = grammar.terminalCount;
+
+            // one entry per nonterminal transition, plus a last one standing for the
+            // transition on the axiom that the start state is entered with
+            std::vector<std::pair<int, Symbol>> transitions;
+            std::vector<std::vector<int>> transitionIds(states.size());
+            for (size_t state = 0; state < states.size(); state++) {
+                for (const auto& [symbol, target] : states[state].transitions) {
+                    if (!grammar.isTerminal(symbol)) {
+                        transitionIds[state].push_back(static_cast<int>(transitions.size()));
+                        transitions.emplace_back(static_cast<int>(state), symbol);
+                    }
+                }
+            }
+            const int startTransition = static_cast<int>(transitions.size());
+
+            auto transitionId = [&](int state, Symbol nonterminal) {
+                for (int id : transitionIds[state]) {
+                    if (transitions[id].second == nonterminal) return id;
+                }
+                return -1;
+            };
+
+            // DR and reads give Read
+            std::vector<TerminalSet> follows(transitions.size() + 1, TerminalSet(terminalCount));
+            std::vector<std::vector<int>> edges(transitions.size() + 1);
+            follows[startTransition].insert(END_SYMBOL);
+            for (size_t id = 0; id < transitions.size(); id++) {
+                int target = transitionTarget(transitions[id].first, transitions[id].second);
+                for (const auto& [symbol, next] : states[target].transitions) {
+                    if (grammar.isTerminal(symbol)) {
+                        follows[id].insert(symbol);
+                    } else if (grammar.nullable[symbol]) {
+                        edges[id].push_back(transitionId(target, symbol));
+                    }
                 }
             }
-        }
+            digraph(edges, follows);
 
-        bool addGotos(Kernel& kernel, std::list<Kernel>& kernels) const {
-            bool lookAheadsPropagated = false;
-            std::map<std::string, std::list<UnifiedItem>> newKernels;
+            // includes gives Follow, lookback ties every reduction to the transitions it follows
+            for (auto& list : edges) list.clear();
+            std::vector<std::vector<std::vector<int>>> lookbacks(states.size());
+            for (size_t state = 0; state < states.size(); state++) {
+                lookbacks[state].resize(states[state].reductions.size());
+            }
 
-            for (UnifiedItem& item : kernel.closure) {
-                std::optional<UnifiedItem> newItem = item.newItemAfterShift();
+            auto walkRule = [&](int state, int ruleIndex, int from) {
+                const Rule& rule = grammar.rules[ruleIndex];
+                const int length = rule.length();
+                for (int dot = 0; dot < length; dot++) {
+                    Symbol symbol = rule.development[dot];
+                    if (!grammar.isTerminal(symbol) && itemNullableRest[itemBase[ruleIndex] + dot]) {
+                        edges[transitionId(state, symbol)].push_back(from);
+                    }
+                    state = transitionTarget(state, symbol);
+                }
 
-                if (newItem != std::nullopt) {
-                    std::string symbolAfterDot = getElement(item.dotIndex, item.rule.development);
+                auto& reductions = states[state].reductions;
+                for (size_t i = 0; i < reductions.size(); i++) {
+                    if (reductions[i].first == ruleIndex) lookbacks[state][i].push_back(from);
+                }
+            };
 
-                    addUnique(symbolAfterDot, kernel.keys);
-                    getOrCreateArray(newKernels, symbolAfterDot);
-                    std::list<UnifiedItem>& newItems = newKernels.at(symbolAfterDot);
-                    newItem.value().addUniqueTo(newItems);
+            // a transition on A out of a state means every rule of A starts in that state
+            walkRule(0, 0, startTransition);
+            for (size_t id = 0; id < transitions.size(); id++) {
+                for (int ruleIndex : grammar.getRulesForNonterminal(transitions[id].second)) {
+                    walkRule(transitions[id].first, ruleIndex, static_cast<int>(id));
                 }
             }
-            
-            for (const std::string& key : kernel.keys) {
-                Kernel newKernel(static_cast<int>(kernels.size()), newKernels.at(key));
-                int targetKernelIndex = indexOf(newKernel, kernels);
+            digraph(edges, follows);
 
-                if (targetKernelIndex < 0) {
-                    kernels.push_back(newKernel);
-                    targetKernelIndex = newKernel.index;
-                } else {
-                    for (const UnifiedItem& item : newKernel.items) {
-                        std::list<UnifiedItem>& items = getUpdateableElement(targetKernelIndex, kernels).items;
-                        lookAheadsPropagated |= item.addUniqueTo(items);
+            for (size_t state = 0; state < states.size(); state++) {
+                auto& reductions = states[state].reductions;
+                for (size_t i = 0; i < reductions.size(); i++) {
+                    for (int from : lookbacks[state][i]) {
+                        reductions[i].second.merge(follows[from]);
                     }
                 }
-                
-                kernel.gotos.insert({key, targetKernelIndex});
             }
-            
-            return lookAheadsPropagated;
         }
 };
 
+// An entry of the ACTION table packed into 32 bits, the top two bits hold the kind
+// and the others the target state of a shift or the rule of a reduction.
 class LRAction {
     public:
-        std::string actionType; // could be optimized to char
-        int actionValue;
+        enum Kind : uint32_t { ERROR = 0, SHIFT = 1, REDUCE = 2, ACCEPT = 3 };
+
+        static constexpr uint32_t VALUE_MASK = (1u << 30) - 1;
+
+        uint32_t bits = 0;
 
         LRAction() = default;
-        LRAction(std::string const& actionType, int actionValue) : actionType(actionType), actionValue(actionValue) {}
+        explicit LRAction(uint32_t bits) : bits(bits) {}
+        LRAction(Kind kind, int value) : bits((static_cast<uint32_t>(kind) << 30) | static_cast<uint32_t>(value)) {}
 
-        std::string toString() const {
-            return actionType + std::to_string(actionValue);
+        Kind kind() const {
+            return static_cast<Kind>(bits >> 30);
         }
 
-        template <class Archive>
-        void serialize(Archive& ar, const unsigned int /* version */) {
-            ar & actionType;
-            ar & actionValue;
+        int value() const {
+            return static_cast<int>(bits & VALUE_MASK);
+        }
+
+        std::string toString() const {
+            switch (kind()) {
+                case SHIFT: return "s" + std::to_string(value());
+                case REDUCE: return "r" + std::to_string(value());
+                case ACCEPT: return "acc";
+                default: return "";
+            }
         }
 
         friend std::ostream& operator<<(std::ostream& os, const LRAction& lrAction) {
@@ -544,213 +772,1002 @@ class LRAction {
         }
 };
 
-class State {
+// The parse table as two dense row-major arrays. ACTION has a column for every
+// terminal ID, GOTO one for every nonterminal ID (offset by terminalCount), so
+// a parse step is a single array load.
+class LRTable {
     public:
-        int index;
-        std::map<std::string, LRAction> mapping;
+        Grammar grammar;
+        int stateCount = 0;
+        std::vector<uint32_t> actions;
+        std::vector<int32_t> gotos;
+        int shiftReduceConflicts = 0;
+        int reduceReduceConflicts = 0;
+        // ACTION and GOTO with pass-through reductions skipped: a transition into a state whose only
+        // action is such a reduction goes on to where the reduction leads, if that state acts on the
+        // same terminals. A parse takes the same course in fewer steps, without the skipped nodes.
+        std::vector<uint32_t> bypassActions;
+        std::vector<int32_t> bypassGotos;
+        int bypassedTransitions = 0;
+
+        LRTable() = default;
+        explicit LRTable(const LRClosureTable& closureTable) : grammar(closureTable.grammar) {
+            const int nonterminalCount = grammar.symbols.size() - grammar.terminalCount;
+            stateCount = static_cast<int>(closureTable.states.size());
+            actions.assign(static_cast<size_t>(stateCount) * grammar.terminalCount, 0);
+            gotos.assign(static_cast<size_t>(stateCount) * nonterminalCount, -1);
+
+            for (int state = 0; state < stateCount; state++) {
+                const LRState& lrState = closureTable.states[state];
+
+                for (const auto& [symbol, target] : lrState.transitions) {
+                    if (grammar.isTerminal(symbol)) {
+                        actions[actionIndex(state, symbol)] = LRAction(LRAction::SHIFT, target).bits;
+                    } else {
+                        gotos[gotoIndex(state, symbol)] = target;
+                    }
+                }
 
-        State() = default;
-        explicit State(std::list<State> const& states) : index(static_cast<int>(states.size())) {}
+                // shift/reduce conflicts are settled by precedence where the rule and the look-ahead have one,
+                // otherwise shifts take precedence over reductions, and earlier rules over later ones
+                std::vector<bool> nonassociative(grammar.terminalCount, false);
+                for (const auto& [ruleIndex, lookAheads] : lrState.reductions) {
+                    lookAheads.forEach([&](Symbol lookAhead) {
+                        uint32_t& entry = actions[actionIndex(state, lookAhead)];
+                        if (nonassociative[lookAhead]) return;
+                        if (entry != 0) {
+                            if (LRAction(entry).kind() != LRAction::SHIFT) {
+                                reduceReduceConflicts++;
+                                return;
+                            }
+
+                            const int rule = grammar.rulePrecedence[ruleIndex];
+                            const int terminal = grammar.terminalPrecedence[lookAhead];
+                            if (rule == 0 || terminal == 0) {
+                                shiftReduceConflicts++;
+                                return;
+                            }
+                            if (rule < terminal || (rule == terminal && grammar.associativity[lookAhead] == Grammar::RIGHT)) return;
+                            if (rule == terminal && grammar.associativity[lookAhead] == Grammar::NONASSOC) {
+                                entry = 0;
+                                nonassociative[lookAhead] = true;
+                                return;
+                            }
+                        }
+
+                        entry = ruleIndex == 0 ? LRAction(LRAction::ACCEPT, 0).bits : LRAction(LRAction::REDUCE, ruleIndex).bits;
+                    });
+                }
+            }
+
+            bypassActions = actions;
+            bypassGotos = gotos;
+            for (int state = 0; state < stateCount; state++) {
+                for (Symbol terminal = 0; terminal < grammar.terminalCount; terminal++) {
+                    LRAction shift = action(state, terminal);
+                    if (shift.kind() != LRAction::SHIFT) continue;
+                    const int target = bypassTarget(state, shift.value());
+                    if (target == shift.value()) continue;
+                    bypassActions[actionIndex(state, terminal)] = LRAction(LRAction::SHIFT, target).bits;
+                    bypassedTransitions++;
+                }
+                for (Symbol nonterminal = grammar.terminalCount; nonterminal < grammar.symbols.size(); nonterminal++) {
+                    const int next = goTo(state, nonterminal);
+                    if (next < 0) continue;
+                    const int target = bypassTarget(state, next);
+                    if (target == next) continue;
+                    bypassGotos[gotoIndex(state, nonterminal)] = target;
+                    bypassedTransitions++;
+                }
+            }
+        }
+
+        size_t actionIndex(int state, Symbol terminal) const {
+            return static_cast<size_t>(state) * grammar.terminalCount + terminal;
+        }
+
+        size_t gotoIndex(int state, Symbol nonterminal) const {
+            return static_cast<size_t>(state) * (grammar.symbols.size() - grammar.terminalCount) + (nonterminal - grammar.terminalCount);
+        }
+
+        LRAction action(int state, Symbol terminal) const {
+            return LRAction(actions[actionIndex(state, terminal)]);
+        }
+
+        int goTo(int state, Symbol nonterminal) const {
+            return gotos[gotoIndex(state, nonterminal)];
+        }
 
         template <class Archive>
         void serialize(Archive& ar, const unsigned int /* version */) {
-            ar & index;
-            ar & mapping;
+            ar & grammar;
+            ar & stateCount;
+            ar & actions;
+            ar & gotos;
+            ar & bypassActions;
+            ar & bypassGotos;
         }
 
-        friend std::ostream& operator<<(std::ostream& os, const State& state) {
-            os << state.index << ": " << state.mapping;
-            return os;
+    private:
+        // the pass-through rule that is the only action of state, -1 if there is none
+        int unitReduction(int state) const {
+            int rule = -1;
+            for (Symbol terminal = 0; terminal < grammar.terminalCount; terminal++) {
+                LRAction entry = action(state, terminal);
+                if (entry.kind() == LRAction::ERROR) continue;
+                if (entry.kind() != LRAction::REDUCE || (rule >= 0 && entry.value() != rule)) return -1;
+                rule = entry.value();
+            }
+            for (Symbol nonterminal = grammar.terminalCount; nonterminal < grammar.symbols.size(); nonterminal++) {
+                if (goTo(state, nonterminal) >= 0) return -1;
+            }
+            return rule >= 0 && grammar.passThrough[rule] ? rule : -1;
+        }
+
+        bool sameTerminals(int state, int other) const {
+            for (Symbol terminal = 0; terminal < grammar.terminalCount; terminal++) {
+                if ((action(state, terminal).kind() == LRAction::ERROR) != (action(other, terminal).kind() == LRAction::ERROR)) return false;
+            }
+            return true;
+        }
+
+        // where a transition from state into target ends up once the pass-through reductions are skipped
+        int bypassTarget(int state, int target) const {
+            for (int steps = 0; steps < stateCount; steps++) {
+                const int rule = unitReduction(target);
+                if (rule < 0) break;
+                const int next = goTo(state, grammar.rules[rule].nonterminal);
+                if (next < 0 || !sameTerminals(target, next)) break;
+                target = next;
+            }
+            return target;
         }
-        
 };
 
-class LRTable {
-    public:
-        Grammar grammar;
-        std::list<State> states = {};
+// Layout of a table file. The header is followed by the sections listed in
+// sectionOffsets, each 8-byte aligned and stored in host byte order; byteOrder
+// lets a reader reject files written on a machine of the other endianness.
+struct TableFileHeader {
+    static constexpr char MAGIC[8] = {'B', 'A', 'B', 'E', 'L', 'T', 'A', 'B'};
+    static constexpr uint32_t VERSION = 3;
+    static constexpr uint32_t ORDER_MARK = 0x01020304;
+
+    enum Section { ACTIONS, GOTOS, RULE_NONTERMINALS, RULE_LENGTHS, NAME_OFFSETS, NAMES, EXPECTED_OFFSETS, EXPECTED, SYNC_FLAGS,
+                   BYPASS_ACTIONS, BYPASS_GOTOS, PASS_THROUGH_FLAGS, SECTION_COUNT };
+
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t grammarHash;
+    uint64_t checksum;          // of everything after the header
+    uint64_t fileSize;
+    int32_t stateCount;
+    int32_t symbolCount;
+    int32_t terminalCount;
+    int32_t ruleCount;
+    int32_t axiom;
+    uint32_t reserved;
+    uint64_t sectionOffsets[SECTION_COUNT];
+    uint64_t sectionSizes[SECTION_COUNT];
+};
 
-        LRTable() = default;
-        explicit LRTable(const LRClosureTable& closureTable) : grammar(closureTable.grammar) {
-            for (const Kernel& kernel : closureTable.kernels) {
-                State state(states);
+// The sections of a table file as separate arrays, the way babel_tablegen writes
+// them into a generated header.
+struct ParserTableArrays {
+    uint64_t grammarHash;
+    int32_t stateCount;
+    int32_t symbolCount;
+    int32_t terminalCount;
+    int32_t ruleCount;
+    int32_t axiom;
+    const uint32_t* actions;
+    const int32_t* gotos;
+    const int32_t* ruleNonterminals;
+    const uint32_t* ruleLengths;
+    const uint32_t* nameOffsets;
+    const char* names;
+    const uint32_t* expectedOffsets;
+    const uint32_t* expected;
+    const uint8_t* syncFlags;
+    const uint32_t* bypassActions;
+    const int32_t* bypassGotos;
+    const uint8_t* passThroughFlags;
+};
+
+// The tables the parser runs on, as flat arrays inside one image: either a buffer
+// encoded from an LRTable or a mapped table file used in place. Nothing is
+// rebuilt when a file is loaded, the arrays point straight into the mapping.
+// Tables compiled into the program have no image, only arrays.
+class ParserTables {
+    private:
+        std::vector<uint64_t> buffer;
+        std::shared_ptr<const MappedFile> mapping;
+        const char* image = nullptr;
+        const TableFileHeader* header = nullptr;
+        TableFileHeader arrayHeader{};
+        const uint32_t* actions = nullptr;
+        const int32_t* gotos = nullptr;
+        const int32_t* ruleNonterminals = nullptr;
+        const uint32_t* ruleLengths = nullptr;
+        const uint32_t* nameOffsets = nullptr;
+        const char* names = nullptr;
+        const uint32_t* expectedOffsets = nullptr;
+        const uint32_t* expectedTerminals = nullptr;
+        const uint8_t* syncFlags = nullptr;
+        const uint32_t* bypassActions = nullptr;
+        const int32_t* bypassGotos = nullptr;
+        const uint8_t* passThroughFlags = nullptr;
+
+        template <typename T>
+        const T* section(TableFileHeader::Section index) const {
+            return reinterpret_cast<const T*>(image + header->sectionOffsets[index]);
+        }
 
-                for (const std::string& key : kernel.keys) {                    
-                    int nextStateIndex = kernel.gotos.at(key);
-                    state.mapping.insert({key, LRAction((isElement(key, closureTable.grammar.terminals) ? "s" : ""), nextStateIndex)});
+        // checks that the image is a table file this build can use and points the arrays into it
+        void bind(const char* data, size_t size, bool verify, const std::string& name) {
+            auto fail = [&](const std::string& reason) {
+                throw std::runtime_error("invalid parser table '" + name + "': " + reason);
+            };
+
+            if (size < sizeof(TableFileHeader)) fail("truncated header");
+            image = data;
+            header = reinterpret_cast<const TableFileHeader*>(data);
+
+            if (std::memcmp(header->magic, TableFileHeader::MAGIC, sizeof(header->magic)) != 0) fail("not a table file");
+            if (header->version != TableFileHeader::VERSION) fail("version " + std::to_string(header->version) + " is not supported");
+            if (header->byteOrder != TableFileHeader::ORDER_MARK) fail("written with a different byte order");
+            if (header->fileSize != size) fail("size mismatch");
+            if (header->stateCount < 0 || header->terminalCount < 2 || header->symbolCount < header->terminalCount || header->ruleCount < 1) fail("bad dimensions");
+
+            const uint64_t states = static_cast<uint64_t>(header->stateCount);
+            const uint64_t expectedSizes[TableFileHeader::SECTION_COUNT] = {
+                states * header->terminalCount * sizeof(uint32_t),
+                states * (header->symbolCount - header->terminalCount) * sizeof(int32_t),
+                static_cast<uint64_t>(header->ruleCount) * sizeof(int32_t),
+                static_cast<uint64_t>(header->ruleCount) * sizeof(uint32_t),
+                (static_cast<uint64_t>(header->symbolCount) + 1) * sizeof(uint32_t),
+                header->sectionSizes[TableFileHeader::NAMES],
+                (states + 1) * sizeof(uint32_t),
+                header->sectionSizes[TableFileHeader::EXPECTED] / sizeof(uint32_t) * sizeof(uint32_t),
+                static_cast<uint64_t>(header->terminalCount),
+                states * header->terminalCount * sizeof(uint32_t),
+                states * (header->symbolCount - header->terminalCount) * sizeof(int32_t),
+                static_cast<uint64_t>(header->ruleCount),
+            };
+            for (int i = 0; i < TableFileHeader::SECTION_COUNT; i++) {
+                uint64_t offset = header->sectionOffsets[i];
+                if (header->sectionSizes[i] != expectedSizes[i] || offset % 8 != 0 || offset < sizeof(TableFileHeader)
+                    || offset > size || header->sectionSizes[i] > size - offset) {
+                    fail("bad section " + std::to_string(i));
                 }
+            }
 
-                for (const UnifiedItem& item : kernel.closure) {
-                    if (item.dotIndex == item.rule.development.size() || item.rule.development.front() == EPSILON) {
-                        for (const std::string& lookAhead : item.lookAheads) {
-                            state.mapping.insert({lookAhead, LRAction("r", item.rule.index)});
-                        }
-                    }
+            if (verify && hashBytes(data + sizeof(TableFileHeader), size - sizeof(TableFileHeader)) != header->checksum) fail("checksum mismatch");
+
+            actions = section<uint32_t>(TableFileHeader::ACTIONS);
+            gotos = section<int32_t>(TableFileHeader::GOTOS);
+            ruleNonterminals = section<int32_t>(TableFileHeader::RULE_NONTERMINALS);
+            ruleLengths = section<uint32_t>(TableFileHeader::RULE_LENGTHS);
+            nameOffsets = section<uint32_t>(TableFileHeader::NAME_OFFSETS);
+            names = section<char>(TableFileHeader::NAMES);
+            expectedOffsets = section<uint32_t>(TableFileHeader::EXPECTED_OFFSETS);
+            expectedTerminals = section<uint32_t>(TableFileHeader::EXPECTED);
+            syncFlags = section<uint8_t>(TableFileHeader::SYNC_FLAGS);
+            bypassActions = section<uint32_t>(TableFileHeader::BYPASS_ACTIONS);
+            bypassGotos = section<int32_t>(TableFileHeader::BYPASS_GOTOS);
+            passThroughFlags = section<uint8_t>(TableFileHeader::PASS_THROUGH_FLAGS);
+            if (nameOffsets[header->symbolCount] > header->sectionSizes[TableFileHeader::NAMES]) fail("bad symbol names");
+            if (expectedOffsets[states] > header->sectionSizes[TableFileHeader::EXPECTED] / sizeof(uint32_t)) fail("bad expected terminals");
+        }
+
+    public:
+        ParserTables() = default;
+        ParserTables(const ParserTables&) = delete;
+        ParserTables& operator=(const ParserTables&) = delete;
+
+        static std::shared_ptr<const ParserTables> fromTable(const LRTable& lrTable) {
+            const Grammar& grammar = lrTable.grammar;
+            const int symbolCount = grammar.symbols.size();
+
+            std::string nameBytes;
+            std::vector<uint32_t> offsets;
+            for (Symbol symbol = 0; symbol < symbolCount; symbol++) {
+                offsets.push_back(static_cast<uint32_t>(nameBytes.size()));
+                nameBytes += grammar.nameOf(symbol);
+            }
+            offsets.push_back(static_cast<uint32_t>(nameBytes.size()));
+
+            std::vector<int32_t> nonterminals;
+            std::vector<uint32_t> lengths;
+            for (const Rule& rule : grammar.rules) {
+                nonterminals.push_back(rule.nonterminal);
+                lengths.push_back(static_cast<uint32_t>(rule.length()));
+            }
+
+            // the terminals with an action in each state, in the order error messages list them
+            std::vector<uint32_t> expectedBegin;
+            std::vector<uint32_t> expected;
+            for (int state = 0; state < lrTable.stateCount; state++) {
+                expectedBegin.push_back(static_cast<uint32_t>(expected.size()));
+                for (Symbol terminal = 0; terminal < grammar.terminalCount; terminal++) {
+                    if (lrTable.action(state, terminal).kind() != LRAction::ERROR) expected.push_back(static_cast<uint32_t>(terminal));
                 }
-                
-                states.push_back(state);
+                std::sort(expected.begin() + expectedBegin.back(), expected.end(), [&](uint32_t a, uint32_t b) {
+                    return grammar.nameOf(a) < grammar.nameOf(b);
+                });
+            }
+            expectedBegin.push_back(static_cast<uint32_t>(expected.size()));
+
+            std::vector<uint8_t> sync(grammar.terminalCount, 0);
+            for (Symbol terminal : grammar.syncTerminals) sync[terminal] = 1;
+            std::vector<uint8_t> passThrough(grammar.passThrough.begin(), grammar.passThrough.end());
+
+            TableFileHeader fileHeader{};
+            std::memcpy(fileHeader.magic, TableFileHeader::MAGIC, sizeof(fileHeader.magic));
+            fileHeader.version = TableFileHeader::VERSION;
+            fileHeader.byteOrder = TableFileHeader::ORDER_MARK;
+            fileHeader.grammarHash = hashGrammar(grammar.text);
+            fileHeader.stateCount = lrTable.stateCount;
+            fileHeader.symbolCount = symbolCount;
+            fileHeader.terminalCount = grammar.terminalCount;
+            fileHeader.ruleCount = static_cast<int32_t>(grammar.rules.size());
+            fileHeader.axiom = grammar.axiom;
+
+            const std::pair<const void*, size_t> sections[TableFileHeader::SECTION_COUNT] = {
+                {lrTable.actions.data(), lrTable.actions.size() * sizeof(uint32_t)},
+                {lrTable.gotos.data(), lrTable.gotos.size() * sizeof(int32_t)},
+                {nonterminals.data(), nonterminals.size() * sizeof(int32_t)},
+                {lengths.data(), lengths.size() * sizeof(uint32_t)},
+                {offsets.data(), offsets.size() * sizeof(uint32_t)},
+                {nameBytes.data(), nameBytes.size()},
+                {expectedBegin.data(), expectedBegin.size() * sizeof(uint32_t)},
+                {expected.data(), expected.size() * sizeof(uint32_t)},
+                {sync.data(), sync.size()},
+                {lrTable.bypassActions.data(), lrTable.bypassActions.size() * sizeof(uint32_t)},
+                {lrTable.bypassGotos.data(), lrTable.bypassGotos.size() * sizeof(int32_t)},
+                {passThrough.data(), passThrough.size()},
+            };
+
+            uint64_t size = sizeof(TableFileHeader);
+            for (int i = 0; i < TableFileHeader::SECTION_COUNT; i++) {
+                fileHeader.sectionOffsets[i] = size;
+                fileHeader.sectionSizes[i] = sections[i].second;
+                size = (size + sections[i].second + 7) / 8 * 8;
+            }
+            fileHeader.fileSize = size;
+
+            auto tables = std::make_shared<ParserTables>();
+            tables->buffer.assign(size / 8, 0);
+            char* data = reinterpret_cast<char*>(tables->buffer.data());
+            for (int i = 0; i < TableFileHeader::SECTION_COUNT; i++) {
+                if (sections[i].second != 0) std::memcpy(data + fileHeader.sectionOffsets[i], sections[i].first, sections[i].second);
             }
+            fileHeader.checksum = hashBytes(data + sizeof(TableFileHeader), size - sizeof(TableFileHeader));
+            std::memcpy(data, &fileHeader, sizeof(TableFileHeader));
+
+            tables->bind(data, size, false, "memory");
+            return tables;
         }
 
-        template <class Archive>
-        void serialize(Archive& ar, const unsigned int /* version */) {
-            ar & grammar;
-            ar & states;
+        // Uses the arrays of a generated header in place, they are not checked.
+        static std::shared_ptr<const ParserTables> fromArrays(const ParserTableArrays& arrays) {
+            auto tables = std::make_shared<ParserTables>();
+            TableFileHeader& fileHeader = tables->arrayHeader;
+            std::memcpy(fileHeader.magic, TableFileHeader::MAGIC, sizeof(fileHeader.magic));
+            fileHeader.version = TableFileHeader::VERSION;
+            fileHeader.byteOrder = TableFileHeader::ORDER_MARK;
+            fileHeader.grammarHash = arrays.grammarHash;
+            fileHeader.stateCount = arrays.stateCount;
+            fileHeader.symbolCount = arrays.symbolCount;
+            fileHeader.terminalCount = arrays.terminalCount;
+            fileHeader.ruleCount = arrays.ruleCount;
+            fileHeader.axiom = arrays.axiom;
+
+            tables->header = &fileHeader;
+            tables->actions = arrays.actions;
+            tables->gotos = arrays.gotos;
+            tables->ruleNonterminals = arrays.ruleNonterminals;
+            tables->ruleLengths = arrays.ruleLengths;
+            tables->nameOffsets = arrays.nameOffsets;
+            tables->names = arrays.names;
+            tables->expectedOffsets = arrays.expectedOffsets;
+            tables->expectedTerminals = arrays.expected;
+            tables->syncFlags = arrays.syncFlags;
+            tables->bypassActions = arrays.bypassActions;
+            tables->bypassGotos = arrays.bypassGotos;
+            tables->passThroughFlags = arrays.passThroughFlags;
+            return tables;
         }
-};
 
-std::optional<LRAction> chooseActionElement(State& state, const std::string& token) {
-    if (state.mapping.find(token) == state.mapping.end()) {
-        return std::nullopt;
-    }
+        // Maps a table file written by save(). The checksum pass reads every page once,
+        // skipping it leaves the pages to be faulted in as the parser touches them.
+        static std::shared_ptr<const ParserTables> load(const std::string& path, bool verify = true) {
+            auto tables = std::make_shared<ParserTables>();
+            tables->mapping = std::make_shared<const MappedFile>(path);
+            tables->bind(tables->mapping->data(), tables->mapping->size(), verify, path);
+            return tables;
+        }
 
-    return state.mapping.at(token);
-}
+        // writes to a temporary file first so a reader never maps a half written table
+        void save(const std::string& path) const {
+            if (image == nullptr) throw std::runtime_error("parser tables compiled into the program have no file image");
+            std::string temporary = path + ".tmp";
+            {
+                std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+                out.write(image, static_cast<std::streamsize>(header->fileSize));
+                if (!out) throw std::runtime_error("cannot write parser table '" + temporary + "'");
+            }
+            std::filesystem::rename(temporary, path);
+        }
 
-struct TreeNode {
-    std::string name;
-    std::optional<std::string> data;
-    std::list<TreeNode> children;
+        // the bytes of a section of the image, for babel_tablegen
+        std::string_view sectionBytes(TableFileHeader::Section index) const {
+            return image == nullptr ? std::string_view() : std::string_view(image + header->sectionOffsets[index], header->sectionSizes[index]);
+        }
+
+        uint64_t grammarHash() const { return header->grammarHash; }
+        int stateCount() const { return header->stateCount; }
+        int symbolCount() const { return header->symbolCount; }
+        int terminalCount() const { return header->terminalCount; }
+        int ruleCount() const { return header->ruleCount; }
+        Symbol axiom() const { return header->axiom; }
+
+        // with bypass, from the tables that skip pass-through reductions
+        LRAction action(int state, Symbol terminal, bool bypass = false) const {
+            return LRAction((bypass ? bypassActions : actions)[static_cast<size_t>(state) * header->terminalCount + terminal]);
+        }
+
+        int goTo(int state, Symbol nonterminal, bool bypass = false) const {
+            return (bypass ? bypassGotos : gotos)[static_cast<size_t>(state) * (header->symbolCount - header->terminalCount) + (nonterminal - header->terminalCount)];
+        }
 
-    friend std::ostream& operator<<(std::ostream& os, const TreeNode& node) {
-        std::stack<std::pair<const TreeNode*, int>> nodeStack;
-        nodeStack.push(std::make_pair(&node, 0));
+        Symbol ruleNonterminal(int rule) const {
+            return ruleNonterminals[rule];
+        }
 
-        while (!nodeStack.empty()) {
-            const TreeNode* currentNode = nodeStack.top().first;
-            int depth = nodeStack.top().second;
-            nodeStack.pop();
+        size_t ruleLength(int rule) const {
+            return ruleLengths[rule];
+        }
+
+        bool isPassThrough(int rule) const {
+            return passThroughFlags[rule] != 0;
+        }
+
+        std::string_view nameOf(Symbol symbol) const {
+            return std::string_view(names + nameOffsets[symbol], nameOffsets[symbol + 1] - nameOffsets[symbol]);
+        }
+
+        // the terminals state has an action for, sorted by name
+        std::span<const uint32_t> expected(int state) const {
+            return std::span<const uint32_t>(expectedTerminals + expectedOffsets[state], expectedOffsets[state + 1] - expectedOffsets[state]);
+        }
+
+        // whether the grammar names terminal in a %sync directive
+        bool isSync(Symbol terminal) const {
+            return syncFlags[terminal] != 0;
+        }
 
-            // Print the current node
-            for (int i = 0; i < depth; ++i) {
-                os << "  ";
+        // returns -1 for names that are not terminals of the grammar
+        Symbol findTerminal(std::string_view name) const {
+            for (Symbol symbol = 0; symbol < header->terminalCount; symbol++) {
+                if (nameOf(symbol) == name) return symbol;
             }
-            if(depth > 0) os << "|_ ";
-            os << currentNode->name << std::endl;
+            return -1;
+        }
+};
+
+// A node of a parse tree. Tokens and reductions alike cover a span of the tree's
+// text; the children of a reduction are a range of the tree's child index array.
+struct TreeNode {
+    Symbol symbol;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t firstChild;
+    uint32_t childCount;
+};
+
+// A syntax error the parser reported. Parsing goes on after it: either a missing
+// terminal is put in front of the found one, or input is skipped up to where the
+// parser can take it again.
+struct SyntaxDiagnostic {
+    int line;
+    int column;
+    int state;          // the parser's state, ParserTables::expected lists what it would have taken
+    Symbol found;       // END_SYMBOL at the end of the input
+    Symbol inserted;    // the terminal put in, -1 when input was skipped
+};
+
+// A parse tree as two flat arrays in an arena that belongs to the tree: nodes in
+// the order the parser created them, so every child comes before its parent, and
+// the child lists of all nodes back to back. Nodes are trivially destructible and
+// the arena is released as a whole, so dropping a tree costs the same however
+// deep it is. Token text is viewed in storage the tree keeps alive: the source
+// buffer of a token list, or the text copied from a stream.
+class ParseTree {
+    private:
+        std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+
+    public:
+        std::pmr::vector<TreeNode> nodes;
+        std::pmr::vector<uint32_t> children;
+        uint32_t root = 0;
+        std::shared_ptr<const ParserTables> tables;
+        std::shared_ptr<const void> storage;
+        std::string_view text;
+        std::pmr::vector<SyntaxDiagnostic> errors;
+        bool accepted = false;     // no syntax errors
+
+        // nodeHint sizes the first arena block, so a tree of up to that many nodes is one
+        // allocation; the blocks come from upstream, which may be a per-thread pool
+        explicit ParseTree(size_t nodeHint = 1024, std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+            : arena(std::make_unique<std::pmr::monotonic_buffer_resource>(nodeHint * (sizeof(TreeNode) + sizeof(uint32_t)) * 2, upstream)),
+              nodes(arena.get()), children(arena.get()), errors(arena.get()) {
+            nodes.reserve(nodeHint);
+            children.reserve(nodeHint);
+        }
 
-            // Push children onto the stack in reverse order
-            for (auto childIter = currentNode->children.rbegin(); childIter != currentNode->children.rend(); ++childIter) {
-                nodeStack.push(std::make_pair(&(*childIter), depth + 1));
+        // the arrays allocate from the arena, so a tree can be moved into a new one but not assigned over another
+        ParseTree(ParseTree&&) = default;
+        ParseTree& operator=(ParseTree&&) = delete;
+
+        const TreeNode& getRoot() const {
+            return nodes[root];
+        }
+
+        std::span<const uint32_t> childrenOf(const TreeNode& node) const {
+            return std::span<const uint32_t>(children.data() + node.firstChild, node.childCount);
+        }
+
+        bool isToken(const TreeNode& node) const {
+            return node.symbol < tables->terminalCount();
+        }
+
+        std::string_view textOf(const TreeNode& node) const {
+            return text.substr(node.offset, node.length);
+        }
+
+        std::string_view nameOf(const TreeNode& node) const {
+            return tables->nameOf(node.symbol);
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const ParseTree& tree) {
+            std::vector<std::pair<uint32_t, int>> nodeStack = {{tree.root, 0}};
+
+            while (!nodeStack.empty()) {
+                const TreeNode& currentNode = tree.nodes[nodeStack.back().first];
+                int depth = nodeStack.back().second;
+                nodeStack.pop_back();
+
+                // Print the current node
+                for (int i = 0; i < depth; ++i) {
+                    os << "  ";
+                }
+                if(depth > 0) os << "|_ ";
+                os << tree.nameOf(currentNode) << std::endl;
+
+                // Push children onto the stack in reverse order
+                std::span<const uint32_t> nodeChildren = tree.childrenOf(currentNode);
+                for (auto childIter = nodeChildren.rbegin(); childIter != nodeChildren.rend(); ++childIter) {
+                    nodeStack.emplace_back(*childIter, depth + 1);
+                }
             }
+
+            return os;
         }
+};
 
-        return os;
-    }
+// What parsing with semantic actions gives: the value of the first rule when the
+// input had no syntax errors, the errors otherwise.
+template <typename Value>
+struct SemanticResult {
+    Value value{};
+    std::vector<SyntaxDiagnostic> errors;
+    bool accepted = false;
 };
 
 class Parser {
+    private:
+        std::shared_ptr<const ParserTables> tables;
+
     public:
-        LRTable lrTable;
+        // ELIDE_PASS_THROUGH leaves out the nodes of pass-through rules, their one child
+        // takes their place in the tree, and runs on the tables that skip their reductions
+        enum TreeMode { FULL_TREE, ELIDE_PASS_THROUGH };
+
         Parser() = default;
-        explicit Parser(const LRTable& lrTable) : lrTable(lrTable) {}
-
-        std::string retrieveMessage(const State& state, const std::string& token) const {
-            std::map<std::string, LRAction> m = state.mapping;
-            
-            std::list<std::string> expected;
-            for (auto it = m.begin(); it != m.end(); ++it) {
-                if (isElement(it->first, lrTable.grammar.nonterminals)) {
-                    expected.splice(expected.end(), lrTable.grammar.firsts.at(it->first));
-                } else {
-                    expected.push_back(it->first);
-                }
-            }
-            
-            std::string msg = "Expected";
-            expected.remove(EPSILON);
-            expected.sort();
-            expected.unique();
-            for (std::string elmnt : expected) {
-                msg += " '" + elmnt + "' or";
-            }
-            msg.erase(msg.rfind(' '));
-            msg += " but found '" + token + "'";
-            return std::regex_replace(msg, std::regex("'\\$'"), "EOF");
-        }
-
-        TreeNode parse(std::list<Token> tokens) const {
-            tokens.push_back(Token("$", "$"));
-            std::stack<TreeNode> nodeStack;
-            std::stack<int> stateStack;
-            stateStack.push(0);
-            int tokenIndex = 0;
-            Token token = *std::next(tokens.begin(), tokenIndex);
-            std::string token_type = token.getType();
-            State state = *std::next(lrTable.states.begin(), stateStack.top());
-            std::optional<LRAction> actionElement = chooseActionElement(state, token_type);
-
-            while (actionElement != std::nullopt && actionElement.value().toString() != "r0") {
-                if (actionElement.value().actionType == "s") {
-                    nodeStack.push(TreeNode{(*std::next(tokens.begin(), tokenIndex)).getType(), std::optional((*std::next(tokens.begin(), tokenIndex)).getValue())});
-                    stateStack.push(actionElement.value().actionValue);
-                    tokenIndex++;
-                } else if (actionElement.value().actionType == "r") {
-                    int ruleIndex = actionElement.value().actionValue;
-                    Rule rule = *std::next(lrTable.grammar.rules.begin(), ruleIndex);
-                    int removeCount = isElement(EPSILON, rule.development) ? 0 : rule.development.size();
-
-                    TreeNode newNode;
-                    newNode.name = rule.nonterminal;
-
-                    for (int i = 0; i < removeCount; i++) {
-                        newNode.children.push_front(nodeStack.top());
-                        nodeStack.pop();
-                        stateStack.pop();
-                    }
+        explicit Parser(const LRTable& lrTable) : tables(ParserTables::fromTable(lrTable)) {}
+        explicit Parser(std::shared_ptr<const ParserTables> tables) : tables(std::move(tables)) {}
 
-                    nodeStack.push(newNode);
-                } else {
-                    stateStack.push(actionElement.value().actionValue);
-                }
-                
-                state = *std::next(lrTable.states.begin(), stateStack.top());
-                token_type = (nodeStack.size() + stateStack.size()) % 2 == 0 ? nodeStack.top().name : (*std::next(tokens.begin(), tokenIndex)).getType();
-                actionElement = chooseActionElement(state, token_type);
-            }
+        const ParserTables& getTables() const {
+            return *tables;
+        }
 
-            if (actionElement == std::nullopt) {
-                std::cout << "SyntaxError: " << retrieveMessage(state, (*std::next(tokens.begin(), tokenIndex)).getValue()) << std::endl;
-            } else if (actionElement.value().toString() == "r0") {
-                std::cout << "success" << std::endl;
+        const std::shared_ptr<const ParserTables>& getSharedTables() const {
+            return tables;
+        }
+
+        // "Expected 'A' or 'B' but found 'c'", with EOF for the end of the input
+        void writeMessage(std::ostream& os, int state, std::string_view token) const {
+            os << "Expected";
+            const char* separator = " ";
+            for (uint32_t terminal : tables->expected(state)) {
+                os << separator;
+                if (terminal == END_SYMBOL) os << "EOF";
+                else os << '\'' << tables->nameOf(terminal) << '\'';
+                separator = " or ";
             }
 
-            return TreeNode{lrTable.grammar.axiom, std::nullopt, {nodeStack.top()}};
+            os << " but found ";
+            if (token == "$") os << "EOF";
+            else os << '\'' << token << '\'';
         }
 
-        template <class Archive>
-        void serialize(Archive& ar, const unsigned int /* version */) {
-            ar & lrTable;
+        std::string retrieveMessage(int state, const std::string& token) const {
+            std::ostringstream msg;
+            writeMessage(msg, state, token);
+            return msg.str();
         }
-};
 
-std::string transform_string(const std::string& input_string) {
-    std::istringstream iss(input_string);
-    std::string line;
-    std::vector<std::string> lines;
-    while (std::getline(iss, line)) {
-        lines.push_back(line);
-    }
+        // Syntax errors and the success message go to diagnostics. Parsing recovers
+        // from errors, so one pass reports all of them; an error within three tokens
+        // of the previous one is not printed, but all of them are kept in the tree's
+        // errors. The tree, and for streams the copied token text, is allocated from
+        // memory; a parser is immutable, so threads parsing at once only need a
+        // resource each.
+        ParseTree parse(const TokenList& tokens, std::ostream& diagnostics = std::cout,
+                        std::pmr::memory_resource* memory = std::pmr::get_default_resource(), TreeMode mode = FULL_TREE) const {
+            TokenListCursor cursor(tokens);
+            return parseFrom(cursor, diagnostics, memory, mode);
+        }
 
-    size_t last_colon_pos;
-    std::string last_colon_part;
+        // Parses tokens as the lexer produces them, so only the lexer's window and
+        // the text of shifted tokens are held in memory, never the whole input.
+        ParseTree parse(StreamingLexer& lexer, std::ostream& diagnostics = std::cout,
+                        std::pmr::memory_resource* memory = std::pmr::get_default_resource(), TreeMode mode = FULL_TREE) const {
+            StreamCursor cursor(lexer, memory);
+            return parseFrom(cursor, diagnostics, memory, mode);
+        }
 
-    for (auto& line : lines) {
-        
-        if (line.rfind(':') != std::string::npos) {
-            last_colon_pos = line.rfind(':');
-            last_colon_part = line.substr(0, last_colon_pos);
+        // Parses without a tree. actions.shift(terminal, text) gives the value of a token and
+        // actions.reduce(rule, values) that of a reduction, from the values of the rule's right
+        // hand side, which it may move from; Actions::Value is the type of both. Pass-through
+        // rules have no action, the value of their one symbol becomes theirs. Diagnostics are
+        // written as by parse, and what an action throws is rethrown after parsing, unless
+        // the input had syntax errors.
+        template <typename Actions>
+        SemanticResult<typename Actions::Value> parseWith(const TokenList& tokens, Actions& actions, std::ostream& diagnostics = std::cout) const {
+            TokenListCursor cursor(tokens);
+            return parseWithFrom(cursor, actions, diagnostics);
         }
-        
-        size_t last_pipe_pos = line.rfind('|');
-        if (last_pipe_pos != std::string::npos) {
-            line.insert(last_pipe_pos, last_colon_part);
+
+        template <typename Actions>
+        SemanticResult<typename Actions::Value> parseWith(StreamingLexer& lexer, Actions& actions, std::ostream& diagnostics = std::cout) const {
+            StreamCursor cursor(lexer, std::pmr::get_default_resource());
+            return parseWithFrom(cursor, actions, diagnostics);
         }
-    }
 
-    std::ostringstream oss;
-    for (const auto& line : lines) {
-        oss << line << '\n';
-    }
-    
-    return std::regex_replace(oss.str(), std::regex(":|\\|"), "->");
-}
+    private:
+        // Whether the parser would shift terminal, or accept, with only the bottom depth
+        // entries of stateStack. Reductions run on trial, which holds what they push on
+        // top of those; after a shift its state is on trial as well.
+        bool simulate(const std::vector<int>& stateStack, size_t& depth, std::vector<int>& trial, Symbol terminal) const;
+
+        // Phrase level recovery: a terminal the state on top expects after which found is
+        // taken, synchronizing terminals first; -1 if there is none.
+        Symbol findMissing(const std::vector<int>& stateStack, Symbol found) const;
+
+        // Panic mode recovery: the largest depth to pop the stack to so that symbol is
+        // taken, 0 if there is none. Only the end of the input, a synchronizing terminal
+        // and, with afterSync, the one after it may pop anything.
+        size_t findResumeDepth(const std::vector<int>& stateStack, Symbol symbol, bool afterSync) const;
+
+        // Walks a materialized token list. The tree's text is the source buffer itself.
+        class TokenListCursor {
+            private:
+                const TokenList& tokens;
+                size_t index = 0;
+
+            public:
+                explicit TokenListCursor(const TokenList& tokens) : tokens(tokens) {}
+
+                const std::vector<std::string>& kinds() const { return *tokens.kinds; }
+                size_t sizeHint() const { return tokens.size() * 2 + 1; }
+                bool atEnd() const { return index >= tokens.size(); }
+                uint32_t kind() const { return tokens[index].kind; }
+                std::string_view peek() const { return tokens.getValue(tokens[index]); }
+                uint32_t offset() const { return atEnd() ? static_cast<uint32_t>(tokens.source->getText().size()) : tokens[index].offset; }
+                uint32_t take() const { return tokens[index].offset; }
+                void advance() { index++; }
+                std::shared_ptr<const void> storage() const { return tokens.source; }
+                std::string_view text() const { return tokens.source->getText(); }
+
+                int line() const { return tokens.source->lineOf(offset()); }
+                int column() const { return tokens.source->columnOf(offset()); }
+
+                std::string location() const {
+                    return tokens.source->getFileName() + ":" + std::to_string(line()) + ":" + std::to_string(column());
+                }
+        };
+
+        // Pulls from a streaming lexer. Its window moves on, so the text of shifted
+        // tokens is copied into a buffer owned by the tree.
+        class StreamCursor {
+            private:
+                StreamingLexer& lexer;
+                std::shared_ptr<std::pmr::string> pool;
+                StreamToken current{};
+                bool more;
+
+            public:
+                StreamCursor(StreamingLexer& lexer, std::pmr::memory_resource* memory)
+                    : lexer(lexer), pool(std::allocate_shared<std::pmr::string>(std::pmr::polymorphic_allocator<std::pmr::string>(memory))),
+                      more(lexer.next(current)) {}
+
+                const std::vector<std::string>& kinds() const { return lexer.getTokenTypes(); }
+                size_t sizeHint() const { return 1024; }
+                bool atEnd() const { return !more; }
+                uint32_t kind() const { return current.kind; }
+                std::string_view peek() const { return current.value; }
+                uint32_t offset() const { return static_cast<uint32_t>(pool->size()); }
+                void advance() { more = lexer.next(current); }
+                std::shared_ptr<const void> storage() const { return pool; }
+                std::string_view text() const { return *pool; }
+
+                uint32_t take() {
+                    if (pool->size() + current.value.size() > UINT32_MAX) throw std::length_error("streamed token text is limited to 4 GiB");
+                    uint32_t offset = static_cast<uint32_t>(pool->size());
+                    pool->append(current.value);
+                    return offset;
+                }
+
+                int line() const { return more ? current.line : lexer.getLine(); }
+                int column() const { return more ? current.column : lexer.getColumn(); }
+
+                std::string location() const {
+                    return lexer.getFileName() + ":" + std::to_string(line()) + ":" + std::to_string(column());
+                }
+        };
+
+        // Builds the tree: a node for every token and every reduction, the node stack
+        // holds the nodes of the symbols on the parser's stack.
+        template <typename Cursor>
+        class TreeBuilder {
+            private:
+                ParseTree& tree;
+                Cursor& cursor;
+                std::vector<uint32_t> nodeStack;
+
+            public:
+                TreeBuilder(ParseTree& tree, Cursor& cursor) : tree(tree), cursor(cursor) {
+                    nodeStack.reserve(64);
+                }
+
+                void shift(Symbol terminal) {
+                    const uint32_t length = static_cast<uint32_t>(cursor.peek().size());
+                    nodeStack.push_back(static_cast<uint32_t>(tree.nodes.size()));
+                    tree.nodes.push_back(TreeNode{terminal, cursor.take(), length, 0, 0});
+                }
+
+                // a missing terminal is an empty token where the found one starts
+                void insert(Symbol terminal) {
+                    nodeStack.push_back(static_cast<uint32_t>(tree.nodes.size()));
+                    tree.nodes.push_back(TreeNode{terminal, cursor.offset(), 0, 0, 0});
+                }
+
+                // appends a node over the top length entries of the node stack
+                void reduce(int, Symbol nonterminal, size_t length) {
+                    std::pmr::vector<TreeNode>& nodes = tree.nodes;
+                    const uint32_t firstChild = static_cast<uint32_t>(tree.children.size());
+                    uint32_t offset = cursor.offset();
+                    uint32_t end = offset;
+                    if (length != 0) {
+                        offset = nodes[nodeStack[nodeStack.size() - length]].offset;
+                        const TreeNode& last = nodes[nodeStack.back()];
+                        end = last.offset + last.length;
+                    }
+
+                    tree.children.insert(tree.children.end(), nodeStack.end() - length, nodeStack.end());
+                    nodeStack.resize(nodeStack.size() - length);
+                    nodeStack.push_back(static_cast<uint32_t>(nodes.size()));
+                    nodes.push_back(TreeNode{nonterminal, offset, end - offset, firstChild, static_cast<uint32_t>(length)});
+                }
+
+                void error(const SyntaxDiagnostic& diagnostic) {
+                    tree.errors.push_back(diagnostic);
+                }
+
+                // the parser's stack was popped to depth states, the bottom one has no symbol
+                void popTo(size_t depth) {
+                    nodeStack.resize(depth - 1);
+                }
+
+                // on accept the stack holds the development of the first rule, after an error whatever was parsed
+                void finish(Symbol axiom) {
+                    reduce(0, axiom, nodeStack.size());
+                    tree.root = nodeStack.back();
+                }
+        };
+
+        // Runs semantic actions instead: a value for every token and for every reduction of
+        // a rule that is not pass-through, on a stack alongside the parser's. The actions
+        // stop at the first syntax error or at the first one that throws.
+        template <typename Cursor, typename Actions>
+        class ActionBuilder {
+            private:
+                using Value = typename Actions::Value;
+
+                Actions& actions;
+                Cursor& cursor;
+                SemanticResult<Value>& result;
+                std::vector<Value> values;
+                std::exception_ptr failure;
+                bool active = true;
+
+                void stop() {
+                    active = false;
+                    values.clear();
+                }
+
+            public:
+                ActionBuilder(Actions& actions, Cursor& cursor, SemanticResult<Value>& result) : actions(actions), cursor(cursor), result(result) {
+                    values.reserve(64);
+                }
+
+                void shift(Symbol terminal) {
+                    if (active) values.push_back(actions.shift(terminal, cursor.peek()));
+                }
+
+                // terminals are only inserted after an error, when the actions have stopped
+                void insert(Symbol) {}
+
+                void reduce(int rule, Symbol, size_t length) {
+                    if (!active) return;
+                    try {
+                        Value value = actions.reduce(rule, std::span<Value>(values).last(length));
+                        values.erase(values.end() - static_cast<std::ptrdiff_t>(length), values.end());
+                        values.push_back(std::move(value));
+                    } catch (...) {
+                        failure = std::current_exception();
+                        stop();
+                    }
+                }
+
+                void error(const SyntaxDiagnostic& diagnostic) {
+                    result.errors.push_back(diagnostic);
+                    stop();
+                }
+
+                void popTo(size_t) {}
+
+                // on accept the values are those of the first rule's right hand side; what an
+                // action threw only matters when the input had no syntax errors
+                void finish() {
+                    if (result.accepted) reduce(0, 0, values.size());
+                    if (result.accepted && failure) std::rethrow_exception(failure);
+                    if (result.accepted) result.value = std::move(values.back());
+                }
+        };
+
+        // The LR loop with error recovery, what it produces is up to the builder. Returns
+        // whether the input had no syntax errors.
+        template <typename Cursor, typename Builder>
+        bool drive(Cursor& cursor, Builder& builder, std::ostream& diagnostics, bool elide) const {
+            const ParserTables& table = *tables;
+
+            // token kinds are resolved to terminals once per parse, not per token;
+            // kinds the grammar does not know map to the EPSILON column, which is always an error
+            std::vector<Symbol> kindSymbols;
+            for (const std::string& kind : cursor.kinds()) {
+                Symbol symbol = table.findTerminal(kind);
+                kindSymbols.push_back(symbol >= 0 ? symbol : EPSILON_SYMBOL);
+            }
+            auto currentSymbol = [&]() {
+                return cursor.atEnd() ? END_SYMBOL : kindSymbols[cursor.kind()];
+            };
+
+            std::vector<int> stateStack = {0};
+            stateStack.reserve(64);
+
+            Symbol symbol = currentSymbol();
+            LRAction action = table.action(stateStack.back(), symbol, elide);
+            size_t shifted = 0;
+            size_t quietUntil = 0;      // errors this close after the last one are not printed, they are mostly its echo
+            bool inserting = false;     // symbol is a missing terminal that is shifted as an empty token
+            bool failed = false;
+
+            while (true) {
+                while (action.kind() == LRAction::SHIFT || action.kind() == LRAction::REDUCE) {
+                    if (action.kind() == LRAction::SHIFT && !inserting) {
+                        builder.shift(symbol);
+                        stateStack.push_back(action.value());
+                        cursor.advance();
+                        symbol = currentSymbol();
+                        shifted++;
+                    } else if (action.kind() == LRAction::SHIFT) {
+                        builder.insert(symbol);
+                        stateStack.push_back(action.value());
+                        symbol = currentSymbol();
+                        inserting = false;
+                    } else {
+                        const int rule = action.value();
+                        const Symbol nonterminal = table.ruleNonterminal(rule);
+                        const size_t length = table.ruleLength(rule);
+
+                        if (!elide || !table.isPassThrough(rule)) builder.reduce(rule, nonterminal, length);
+                        stateStack.resize(stateStack.size() - length);
+                        stateStack.push_back(table.goTo(stateStack.back(), nonterminal, elide));
+                    }
+
+                    action = table.action(stateStack.back(), symbol, elide);
+                }
+
+                if (action.kind() == LRAction::ACCEPT) break;
+
+                const int state = stateStack.back();
+                const bool report = !failed || shifted >= quietUntil;
+                quietUntil = shifted + 3;
+                if (report) {
+                    diagnostics << cursor.location() << ": SyntaxError: ";
+                    writeMessage(diagnostics, state, cursor.atEnd() ? std::string_view("$") : cursor.peek());
+                    diagnostics << std::endl;
+                }
+
+                // a missing terminal goes through the loop above like a token, without text
+                const Symbol inserted = findMissing(stateStack, symbol);
+                // every error is kept, report only decides what goes to diagnostics
+                builder.error(SyntaxDiagnostic{cursor.line(), cursor.column(), state, symbol, inserted});
+                failed = true;
+                if (inserted >= 0) {
+                    symbol = inserted;
+                    inserting = true;
+                    action = table.action(stateStack.back(), symbol, elide);
+                    continue;
+                }
+
+                // otherwise input is skipped, at a synchronizing terminal and the one after
+                // it the stack may be popped as well
+                bool afterSync = false;
+                size_t depth = 0;
+                while ((depth = findResumeDepth(stateStack, symbol, afterSync)) == 0 && symbol != END_SYMBOL) {
+                    afterSync = table.isSync(symbol);
+                    cursor.advance();
+                    symbol = currentSymbol();
+                }
+                if (depth == 0) break;
+
+                stateStack.resize(depth);
+                builder.popTo(depth);
+                action = table.action(stateStack.back(), symbol, elide);
+            }
+
+            if (!failed) diagnostics << "success" << std::endl;
+            return !failed;
+        }
+
+        template <typename Cursor>
+        ParseTree parseFrom(Cursor& cursor, std::ostream& diagnostics, std::pmr::memory_resource* memory, TreeMode mode) const {
+            // the bypass tables behave like the others on every terminal, so error recovery need not know about them
+            ParseTree tree(cursor.sizeHint(), memory);
+            TreeBuilder<Cursor> builder(tree, cursor);
+            tree.accepted = drive(cursor, builder, diagnostics, mode == ELIDE_PASS_THROUGH);
+            builder.finish(tables->axiom());
+            tree.tables = tables;
+            tree.storage = cursor.storage();
+            tree.text = cursor.text();
+            return tree;
+        }
+
+        // pass-through rules never have an action, so the tables that skip them are always used
+        template <typename Cursor, typename Actions>
+        SemanticResult<typename Actions::Value> parseWithFrom(Cursor& cursor, Actions& actions, std::ostream& diagnostics) const {
+            SemanticResult<typename Actions::Value> result;
+            ActionBuilder<Cursor, Actions> builder(actions, cursor, result);
+            result.accepted = drive(cursor, builder, diagnostics, true);
+            builder.finish();
+            return result;
+        }
+};
+
+// rewrites the grammar notation with ":" and "|" into one "->" rule per line
+std::string transform_string(const std::string& input_string);
+
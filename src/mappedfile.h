@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. The pages are only read from disk when
+// touched, so a file can be scanned front to back without reading it up front.
+class MappedFile {
+    private:
+        std::string path;
+        const char* bytes = nullptr;
+        size_t length = 0;
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
+
+        [[noreturn]] void fail(const std::string& what) const {
+            throw std::runtime_error("cannot " + what + " '" + path + "'");
+        }
+
+    public:
+        explicit MappedFile (std::string path) : path(std::move(path)) {
+#ifdef _WIN32
+            file = CreateFileA(this->path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file == INVALID_HANDLE_VALUE) fail("open");
+
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(file, &fileSize)) fail("stat");
+            length = static_cast<size_t>(fileSize.QuadPart);
+            if (length == 0) return;
+
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping == nullptr) fail("map");
+            bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            if (bytes == nullptr) fail("map");
+#else
+            int fd = ::open(this->path.c_str(), O_RDONLY);
+            if (fd < 0) fail("open");
+
+            struct stat info;
+            if (::fstat(fd, &info) != 0) {
+                ::close(fd);
+                fail("stat");
+            }
+            length = static_cast<size_t>(info.st_size);
+
+            if (length != 0) {
+                void* address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                if (address == MAP_FAILED) fail("map");
+                bytes = static_cast<const char*>(address);
+                ::madvise(address, length, MADV_SEQUENTIAL);
+            } else {
+                ::close(fd);
+            }
+#endif
+        }
+
+        MappedFile (const MappedFile&) = delete;
+        MappedFile& operator= (const MappedFile&) = delete;
+
+        ~MappedFile () {
+#ifdef _WIN32
+            if (bytes != nullptr) UnmapViewOfFile(bytes);
+            if (mapping != nullptr) CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+            if (bytes != nullptr) ::munmap(const_cast<char*>(bytes), length);
+#endif
+        }
+
+        const std::string& getPath () const {
+            return path;
+        }
+
+        const char* data () const {
+            return bytes;
+        }
+
+        size_t size () const {
+            return length;
+        }
+
+        // Tells the OS that the first end bytes will not be read again, so their pages
+        // can leave the resident set. Only whole pages are dropped.
+        void release (size_t end) const {
+#ifndef _WIN32
+            static const size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+            end -= end % pageSize;
+            if (bytes != nullptr && end != 0) ::madvise(const_cast<char*>(bytes), end, MADV_DONTNEED);
+#else
+            (void) end;
+#endif
+        }
+};
@@ -1,8 +1,19 @@
 //#include "lexer.h"
-#include "lrparser.h"
+#include "frontend.h"
+#include "incremental.h"
 #include "colormod.h"
-#include <boost/iostreams/filtering_stream.hpp>
-#include <boost/iostreams/filter/zlib.hpp>
+#ifdef BABEL_EMBEDDED_TABLES
+#include "babel_tables.h"
+#endif
+#ifdef BABEL_HAVE_LLVM
+#include "cache.h"
+#include "compile.h"
+#include "handlers.h"
+#include "interpreter.h"
+#include "jit.h"
+#include "lower.h"
+#endif
+#include <cstdio>
 #include <fstream>
 #include <string>
 #include <sstream>
@@ -11,128 +22,146 @@
 #include <iostream>
 #include <string>
 #include <filesystem>
+#include <optional>
 
-void run(const Lexer& lexer, const Parser& parser, const std::string& text) {
-    std::list<Token> tokens = lexer.tokenize(text);
-    std::cout << parser.parse(tokens) << std::endl;
+// the parse table in use, a compiled in one was generated from it as well
+std::filesystem::path parserTablePath(const std::filesystem::path& project_root) {
+    return project_root / "assets" / "parser.tbl";
 }
 
-void saveParserData(const Parser& parser, const std::filesystem::path& filename) {
-    std::ofstream ofs(filename, std::ios::binary);
-    boost::archive::binary_oarchive ar(ofs);
-    ar << parser;
+// assets/parser.tbl is kept up to date with build/grammar.txt, unless the table was compiled in
+Parser loadParserData([[maybe_unused]] const std::filesystem::path& project_root) {
+#ifdef BABEL_EMBEDDED_TABLES
+    return Parser(ParserTables::fromArrays(generated::PARSER_TABLES));
+#else
+    return loadParser(parserTablePath(project_root), project_root / "build" / "grammar.txt");
+#endif
 }
 
-Parser loadParserData(const std::filesystem::path& project_root) {
-    Parser parser;
-    std::filesystem::path dataPath = project_root / "assets" / "parser.dat";
-
-    if (auto ifs = std::ifstream(dataPath, std::ios::binary)/*; false*/) {
-        boost::archive::binary_iarchive ar(ifs);
-        ar >> parser;
-    } else {
-        std::filesystem::path grammarPath = project_root / "build" / "grammar.txt";
-        std::ifstream t(grammarPath);
-        if (!t.is_open()) { std::cout << "Error opening file" << std::endl; }
-        std::stringstream buffer;
-        buffer << t.rdbuf();
-
-        Grammar grammar(transform_string(buffer.str()));
-        std::cout << grammar.alphabet << std::endl;
-        LRClosureTable closureTable(grammar);
-        LRTable lrTable(closureTable);
-        parser = Parser(lrTable);
-        saveParserData(parser, dataPath);
+#ifdef BABEL_HAVE_LLVM
+// runs an accepted input in the interpreter or the JIT, which echo the value of a call on its own
+template <typename Tier>
+void execute(Tier& tier, const ParseTree& tree) {
+    try {
+        std::vector<std::unique_ptr<BaseAST>> statements = lowerProgram(tree);
+        tier.run(statements);
+    } catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
     }
-    return parser;
 }
 
+// babel --run [--jit] file
+//
+// Runs a whole file, in the interpreter unless --jit asks for native code from the start.
+int runFile(const Lexer& lexer, const Parser& parser, const std::string& file, bool useJit) {
+    try {
+        StreamingLexer stream(lexer, std::make_shared<const MappedFile>(file));
+        std::ostringstream diagnostics;
+        SemanticActions actions(parser.getTables());
+        auto result = parser.parseWith(stream, actions, diagnostics);
+        if (!result.accepted) {
+            std::cerr << diagnostics.str();
+            return 1;
+        }
+
+        std::vector<std::unique_ptr<BaseAST>> statements = std::get<SemanticActions::ASTList>(std::move(result.value));
+        const bool ran = useJit ? BabelJIT().run(statements, false) : BabelInterpreter().run(statements, false);
+        return ran ? 0 : 1;
+    } catch (const std::exception& e) {
+        // what the program printed comes before the error
+        std::fflush(stdout);
+        std::cerr << file << ": " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+// Identifies the compiler for cache keys: a rebuilt babel may generate different code.
+std::string compilerStamp(const std::filesystem::path& executable) {
+    std::error_code error;
+    const auto size = std::filesystem::file_size(executable, error);
+    const auto modified = std::filesystem::last_write_time(executable, error).time_since_epoch().count();
+    return std::to_string(size) + "/" + std::to_string(modified);
+}
+
+// writes next to path and renames, so a failed write never leaves half an output behind
+void writeOutput(const std::string& path, const std::string& bytes, bool executable) {
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (!out) throw std::runtime_error("cannot write " + path);
+    }
+    if (executable) {
+        std::filesystem::permissions(temporary, std::filesystem::perms::owner_exec | std::filesystem::perms::group_exec | std::filesystem::perms::others_exec,
+                                     std::filesystem::perm_options::add);
+    }
+    std::filesystem::rename(temporary, path);
+}
+
+// babel [-c | -S] [--emit-llvm] [-flto] [-O0..-O3] [-mcpu=name] [-o file] [--cache dir] [--no-cache] file
+//
+// The output is cached under the key of the file's normalized path and text, the grammar, the
+// compiler and the options, so compiling an unchanged file again only copies the output from
+// the cache. Like babelc, the cache is next to the parse table unless --cache names one.
+int compileFile(const Lexer& lexer, const Parser& parser, const std::string& file, const CompileOptions& options, std::string output,
+                const BuildCache* cache, const std::string& compiler) {
+    static const char* extensions[] = {".o", ".s", ".bc", ".ll", ""};
+    static const char* kinds[] = {"o", "s", "bc", "ll", "exe"};
+    if (output.empty()) {
+        output = options.output == CompileOptions::EXECUTABLE ? "a.out" : std::filesystem::path(file).stem().string() + extensions[options.output];
+    }
+
+    try {
+        auto source = std::make_shared<const MappedFile>(file);
+        CacheKey key;
+        if (cache) {
+            const std::string context = "compile " + compiler + " " + std::to_string(parser.getTables().grammarHash()) + " "
+                                      + std::to_string(hashTokenSpecs(babelTokenSpecs())) + " " + describeOptions(options) + " "
+                                      + std::filesystem::weakly_canonical(std::filesystem::absolute(file)).string();
+            key = CacheKey(std::string_view(source->data(), source->size()), context);
+            if (std::optional<std::string> entry = cache->load(key, kinds[options.output])) {
+                writeOutput(output, *entry, options.output == CompileOptions::EXECUTABLE);
+                return 0;
+            }
+        }
+
+        // the nodes are built while parsing, there is no parse tree
+        StreamingLexer stream(lexer, source);
+        std::ostringstream diagnostics;
+        SemanticActions actions(parser.getTables());
+        auto result = parser.parseWith(stream, actions, diagnostics);
+        if (!result.accepted) {
+            std::cerr << diagnostics.str();
+            return 1;
+        }
+
+        std::vector<std::unique_ptr<BaseAST>> statements = std::get<SemanticActions::ASTList>(std::move(result.value));
+        if (!compileProgram(statements, file, options, output)) return 1;
+
+        if (cache) {
+            std::ifstream in(output, std::ios::binary);
+            std::stringstream bytes;
+            bytes << in.rdbuf();
+            if (in) {
+                cache->store(key, kinds[options.output], bytes.str());
+                cache->evict();
+            }
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << file << ": " << e.what() << std::endl;
+        return 1;
+    }
+}
+#endif
+
 Lexer setupModuleAndLexer(const std::string& file_name) {
-    // Open a new context and module.
-    // TheContext = std::make_unique<LLVMContext>();
-    // TheModule = std::make_unique<Module>("Babel Core", *TheContext);
-
-    // Create a new builder for the module.
-    // Builder = std::make_unique<IRBuilder<>>(*TheContext);
-
-    auto lexer = Lexer(file_name, {
-        {"TYPE", "\\b(?:int|float|bool|string|char|list|tuple|map|dict|any|void)\\b"},
-        {"CLASS", "\\bclass\\b"},
-        {"TASK", "\\btask\\b"},
-        {"STRUCT", "\\bstruct\\b"},
-        {"STORAGE_MODIFIER", "\\b(?:static|const|final)\\b"},
-        {"STRING", R"("[^"]*")"},
-        {"CHAR", "'[^']{1}'"},
-        {"FLOATING_POINT", "\\d*\\.\\d+"},
-        {"BOOL", "(TRUE|FALSE)"},
-        {"LPAREN", "\\("},
-        {"LSQUARE", "\\["},
-        {"RSQUARE", "\\]"},
-        {"LBRACE", "\\{"},
-        {"RBRACE", "\\}"},
-        {"RPAREN", "\\)"},
-        {"IF", "if"},
-        {"ELSE", "else"},
-        {"ELIF", "elif"},
-        {"THEN", "then"},
-        {"MATCH", "macth"},
-        {"CASE", "case"},
-        {"OTHERWISE", "otherwise"},
-        {"END", "end"},
-        {"DO", "do"},
-        {"WHILE", "while"},
-        {"FOR", "for"},
-        {"TO", "to"},
-        {"STEP", "step"},
-        {"TRY", "try"},
-        {"CATCH", "catch"},
-        {"FINALLY", "finally"},
-        {"PASS", "pass"},
-        {"CONTINUE", "continue"},
-        {"BREAK", "break"},
-        {"RETURN", "return"},
-        {"RAISE", "raise"},
-        {"IMPORT", "imp"},    
-        {"EQEQ", "=="},
-        {"PLUS_EQUALS", "\\+="},
-        {"MINUS_EQUALS", "-="},
-        {"MULTIPLY_EQUALS", "\\*="},
-        {"DIVIDE_EQUALS", "/="},
-        {"POWER_EQUALS", "\\^="},
-        {"MODULO_EQUALS", "%="},
-        {"INTEGER_DIVIDE_EQUALS", "//="},
-        {"NEGLIGIBLY_LOW", "<<<"},
-        {"LSHIFT", "<<"},
-        {"RSHIFT", ">>"},
-        {"LTEQ", "<="},
-        {"GTEQ", ">="},
-        {"NOTEQ", "!="},
-        {"RARR","=>"},
-        {"INTEGER_DIVIDE", "//"},
-        {"INCREMENT", "\\+\\+"},
-        {"DECREMENT", "--"},
-        {"PLUS", "\\+"},
-        {"MINUS", "-"},
-        {"MULTIPLY", "\\*"},
-        {"DIVIDE", "/"},
-        {"POWER", "\\^"},
-        {"MODULO", "%"},
-        {"EQUALS", "="},
-        {"OR", "\\|"},
-        {"AND", "&"},
-        {"NOT", "!"},
-        {"LT", "<"},
-        {"GT", ">"},
-        {"DOT", "\\."},
-        {"COMMA", ","},
-        {"COLON", ":"},
-        {"SEMICOLON", ";"},
-        {"NEWLINE", "\n"},
-        {"NULL", "null"},
-        {"NEW", "new"},
-        {"VAR", "[a-zA-Z_][a-zA-Z0-9_]*"},
-        {"INTEGER", "\\d*"} //leave INTEGER here, it matches all expressions
-    });
+#ifdef BABEL_EMBEDDED_TABLES
+    auto lexer = Lexer(file_name, LexerDfa(generated::LEXER_TABLES),
+                       std::vector<std::string>(std::begin(generated::TOKEN_KINDS), std::end(generated::TOKEN_KINDS)));
+#else
+    auto lexer = Lexer(file_name, babelTokenSpecs());
+#endif
 
     return lexer;
 }
@@ -142,6 +171,76 @@ int main(int argc, char* argv[]) {
     const std::filesystem::path ROOT_DIR = std::filesystem::absolute(std::filesystem::path(argv[0])).parent_path().parent_path();
     Parser parser = loadParserData(ROOT_DIR);
 
+    std::string file;
+    std::string output;
+    bool object = false, assembly = false, bitcode = false;
+#ifdef BABEL_HAVE_LLVM
+    CompileOptions options;
+    bool useCache = true;
+    std::filesystem::path cachePath;
+    bool run = false, useJit = false;
+#endif
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-c") object = true;
+        else if (arg == "-S") assembly = true;
+        else if (arg == "--emit-llvm") bitcode = true;
+        else if (arg == "-o" && i + 1 < argc) output = argv[++i];
+#ifdef BABEL_HAVE_LLVM
+        else if (arg == "-flto") options.lto = bitcode = true;
+        else if (arg.size() == 3 && arg.rfind("-O", 0) == 0 && arg[2] >= '0' && arg[2] <= '3') options.optLevel = arg[2] - '0';
+        else if (arg.rfind("-mcpu=", 0) == 0) options.cpu = arg.substr(6);
+        else if (arg == "--cache" && i + 1 < argc) cachePath = argv[++i];
+        else if (arg == "--no-cache") useCache = false;
+        else if (arg == "--run") run = true;
+        else if (arg == "--jit") useJit = true;
+#endif
+        else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "babel: unknown option " << arg << std::endl;
+            return 2;
+        } else {
+            file = arg;
+        }
+    }
+
+    // with -c, -S, --emit-llvm or -o the file is compiled ahead of time
+    if (object || assembly || bitcode || !output.empty()) {
+#ifdef BABEL_HAVE_LLVM
+        if (file.empty()) {
+            std::cerr << "babel: no input file" << std::endl;
+            return 2;
+        }
+        if (bitcode) options.output = assembly ? CompileOptions::IR : CompileOptions::BITCODE;
+        else if (assembly) options.output = CompileOptions::ASSEMBLY;
+        else if (object) options.output = CompileOptions::OBJECT;
+        else options.output = CompileOptions::EXECUTABLE;
+        std::optional<BuildCache> cache;
+        if (cachePath.empty()) cachePath = parserTablePath(ROOT_DIR).parent_path() / "cache";
+        if (useCache) cache.emplace(cachePath);
+        return compileFile(lexer, parser, file, options, output, cache ? &*cache : nullptr, compilerStamp(std::filesystem::absolute(argv[0])));
+#else
+        std::cerr << "babel: compiling needs a build with LLVM" << std::endl;
+        return 2;
+#endif
+    }
+
+#ifdef BABEL_HAVE_LLVM
+    if (run) {
+        if (file.empty()) {
+            std::cerr << "babel: no input file" << std::endl;
+            return 2;
+        }
+        return runFile(lexer, parser, file, useJit);
+    }
+#endif
+
+    // a file argument is streamed through the lexer instead of being read up front
+    if (!file.empty()) {
+        StreamingLexer stream(lexer, std::make_shared<const MappedFile>(file));
+        std::cout << parser.parse(stream) << std::endl;
+        return 0;
+    }
+
     printf(" _____       _          _   |  Documentation: https://github.com/WehrWolff/babel/wiki\n");
     printf("| ___ \\     | |        | |  |  \n");
     printf("| |_/ / __ _| |__   ___| |  |  Use bemo for managing packages\n");
@@ -149,13 +248,37 @@ int main(int argc, char* argv[]) {
     printf("| |_/ / (_| | |_) |  __/ |  |  Version UNRELEASED (Mar 28, 2024)\n");
     printf("\\____/ \\__,_|_.__/ \\___|_|  |  https://github.com/WehrWolff/babel\n\n");
 
+    // lines are collected until they form a complete input, each one only parses itself and reuses the rest
+    IncrementalParser input(lexer, parser, "repl");
+#ifdef BABEL_HAVE_LLVM
+    // inputs run in the interpreter, which starts without building an LLVM module and compiles
+    // the tasks that get hot, unless --jit asks for native code from the start
+    BabelInterpreter interpreter;
+    std::optional<BabelJIT> jit;
+    if (useJit) jit.emplace();
+#endif
     while (true) {
         std::string text;
-        std::cout << color::rize("babel> ", color::BOLD, color::MAGENTA);
-        getline(std::cin, text);
-        
-        if (text == "exit()") break;
-        run(lexer, parser, text);
+        std::cout << color::rize(input.getText().empty() ? "babel> " : "   ... ", color::BOLD, color::MAGENTA);
+        if (!getline(std::cin, text)) break;
+
+        if (input.getText().empty() && text == "exit()") break;
+        if (input.getText().empty() && text.empty()) continue;
+        input.edit(input.getText().size(), 0, input.getText().empty() ? text : "\n" + text);
+
+        if (input.isAccepted()) {
+#ifdef BABEL_HAVE_LLVM
+            if (jit) execute(*jit, input.toParseTree());
+            else execute(interpreter, input.toParseTree());
+#else
+            std::cout << input.toParseTree() << std::endl;
+#endif
+        } else if (input.isIncomplete()) {
+            continue;
+        } else {
+            std::cout << input.getDiagnostic() << std::endl;
+        }
+        input.edit(0, input.getText().size(), "");
     }
 
     return 0;
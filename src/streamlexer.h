@@ -0,0 +1,262 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "lexer.h"
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+// Source of raw input for the streaming lexer.
+class ChunkReader {
+    public:
+        virtual ~ChunkReader () = default;
+
+        // Reads at most size bytes into data. Returns 0 only at the end of the input.
+        virtual size_t read (char* data, size_t size) = 0;
+};
+
+class IstreamReader : public ChunkReader {
+    private:
+        std::istream& stream;
+
+    public:
+        explicit IstreamReader (std::istream& stream) : stream(stream) {}
+
+        size_t read (char* data, size_t size) override {
+            stream.read(data, static_cast<std::streamsize>(size));
+            return static_cast<size_t>(stream.gcount());
+        }
+};
+
+// Reads from a file descriptor the caller keeps open.
+class FdReader : public ChunkReader {
+    private:
+        int fd;
+
+    public:
+        explicit FdReader (int fd) : fd(fd) {}
+
+        size_t read (char* data, size_t size) override {
+#ifdef _WIN32
+            int count = ::_read(fd, data, static_cast<unsigned int>(size));
+#else
+            ssize_t count;
+            do {
+                count = ::read(fd, data, size);
+            } while (count < 0 && errno == EINTR);
+#endif
+            if (count < 0) throw std::runtime_error("cannot read from file descriptor " + std::to_string(fd));
+            return static_cast<size_t>(count);
+        }
+};
+
+// Reads the next chunk of another reader on a background thread while the current
+// one is being lexed and parsed.
+class PrefetchReader : public ChunkReader {
+    private:
+        std::unique_ptr<ChunkReader> source;
+        std::vector<char> chunk;
+        size_t chunk_fill = 0;
+        size_t chunk_used = 0;
+        bool ready = false;
+        bool finished = false;
+        bool stopping = false;
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::thread worker;
+
+        void fill () {
+            std::vector<char> next(chunk.size());
+            while (true) {
+                size_t count = 0;
+                std::exception_ptr failure;
+                try {
+                    count = source->read(next.data(), next.size());
+                } catch (...) {
+                    failure = std::current_exception();
+                }
+
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return !ready || stopping; });
+                if (stopping) return;
+
+                chunk.swap(next);
+                chunk_fill = count;
+                chunk_used = 0;
+                error = failure;
+                finished = count == 0 || failure != nullptr;
+                ready = true;
+                changed.notify_all();
+                if (finished) return;
+            }
+        }
+
+    public:
+        explicit PrefetchReader (std::unique_ptr<ChunkReader> source, size_t chunk_size = 64 * 1024) : source(std::move(source)), chunk(chunk_size) {
+            worker = std::thread([this] { fill(); });
+        }
+
+        // the worker may be blocked in the underlying read, so this waits for that read to return
+        ~PrefetchReader () override {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            changed.notify_all();
+            worker.join();
+        }
+
+        size_t read (char* data, size_t size) override {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return ready; });
+            if (error) std::rethrow_exception(error);
+            if (chunk_fill == 0) return 0;
+
+            size_t count = std::min(size, chunk_fill - chunk_used);
+            std::memcpy(data, chunk.data() + chunk_used, count);
+            chunk_used += count;
+            if (chunk_used == chunk_fill && !finished) {
+                ready = false;
+                changed.notify_all();
+            }
+            return count;
+        }
+};
+
+// A token of a stream. The value is only valid until the lexer is advanced.
+struct StreamToken {
+    uint32_t kind;
+    std::string_view value;
+    uint64_t offset;
+    int line;
+    int column;
+};
+
+// Pull based lexer over input that is never held in memory as a whole. Reader
+// input goes through a window of about one chunk, which grows only while a single
+// token is longer than that; mapped files are scanned in place and their pages
+// dropped behind the cursor.
+class StreamingLexer {
+    private:
+        const Lexer& lexer;
+        std::string file_name;
+        std::unique_ptr<ChunkReader> reader;
+        std::shared_ptr<const MappedFile> mapping;
+        std::vector<char> window;
+        size_t chunk_size;
+
+        const char* data = nullptr;
+        size_t size = 0;
+        size_t pos = 0;
+        size_t released = 0;
+        bool eof = false;
+        uint64_t base = 0;          // stream offset of data[0]
+        int line = 1;
+        uint64_t line_start = 0;    // stream offset of the current line
+
+        // Drops what is behind the cursor and appends the next chunk. One byte before
+        // the cursor is kept since \b needs the character before a token.
+        bool refill () {
+            if (eof) return false;
+
+            size_t keep = pos > 0 ? pos - 1 : 0;
+            if (keep > 0) std::memmove(window.data(), window.data() + keep, size - keep);
+            base += keep;
+            size -= keep;
+            pos -= keep;
+
+            if (window.size() < size + chunk_size) window.resize(size + chunk_size);
+            size_t count = reader->read(window.data() + size, chunk_size);
+            if (count == 0) eof = true;
+            size += count;
+            data = window.data();
+            return true;
+        }
+
+        void advance (size_t end) {
+            const char* cursor = data + pos;
+            const char* stop = data + end;
+            while ((cursor = static_cast<const char*>(std::memchr(cursor, '\n', stop - cursor))) != nullptr) {
+                cursor++;
+                line++;
+                line_start = base + (cursor - data);
+            }
+            pos = end;
+
+            if (mapping && pos - released >= chunk_size) {
+                mapping->release(pos - 1);
+                released = pos;
+            }
+        }
+
+    public:
+        StreamingLexer (const Lexer& lexer, std::unique_ptr<ChunkReader> reader, std::string file_name, size_t chunk_size = 64 * 1024)
+            : lexer(lexer), file_name(std::move(file_name)), reader(std::move(reader)), chunk_size(chunk_size) {}
+
+        StreamingLexer (const Lexer& lexer, std::shared_ptr<const MappedFile> mapping, size_t chunk_size = 1024 * 1024)
+            : lexer(lexer), file_name(mapping->getPath()), mapping(mapping), chunk_size(chunk_size),
+              data(mapping->data()), size(mapping->size()), eof(true) {}
+
+        const std::string& getFileName () const {
+            return file_name;
+        }
+
+        const std::vector<std::string>& getTokenTypes () const {
+            return lexer.getTokenTypes();
+        }
+
+        // 1-based line and column of the next character to be scanned
+        int getLine () const {
+            return line;
+        }
+
+        int getColumn () const {
+            return static_cast<int>(base + pos - line_start) + 1;
+        }
+
+        bool next (StreamToken& token) {
+            const LexerDfa& dfa = lexer.getDfa();
+
+            while (true) {
+                if (pos >= size) {
+                    if (!refill()) return false;
+                    continue;
+                }
+
+                size_t length;
+                bool truncated;
+                int token_type = dfa.match(data, size, pos, length, truncated);
+
+                // the token may continue in the next chunk, so scan it again once that is in
+                if (truncated && !eof) {
+                    refill();
+                    continue;
+                }
+
+                if (token_type < 0) {
+                    //ignore or handle errors
+                    advance(pos + 1);
+                    continue;
+                }
+
+                token = StreamToken{static_cast<uint32_t>(token_type), std::string_view(data + pos, length), base + pos, line, getColumn()};
+                advance(pos + length);
+                return true;
+            }
+        }
+};
@@ -0,0 +1,133 @@
+// Build time generator: reads the grammar and the token specs and writes a header
+// with the parse table and the lexer automaton as constexpr arrays, so babel starts
+// without building a table or reading one from disk. The header is only rewritten
+// when its text changes, so an unchanged grammar does not rebuild anything.
+//
+// usage: babel_tablegen grammar.txt output.h
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "lexer.h"
+#include "lrparser.h"
+
+namespace {
+
+// writes count values of type T from data as the constexpr array name
+template <typename T>
+void writeArray(std::ostream& out, const char* type, const std::string& name, const T* data, size_t count) {
+    out << "inline constexpr " << type << " " << name << "[] = {";
+    // an array can not be empty, the lengths elsewhere say how much of it is used
+    if (count == 0) out << "0";
+    for (size_t i = 0; i < count; i++) {
+        out << (i % 16 == 0 ? "\n    " : " ") << +data[i] << ',';
+    }
+    out << "\n};\n\n";
+}
+
+template <typename T>
+void writeSection(std::ostream& out, const char* type, const std::string& name, const ParserTables& tables, TableFileHeader::Section section) {
+    std::string_view bytes = tables.sectionBytes(section);
+    writeArray(out, type, name, reinterpret_cast<const T*>(bytes.data()), bytes.size() / sizeof(T));
+}
+
+std::string generate(const std::string& grammarText) {
+    Grammar grammar(grammarText);
+    LRClosureTable closureTable(grammar);
+    LRTable lrTable(closureTable);
+    auto tables = ParserTables::fromTable(lrTable);
+
+    std::list<std::pair<std::string, std::string>> specs = babelTokenSpecs();
+    LexerDfa dfa(specs);
+    LexerDfaTables lexer = dfa.getTables();
+
+    std::ostringstream out;
+    out << "// Generated by babel_tablegen from the grammar and the token specs, do not edit.\n\n";
+    out << "#pragma once\n\n#include \"dfa.h\"\n#include \"lrparser.h\"\n\nnamespace generated {\n\n";
+
+    using S = TableFileHeader::Section;
+    writeSection<uint32_t>(out, "uint32_t", "ACTIONS", *tables, S::ACTIONS);
+    writeSection<int32_t>(out, "int32_t", "GOTOS", *tables, S::GOTOS);
+    writeSection<int32_t>(out, "int32_t", "RULE_NONTERMINALS", *tables, S::RULE_NONTERMINALS);
+    writeSection<uint32_t>(out, "uint32_t", "RULE_LENGTHS", *tables, S::RULE_LENGTHS);
+    writeSection<uint32_t>(out, "uint32_t", "NAME_OFFSETS", *tables, S::NAME_OFFSETS);
+    writeSection<signed char>(out, "char", "NAMES", *tables, S::NAMES);
+    writeSection<uint32_t>(out, "uint32_t", "EXPECTED_OFFSETS", *tables, S::EXPECTED_OFFSETS);
+    writeSection<uint32_t>(out, "uint32_t", "EXPECTED", *tables, S::EXPECTED);
+    writeSection<uint8_t>(out, "uint8_t", "SYNC_FLAGS", *tables, S::SYNC_FLAGS);
+    writeSection<uint32_t>(out, "uint32_t", "BYPASS_ACTIONS", *tables, S::BYPASS_ACTIONS);
+    writeSection<int32_t>(out, "int32_t", "BYPASS_GOTOS", *tables, S::BYPASS_GOTOS);
+    writeSection<uint8_t>(out, "uint8_t", "PASS_THROUGH_FLAGS", *tables, S::PASS_THROUGH_FLAGS);
+
+    out << "inline constexpr ParserTableArrays PARSER_TABLES = {\n"
+        << "    " << tables->grammarHash() << "ull, " << tables->stateCount() << ", " << tables->symbolCount() << ", "
+        << tables->terminalCount() << ", " << tables->ruleCount() << ", " << tables->axiom() << ",\n"
+        << "    ACTIONS, GOTOS, RULE_NONTERMINALS, RULE_LENGTHS, NAME_OFFSETS, NAMES, EXPECTED_OFFSETS, EXPECTED, SYNC_FLAGS,\n"
+        << "    BYPASS_ACTIONS, BYPASS_GOTOS, PASS_THROUGH_FLAGS,\n};\n\n";
+
+    writeArray(out, "uint8_t", "BYTE_CLASSES", lexer.byteClass, 256);
+    writeArray(out, "int32_t", "DFA_TRANSITIONS", lexer.transitions, static_cast<size_t>(lexer.stateCount) * lexer.classCount);
+    writeArray(out, "int32_t", "ACCEPT_BEGIN", lexer.acceptBegin, static_cast<size_t>(lexer.stateCount) + 1);
+    writeArray(out, "int32_t", "ACCEPT_TOKENS", lexer.acceptTokens, static_cast<size_t>(lexer.acceptBegin[lexer.stateCount]));
+    writeArray(out, "uint8_t", "BOUNDARY_FLAGS", lexer.boundaryFlags, static_cast<size_t>(lexer.tokenCount));
+
+    out << "inline constexpr LexerDfaTables LEXER_TABLES = {\n"
+        << "    BYTE_CLASSES, " << lexer.classCount << ", " << lexer.stateCount << ", " << lexer.tokenCount << ",\n"
+        << "    DFA_TRANSITIONS, ACCEPT_BEGIN, ACCEPT_TOKENS, BOUNDARY_FLAGS,\n};\n\n";
+
+    // token kind names are plain identifiers
+    out << "inline constexpr const char* TOKEN_KINDS[] = {";
+    size_t i = 0;
+    for (const auto& spec : specs) {
+        out << (i++ % 8 == 0 ? "\n    " : " ") << '"' << spec.first << "\",";
+    }
+    out << "\n};\n\n}\n";
+    return out.str();
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: babel_tablegen grammar.txt output.h" << std::endl;
+        return 2;
+    }
+
+    std::ifstream grammarFile(argv[1]);
+    if (!grammarFile.is_open()) {
+        std::cerr << "babel_tablegen: cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    std::stringstream buffer;
+    buffer << grammarFile.rdbuf();
+
+    std::string header;
+    try {
+        header = generate(transform_string(buffer.str()));
+    } catch (const std::exception& e) {
+        std::cerr << "babel_tablegen: " << e.what() << std::endl;
+        return 1;
+    }
+
+    const std::filesystem::path output = argv[2];
+    if (std::ifstream existing(output, std::ios::binary); existing.is_open()) {
+        std::stringstream old;
+        old << existing.rdbuf();
+        if (old.str() == header) return 0;
+    }
+
+    if (output.has_parent_path()) std::filesystem::create_directories(output.parent_path());
+    const std::string temporary = output.string() + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out << header;
+        if (!out) {
+            std::cerr << "babel_tablegen: cannot write " << temporary << std::endl;
+            return 1;
+        }
+    }
+    std::filesystem::rename(temporary, output);
+    return 0;
+}
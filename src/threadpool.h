@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data parallel loops. The thread calling
+// parallelFor works as well, as worker 0, so a pool of size 1 has no threads and
+// runs everything inline.
+//
+// The indices of a loop are split into one contiguous range per worker. A worker
+// takes indices from the front of its own range and, once that is empty, steals
+// the back half of another worker's range, so uneven tasks still keep every
+// worker busy while neighbouring indices mostly stay on one thread.
+class ThreadPool {
+    private:
+        struct alignas(64) WorkRange {
+            std::mutex mutex;
+            size_t begin = 0;
+            size_t end = 0;
+        };
+
+        std::vector<std::thread> threads;
+        std::unique_ptr<WorkRange[]> ranges;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+
+        const std::function<void(size_t, unsigned)>* task = nullptr;
+        std::atomic<bool> failed{false};
+        uint64_t generation = 0;
+        unsigned busy = 0;
+        bool stopping = false;
+        std::exception_ptr error;
+
+        bool takeOwn(unsigned worker, size_t& index) {
+            WorkRange& own = ranges[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (own.begin == own.end) return false;
+            index = own.begin++;
+            return true;
+        }
+
+        // moves the back half of the first non-empty range after the worker's own into it
+        bool steal(unsigned worker, size_t& index) {
+            const unsigned workers = size();
+            for (unsigned offset = 1; offset < workers; offset++) {
+                WorkRange& victim = ranges[(worker + offset) % workers];
+                size_t begin, end;
+                {
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    if (victim.begin == victim.end) continue;
+                    begin = victim.begin + (victim.end - victim.begin) / 2;
+                    end = victim.end;
+                    victim.end = begin;
+                }
+
+                WorkRange& own = ranges[worker];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                own.begin = begin + 1;
+                own.end = end;
+                index = begin;
+                return true;
+            }
+            return false;
+        }
+
+        void runTask(unsigned worker) {
+            size_t index;
+            while (!failed.load(std::memory_order_relaxed) && (takeOwn(worker, index) || steal(worker, index))) {
+                try {
+                    (*task)(index, worker);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error) error = std::current_exception();
+                    failed.store(true, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void workerLoop(unsigned worker) {
+            uint64_t seen = 0;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [&] { return stopping || generation != seen; });
+                    if (stopping) return;
+                    seen = generation;
+                }
+
+                runTask(worker);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--busy == 0) done.notify_all();
+            }
+        }
+
+    public:
+        explicit ThreadPool(unsigned size = std::max(1u, std::thread::hardware_concurrency())) : ranges(new WorkRange[std::max(1u, size)]) {
+            for (unsigned worker = 1; worker < size; worker++) {
+                threads.emplace_back([this, worker] { workerLoop(worker); });
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (std::thread& thread : threads) thread.join();
+        }
+
+        // number of workers including the calling thread, worker IDs are below this
+        unsigned size() const {
+            return static_cast<unsigned>(threads.size()) + 1;
+        }
+
+        // Calls task(index, worker) for every index below count and returns once all
+        // calls are done. The first exception thrown by a task is rethrown here, the
+        // indices that were not started by then are skipped.
+        void parallelFor(size_t count, const std::function<void(size_t, unsigned)>& task) {
+            if (threads.empty() || count <= 1) {
+                for (size_t index = 0; index < count; index++) task(index, 0);
+                return;
+            }
+
+            const unsigned workers = size();
+            for (unsigned worker = 0; worker < workers; worker++) {
+                std::lock_guard<std::mutex> lock(ranges[worker].mutex);
+                ranges[worker].begin = count * worker / workers;
+                ranges[worker].end = count * (worker + 1) / workers;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                this->task = &task;
+                failed.store(false, std::memory_order_relaxed);
+                error = nullptr;
+                busy = static_cast<unsigned>(threads.size());
+                generation++;
+            }
+            wake.notify_all();
+
+            runTask(0);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [&] { return busy == 0; });
+            this->task = nullptr;
+            if (error) std::rethrow_exception(error);
+        }
+};
@@ -0,0 +1,27 @@
+#include "tools.h"
+
+std::list<std::string> trimElements(std::list<std::string> list) {
+    std::list<std::string> result = {};
+
+    for (const std::string& elmnt : list) {
+        result.push_back(boost::trim_copy(elmnt));
+    }
+
+    return result;
+}
+
+std::list<std::string> splitString(const std::string& input, const std::string& delimiter) {
+    std::list<std::string> result;
+    size_t startPos = 0;
+    size_t foundPos;
+
+    while ((foundPos = input.find(delimiter, startPos)) != std::string::npos) {
+        result.push_back(input.substr(startPos, foundPos - startPos));
+        startPos = foundPos + delimiter.length();
+    }
+
+    // Add the last part of the string
+    result.push_back(input.substr(startPos));
+
+    return result;
+}
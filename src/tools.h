@@ -1,3 +1,5 @@
+#pragma once
+
 #include <algorithm>
 #include <boost/algorithm/string.hpp>
 #include <iterator>
@@ -39,10 +41,16 @@ int indexOf(T element, const std::list<T>& list) {
     return -1;
 }
 
-template <typename T>
-bool includes(std::list<T> list1, std::list<T> list2) {
+// leave for clarity, potentially replace later
+template <typename T, typename Container>
+bool isElement(const T& elmnt, const Container& list) {
+    return std::find(list.begin(), list.end(), elmnt) != list.end();
+}
+
+template <typename Container>
+bool includes(const Container& list1, const Container& list2) {
     for (const auto& elmnt : list1) {
-        if (indexOf(elmnt, list2) < 0){
+        if (!isElement(elmnt, list2)) {
             return false;
         }
     }
@@ -50,8 +58,8 @@ bool includes(std::list<T> list1, std::list<T> list2) {
     return true;
 }
 
-template <typename T>
-bool includeEachOther(std::list<T> list1, std::list<T> list2) {
+template <typename Container>
+bool includeEachOther(const Container& list1, const Container& list2) {
     return includes(list1, list2) && includes(list2, list1);
 }
 
@@ -61,40 +69,12 @@ std::list<T> getOrCreateArray(std::map<std::string, std::list<T>>& dict, std::st
     return dict[key];
 }
 
-std::list<std::string> trimElements(std::list<std::string> list) {
-    std::list<std::string> result = {};
-
-    for (const std::string& elmnt : list) {
-        result.push_back(boost::trim_copy(elmnt));
-    }
-
-    return result;
-}
-
-std::list<std::string> splitString(const std::string& input, const std::string& delimiter) {
-    std::list<std::string> result;
-    size_t startPos = 0;
-    size_t foundPos;
-
-    while ((foundPos = input.find(delimiter, startPos)) != std::string::npos) {
-        result.push_back(input.substr(startPos, foundPos - startPos));
-        startPos = foundPos + delimiter.length();
-    }
-
-    // Add the last part of the string
-    result.push_back(input.substr(startPos));
-
-    return result;
-}
+std::list<std::string> trimElements(std::list<std::string> list);
 
-// leave for clarity, potentially replace later
-template <typename T>
-bool isElement(T elmnt, const std::list<T>& list) {
-    return std::find(list.begin(), list.end(), elmnt) != list.end();
-}
+std::list<std::string> splitString(const std::string& input, const std::string& delimiter);
 
-template <typename T>
-bool addUnique(T elmnt, std::list<T>& list) {
+template <typename T, typename Container>
+bool addUnique(T elmnt, Container& list) {
     if (!isElement(elmnt, list)) {
         list.push_back(elmnt);
 
@@ -0,0 +1,264 @@
+#include "ast.h"
+
+// a condition may be of any type with a value, codegen compares it against zero
+static void checkCondition(TypeChecker &checker, BaseAST &cond) {
+    if (checker.resolve(cond.check(checker)) == BabelType::Void) checker.fail("a condition needs a value");
+}
+
+int VariableAST::check(TypeChecker &checker) {
+    int type;
+    if (auto local = checker.locals.find(Name); local != checker.locals.end()) {
+        type = local->second;
+    } else if (auto global = checker.globals.find(Name); global != checker.globals.end()) {
+        type = checker.of(global->second);
+    } else {
+        checker.fail("unknown variable " + Name);
+    }
+    Type = checker.resolve(type);
+    return type;
+}
+
+int IntegerAST::check(TypeChecker &checker) {
+    Type = BabelType::Int;
+    return checker.of(Type);
+}
+
+int FloatingPointAST::check(TypeChecker &checker) {
+    Type = BabelType::Float;
+    return checker.of(Type);
+}
+
+int BoolAST::check(TypeChecker &checker) {
+    Type = BabelType::Bool;
+    return checker.of(Type);
+}
+
+int CharAST::check(TypeChecker &checker) {
+    Type = BabelType::Char;
+    return checker.of(Type);
+}
+
+int UnaryOperatorAST::check(TypeChecker &checker) {
+    int type = Operand->check(checker);
+    if (Op == "!") {
+        if (checker.resolve(type) == BabelType::Void) checker.fail("! needs a value");
+        type = checker.of(BabelType::Bool);
+    } else {
+        if ((Op == "++" || Op == "--") && !dynamic_cast<VariableAST *>(Operand.get())) checker.fail(Op + " needs a variable");
+        type = checker.numeric(type, type, Op);
+    }
+    Type = checker.resolve(type);
+    return type;
+}
+
+int BinaryOperatorAST::check(TypeChecker &checker) {
+    const int left = LHS->check(checker);
+    const int right = RHS->check(checker);
+    const std::string what = "operator " + Op;
+    auto isNumber = [&](int type) {
+        return checker.resolve(type) == BabelType::Int || checker.resolve(type) == BabelType::Float;
+    };
+
+    int operands;
+    int result;
+    if (Op == "&" || Op == "|") {
+        if (checker.resolve(left) == BabelType::Void || checker.resolve(right) == BabelType::Void) checker.fail(what + " needs values");
+        operands = result = checker.of(BabelType::Bool);
+    } else if (Op == "==" || Op == "!=" || Op == "<" || Op == "<=" || Op == ">" || Op == ">=") {
+        // numbers compare as numbers, chars with chars and bools only for equality
+        const bool ordered = Op != "==" && Op != "!=";
+        if (isNumber(left) || isNumber(right) || (ordered && checker.resolve(left) != BabelType::Char && checker.resolve(right) != BabelType::Char)) {
+            operands = checker.numeric(left, right, what);
+        } else {
+            checker.unify(left, right, what);
+            operands = left;
+        }
+        result = checker.of(BabelType::Bool);
+    } else if (Op == "bit_or" || Op == "bit_xor" || Op == "bit_and" || Op == "<<" || Op == ">>") {
+        checker.unify(left, checker.of(BabelType::Int), what);
+        checker.unify(right, checker.of(BabelType::Int), what);
+        operands = result = checker.of(BabelType::Int);
+    } else {
+        operands = result = checker.numeric(left, right, what);
+        // / always divides as floats, // is the one that stays int
+        if (Op == "/") operands = result = checker.of(BabelType::Float);
+    }
+
+    OperandType = checker.resolve(operands);
+    Type = checker.resolve(result);
+    return result;
+}
+
+int TaskCallAST::check(TypeChecker &checker) {
+    std::vector<int> argTypes;
+    for (auto &Arg : Args) argTypes.push_back(Arg->check(checker));
+
+    // print takes a value of any type and gives it back
+    if (callsTo == "print") {
+        if (Args.size() != 1) checker.fail("print takes one argument");
+        if (checker.resolve(argTypes[0]) == BabelType::Void) checker.fail("print needs a value");
+        ParamTypes = {checker.resolve(argTypes[0])};
+        Type = ParamTypes[0];
+        return argTypes[0];
+    }
+
+    std::vector<int> params;
+    int result;
+    if (checker.inTask && callsTo == checker.taskName) {
+        params = checker.taskArgs;
+        result = checker.taskResult;
+    } else if (auto task = checker.tasks.find(callsTo); task != checker.tasks.end()) {
+        for (BabelType param : task->second.args) params.push_back(checker.of(param));
+        result = checker.of(task->second.result);
+    } else {
+        checker.fail("unknown task " + callsTo);
+    }
+
+    if (params.size() != Args.size()) {
+        checker.fail(callsTo + " takes " + std::to_string(params.size()) + " arguments, not " + std::to_string(Args.size()));
+    }
+    ParamTypes.clear();
+    for (size_t i = 0; i < params.size(); i++) {
+        checker.assign(params[i], argTypes[i], "argument " + std::to_string(i + 1) + " of " + callsTo);
+        ParamTypes.push_back(checker.resolve(params[i]));
+    }
+
+    Type = checker.resolve(result);
+    return result;
+}
+
+int AssignmentAST::check(TypeChecker &checker) {
+    const int value = Val->check(checker);
+    if (checker.resolve(value) == BabelType::Void) checker.fail(Name + " can not be assigned nothing");
+
+    int target;
+    if (auto local = checker.locals.find(Name); local != checker.locals.end()) {
+        target = local->second;
+    } else if (auto global = checker.globals.find(Name); global != checker.globals.end()) {
+        target = checker.of(global->second);
+    } else {
+        // the first assignment declares the variable, with the type of its value unless one is given
+        target = DeclaredType != BabelType::Unknown ? checker.of(DeclaredType) : value;
+        if (checker.inTask) checker.locals[Name] = target;
+        else checker.globals[Name] = checker.resolve(target);
+    }
+
+    if (DeclaredType != BabelType::Unknown) checker.unify(target, checker.of(DeclaredType), "the declaration of " + Name);
+    checker.assign(target, value, "the assignment to " + Name);
+    Type = checker.resolve(target);
+    return target;
+}
+
+int BlockAST::check(TypeChecker &checker) {
+    int last = checker.of(BabelType::Void);
+    for (auto &Statement : Statements) last = Statement->check(checker);
+    Type = checker.resolve(last);
+    return last;
+}
+
+int IfAST::check(TypeChecker &checker) {
+    checkCondition(checker, *Cond);
+    Then->check(checker);
+    if (Else) Else->check(checker);
+    Type = BabelType::Void;
+    return checker.of(Type);
+}
+
+int WhileAST::check(TypeChecker &checker) {
+    checkCondition(checker, *Cond);
+    Body->check(checker);
+    if (Step) Step->check(checker);
+    Type = BabelType::Void;
+    return checker.of(Type);
+}
+
+int LoopControlAST::check(TypeChecker &checker) {
+    Type = BabelType::Void;
+    return checker.of(Type);
+}
+
+int RaiseAST::check(TypeChecker &checker) {
+    Type = BabelType::Void;
+    return checker.of(Type);
+}
+
+int TryAST::check(TypeChecker &checker) {
+    Body->check(checker);
+    for (auto &Catch : Catches) Catch.second->check(checker);
+    if (Finally) Finally->check(checker);
+    Type = BabelType::Void;
+    return checker.of(Type);
+}
+
+// Type is the type the task returns, the value is converted to it
+int ReturnAST::check(TypeChecker &checker) {
+    if (!checker.inTask) checker.fail("return outside of a task");
+
+    if (Val) {
+        const int value = Val->check(checker);
+        if (checker.resolve(value) == BabelType::Void) checker.fail("return of nothing from " + checker.taskName);
+        checker.assign(checker.taskResult, value, "the result of " + checker.taskName);
+        checker.returnsValue = true;
+    } else {
+        checker.unify(checker.taskResult, checker.of(BabelType::Void), "the result of " + checker.taskName);
+    }
+    Type = checker.resolve(checker.taskResult);
+    return checker.of(BabelType::Void);
+}
+
+int TaskHeaderAST::check(TypeChecker &checker) {
+    Type = BabelType::Void;
+    return checker.of(Type);
+}
+
+// The body is checked twice: first with open types for what is not annotated, which are
+// bound by their uses or else default to float, and then with the signature that came
+// out, so every node in the body gets a concrete type.
+int TaskAST::check(TypeChecker &checker) {
+    const std::string &name = Header->getName();
+    if (name == "print" || checker.tasks.count(name)) checker.fail("task " + name + " is already defined");
+
+    checker.inTask = true;
+    checker.taskName = name;
+    TaskSignature signature;
+    for (int pass = 0; pass < 2; pass++) {
+        checker.locals.clear();
+        checker.taskArgs.clear();
+        for (size_t i = 0; i < Header->getArgs().size(); i++) {
+            const BabelType annotated = pass == 0 ? Header->getArgTypes()[i] : signature.args[i];
+            checker.taskArgs.push_back(annotated != BabelType::Unknown ? checker.of(annotated) : checker.fresh());
+            checker.locals[Header->getArgs()[i]] = checker.taskArgs.back();
+        }
+        const BabelType result = pass == 0 ? Header->getReturnType() : signature.result;
+        checker.taskResult = result != BabelType::Unknown ? checker.of(result) : checker.fresh();
+        checker.returnsValue = false;
+
+        Body->check(checker);
+
+        if (pass == 0) {
+            if (!checker.returnsValue) checker.bindOpen(checker.taskResult, BabelType::Void);
+            for (int arg : checker.taskArgs) {
+                checker.bindOpen(arg, BabelType::Float);
+                signature.args.push_back(checker.resolve(arg));
+            }
+            checker.bindOpen(checker.taskResult, BabelType::Float);
+            signature.result = checker.resolve(checker.taskResult);
+        }
+    }
+
+    checker.inTask = false;
+    checker.locals.clear();
+    Header->setSignature(signature);
+    checker.tasks[name] = signature;
+    Type = BabelType::Void;
+    return checker.of(Type);
+}
+
+ProgramTypes checkProgram(std::vector<std::unique_ptr<BaseAST>> &statements, const ProgramTypes &defined) {
+    TypeChecker checker;
+    checker.globals = defined.globals;
+    checker.tasks = defined.tasks;
+    for (auto &statement : statements) statement->check(checker);
+
+    return {std::move(checker.globals), std::move(checker.tasks)};
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The types values have at run time, codegen keeps them unboxed: int is i64, float is
+// double, bool is i1 and char is i8. Void is only the result of a task without a value.
+enum class BabelType { Int, Float, Bool, Char, Void, Unknown };
+
+inline const char* typeName(BabelType type) {
+    switch (type) {
+        case BabelType::Int: return "int";
+        case BabelType::Float: return "float";
+        case BabelType::Bool: return "bool";
+        case BabelType::Char: return "char";
+        case BabelType::Void: return "void";
+        default: return "unknown";
+    }
+}
+
+// the type a TYPE token names, Unknown for the ones codegen has no representation for
+inline BabelType typeNamed(const std::string& name) {
+    if (name == "int") return BabelType::Int;
+    if (name == "float") return BabelType::Float;
+    if (name == "bool") return BabelType::Bool;
+    if (name == "char") return BabelType::Char;
+    if (name == "void") return BabelType::Void;
+    return BabelType::Unknown;
+}
+
+struct TaskSignature {
+    std::vector<BabelType> args;
+    BabelType result = BabelType::Void;
+};
+
+// what the programs of a session defined, every tier keeps its own
+struct ProgramTypes {
+    std::map<std::string, BabelType> globals;
+    std::map<std::string, TaskSignature> tasks;
+};
+
+// State of the type checker. Types are ids into a union-find forest whose first ids are
+// the concrete types, so unannotated arguments and results of a task start as ids of
+// their own and are bound to what the body does with them. An int may be used where a
+// float is expected, nothing else converts.
+class TypeChecker {
+    private:
+        std::vector<int> parent;
+
+    public:
+        std::map<std::string, int> locals;
+        std::map<std::string, BabelType> globals;
+        std::map<std::string, TaskSignature> tasks;
+
+        // the task being checked, its own calls use the ids of its arguments and result
+        bool inTask = false;
+        std::string taskName;
+        std::vector<int> taskArgs;
+        int taskResult = 0;
+        bool returnsValue = false;
+
+        TypeChecker() {
+            for (int type = 0; type < static_cast<int>(BabelType::Unknown); type++) parent.push_back(type);
+        }
+
+        [[noreturn]] static void fail(const std::string& message) {
+            throw std::runtime_error("TypeError: " + message);
+        }
+
+        int of(BabelType type) const {
+            return static_cast<int>(type);
+        }
+
+        int fresh() {
+            parent.push_back(static_cast<int>(parent.size()));
+            return parent.back();
+        }
+
+        int find(int type) {
+            while (parent[type] != type) type = parent[type] = parent[parent[type]];
+            return type;
+        }
+
+        BabelType resolve(int type) {
+            type = find(type);
+            return type < static_cast<int>(BabelType::Unknown) ? static_cast<BabelType>(type) : BabelType::Unknown;
+        }
+
+        // the concrete type a still open id ends up as
+        void bindOpen(int type, BabelType fallback) {
+            type = find(type);
+            if (resolve(type) == BabelType::Unknown) parent[type] = of(fallback);
+        }
+
+        void unify(int a, int b, const std::string& what) {
+            a = find(a);
+            b = find(b);
+            if (a == b) return;
+            if (resolve(a) != BabelType::Unknown && resolve(b) != BabelType::Unknown) {
+                fail(what + " mixes " + typeName(resolve(a)) + " and " + typeName(resolve(b)));
+            }
+            if (resolve(a) == BabelType::Unknown) parent[a] = b;
+            else parent[b] = a;
+        }
+
+        // a value of type from stored where target is expected
+        void assign(int target, int from, const std::string& what) {
+            if (resolve(target) == BabelType::Float && resolve(from) == BabelType::Int) return;
+            unify(target, from, what);
+        }
+
+        // the common type of two numbers, int and float give float
+        int numeric(int a, int b, const std::string& what) {
+            const BabelType left = resolve(a);
+            const BabelType right = resolve(b);
+            if (left == BabelType::Bool || left == BabelType::Char || left == BabelType::Void ||
+                right == BabelType::Bool || right == BabelType::Char || right == BabelType::Void) {
+                fail(what + " needs numbers, not " + typeName(left == BabelType::Int || left == BabelType::Float ? right : left));
+            }
+            if (left == BabelType::Float && right == BabelType::Int) return a;
+            if (left == BabelType::Int && right == BabelType::Float) return b;
+            unify(a, b, what);
+            return find(a);
+        }
+};
@@ -0,0 +1,43 @@
+# Runs PROGRAM with babel --run, babel --run --jit and as executables compiled at -O0 and
+# -O2, and fails when what they print or whether they succeed differs from the
+# interpreter. Error messages go to stderr and are worded by each tier, so they are not
+# compared.
+#
+# cmake -DBABEL=path -DPROGRAM=file.bbl -DWORK_DIR=dir -P run_tiers.cmake
+
+get_filename_component(name ${PROGRAM} NAME_WE)
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+execute_process(COMMAND ${BABEL} --run ${PROGRAM} OUTPUT_VARIABLE expected RESULT_VARIABLE status ERROR_QUIET)
+if(status STREQUAL "0")
+    set(expected_status "success")
+else()
+    set(expected_status "failure")
+endif()
+
+# compares a tier with the interpreter
+function(compare tier output status)
+    if(status STREQUAL "0")
+        set(status "success")
+    else()
+        set(status "failure")
+    endif()
+    if(NOT output STREQUAL expected OR NOT status STREQUAL expected_status)
+        message(FATAL_ERROR "${PROGRAM}: ${tier} differs from the interpreter\n"
+                            "--- interpreter (${expected_status})\n${expected}"
+                            "--- ${tier} (${status})\n${output}")
+    endif()
+endfunction()
+
+execute_process(COMMAND ${BABEL} --run --jit ${PROGRAM} OUTPUT_VARIABLE output RESULT_VARIABLE status ERROR_QUIET)
+compare("the JIT" "${output}" "${status}")
+
+foreach(level 0 2)
+    set(executable ${WORK_DIR}/${name}-O${level}${CMAKE_EXECUTABLE_SUFFIX})
+    execute_process(COMMAND ${BABEL} -O${level} --no-cache -o ${executable} ${PROGRAM} RESULT_VARIABLE status)
+    if(NOT status STREQUAL "0")
+        message(FATAL_ERROR "${PROGRAM}: compiling at -O${level} failed")
+    endif()
+    execute_process(COMMAND ${executable} OUTPUT_VARIABLE output RESULT_VARIABLE status ERROR_QUIET)
+    compare("-O${level}" "${output}" "${status}")
+endforeach()